@@ -48,9 +48,12 @@ void ConvertToSLSampleFormat(SLAndroidDataFormat_PCM_EX* pFormat,
       pFormat->formatType = SL_ANDROID_DATAFORMAT_PCM_EX;
       break;
     case SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT:
-      pFormat->bitsPerSample =
-          SL_PCMSAMPLEFORMAT_FIXED_16;  // supports 16, 24, and 32
-      pFormat->containerSize = SL_PCMSAMPLEFORMAT_FIXED_16;
+      // supports 16, 24 (packed, see PCM_FORMAT_S24_PACKED) and 32
+      if (pSampleInfo_->pcmFormat_ != SL_PCMSAMPLEFORMAT_FIXED_24 &&
+          pSampleInfo_->pcmFormat_ != SL_PCMSAMPLEFORMAT_FIXED_32) {
+        pFormat->bitsPerSample = SL_PCMSAMPLEFORMAT_FIXED_16;
+        pFormat->containerSize = SL_PCMSAMPLEFORMAT_FIXED_16;
+      }
       pFormat->formatType = SL_ANDROID_DATAFORMAT_PCM_EX;
       break;
     case SL_ANDROID_PCM_REPRESENTATION_FLOAT:
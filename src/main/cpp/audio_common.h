@@ -19,6 +19,8 @@
 
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
+#include <sys/time.h>
+#include <time.h>
 
 #include "android_debug.h"
 #include "debug_utils.h"
@@ -57,6 +59,17 @@ __inline__ uint64_t GetSystemTicks(void) {
   return (static_cast<uint64_t>(1000000) * Time.tv_sec + Time.tv_usec);
 }
 
+/*
+ * GetMonotonicNanos(void): CLOCK_MONOTONIC time in nano sec, used for
+ *                          timestamps which are compared across threads
+ */
+__inline__ int64_t GetMonotonicNanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return static_cast<int64_t>(1000000000) * ts.tv_sec + ts.tv_nsec;
+}
+
 #define SLASSERT(x)                   \
   do {                                \
     assert(SL_RESULT_SUCCESS == (x)); \
@@ -64,16 +77,28 @@ __inline__ uint64_t GetSystemTicks(void) {
   } while (0)
 
 /*
- * Interface for player and recorder to communicate with engine
+ * Interface for player and recorder to communicate with engine; for
+ * RECORDED_AUDIO_AVAILABLE the engine returns false when it keeps the
+ * buffer, and queues it for the player itself later
  */
 #define ENGINE_SERVICE_MSG_KICKSTART_PLAYER 1
 #define ENGINE_SERVICE_MSG_RETRIEVE_DUMP_BUFS 2
 #define ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE 3
+#define ENGINE_SERVICE_MSG_FREE_BUFS_AVAILABLE 4
+#define ENGINE_SERVICE_MSG_PLAYED_AUDIO_AVAILABLE 5
 typedef bool (*ENGINE_CALLBACK)(void* pCTX, uint32_t msg, void* pData);
 
 /*
- * flag to enable file dumping
+ * flag to enable callback logging: records go through the lock-free RTLOG
+ * rings (rt_log.h) and are written to file by a background thread, so the
+ * callbacks' timing is not affected
  */
 // #define ENABLE_LOG  1
 
+/*
+ * flag to compile in the TRACE_* pipeline events (trace.h); without it the
+ * macros are empty
+ */
+// #define ENABLE_TRACE  1
+
 #endif  // NATIVE_AUDIO_AUDIO_COMMON_H
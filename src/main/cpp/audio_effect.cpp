@@ -15,15 +15,26 @@
  */
 #include "audio_effect.h"
 #include "audio_common.h"
+#include "dynamics.h"
+#include "trace.h"
+#include <algorithm>
 #include <climits>
+#include <cmath>
 #include <cstring>
 
-/*
- * Mixing Audio in integer domain to avoid FP calculation
- *   (FG * ( MixFactor * 16 ) + BG * ( (1.0f-MixFactor) * 16 )) / 16
- */
-static const int32_t kFloatToIntMapFactor = 128;
+const size_t AudioDelay::kMaxDelayMs;
+
 static const uint32_t kMsPerSec = 1000;
+static const float kMaxFeedback = 0.95f;
+static const float kSilentDb = -90.0f;
+static const float kS16Scale = 32768.0f;
+
+static inline int16_t SaturateS16(float sample) {
+  if (sample >= 32767.0f) return 32767;
+  if (sample <= -32768.0f) return -32768;
+  return static_cast<int16_t>(lrintf(sample));
+}
+
 /**
  * Constructor for AudioDelay
  * @param sampleRate
@@ -35,154 +46,226 @@ AudioDelay::AudioDelay(int32_t sampleRate, int32_t channelCount,
                        SLuint32 format, size_t delayTimeLInMs, size_t delayTimeRInMs                                        //ここ重要なのに分からない。コロンの使い方？
                        )                                                                            //float decayWeight
     : AudioFormat(sampleRate, channelCount, format),                                                //decayWeight_(decayWeight)
-      delayTimeL_(delayTimeLInMs), delayTimeR_(delayTimeRInMs){                                                                   //音の重さ　とは？
-    feedbackFactor_ = static_cast<int32_t>(decayWeight_ * kFloatToIntMapFactor);                    //これとると遅延反応しなくなる kFloatToIntMapFactorのポインタ。何のアドレス示してる？
-  liveAudioFactor_ = kFloatToIntMapFactor - feedbackFactor_;
-  allocateBufferL();
-  allocateBufferR();                                                                                 //OuterClass::InnerClass　名前区切りにコｒン２つ
-}                                                                                                   //(){}の形分からない
+      feedback_(0.0f), mix_(1.0f) {
+  assert(format_ == SL_PCMSAMPLEFORMAT_FIXED_16);
+  // one extra frame to interpolate at the longest delay, one for the write
+  bufFrames_ = static_cast<uint32_t>(msToFrames(kMaxDelayMs)) + 2;
+  buffer_ = new int16_t[bufFrames_ * channelCount_];
+  memset(buffer_, 0, bufFrames_ * channelCount_ * sizeof(int16_t));
+  writePos_ = 0;
+
+  delayFrames_[0].set(msToFrames(std::min(delayTimeLInMs, kMaxDelayMs)), 0);
+  delayFrames_[1].set(msToFrames(std::min(delayTimeRInMs, kMaxDelayMs)), 0);
+}
 
 /**
  * Destructor
  */
 AudioDelay::~AudioDelay() {
-  if (bufferR_) delete static_cast<uint8_t*>(bufferR_);
-  if (bufferL_) delete static_cast<uint8_t*>(bufferL_);                                           //AudioDelay()で呼び出すと何するのこれ？
+  delete[] buffer_;
+}
+
+// sampleRate_ is in milli Hz
+float AudioDelay::msToFrames(float ms) const {
+  return roundf(ms / kMsPerSec * (float)sampleRate_ / kMsPerSec);
 }
 
 /**
- * Configure for delay time ( in miliseconds ), dynamically adjustable
- * @param delayTimeInMS in miliseconds
- * @return true if delay time is set successfully
+ * Queue a parameter change for the next process() call, offset frames into
+ * the buffer; an offset before the previous one's is moved up to it.
+ * Audio thread only.
+ * @return false if the schedule is full or param is unknown
  */
-bool AudioDelay::setDelayTime(size_t delayTimeLInMS, size_t delayTimeRInMS) {
-  if ((delayTimeLInMS == delayTimeL_) && (delayTimeRInMS == delayTimeR_)) return true;
+bool AudioDelay::schedule(int32_t param, float value, uint32_t offset,
+                          uint32_t rampFrames) {
+  if (param < 0 || param >= DELAY_PARAM_COUNT || schedule_.isFull()) {
+    return false;
+  }
+  schedule_.add(param, value, offset, rampFrames);
+  return true;
+}
 
-  std::lock_guard<std::mutex> lock(lock_);
+/*
+ * For a buffer the effect does not process (bypassed, or skipped as
+ * silent): the scheduled changes take effect as if stamped past its end,
+ * so the schedule is free for the next buffer.
+ */
+void AudioDelay::skipSchedule(void) {
+  for (int32_t i = 0; i < schedule_.size(); i++) {
+    setParam(schedule_[i]);
+  }
+  schedule_.clear();
+}
 
-  if (bufferL_) {
-    delete static_cast<uint8_t*>(bufferL_);
-    bufferL_ = nullptr;
+/*
+ * The longest delay (current or ramp target) once for each repeat the
+ * feedback keeps above -90 dB; no tail when only the dry signal is heard.
+ */
+uint32_t AudioDelay::tailFrames(void) const {
+  if (mix_.value() == 0.0f && mix_.target() == 0.0f) {
+    return 0;
   }
-  if (bufferR_) {
-      delete static_cast<uint8_t*>(bufferR_);
-      bufferR_ = nullptr;
+  float longest = std::max(std::max(delayFrames_[0].value(),
+                                    delayFrames_[0].target()),
+                           std::max(delayFrames_[1].value(),
+                                    delayFrames_[1].target()));
+  float feedback = std::max(feedback_.value(), feedback_.target());
+  uint32_t repeats = 1;
+  if (feedback > 0.0f) {
+    repeats += static_cast<uint32_t>(ceilf(kSilentDb / 20.0f /
+                                           log10f(feedback)));
   }
-
-  delayTimeL_ = delayTimeLInMS;                                                                       //audio_effectオブジェクトのフィールド値にaudio_mainに代入？
-  allocateBufferL();
-  delayTimeR_ = delayTimeRInMS;
-  allocateBufferR();
-  return ((bufferL_ != nullptr) && (bufferR_ != nullptr));
+  return static_cast<uint32_t>(ceilf(longest)) * repeats;
 }
 
-/**
- * Internal helper function to allocate buffer for the delay
- *  - calculate the buffer size for the delay time
- *  - allocate and zero out buffer (0 means silent audio)
- *  - configure bufSize_ to be size of audioFrames
+/*
+ * What goes into the line leaves the loop processor latencyFrames() later;
+ * the frames it still holds are lost when it is taken out (a few ms of the
+ * repeats go silent) and it starts empty when put in.
  */
-void AudioDelay::allocateBufferL(void) {                                                           //遅延させるためのバッファ？　遅延時間に応じたバッファサイズ算出
-  float floatDelayTime = (float)delayTimeL_ / kMsPerSec;
-  float fNumFrames = floatDelayTime * (float)sampleRate_ / kMsPerSec;
-  size_t sampleCount = static_cast<uint32_t>(fNumFrames + 0.5f) * channelCount_;
-
-  uint32_t bytePerSample = format_ / 8;
-  assert(bytePerSample <= 4 && bytePerSample);
-
-  uint32_t bytePerFrame = channelCount_ * bytePerSample;
-
-  // get bufCapacity in bytes
-  bufCapacityL_ = sampleCount * bytePerSample;
-  bufCapacityL_ =
-      ((bufCapacityL_ + bytePerFrame - 1) / bytePerFrame) * bytePerFrame;
-
-  bufferL_ = new uint8_t[bufCapacityL_];
-  assert(bufferL_);
-
-  memset(bufferL_, 0, bufCapacityL_);
-  curPosL_ = 0;
-
-  // bufSize_ is in Frames ( not samples, not bytes )
-  bufSizeL_ = bufCapacityL_ / bytePerFrame;
+void AudioDelay::setLoopDynamics(DynamicsProcessor *dynamics) {
+  if (dynamics == loopDynamics_) {
+    return;
+  }
+  if (loopDynamics_) {
+    uint32_t latency = loopDynamics_->latencyFrames();
+    for (uint32_t i = 1; i <= latency; i++) {
+      uint32_t pos = (writePos_ + bufFrames_ - i) % bufFrames_;
+      memset(buffer_ + pos * channelCount_, 0, channelCount_ * sizeof(int16_t));
+    }
+  }
+  loopDynamics_ = dynamics;
 }
 
-void AudioDelay::allocateBufferR(void) {                                                           //遅延させるためのバッファ？　遅延時間に応じたバッファサイズ算出
-    float floatDelayTime = (float)delayTimeR_ / kMsPerSec;
-    float fNumFrames = floatDelayTime * (float)sampleRate_ / kMsPerSec;
-    size_t sampleCount = static_cast<uint32_t>(fNumFrames + 0.5f) * channelCount_;
-
-    uint32_t bytePerSample = format_ / 8;
-    assert(bytePerSample <= 4 && bytePerSample);
-
-    uint32_t bytePerFrame = channelCount_ * bytePerSample;
-
-    // get bufCapacity in bytes
-    bufCapacityR_ = sampleCount * bytePerSample;
-    bufCapacityR_ =
-            ((bufCapacityR_ + bytePerFrame - 1) / bytePerFrame) * bytePerFrame;
-
-    bufferR_ = new uint8_t[bufCapacityR_];
-    assert(bufferR_);
-
-    memset(bufferR_, 0, bufCapacityR_);
-    curPosR_ = 0;
-
-    // bufSize_ is in Frames ( not samples, not bytes )
-    bufSizeR_ = bufCapacityR_ / bytePerFrame;
+void AudioDelay::setParam(const ParamEvent &event) {
+  float value = event.value_;
+  switch (event.param_) {
+    case DELAY_PARAM_TIME_L_MS:
+    case DELAY_PARAM_TIME_R_MS:
+      value = std::max(0.0f, std::min(value, static_cast<float>(kMaxDelayMs)));
+      delayFrames_[event.param_ - DELAY_PARAM_TIME_L_MS].set(msToFrames(value),
+                                                              event.rampFrames_);
+      break;
+    case DELAY_PARAM_FEEDBACK:
+      feedback_.set(std::max(0.0f, std::min(value, kMaxFeedback)),
+                    event.rampFrames_);
+      break;
+    case DELAY_PARAM_MIX:
+      mix_.set(std::max(0.0f, std::min(value, 1.0f)), event.rampFrames_);
+      break;
+    default:
+      break;
+  }
 }
 
-
-size_t AudioDelay::getDelayTime(void) const { return delayTimeL_; }
-
-/**
- * setDecayWeight(): set the decay factor
- * ratio: value of 0.0 -- 1.0f;
- *
- * the calculation is in integer ( not in float )
- * for performance purpose
+/*
+ * Run the buffer in pieces between the scheduled parameter changes, so each
+ * one lands on its frame.
  */
-
 void AudioDelay::process(int16_t* liveAudio, int32_t numFrames) {                                   //liveoudio18,numframe 192       L146から
-  // return;                                                                                        // ここでreturnすると、遅延バッファの処理をしない。
-
-  if (feedbackFactor_ == 0 || bufSizeL_  < numFrames || bufSizeR_  < numFrames) {                                         //0msで何もしない
-    return;
+  TRACE_SCOPE("AudioDelay::process");
+  int32_t frame = 0;
+  int32_t next = 0;
+  while (frame < numFrames) {
+    while (next < schedule_.size() &&
+           schedule_[next].offset_ <= static_cast<uint32_t>(frame)) {
+      setParam(schedule_[next++]);
+    }
+    int32_t end = numFrames;
+    if (next < schedule_.size() &&
+        schedule_[next].offset_ < static_cast<uint32_t>(numFrames)) {
+      end = schedule_[next].offset_;
+    }
+    if (loopDynamics_) {
+      processLoopFrames(liveAudio + frame * channelCount_, end - frame);
+    } else {
+      processFrames(liveAudio + frame * channelCount_, end - frame);
+    }
+    frame = end;
   }
-
-  if (!lock_.try_lock()) {
-    return;
+  // anything stamped past this buffer takes effect from the next one
+  while (next < schedule_.size()) {
+    setParam(schedule_[next++]);
   }
+  schedule_.clear();
+}
 
-  if (numFrames + curPosL_ > bufSizeL_) {                                                           //遅延0.1sでバッファサイズ4800sample
-    curPosL_ = 0;
+// the line delay frames back from writePos_, between two frames for a
+// fractional delay
+float AudioDelay::readLine(float delay, int32_t ch) const {
+  uint32_t whole = static_cast<uint32_t>(delay);
+  float frac = delay - whole;
+  uint32_t pos = writePos_ >= whole ? writePos_ - whole
+                                    : writePos_ + bufFrames_ - whole;
+  float delayed = buffer_[pos * channelCount_ + ch];
+  if (frac > 0.0f) {
+    pos = pos ? pos - 1 : bufFrames_ - 1;
+    delayed += frac * (buffer_[pos * channelCount_ + ch] - delayed);
   }
+  return delayed;
+}
 
-  if (numFrames + curPosR_ > bufSizeR_) {                                                           //遅延0.2sでバッファサイズ9600sample
-    curPosR_ = 0;
+/*
+ * Per frame: the input goes into the delay line, the output is the line
+ * read delayFrames_ back (between two frames while the delay glides),
+ * mixed with the input by mix_; feedback_ adds the delayed signal back
+ * into the line for repeating echoes.
+ */
+void AudioDelay::processFrames(int16_t* liveAudio, int32_t numFrames) {
+  for (int32_t f = 0; f < numFrames; f++) {
+    float mix = mix_.next();
+    float feedback = feedback_.next();
+    float delays[2] = {delayFrames_[0].next(), delayFrames_[1].next()};
+    int16_t* line = buffer_ + writePos_ * channelCount_;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      line[ch] = liveAudio[ch];
+    }
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      float delayed = readLine(delays[ch ? 1 : 0], ch);
+      float dry = liveAudio[ch];
+      if (feedback > 0.0f) {
+        line[ch] = SaturateS16(dry + feedback * delayed);
+      }
+      liveAudio[ch] = SaturateS16(dry + mix * (delayed - dry));
+    }
+    liveAudio += channelCount_;
+    if (++writePos_ == bufFrames_) {
+      writePos_ = 0;
+    }
   }
+}
 
-  // process every sample
-  int32_t sampleCount = channelCount_ * numFrames;                                                      //samplecount= 2チャンネル分*バッファサイズ192Sample = 384では？
-  int16_t* samplesL = &static_cast<int16_t*>(bufferL_)[curPosL_ * channelCount_];
-  int16_t* samplesR = &static_cast<int16_t*>(bufferR_)[curPosR_ * channelCount_];                    //右用リングバッファは、右用のカーソル位置　*  チャンネルいくつ数えたか
-  for (size_t idx = 0; idx < sampleCount; idx++) {
-
-    // Pure delay
-      int16_t tmp = liveAudio[idx];
-      if(idx % 2 == 0){                          //左                                                     //バッファ？liveAudioデータ値　から　左リングバッファsamples　へ　移す
-          liveAudio[idx] = samplesL[idx];
-//          samplesL[idx] = tmp;                                                                           //samples[idx] = tmp;   左チャンネル音声データのみ、バッファから遅延用バッファへ移す　なら、　右チャンネル音声データは　だだ漏れでは？
-
-      }else{                                       //右
-          liveAudio[idx] = samplesR[idx];
-//          samplesR[idx] = tmp;
-      }
-      samplesL[idx] = tmp;
-      samplesR[idx] = tmp;
-  }                                                                                                 //バッファ一杯192sample分のやりとり。合わせてSampleCount384個分。48khzのデータをバッファに192sample分溜めるまでに理論値4msかかる。往復で8ms。
-                                                                                                    //
-  curPosL_ += numFrames;                                                                            //遅延用バッファL一周4800Sample分遅延させた音声データをバッファ一杯192sample分だけバッファへ渡し、バッファから192sample分だけ受け取る。　約24回後に0.1s遅延
-  curPosR_ += numFrames;                                                                            //遅延用バッファL一周9600Sample分遅延させた音声データをバッファ一杯192sample分だけバッファへ渡し、バッファから192sample分だけ受け取る。　約24回後に0.2s遅延
-  lock_.unlock();
+/*
+ * Same with the loop processor: input plus feedback go through it in
+ * float, one frame at a time as each frame feeds the next ones, and what
+ * it returns is written latency frames back. Delays are at least one frame
+ * longer, so nothing is read before it is written.
+ */
+void AudioDelay::processLoopFrames(int16_t* liveAudio, int32_t numFrames) {
+  const int32_t kMaxChannels = 2;
+  uint32_t latency = loopDynamics_->latencyFrames();
+  float minDelay = static_cast<float>(latency + 1);
+  for (int32_t f = 0; f < numFrames; f++) {
+    float mix = mix_.next();
+    float feedback = feedback_.next();
+    float delays[2] = {std::max(delayFrames_[0].next(), minDelay),
+                       std::max(delayFrames_[1].next(), minDelay)};
+    float loop[kMaxChannels];
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      float delayed = readLine(delays[ch ? 1 : 0], ch);
+      float dry = liveAudio[ch];
+      loop[ch] = (dry + feedback * delayed) / kS16Scale;
+      liveAudio[ch] = SaturateS16(dry + mix * (delayed - dry));
+    }
+    loopDynamics_->processFloat(loop, 1);
+    uint32_t pos = (writePos_ + bufFrames_ - latency) % bufFrames_;
+    int16_t* line = buffer_ + pos * channelCount_;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      line[ch] = SaturateS16(loop[ch] * kS16Scale);
+    }
+    liveAudio += channelCount_;
+    if (++writePos_ == bufFrames_) {
+      writePos_ = 0;
+    }
+  }
 }
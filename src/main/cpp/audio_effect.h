@@ -21,6 +21,9 @@
 #include <cstdint>
 #include <atomic>
 #include <mutex>
+#include "control_queue.h"
+
+class DynamicsProcessor;
 
 class AudioFormat {
  protected:
@@ -36,39 +39,50 @@ class AudioFormat {
 
 /**
  * An audio delay effect:
- *   - decay is for feedback(echo)weight
- *   - delay time is adjustable
+ *   - one delay line per side (channel 0 left, the others right), allocated
+ *     for kMaxDelayMs up front: nothing is allocated or locked while running
+ *   - delay time, feedback (decay) and dry/wet mix change at exact frames
+ *     through schedule(), optionally with a linear ramp; a ramped delay time
+ *     glides, reading between frames
+ *   - a DynamicsProcessor may sit in the feedback loop: what goes into the
+ *     line passes through it, and comes out its latency later. It is
+ *     written that far back, so repeats keep their timing; delays shorter
+ *     than the latency are stretched to it.
  */
 class AudioDelay : public AudioFormat {
  public:
+  static const size_t kMaxDelayMs = 1000;
+
   ~AudioDelay();
 
   explicit AudioDelay(int32_t sampleRate, int32_t channelCount, SLuint32 format,
                       size_t delayTimeLInMs, size_t delayTimeRInMs);                                                        //, float Weight
-  bool setDelayTime(size_t delayTimeLInMiliSec, size_t delayTimeRInMiliSec);
-  size_t getDelayTime(void) const;
-  void setDecayWeight(float weight);
-  float getDecayWeight(void) const;
+  // audio thread: DELAY_PARAM_* change offset frames into the next process()
+  bool schedule(int32_t param, float value, uint32_t offset,
+                uint32_t rampFrames);
+  bool isScheduleFull(void) const { return schedule_.isFull(); }
+  void skipSchedule(void);
+  // frames the output may still be audible after the input went silent
+  uint32_t tailFrames(void) const;
+  // audio thread; nullptr takes it out of the loop
+  void setLoopDynamics(DynamicsProcessor *dynamics);
   void process(int16_t *liveAudio, int32_t numFrames);
 
  private:
-  size_t delayTimeL_ = 0;
-  float decayWeight_ = 0.5;
-  void *bufferL_ = nullptr;
-  size_t bufCapacityL_ = 0;
-  size_t bufSizeL_ = 0;
-  size_t curPosL_ = 0;
+  int16_t *buffer_ = nullptr;  // interleaved delay line
+  uint32_t bufFrames_ = 0;
+  uint32_t writePos_ = 0;
 
-  size_t delayTimeR_ = 0;
-  void *bufferR_ = nullptr;
-  size_t bufCapacityR_ = 0;
-  size_t bufSizeR_ = 0;
-  size_t curPosR_ = 0;
+  RampedParam delayFrames_[2];  // left, right
+  RampedParam feedback_;
+  RampedParam mix_;
+  ParamSchedule schedule_;
+  DynamicsProcessor *loopDynamics_ = nullptr;
 
-  std::mutex lock_;
-  int32_t feedbackFactor_;
-  int32_t liveAudioFactor_;
-  void allocateBufferL(void);
-  void allocateBufferR(void);
+  float msToFrames(float ms) const;
+  float readLine(float delay, int32_t ch) const;
+  void setParam(const ParamEvent &event);
+  void processFrames(int16_t *liveAudio, int32_t numFrames);
+  void processLoopFrames(int16_t *liveAudio, int32_t numFrames);
 };
 #endif  // EFFECT_PROCESSOR_H
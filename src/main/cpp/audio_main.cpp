@@ -17,12 +17,34 @@
 #include "audio_recorder.h"
 #include "audio_player.h"
 #include "audio_effect.h"
+#include "input_conditioner.h"
+#include "echo_canceller.h"
+#include "rt_log.h"
 #include "audio_common.h"
+#include "offline_render.h"
+#include "pcm_tap.h"
+#include "glitch_detector.h"
+#include "latency_meter.h"
+#include "trace.h"
+#include "dsp_load.h"
+#include "control_queue.h"
+#include "thread_policy.h"
+#include "silence_detector.h"
+#include "drift_compensator.h"
+#include "pitch_shifter.h"
+#include "equalizer.h"
+#include "dynamics.h"
+#include "spectrum_analyzer.h"
+#include "buffer_exchange.h"
+#include "session_recorder.h"
 #include <jni.h>
 #include <SLES/OpenSLES_Android.h>
 #include <sys/types.h>
 #include <cassert>
+#include <algorithm>
 #include <cstring>
+#include <mutex>
+#include <vector>
 
 struct EchoAudioEngine {                                                                            //クラスとなるEchoAudioEngine                     unitとは？
     SLmilliHertz fastPathSampleRate_;                                                                //最初のサンプリング周波数？
@@ -30,8 +52,7 @@ struct EchoAudioEngine {
     uint16_t sampleChannels_;                                                                       //テャンネル数
     uint16_t bitsPerSample_;                                                                        //ビット数
 
-    SLObjectItf slEngineObj_;
-    SLEngineItf slEngineItf_;
+    SLEngineItf slEngineItf_;   // shared, see AcquireSLEngine()
 
     AudioRecorder *recorder_;
     AudioPlayer *player_;
@@ -44,34 +65,104 @@ struct EchoAudioEngine {
     int64_t echoDelayL_;
     int64_t echoDelayR_;                                                                             //EchoAudioEngineクラスのフィールド値echoDelay_
     float echoDecay_;
-    AudioDelay *delayEffect_;                                                                        //ポインタ変数delayEffectの宣言。そこにAudioDelayが入る？・・・
+    AudioDelay *delayEffect_;
+    PitchShifter *pitchShifter_;
+    Equalizer *equalizer_;
+    DynamicsProcessor *dynamics_;
+    InputConditioner *conditioner_;
+    EchoCanceller *echoCanceller_;
+    PcmTap *pcmTap_;
+    SpectrumAnalyzer *spectrum_;
+    SessionRecorder *sessionRecorder_;
+    BufferExchange *bufExchange_;
+    GlitchDetector *glitchDetector_;
+    LatencyMeter *latencyMeter_;
+    DspLoadMeter *dspLoad_;
+    ControlQueue *controlQueue_;
+    SilenceDetector *silenceDetector_;
+    DriftCompensator *drift_;
+    RecorderOverflowPolicy recOverflowPolicy_;                                                                        //ポインタ変数delayEffectの宣言。そこにAudioDelayが入る？・・・
+};
+
+/*
+ * Java holds each engine instance as an opaque jlong handle: the
+ * EchoAudioEngine pointer created by createSLEngine(). Instances share
+ * nothing but the OpenSL ES engine object, so several sessions can run side
+ * by side.
+ */
+static inline EchoAudioEngine *EngineFromHandle(jlong handle) {
+    EchoAudioEngine *engine = reinterpret_cast<EchoAudioEngine *>(handle);
+    assert(engine);
+    return engine;
+}
+
+/*
+ * OpenSL ES allows a single engine object per process: instances share it
+ * and the last one released destroys it.
+ */
+static std::mutex slEngineLock;
+static SLObjectItf slEngineObj = nullptr;
+static SLEngineItf slEngineItf = nullptr;
+static uint32_t slEngineUsers = 0;
+
+static SLEngineItf AcquireSLEngine(void) {
+    std::lock_guard<std::mutex> lock(slEngineLock);
+    if (slEngineUsers == 0) {
+        SLresult result = slCreateEngine(&slEngineObj, 0, NULL, 0, NULL, NULL);
+        SLASSERT(result);
+
+        result = (*slEngineObj)->Realize(slEngineObj, SL_BOOLEAN_FALSE);
+        SLASSERT(result);
+
+        result = (*slEngineObj)->GetInterface(slEngineObj, SL_IID_ENGINE,
+                                              &slEngineItf);
+        SLASSERT(result);
+#ifdef ENABLE_LOG
+        RtLogger::instance()->start();
+#endif
+    }
+    slEngineUsers++;
+    return slEngineItf;
+}
+
+static void ReleaseSLEngine(void) {
+    std::lock_guard<std::mutex> lock(slEngineLock);
+    assert(slEngineUsers > 0);
+    if (--slEngineUsers) {
+        return;
+    }
+    (*slEngineObj)->Destroy(slEngineObj);
+    slEngineObj = nullptr;
+    slEngineItf = nullptr;
+#ifdef ENABLE_LOG
+    RtLogger::instance()->stop();
+#endif
+}
+
+/*
+ * streams of getCallbackTiming(), mirrored in MainActivity.java
+ */
+enum CallbackTimingStream {
+    CALLBACK_TIMING_RECORDER = 0,
+    CALLBACK_TIMING_PLAYER = 1,
 };
-static EchoAudioEngine engine;                                                                      //Struct EchoAudioEngineというデータ型をengineというデータ型に付け替える
 
 bool EngineService(void *ctx, uint32_t msg, void *data);
 
-JNIEXPORT void JNICALL Java_com_google_sample_echo_MainActivity_createSLEngine(
+JNIEXPORT jlong JNICALL Java_com_google_sample_echo_MainActivity_createSLEngine(
         JNIEnv *env, jclass type, jint sampleRate, jint framesPerBuf,
         jlong delayLInMs, jlong delayRInMs) {                                                                          //javaメインクラスからのechoDelayProgressを引数としてdelayInMsで受け取る
-    SLresult result;                                                                                //, jfloat decay
-    memset(&engine, 0, sizeof(engine));
-
-    engine.fastPathSampleRate_ = static_cast<SLmilliHertz>(sampleRate) * 1000;
-    engine.fastPathFramesPerBuf_ = static_cast<uint32_t>(framesPerBuf);
-    engine.sampleChannels_ = AUDIO_SAMPLE_CHANNELS;
-    engine.bitsPerSample_ = SL_PCMSAMPLEFORMAT_FIXED_16;                                             //16ビット？
-
-    result = slCreateEngine(&engine.slEngineObj_, 0, NULL, 0, NULL, NULL);
-    SLASSERT(result);
+    EchoAudioEngine *engine = new EchoAudioEngine();                                                //, jfloat decay
+#ifdef ENABLE_TRACE
+    Tracer::instance();  // allocate the rings before the callbacks need them
+#endif
 
-    result =
-            (*engine.slEngineObj_)->Realize(engine.slEngineObj_, SL_BOOLEAN_FALSE);
-    SLASSERT(result);
+    engine->fastPathSampleRate_ = static_cast<SLmilliHertz>(sampleRate) * 1000;
+    engine->fastPathFramesPerBuf_ = static_cast<uint32_t>(framesPerBuf);
+    engine->sampleChannels_ = AUDIO_SAMPLE_CHANNELS;
+    engine->bitsPerSample_ = SL_PCMSAMPLEFORMAT_FIXED_16;                                             //16ビット？
 
-    result = (*engine.slEngineObj_)
-            ->GetInterface(engine.slEngineObj_, SL_IID_ENGINE,
-                           &engine.slEngineItf_);
-    SLASSERT(result);
+    engine->slEngineItf_ = AcquireSLEngine();
 
     // compute the RECOMMENDED fast audio buffer size:
     //   the lower latency required
@@ -79,156 +170,1566 @@ JNIEXPORT void JNICALL Java_com_google_sample_echo_MainActivity_createSLEngine(
     //     *) the less buffering should be before starting player AFTER
     //        receiving the recorder buffer
     //   Adjust the bufSize here to fit your bill [before it busts]
-    uint32_t bufSize = engine.fastPathFramesPerBuf_ * engine.sampleChannels_ *
-                       engine.bitsPerSample_;
+    // with room for the frames drift compensation may add
+    uint32_t bufSize = (engine->fastPathFramesPerBuf_ +
+                        DriftCompensator::HeadroomFrames(engine->fastPathFramesPerBuf_)) *
+                       engine->sampleChannels_ * engine->bitsPerSample_;
     bufSize = (bufSize + 7) >> 3;  // bits --> byte
-    engine.bufCount_ = BUF_COUNT;
-    engine.bufs_ = allocateSampleBufs(engine.bufCount_, bufSize);
-    assert(engine.bufs_);
+    engine->bufCount_ = BUF_COUNT;
+    engine->bufs_ = allocateSampleBufs(engine->bufCount_, bufSize);
+    assert(engine->bufs_);
 
-    engine.freeBufQueue_ = new AudioQueue(engine.bufCount_);                                        //AdudioQueueクラスにbufCount_代入して、オブジェクトfreeBufQueue_、recBufQueue_ の作成。
-    engine.recBufQueue_ = new AudioQueue(engine.bufCount_);
-    assert(engine.freeBufQueue_ && engine.recBufQueue_);
-    for (uint32_t i = 0; i < engine.bufCount_; i++) {
-        engine.freeBufQueue_->push(&engine.bufs_[i]);
+    engine->freeBufQueue_ = new AudioQueue(engine->bufCount_);                                        //AdudioQueueクラスにbufCount_代入して、オブジェクトfreeBufQueue_、recBufQueue_ の作成。
+    engine->recBufQueue_ = new AudioQueue(engine->bufCount_);
+    assert(engine->freeBufQueue_ && engine->recBufQueue_);
+    for (uint32_t i = 0; i < engine->bufCount_; i++) {
+        engine->freeBufQueue_->push(&engine->bufs_[i]);
     }
+    engine->bufExchange_ = new BufferExchange(engine->bufs_, engine->bufCount_,
+                                              engine->fastPathSampleRate_,
+                                              engine->sampleChannels_);
 
-    engine.echoDelayL_ = delayLInMs;
-    engine.echoDelayR_ = delayRInMs;
-                                                                                                    //engine.echoDecay_ = decay;
-    engine.delayEffect_ = new AudioDelay(                                                                   //delayEffectクラスからオブジェクト AudioDelayを作成
-            engine.fastPathSampleRate_, engine.sampleChannels_, engine.bitsPerSample_,
-            engine.echoDelayL_, engine.echoDelayR_);                                                                      //, engine.echoDecay_
-    assert(engine.delayEffect_);                                                                    //assertはdelayEffectが異常値でないかテスト？　
+    engine->echoDelayL_ = delayLInMs;
+    engine->echoDelayR_ = delayRInMs;
+    engine->recOverflowPolicy_ = RECORDER_OVERFLOW_PAUSE_RESUME;
+                                                                                                    //engine->echoDecay_ = decay;
+    engine->delayEffect_ = new AudioDelay(                                                                   //delayEffectクラスからオブジェクト AudioDelayを作成
+            engine->fastPathSampleRate_, engine->sampleChannels_, engine->bitsPerSample_,
+            engine->echoDelayL_, engine->echoDelayR_);                                                                      //, engine->echoDecay_
+    assert(engine->delayEffect_);                                                                    //assertはdelayEffectが異常値でないかテスト？　
+    engine->pitchShifter_ = new PitchShifter(
+            engine->fastPathSampleRate_, engine->sampleChannels_, engine->bitsPerSample_);
+    engine->equalizer_ = new Equalizer(
+            engine->fastPathSampleRate_, engine->sampleChannels_, engine->bitsPerSample_,
+            engine->fastPathFramesPerBuf_);
+    engine->dynamics_ = new DynamicsProcessor(
+            engine->fastPathSampleRate_, engine->sampleChannels_, engine->bitsPerSample_,
+            engine->fastPathFramesPerBuf_);
+
+    engine->conditioner_ = new InputConditioner(
+            engine->fastPathSampleRate_, engine->sampleChannels_, engine->bitsPerSample_);
+    // played buffers carry up to the drift headroom more
+    engine->echoCanceller_ = new EchoCanceller(
+            engine->fastPathSampleRate_, engine->sampleChannels_, engine->bitsPerSample_,
+            engine->fastPathFramesPerBuf_ +
+            DriftCompensator::HeadroomFrames(engine->fastPathFramesPerBuf_));
+    engine->pcmTap_ = new PcmTap(engine->fastPathSampleRate_, engine->sampleChannels_);
+    engine->spectrum_ =
+            new SpectrumAnalyzer(engine->fastPathSampleRate_, engine->sampleChannels_);
+    engine->sessionRecorder_ =
+            new SessionRecorder(engine->fastPathSampleRate_, engine->sampleChannels_);
+    engine->glitchDetector_ =
+            new GlitchDetector(engine->fastPathSampleRate_, engine->sampleChannels_);
+    engine->latencyMeter_ =
+            new LatencyMeter(engine->fastPathSampleRate_ / 1000, engine->sampleChannels_);
+    engine->dspLoad_ =
+            new DspLoadMeter(engine->fastPathSampleRate_, engine->fastPathFramesPerBuf_);
+    engine->controlQueue_ = new ControlQueue();
+    engine->silenceDetector_ =
+            new SilenceDetector(engine->fastPathSampleRate_, engine->sampleChannels_);
+    engine->drift_ = new DriftCompensator(engine->fastPathSampleRate_,
+                                          engine->sampleChannels_,
+                                          engine->fastPathFramesPerBuf_);
+    return reinterpret_cast<jlong>(engine);
 }
 
 JNIEXPORT jboolean JNICALL
 Java_com_google_sample_echo_MainActivity_configureEcho(JNIEnv *env, jclass type,
+                                                       jlong engineHandle,
                                                        jint delayLInMs,jint delayRInMs
                                                        ) {                                                  //jfloat decay
-    engine.echoDelayL_ = delayLInMs;                                                                                   //engine.echoDecay_ = decay;
-    engine.echoDelayR_ = delayRInMs;                                                                  //なんで
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    engine->echoDelayL_ = delayLInMs;                                                                                   //engine->echoDecay_ = decay;
+    engine->echoDelayR_ = delayRInMs;                                                                  //なんで
+
+    // picked up by the audio thread with the next buffer
+    ControlCommand cmd = {CONTROL_TARGET_DELAY, DELAY_PARAM_TIME_L_MS,
+                          static_cast<float>(delayLInMs), kControlNow, 0};
+    bool posted = engine->controlQueue_->post(cmd);
+    cmd.param_ = DELAY_PARAM_TIME_R_MS;
+    cmd.value_ = static_cast<float>(delayRInMs);
+    posted = engine->controlQueue_->post(cmd) && posted;
+                                                                                                    //engine->delayEffect_->setDecayWeight(decay);
+    return posted ? JNI_TRUE : JNI_FALSE;                                                           //何のためにポインタつけるか。無駄なくメモリを使用するため？
+}
+
+/*
+ * Pitch shift by semitones + cents (-12 .. 12 semitones in total), mixed
+ * with the dry input; mix 0 bypasses the shifter.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configurePitchShift(JNIEnv *env,
+                                                             jclass type,
+                                                             jlong engineHandle,
+                                                             jfloat semitones,
+                                                             jfloat cents,
+                                                             jfloat mix) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    ControlCommand cmd = {CONTROL_TARGET_PITCH, PITCH_PARAM_SEMITONES, semitones,
+                          kControlNow, 0};
+    bool posted = engine->controlQueue_->post(cmd);
+    cmd.param_ = PITCH_PARAM_CENTS;
+    cmd.value_ = cents;
+    posted = engine->controlQueue_->post(cmd) && posted;
+    cmd.param_ = PITCH_PARAM_MIX;
+    cmd.value_ = mix;
+    posted = engine->controlQueue_->post(cmd) && posted;
+    return posted ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * One equalizer section (0 .. kEqMaxSections - 1): type EQ_TYPE_*, gainDb
+ * only matters to shelves and peaks. The coefficients glide to the new
+ * design over rampFrames, 10 ms at least.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configureEqSection(JNIEnv *env,
+                                                            jclass type,
+                                                            jlong engineHandle,
+                                                            jint section,
+                                                            jint eqType,
+                                                            jfloat freqHz,
+                                                            jfloat q,
+                                                            jfloat gainDb,
+                                                            jint rampFrames) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (section < 0 || section >= kEqMaxSections || eqType < 0 ||
+        eqType >= EQ_TYPE_COUNT || rampFrames < 0) {
+        LOGE("====configureEqSection: invalid section %d type %d", section, eqType);
+        return JNI_FALSE;
+    }
+    int32_t base = section * EQ_SECTION_PARAMS;
+    ControlCommand cmd = {CONTROL_TARGET_EQ, base + EQ_PARAM_FREQ_HZ, freqHz,
+                          kControlNow, static_cast<uint32_t>(rampFrames)};
+    bool posted = engine->controlQueue_->post(cmd);
+    cmd.param_ = base + EQ_PARAM_Q;
+    cmd.value_ = q;
+    posted = engine->controlQueue_->post(cmd) && posted;
+    cmd.param_ = base + EQ_PARAM_GAIN_DB;
+    cmd.value_ = gainDb;
+    posted = engine->controlQueue_->post(cmd) && posted;
+    cmd.param_ = base + EQ_PARAM_TYPE;
+    cmd.value_ = static_cast<float>(eqType);
+    posted = engine->controlQueue_->post(cmd) && posted;
+    return posted ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Compressor and lookahead limiter, placement DYNAMICS_PLACEMENT_*: after the
+ * equalizer, or inside the delay's feedback loop so the repeats cannot
+ * build up past the ceiling. ratio 1 leaves only the limiter. Applied from
+ * the next buffer, without ramps.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configureDynamics(
+        JNIEnv *env, jclass type, jlong engineHandle, jint placement,
+        jfloat thresholdDb, jfloat ratio, jfloat kneeDb, jfloat attackMs,
+        jfloat releaseMs, jfloat makeupDb, jfloat ceilingDb,
+        jfloat limitReleaseMs) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (placement < 0 || placement >= DYNAMICS_PLACEMENT_COUNT) {
+        LOGE("====configureDynamics: invalid placement %d", placement);
+        return JNI_FALSE;
+    }
+    // the placement last, once the rest is in
+    const float values[DYNAMICS_PARAM_COUNT] = {
+        static_cast<float>(placement), thresholdDb, ratio, kneeDb, attackMs,
+        releaseMs, makeupDb, ceilingDb, limitReleaseMs};
+    bool posted = true;
+    for (int32_t param = DYNAMICS_PARAM_COUNT - 1; param >= 0; param--) {
+        ControlCommand cmd = {CONTROL_TARGET_DYNAMICS, param, values[param],
+                              kControlNow, 0};
+        posted = engine->controlQueue_->post(cmd) && posted;
+    }
+    return posted ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * {compressorDb, limiterDb, maxDb}: gain reduction of each stage at the
+ * end of the last buffer, and the largest total reduction since the
+ * previous call.
+ */
+JNIEXPORT jfloatArray JNICALL
+Java_com_google_sample_echo_MainActivity_getDynamicsMeter(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    DynamicsMeter meter;
+    engine->dynamics_->getMeter(&meter);
+    jfloat values[3] = {meter.compressorDb_, meter.limiterDb_, meter.maxDb_};
+    jfloatArray result = env->NewFloatArray(3);
+    if (result != nullptr) {
+        env->SetFloatArrayRegion(result, 0, 3, values);
+    }
+    return result;
+}
 
-    engine.delayEffect_->setDelayTime(delayLInMs,delayRInMs);                                                    //->は間接メンバ参照演算子 　ポインタdelayEffectオブジェクトに遅延時間参照？？？？？？？
-                                                                                                    //engine.delayEffect_->setDecayWeight(decay);
-    return JNI_FALSE;                                                                               //何のためにポインタつけるか。無駄なくメモリを使用するため？
+/*
+ * DC blocker and noise gate, applied from the next buffer.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configureInputConditioner(
+        JNIEnv *env, jclass type, jlong engineHandle, jboolean dcBlock,
+        jboolean gate, jfloat gateThresholdDb, jfloat attackMs, jfloat holdMs,
+        jfloat releaseMs) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!InputConditioner::isValidGate(gateThresholdDb, attackMs, holdMs,
+                                       releaseMs)) {
+        return JNI_FALSE;
+    }
+    // the switches last, once the times are in
+    const float values[CONDITIONER_PARAM_COUNT] = {
+        dcBlock == JNI_TRUE ? 1.0f : 0.0f, gate == JNI_TRUE ? 1.0f : 0.0f,
+        gateThresholdDb, attackMs, holdMs, releaseMs};
+    bool posted = true;
+    for (int32_t param = CONDITIONER_PARAM_COUNT - 1; param >= 0; param--) {
+        ControlCommand cmd = {CONTROL_TARGET_CONDITIONER, param, values[param],
+                              kControlNow, 0};
+        posted = engine->controlQueue_->post(cmd) && posted;
+    }
+    return posted ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_enableEchoCanceller(
+        JNIEnv *env, jclass type, jlong engineHandle, jboolean enable) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    ControlCommand cmd = {CONTROL_TARGET_ECHO_CANCELLER,
+                          ECHO_CANCELLER_PARAM_ENABLE,
+                          enable == JNI_TRUE ? 1.0f : 0.0f, kControlNow, 0};
+    if (!engine->controlQueue_->post(cmd)) {
+        LOGE("====enableEchoCanceller: control queue full");
+    }
+}
+
+/*
+ * echo return loss enhancement (dB) the canceller currently achieves
+ */
+JNIEXPORT jfloat JNICALL
+Java_com_google_sample_echo_MainActivity_getEchoCancellerErle(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    return engine->echoCanceller_->getErleDb();
+}
+
+/*
+ * Bulk delay (ms) the echo canceller holds the far end reference back by,
+ * so that its filter only has to cover the room; returns false when the
+ * control queue is full.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_setEchoCancellerDelay(
+        JNIEnv *env, jclass type, jlong engineHandle, jfloat delayMs) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    ControlCommand cmd = {CONTROL_TARGET_ECHO_CANCELLER,
+                          ECHO_CANCELLER_PARAM_DELAY_MS, delayMs, kControlNow,
+                          0};
+    return engine->controlQueue_->post(cmd) ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Measure the bulk delay on the running session: for about a second the
+ * canceller (enabled, with the far end playing) collects what it sees.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startEchoDelayEstimate(
+        JNIEnv *env, jclass type, jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    return engine->echoCanceller_->startDelayEstimate() ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * {delayMs, confidence} once the estimate is done, null before: the delay
+ * now in use, and the peak to rms ratio of the correlation. Below 8 no
+ * echo was found and the delay did not change.
+ */
+JNIEXPORT jfloatArray JNICALL
+Java_com_google_sample_echo_MainActivity_getEchoDelayEstimate(
+        JNIEnv *env, jclass type, jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    jfloat values[2];
+    if (!engine->echoCanceller_->getDelayEstimate(&values[0], &values[1])) {
+        return nullptr;
+    }
+    jfloatArray result = env->NewFloatArray(2);
+    if (result) {
+        env->SetFloatArrayRegion(result, 0, 2, values);
+    }
+    return result;
 }
 
 
 
 JNIEXPORT jboolean JNICALL
 Java_com_google_sample_echo_MainActivity_createSLBufferQueueAudioPlayer(
-        JNIEnv *env, jclass type) {
+        JNIEnv *env, jclass type, jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
     SampleFormat sampleFormat;
     memset(&sampleFormat, 0, sizeof(sampleFormat));
-    sampleFormat.pcmFormat_ = (uint16_t)engine.bitsPerSample_;
-    sampleFormat.framesPerBuf_ = engine.fastPathFramesPerBuf_;
+    sampleFormat.pcmFormat_ = (uint16_t)engine->bitsPerSample_;
+    sampleFormat.framesPerBuf_ = engine->fastPathFramesPerBuf_;
 
     // SampleFormat.representation_ = SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT;
-    sampleFormat.channels_ = (uint16_t)engine.sampleChannels_;
-    sampleFormat.sampleRate_ = engine.fastPathSampleRate_;
+    sampleFormat.channels_ = (uint16_t)engine->sampleChannels_;
+    sampleFormat.sampleRate_ = engine->fastPathSampleRate_;
 
-    engine.player_ = new AudioPlayer(&sampleFormat, engine.slEngineItf_);                           //AudioPlayerクラスからオブジェクトplayer_を作成する
-    assert(engine.player_);
-    if (engine.player_ == nullptr) return JNI_FALSE;
+    engine->player_ = new AudioPlayer(&sampleFormat, engine->slEngineItf_);                           //AudioPlayerクラスからオブジェクトplayer_を作成する
+    assert(engine->player_);
+    if (engine->player_ == nullptr) return JNI_FALSE;
 
-    engine.player_->SetBufQueue(engine.recBufQueue_, engine.freeBufQueue_);
-    engine.player_->RegisterCallback(EngineService, (void *)&engine);
+    engine->player_->SetBufQueue(engine->recBufQueue_, engine->freeBufQueue_);
+    engine->player_->RegisterCallback(EngineService, (void *)engine);
 
     return JNI_TRUE;
 }
 
 JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_deleteSLBufferQueueAudioPlayer(
-        JNIEnv *env, jclass type) {
-    if (engine.player_) {
-        delete engine.player_;
-        engine.player_ = nullptr;
+        JNIEnv *env, jclass type, jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (engine->player_) {
+        delete engine->player_;
+        engine->player_ = nullptr;
     }
 }
 
 JNIEXPORT jboolean JNICALL
 Java_com_google_sample_echo_MainActivity_createAudioRecorder(JNIEnv *env,
-                                                             jclass type) {
+                                                             jclass type,
+                                                             jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
     SampleFormat sampleFormat;
     memset(&sampleFormat, 0, sizeof(sampleFormat));
-    sampleFormat.pcmFormat_ = static_cast<uint16_t>(engine.bitsPerSample_);
+    sampleFormat.pcmFormat_ = static_cast<uint16_t>(engine->bitsPerSample_);
 
     // SampleFormat.representation_ = SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT;
-    sampleFormat.channels_ = engine.sampleChannels_;
-    sampleFormat.sampleRate_ = engine.fastPathSampleRate_;
-    sampleFormat.framesPerBuf_ = engine.fastPathFramesPerBuf_;
-    engine.recorder_ = new AudioRecorder(&sampleFormat, engine.slEngineItf_);                       //AudioRecorderクラスからオブジェクトrecorder_を作成する
-    if (!engine.recorder_) {
+    sampleFormat.channels_ = engine->sampleChannels_;
+    sampleFormat.sampleRate_ = engine->fastPathSampleRate_;
+    sampleFormat.framesPerBuf_ = engine->fastPathFramesPerBuf_;
+    engine->recorder_ = new AudioRecorder(&sampleFormat, engine->slEngineItf_);                       //AudioRecorderクラスからオブジェクトrecorder_を作成する
+    if (!engine->recorder_) {
         return JNI_FALSE;
     }
-    engine.recorder_->SetBufQueues(engine.freeBufQueue_, engine.recBufQueue_);
-    engine.recorder_->RegisterCallback(EngineService, (void *)&engine);
+    engine->recorder_->SetBufQueues(engine->freeBufQueue_, engine->recBufQueue_);
+    engine->recorder_->SetOverflowPolicy(engine->recOverflowPolicy_);
+    engine->recorder_->RegisterCallback(EngineService, (void *)engine);
     return JNI_TRUE;
 }
 
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_setRecorderOverflowPolicy(
+        JNIEnv *env, jclass type, jlong engineHandle, jint policy) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (policy < RECORDER_OVERFLOW_DROP_NEWEST ||
+        policy > RECORDER_OVERFLOW_PAUSE_RESUME) {
+        LOGE("====unknown recorder overflow policy %d", policy);
+        return;
+    }
+    engine->recOverflowPolicy_ = static_cast<RecorderOverflowPolicy>(policy);
+    if (engine->recorder_) {
+        engine->recorder_->SetOverflowPolicy(engine->recOverflowPolicy_);
+    }
+}
+
+/*
+ * Returns {overflows, droppedNewest, droppedOldest, pauses, resumes} of the
+ * current recorder, or null when no recorder exists.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getRecorderOverflowStats(
+        JNIEnv *env, jclass type, jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->recorder_) {
+        return nullptr;
+    }
+    RecorderOverflowStats stats;
+    engine->recorder_->GetOverflowStats(&stats);
+    jlong values[] = {stats.overflows_, stats.droppedNewest_,
+                      stats.droppedOldest_, stats.pauses_, stats.resumes_};
+    jint count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
+    }
+    return result;
+}
+
 JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_deleteAudioRecorder(JNIEnv *env,
-                                                             jclass type) {
-    if (engine.recorder_) delete engine.recorder_;
+                                                             jclass type,
+                                                             jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (engine->recorder_) delete engine->recorder_;
 
-    engine.recorder_ = nullptr;
+    engine->recorder_ = nullptr;
 }
 
 JNIEXPORT void JNICALL
-Java_com_google_sample_echo_MainActivity_startPlay(JNIEnv *env, jclass type) {
-    engine.frameCount_ = 0;
+Java_com_google_sample_echo_MainActivity_startPlay(JNIEnv *env, jclass type,
+                                                   jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    engine->frameCount_ = 0;
+    // the echo path is re-learned for every session
+    engine->echoCanceller_->reset();
     /*
      * start player: make it into waitForData state
      */
-    if (SL_BOOLEAN_FALSE == engine.player_->Start()) {
+    if (SL_BOOLEAN_FALSE == engine->player_->Start()) {
         LOGE("====%s failed", __FUNCTION__);
         return;
     }
-    engine.recorder_->Start();
+    engine->recorder_->Start();
 }
 
 JNIEXPORT void JNICALL
-Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type) {
-    engine.recorder_->Stop();
-    engine.player_->Stop();
+Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type,
+                                                  jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    engine->recorder_->Stop();
+    engine->player_->Stop();
+
+    PlayerStreamStats stats;
+    engine->player_->GetStreamStats(&stats);
+    LOGI("session: played %u bufs, %u gaps (%u bufs lost), latency "
+         "last %lld us max %lld us, last start %lld us", stats.played_,
+         stats.gaps_, stats.lost_, (long long)(stats.lastLatencyNs_ / 1000),
+         (long long)(stats.maxLatencyNs_ / 1000),
+         (long long)(stats.startLatencyNs_ / 1000));
+    LatencySummary interval, service;
+    engine->recorder_->GetTimingStats(&interval, &service);
+    LOGI("session: rec callback interval p50 %lld us p99 %lld us max %lld us",
+         (long long)(interval.p50Ns_ / 1000), (long long)(interval.p99Ns_ / 1000),
+         (long long)(interval.maxNs_ / 1000));
+    engine->player_->GetTimingStats(&interval, &service);
+    LOGI("session: play callback interval p50 %lld us p99 %lld us max %lld us",
+         (long long)(interval.p50Ns_ / 1000), (long long)(interval.p99Ns_ / 1000),
+         (long long)(interval.maxNs_ / 1000));
+
+    delete engine->recorder_;
+    delete engine->player_;
+    engine->recorder_ = NULL;
+    engine->player_ = NULL;
+}
+
+/*
+ * Pause the echo but keep the realized player and recorder, the buffer pool
+ * and the effect state: both devices stop and every buffer goes back to the
+ * free queue, ready for resumePlay().
+ */
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_pausePlay(JNIEnv *env, jclass type,
+                                                   jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->recorder_ || !engine->player_) {
+        return;
+    }
+    engine->recorder_->Stop();
+    engine->player_->Stop();
+}
 
-    delete engine.recorder_;
-    delete engine.player_;
-    engine.recorder_ = NULL;
-    engine.player_ = NULL;
+/*
+ * Restart a paused echo on the existing OpenSL objects. The echo canceller
+ * keeps the echo path it learned and only drops the stale reference; the
+ * time to the first recorded buffer reaching the device is reported by
+ * getPlayerStreamStats().
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_resumePlay(JNIEnv *env, jclass type,
+                                                    jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->recorder_ || !engine->player_) {
+        return JNI_FALSE;
+    }
+    engine->echoCanceller_->resync();
+    if (SL_BOOLEAN_FALSE == engine->player_->Start()) {
+        LOGE("====%s failed", __FUNCTION__);
+        return JNI_FALSE;
+    }
+    return engine->recorder_->Start() ? JNI_TRUE : JNI_FALSE;
 }
 
 JNIEXPORT void JNICALL Java_com_google_sample_echo_MainActivity_deleteSLEngine(
-        JNIEnv *env, jclass type) {
-    delete engine.recBufQueue_;
-    delete engine.freeBufQueue_;
-    releaseSampleBufs(engine.bufs_, engine.bufCount_);
-    if (engine.slEngineObj_ != NULL) {
-        (*engine.slEngineObj_)->Destroy(engine.slEngineObj_);
-        engine.slEngineObj_ = NULL;
-        engine.slEngineItf_ = NULL;
+        JNIEnv *env, jclass type, jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    delete engine->bufExchange_;
+    engine->bufExchange_ = nullptr;
+    delete engine->recBufQueue_;
+    delete engine->freeBufQueue_;
+    releaseSampleBufs(engine->bufs_, engine->bufCount_);
+    if (engine->slEngineItf_ != NULL) {
+        ReleaseSLEngine();
+        engine->slEngineItf_ = NULL;
+    }
+
+    if (engine->delayEffect_) {
+        delete engine->delayEffect_;
+        engine->delayEffect_ = nullptr;
+    }
+    if (engine->pitchShifter_) {
+        delete engine->pitchShifter_;
+        engine->pitchShifter_ = nullptr;
+    }
+    if (engine->equalizer_) {
+        delete engine->equalizer_;
+        engine->equalizer_ = nullptr;
+    }
+    if (engine->dynamics_) {
+        delete engine->dynamics_;
+        engine->dynamics_ = nullptr;
+    }
+    if (engine->controlQueue_) {
+        delete engine->controlQueue_;
+        engine->controlQueue_ = nullptr;
+    }
+    if (engine->silenceDetector_) {
+        delete engine->silenceDetector_;
+        engine->silenceDetector_ = nullptr;
+    }
+    if (engine->drift_) {
+        delete engine->drift_;
+        engine->drift_ = nullptr;
+    }
+    if (engine->conditioner_) {
+        delete engine->conditioner_;
+        engine->conditioner_ = nullptr;
+    }
+    if (engine->echoCanceller_) {
+        delete engine->echoCanceller_;
+        engine->echoCanceller_ = nullptr;
+    }
+    if (engine->pcmTap_) {
+        delete engine->pcmTap_;
+        engine->pcmTap_ = nullptr;
+    }
+    if (engine->spectrum_) {
+        delete engine->spectrum_;
+        engine->spectrum_ = nullptr;
+    }
+    if (engine->sessionRecorder_) {
+        delete engine->sessionRecorder_;
+        engine->sessionRecorder_ = nullptr;
+    }
+    if (engine->glitchDetector_) {
+        delete engine->glitchDetector_;
+        engine->glitchDetector_ = nullptr;
+    }
+    if (engine->latencyMeter_) {
+        delete engine->latencyMeter_;
+        engine->latencyMeter_ = nullptr;
+    }
+    if (engine->dspLoad_) {
+        delete engine->dspLoad_;
+        engine->dspLoad_ = nullptr;
+    }
+    delete engine;
+}
+
+/*
+ * Render a wav file through the same EngineService processing as the live
+ * path. A private engine context with freshly created effects is used, so a
+ * running session keeps its own effect state; the last value posted for
+ * every parameter is replayed into its own control queue and applied with
+ * the first block. The echo canceller and drift compensation have no
+ * offline counterpart and are left out.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_renderFile(JNIEnv *env, jclass type,
+                                                    jlong engineHandle,
+                                                    jstring inPath,
+                                                    jstring outPath) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    EchoAudioEngine renderEngine;
+    memset(&renderEngine, 0, sizeof(renderEngine));
+    renderEngine.fastPathSampleRate_ = engine->fastPathSampleRate_;
+    renderEngine.fastPathFramesPerBuf_ = engine->fastPathFramesPerBuf_;
+    renderEngine.sampleChannels_ = engine->sampleChannels_;
+    renderEngine.bitsPerSample_ = engine->bitsPerSample_;
+    renderEngine.echoDelayL_ = engine->echoDelayL_;
+    renderEngine.echoDelayR_ = engine->echoDelayR_;
+    renderEngine.delayEffect_ = new AudioDelay(
+            renderEngine.fastPathSampleRate_, renderEngine.sampleChannels_,
+            renderEngine.bitsPerSample_, renderEngine.echoDelayL_,
+            renderEngine.echoDelayR_);
+    renderEngine.pitchShifter_ = new PitchShifter(
+            renderEngine.fastPathSampleRate_, renderEngine.sampleChannels_,
+            renderEngine.bitsPerSample_);
+    renderEngine.equalizer_ = new Equalizer(
+            renderEngine.fastPathSampleRate_, renderEngine.sampleChannels_,
+            renderEngine.bitsPerSample_, renderEngine.fastPathFramesPerBuf_);
+    renderEngine.dynamics_ = new DynamicsProcessor(
+            renderEngine.fastPathSampleRate_, renderEngine.sampleChannels_,
+            renderEngine.bitsPerSample_, renderEngine.fastPathFramesPerBuf_);
+    renderEngine.conditioner_ = new InputConditioner(
+            renderEngine.fastPathSampleRate_, renderEngine.sampleChannels_,
+            renderEngine.bitsPerSample_);
+    renderEngine.silenceDetector_ = new SilenceDetector(
+            renderEngine.fastPathSampleRate_, renderEngine.sampleChannels_);
+    renderEngine.controlQueue_ = new ControlQueue();
+    ControlCommand latest[kControlMaxParams * CONTROL_TARGET_COUNT];
+    uint32_t count = engine->controlQueue_->getLatest(
+            latest, sizeof(latest) / sizeof(latest[0]));
+    for (uint32_t i = 0; i < count; i++) {
+        if (!renderEngine.controlQueue_->post(latest[i])) {
+            LOGW("renderFile: setting %d/%d not applied", latest[i].target_,
+                 latest[i].param_);
+        }
+    }
+
+    SampleFormat sampleFormat;
+    memset(&sampleFormat, 0, sizeof(sampleFormat));
+    sampleFormat.pcmFormat_ = renderEngine.bitsPerSample_;
+    sampleFormat.channels_ = renderEngine.sampleChannels_;
+    sampleFormat.sampleRate_ = renderEngine.fastPathSampleRate_;
+    sampleFormat.framesPerBuf_ = renderEngine.fastPathFramesPerBuf_;
+
+    const char *in = env->GetStringUTFChars(inPath, nullptr);
+    const char *out = env->GetStringUTFChars(outPath, nullptr);
+    OfflineRenderStats stats;
+    bool result = OfflineRenderWav(in, out, &sampleFormat, EngineService,
+                                   &renderEngine, &stats);
+    if (result) {
+        double audioUs = 1000000.0 * stats.frames_ /
+                         (renderEngine.fastPathSampleRate_ / 1000);
+        LOGI("rendered %s: %llu frames, %llu blocks in %llu us (%.1fx realtime)",
+             out, (unsigned long long)stats.frames_,
+             (unsigned long long)stats.blocks_,
+             (unsigned long long)stats.elapsedUs_,
+             stats.elapsedUs_ ? audioUs / stats.elapsedUs_ : 0.0);
+    }
+    env->ReleaseStringUTFChars(inPath, in);
+    env->ReleaseStringUTFChars(outPath, out);
+
+    delete renderEngine.controlQueue_;
+    delete renderEngine.silenceDetector_;
+    delete renderEngine.conditioner_;
+    delete renderEngine.dynamics_;
+    delete renderEngine.equalizer_;
+    delete renderEngine.pitchShifter_;
+    delete renderEngine.delayEffect_;
+    return result ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Returns {played, gaps, lostBufs, lastLatencyUs, maxLatencyUs,
+ * startLatencyUs} of the current player, or null when no player exists;
+ * startLatencyUs is the time from the last start/resume to the first
+ * recorded buffer handed to the device.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getPlayerStreamStats(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->player_) {
+        return nullptr;
+    }
+    PlayerStreamStats stats;
+    engine->player_->GetStreamStats(&stats);
+    jlong values[] = {stats.played_, stats.gaps_, stats.lost_,
+                      stats.lastLatencyNs_ / 1000, stats.maxLatencyNs_ / 1000,
+                      stats.startLatencyNs_ / 1000};
+    jint count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
+    }
+    return result;
+}
+
+/*
+ * Start recording the pipeline points in pointMask (bit n = PcmTapPoint n)
+ * to <pathPrefix>_<point>.wav, keeping the last maxSeconds of each.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startPcmTap(JNIEnv *env, jclass type,
+                                                     jlong engineHandle,
+                                                     jstring pathPrefix,
+                                                     jint pointMask,
+                                                     jint maxSeconds) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->pcmTap_ || pointMask <= 0 || maxSeconds <= 0) {
+        return JNI_FALSE;
+    }
+    const char *prefix = env->GetStringUTFChars(pathPrefix, nullptr);
+    bool result = engine->pcmTap_->start(prefix, static_cast<uint32_t>(pointMask),
+                                        static_cast<uint32_t>(maxSeconds));
+    env->ReleaseStringUTFChars(pathPrefix, prefix);
+    return result ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * Stop the taps and finalize the files; returns the number of buffers the
+ * taps had to drop.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_google_sample_echo_MainActivity_stopPcmTap(JNIEnv *env, jclass type,
+                                                    jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->pcmTap_) {
+        return 0;
+    }
+    engine->pcmTap_->stop();
+    return static_cast<jlong>(engine->pcmTap_->getDropped());
+}
+
+/*
+ * Record the streams in streamMask (bit n = SessionStream n) losslessly to
+ * <pathPrefix>_input.flac and <pathPrefix>_output.flac, for as long as it
+ * runs.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startSessionRecording(JNIEnv *env,
+                                                               jclass type,
+                                                               jlong engineHandle,
+                                                               jstring pathPrefix,
+                                                               jint streamMask) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->sessionRecorder_ || streamMask <= 0) {
+        return JNI_FALSE;
+    }
+    const char *prefix = env->GetStringUTFChars(pathPrefix, nullptr);
+    bool result = engine->sessionRecorder_->start(prefix,
+                                                  static_cast<uint32_t>(streamMask));
+    env->ReleaseStringUTFChars(pathPrefix, prefix);
+    return result ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * {inputFrames, inputBytes, outputFrames, outputBytes, droppedBuffers} of
+ * the current (or last) session recording
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getSessionRecordingStats(
+        JNIEnv *env, jclass type, jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->sessionRecorder_) {
+        return nullptr;
+    }
+    SessionStreamStats input, output;
+    engine->sessionRecorder_->getStats(SESSION_STREAM_INPUT, &input);
+    engine->sessionRecorder_->getStats(SESSION_STREAM_OUTPUT, &output);
+    jlong values[] = {static_cast<jlong>(input.frames_),
+                      static_cast<jlong>(input.bytes_),
+                      static_cast<jlong>(output.frames_),
+                      static_cast<jlong>(output.bytes_),
+                      static_cast<jlong>(engine->sessionRecorder_->getDropped())};
+    jint count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
+    }
+    return result;
+}
+
+/*
+ * Stop recording and finalize the files; returns the final
+ * getSessionRecordingStats().
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_stopSessionRecording(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (engine->sessionRecorder_) {
+        engine->sessionRecorder_->stop();
+    }
+    return Java_com_google_sample_echo_MainActivity_getSessionRecordingStats(
+            env, type, engineHandle);
+}
+
+/*
+ * Level and spectrum of the processed audio, fftSize frames (a power of two,
+ * 256 .. 4096) framesPerSecond times a second, into the region
+ * getSpectrumBuffer() maps.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startSpectrum(JNIEnv *env, jclass type,
+                                                       jlong engineHandle,
+                                                       jint fftSize,
+                                                       jint framesPerSecond) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->spectrum_ || fftSize <= 0 || framesPerSecond <= 0) {
+        return JNI_FALSE;
+    }
+    return engine->spectrum_->start(static_cast<uint32_t>(fftSize),
+                                    static_cast<uint32_t>(framesPerSecond))
+           ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_stopSpectrum(JNIEnv *env, jclass type,
+                                                      jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (engine->spectrum_) {
+        engine->spectrum_->stop();
+    }
+}
+
+/*
+ * The analyzer's shared region as a direct ByteBuffer, valid until the
+ * engine is deleted; the layout is SpectrumHeader and two SpectrumSlots.
+ */
+JNIEXPORT jobject JNICALL
+Java_com_google_sample_echo_MainActivity_getSpectrumBuffer(JNIEnv *env,
+                                                           jclass type,
+                                                           jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->spectrum_) {
+        return nullptr;
+    }
+    return env->NewDirectByteBuffer(engine->spectrum_->region(),
+                                    engine->spectrum_->regionSize());
+}
+
+/*
+ * Copy the newest frame out: levels gets {peakL, peakR, rmsL, rmsR} in dB,
+ * magnitudesDb as many bins as it holds. Returns the frame's sequence, or -1
+ * when there is none yet or it kept being replaced meanwhile (poll again).
+ * The copy is here rather than on the ByteBuffer: it has to be ordered
+ * against the analyzer thread, and Java has no acquire loads for that
+ * before VarHandle.
+ */
+JNIEXPORT jint JNICALL
+Java_com_google_sample_echo_MainActivity_readSpectrum(JNIEnv *env, jclass type,
+                                                      jlong engineHandle,
+                                                      jfloatArray levels,
+                                                      jfloatArray magnitudesDb) {
+    const uint32_t kMaxBins = SpectrumAnalyzer::kMaxFftSize / 2 + 1;
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!engine->spectrum_) {
+        return -1;
     }
+    float levelsDb[4];
+    std::vector<float> bins(kMaxBins);
+    uint32_t maxBins = std::min(
+            static_cast<uint32_t>(env->GetArrayLength(magnitudesDb)), kMaxBins);
+    uint32_t count = 0;
+    int32_t sequence = engine->spectrum_->read(levelsDb, levelsDb + 2,
+                                               bins.data(), maxBins, &count);
+    if (sequence < 0) {
+        return -1;
+    }
+    jsize levelCount = std::min(env->GetArrayLength(levels), 4);
+    env->SetFloatArrayRegion(levels, 0, levelCount, levelsDb);
+    env->SetFloatArrayRegion(magnitudesDb, 0, static_cast<jsize>(count),
+                             bins.data());
+    return sequence;
+}
+
+/*
+ * Hand the processed capture buffers to Java, in place, instead of straight
+ * to the player (see BufferExchange for who owns what when).
+ */
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_enableBufferExchange(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle,
+                                                              jboolean enable) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    engine->bufExchange_->setEnabled(enable == JNI_TRUE);
+}
+
+/*
+ * The exchange's control region: BufferExchangeHeader and the two rings.
+ */
+JNIEXPORT jobject JNICALL
+Java_com_google_sample_echo_MainActivity_getBufferExchange(JNIEnv *env,
+                                                           jclass type,
+                                                           jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    return env->NewDirectByteBuffer(engine->bufExchange_->region(),
+                                    engine->bufExchange_->regionSize());
+}
+
+/*
+ * One direct ByteBuffer per engine buffer, indexed like the ring entries;
+ * fetch them once, they stay valid until the engine is deleted.
+ */
+JNIEXPORT jobjectArray JNICALL
+Java_com_google_sample_echo_MainActivity_getBufferViews(JNIEnv *env,
+                                                        jclass type,
+                                                        jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    jclass byteBufferClass = env->FindClass("java/nio/ByteBuffer");
+    if (byteBufferClass == nullptr) {
+        return nullptr;
+    }
+    uint32_t count = engine->bufExchange_->bufCount();
+    jobjectArray views = env->NewObjectArray(count, byteBufferClass, nullptr);
+    if (views == nullptr) {
+        return nullptr;
+    }
+    sample_buf *bufs = engine->bufExchange_->bufs();
+    for (uint32_t i = 0; i < count; i++) {
+        jobject view = env->NewDirectByteBuffer(bufs[i].buf_, bufs[i].cap_);
+        if (view == nullptr) {
+            return nullptr;
+        }
+        env->SetObjectArrayElement(views, i, view);
+        env->DeleteLocalRef(view);
+    }
+    return views;
+}
+
+/*
+ * Take the oldest buffer the engine handed out: returns its view index, or
+ * -1 when there is none; info gets {sizeBytes, framePos}.
+ */
+JNIEXPORT jint JNICALL
+Java_com_google_sample_echo_MainActivity_takeSharedBuffer(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong engineHandle,
+                                                          jlongArray info) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    uint32_t sizeBytes;
+    int64_t framePos;
+    int32_t index = engine->bufExchange_->take(&sizeBytes, &framePos);
+    if (index >= 0) {
+        jlong values[] = {static_cast<jlong>(sizeBytes),
+                          static_cast<jlong>(framePos)};
+        jsize count = std::min(env->GetArrayLength(info), 2);
+        env->SetLongArrayRegion(info, 0, count, values);
+    }
+    return index;
+}
+
+/*
+ * Give a buffer back for playing, once done with its view.
+ */
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_returnSharedBuffer(JNIEnv *env,
+                                                            jclass type,
+                                                            jlong engineHandle,
+                                                            jint index) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    engine->bufExchange_->giveBack(index);
+}
+
+/*
+ * Indices Java gave back without owning them, since the engine started.
+ */
+JNIEXPORT jlong JNICALL
+Java_com_google_sample_echo_MainActivity_getBufferExchangeErrors(
+        JNIEnv *env, jclass type, jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    return static_cast<jlong>(engine->bufExchange_->getInvalid());
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_enableGlitchDetector(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle,
+                                                              jboolean enable) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    engine->glitchDetector_->setEnabled(enable == JNI_TRUE);
+}
+
+/*
+ * Glitches detected since the last call, oldest first, flattened as
+ *   {timeNs, point, type, framePos, value} per event
+ * (point: PCM_TAP_* bit position, type: GLITCH_*).
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getGlitchEvents(JNIEnv *env,
+                                                         jclass type,
+                                                         jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    const uint32_t kFields = 5;
+    const uint32_t kMaxEvents =
+            GlitchDetector::kEventsPerPoint * PCM_TAP_POINT_COUNT;
+    GlitchEvent events[kMaxEvents];
+    uint32_t count = engine->glitchDetector_->getEvents(events, kMaxEvents);
+
+    jlong values[kMaxEvents * kFields];
+    for (uint32_t i = 0; i < count; i++) {
+        values[i * kFields] = events[i].time_;
+        values[i * kFields + 1] = events[i].point_;
+        values[i * kFields + 2] = events[i].type_;
+        values[i * kFields + 3] = static_cast<jlong>(events[i].framePos_);
+        values[i * kFields + 4] = events[i].value_;
+    }
+    jlongArray result = env->NewLongArray(count * kFields);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count * kFields, values);
+    }
+    return result;
+}
+
+/*
+ * Totals since the detector was enabled:
+ *   {discontinuities, zeroRuns, clippingBursts, sequenceGaps, droppedEvents}
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getGlitchCounts(JNIEnv *env,
+                                                         jclass type,
+                                                         jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    GlitchDetector *detector = engine->glitchDetector_;
+    jlong values[] = {
+            static_cast<jlong>(detector->getCount(GLITCH_DISCONTINUITY)),
+            static_cast<jlong>(detector->getCount(GLITCH_ZERO_RUN)),
+            static_cast<jlong>(detector->getCount(GLITCH_CLIPPING)),
+            static_cast<jlong>(detector->getCount(GLITCH_SEQUENCE_GAP)),
+            static_cast<jlong>(detector->getDropped())};
+    jint count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
+    }
+    return result;
+}
+
+/*
+ * Round trip latency measurement: for the next bursts * ~0.6 s the player
+ * sends MLS bursts instead of the processed mic audio. Keep the echo
+ * running until getLatencyResult() returns a result.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startLatencyMeasurement(
+        JNIEnv *env, jclass type, jlong engineHandle, jint bursts) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    return engine->latencyMeter_->start(bursts) ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * {bursts, validBursts, meanMs, stdDevMs, minMs, maxMs} of the last
+ * measurement, or null while it is still running (or none was started).
+ */
+JNIEXPORT jdoubleArray JNICALL
+Java_com_google_sample_echo_MainActivity_getLatencyResult(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    LatencyResult res;
+    if (!engine->latencyMeter_->getResult(&res)) {
+        return nullptr;
+    }
+    jdouble values[] = {static_cast<jdouble>(res.bursts_),
+                        static_cast<jdouble>(res.valid_), res.meanMs_,
+                        res.stdDevMs_, res.minMs_, res.maxMs_};
+    jint count = sizeof(values) / sizeof(values[0]);
+    jdoubleArray result = env->NewDoubleArray(count);
+    if (result) {
+        env->SetDoubleArrayRegion(result, 0, count, values);
+    }
+    return result;
+}
+
+/*
+ * Pipeline tracing (needs ENABLE_TRACE): startTrace() clears and starts
+ * collecting, stopTrace() stops, exportTrace() writes the collected events
+ * as Chrome trace JSON (open in chrome://tracing or ui.perfetto.dev).
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startTrace(JNIEnv *env, jclass type) {
+#ifdef ENABLE_TRACE
+    Tracer::instance()->start();
+    return JNI_TRUE;
+#else
+    return JNI_FALSE;
+#endif
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_stopTrace(JNIEnv *env, jclass type) {
+#ifdef ENABLE_TRACE
+    Tracer::instance()->stop();
+#endif
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_exportTrace(JNIEnv *env, jclass type,
+                                                     jstring path) {
+#ifdef ENABLE_TRACE
+    const char *file = env->GetStringUTFChars(path, nullptr);
+    bool result = Tracer::instance()->exportChromeJson(file);
+    env->ReleaseStringUTFChars(path, file);
+    return result ? JNI_TRUE : JNI_FALSE;
+#else
+    return JNI_FALSE;
+#endif
+}
+
+/*
+ * DSP load of the capture chain, per DSP_SLOT_* (echo canceller,
+ * conditioner, delay, total), flattened as
+ *   {current, peak, overruns, bypassed} per slot
+ * where current/peak are fractions of the buffer period.
+ */
+JNIEXPORT jfloatArray JNICALL
+Java_com_google_sample_echo_MainActivity_getDspLoad(JNIEnv *env, jclass type,
+                                                    jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    const int32_t kFields = 4;
+    jfloat values[DSP_SLOT_COUNT * kFields];
+    for (int32_t slot = 0; slot < DSP_SLOT_COUNT; slot++) {
+        DspLoad load;
+        engine->dspLoad_->getLoad(static_cast<DspSlot>(slot), &load);
+        values[slot * kFields] = load.current_;
+        values[slot * kFields + 1] = load.peak_;
+        values[slot * kFields + 2] = static_cast<jfloat>(load.overruns_);
+        values[slot * kFields + 3] = load.bypassed_ ? 1.0f : 0.0f;
+    }
+    jint count = sizeof(values) / sizeof(values[0]);
+    jfloatArray result = env->NewFloatArray(count);
+    if (result) {
+        env->SetFloatArrayRegion(result, 0, count, values);
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_resetDspLoad(JNIEnv *env,
+                                                      jclass type,
+                                                      jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    engine->dspLoad_->reset();
+}
+
+/*
+ * Let the engine bypass the most expensive effects while the total load is
+ * above threshold (fraction of the buffer period, e.g. 0.9).
+ */
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_setDspAutoBypass(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong engineHandle,
+                                                          jboolean enable,
+                                                          jfloat threshold) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    engine->dspLoad_->setAutoBypass(enable == JNI_TRUE, threshold);
+}
+
+/*
+ * parameter count of each ControlTarget
+ */
+static const int32_t kControlParamCount[CONTROL_TARGET_COUNT] = {
+    DELAY_PARAM_COUNT,
+    PITCH_PARAM_COUNT,
+    kEqMaxSections * EQ_SECTION_PARAMS,
+    DYNAMICS_PARAM_COUNT,
+    CONDITIONER_PARAM_COUNT,
+    ECHO_CANCELLER_PARAM_COUNT,
+    SILENCE_PARAM_COUNT,
+    DRIFT_PARAM_COUNT,
+};
+
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_postControl(JNIEnv *env, jclass type,
+                                                     jlong engineHandle,
+                                                     jint target, jint param,
+                                                     jfloat value,
+                                                     jlong framePos,
+                                                     jint rampFrames) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (target < 0 || target >= CONTROL_TARGET_COUNT || param < 0 ||
+        param >= kControlParamCount[target] || framePos < 0 || rampFrames < 0) {
+        LOGE("====postControl: invalid target %d param %d", target, param);
+        return JNI_FALSE;
+    }
+    ControlCommand cmd = {target, param, value, static_cast<uint64_t>(framePos),
+                          static_cast<uint32_t>(rampFrames)};
+    return engine->controlQueue_->post(cmd) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_google_sample_echo_MainActivity_getControlFramePosition(
+        JNIEnv *env, jclass type, jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    return static_cast<jlong>(engine->controlQueue_->getFramePosition());
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configureSilenceBypass(
+        JNIEnv *env, jclass type, jlong engineHandle, jboolean enable,
+        jfloat thresholdDb, jfloat holdMs) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (!SilenceDetector::isValid(thresholdDb, holdMs)) {
+        return JNI_FALSE;
+    }
+    ControlCommand cmd = {CONTROL_TARGET_SILENCE, SILENCE_PARAM_THRESHOLD_DB,
+                          thresholdDb, kControlNow, 0};
+    bool posted = engine->controlQueue_->post(cmd);
+    cmd.param_ = SILENCE_PARAM_HOLD_MS;
+    cmd.value_ = holdMs;
+    posted = engine->controlQueue_->post(cmd) && posted;
+    cmd.param_ = SILENCE_PARAM_ENABLE;
+    cmd.value_ = enable == JNI_TRUE ? 1.0f : 0.0f;
+    posted = engine->controlQueue_->post(cmd) && posted;
+    return posted ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * {buffers, skipped, resumes, skipping} of the silence bypass
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getSilenceStats(JNIEnv *env,
+                                                         jclass type,
+                                                         jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    SilenceStats stats;
+    engine->silenceDetector_->getStats(&stats);
+    jlong values[] = {
+        static_cast<jlong>(stats.buffers_),
+        static_cast<jlong>(stats.skipped_),
+        static_cast<jlong>(stats.resumes_),
+        stats.skipping_ ? 1 : 0,
+    };
+    jlongArray result = env->NewLongArray(4);
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, 4, values);
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_enableDriftCompensation(
+        JNIEnv *env, jclass type, jlong engineHandle, jboolean enable) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    ControlCommand cmd = {CONTROL_TARGET_DRIFT, DRIFT_PARAM_ENABLE,
+                          enable == JNI_TRUE ? 1.0f : 0.0f, kControlNow, 0};
+    if (!engine->controlQueue_->post(cmd)) {
+        LOGE("====enableDriftCompensation: control queue full");
+    }
+}
+
+/*
+ * {ratio, feedForward, captureHz, playHz, depth, targetDepth}: the capture
+ * resampling ratio (output / input), the part of it coming from the stream
+ * rates, both rates as measured on CLOCK_MONOTONIC (0 until known) and the
+ * smoothed recorded queue depth with the depth being held, in buffers.
+ */
+JNIEXPORT jdoubleArray JNICALL
+Java_com_google_sample_echo_MainActivity_getDriftStats(JNIEnv *env,
+                                                       jclass type,
+                                                       jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    DriftStats stats;
+    engine->drift_->getStats(&stats);
+    jdouble values[] = {stats.ratio_, stats.feedForward_, stats.captureHz_,
+                        stats.playHz_, stats.depth_, stats.target_};
+    jdoubleArray result = env->NewDoubleArray(6);
+    if (result != nullptr) {
+        env->SetDoubleArrayRegion(result, 0, 6, values);
+    }
+    return result;
+}
+
+/*
+ * Scheduling of the audio callback and worker threads, process wide: every
+ * thread applies its role's policy on its next buffer or loop.
+ * cpuMask is a mask of cpus, kThreadCpusAny or kThreadCpusBigCores.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_setThreadPolicy(JNIEnv *env,
+                                                         jclass type,
+                                                         jint role, jint sched,
+                                                         jint fifoPriority,
+                                                         jint nice,
+                                                         jlong cpuMask) {
+    ThreadPolicyConfig config = {sched, fifoPriority, nice, cpuMask};
+    return ThreadPolicy::instance()->configure(static_cast<ThreadRole>(role),
+                                               config)
+           ? JNI_TRUE : JNI_FALSE;
+}
+
+/*
+ * {tid, role, policy, priority, nice, cpuMask} for each thread which applied
+ * a policy, as the kernel reports it afterwards.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getThreadPolicyReport(JNIEnv *env,
+                                                               jclass type) {
+    const uint32_t kFields = 6;
+    ThreadPolicyResult results[ThreadPolicy::kMaxThreads];
+    uint32_t count = ThreadPolicy::instance()->getReport(
+            results, ThreadPolicy::kMaxThreads);
+    jlong values[ThreadPolicy::kMaxThreads * kFields];
+    for (uint32_t i = 0; i < count; i++) {
+        jlong *row = &values[i * kFields];
+        row[0] = results[i].tid_;
+        row[1] = results[i].role_;
+        row[2] = results[i].policy_;
+        row[3] = results[i].priority_;
+        row[4] = results[i].nice_;
+        row[5] = static_cast<jlong>(results[i].cpuMask_);
+    }
+    jlongArray result = env->NewLongArray(count * kFields);
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, count * kFields, values);
+    }
+    return result;
+}
+
+/*
+ * Hand the commands due inside the buffer starting at framePos to their
+ * effects, at their frame offset; once a command's effect has a full
+ * schedule, it and everything after it stay queued for the next buffer.
+ * Targets without a schedule take theirs from the start of the buffer;
+ * the ones an engine lacks (no canceller when rendering) are dropped.
+ */
+static void DispatchControls(EchoAudioEngine *eng, uint64_t framePos,
+                             uint32_t frames) {
+    if (!eng->controlQueue_) {
+        return;
+    }
+    ControlCommand cmd;
+    while (eng->controlQueue_->nextDue(framePos, framePos + frames, &cmd)) {
+        uint32_t offset = cmd.framePos_ > framePos
+                          ? static_cast<uint32_t>(cmd.framePos_ - framePos) : 0;
+        bool full;
+        switch (cmd.target_) {
+            case CONTROL_TARGET_PITCH:
+                full = eng->pitchShifter_->isScheduleFull();
+                if (!full) {
+                    eng->pitchShifter_->schedule(cmd.param_, cmd.value_, offset,
+                                                 cmd.rampFrames_);
+                }
+                break;
+            case CONTROL_TARGET_EQ:
+                full = eng->equalizer_->isScheduleFull();
+                if (!full) {
+                    eng->equalizer_->schedule(cmd.param_, cmd.value_, offset,
+                                              cmd.rampFrames_);
+                }
+                break;
+            case CONTROL_TARGET_DYNAMICS:
+                // no schedule: applies from the start of this buffer
+                full = false;
+                eng->dynamics_->setParam(cmd.param_, cmd.value_);
+                eng->delayEffect_->setLoopDynamics(
+                        eng->dynamics_->placement() == DYNAMICS_PLACEMENT_FEEDBACK
+                        ? eng->dynamics_ : nullptr);
+                break;
+            case CONTROL_TARGET_CONDITIONER:
+                full = false;
+                eng->conditioner_->setParam(cmd.param_, cmd.value_);
+                break;
+            case CONTROL_TARGET_ECHO_CANCELLER:
+                full = false;
+                if (!eng->echoCanceller_) {
+                    break;
+                }
+                if (cmd.param_ == ECHO_CANCELLER_PARAM_ENABLE) {
+                    eng->echoCanceller_->setEnabled(cmd.value_ != 0.0f);
+                } else if (cmd.param_ == ECHO_CANCELLER_PARAM_DELAY_MS) {
+                    eng->echoCanceller_->setDelayMs(cmd.value_);
+                }
+                break;
+            case CONTROL_TARGET_SILENCE:
+                full = false;
+                if (eng->silenceDetector_) {
+                    eng->silenceDetector_->setParam(cmd.param_, cmd.value_);
+                }
+                break;
+            case CONTROL_TARGET_DRIFT:
+                full = false;
+                if (eng->drift_) {
+                    eng->drift_->setEnabled(cmd.value_ != 0.0f);
+                }
+                break;
+            default:
+                full = eng->delayEffect_->isScheduleFull();
+                if (!full) {
+                    eng->delayEffect_->schedule(cmd.param_, cmd.value_, offset,
+                                                cmd.rampFrames_);
+                }
+                break;
+        }
+        if (full) {
+            break;
+        }
+        eng->controlQueue_->pop();
+    }
+}
+
+static inline bool DspSlotActive(EchoAudioEngine *eng, DspSlot slot) {
+    return !eng->dspLoad_ || !eng->dspLoad_->isBypassed(slot);
+}
+
+static inline void DspSlotDone(EchoAudioEngine *eng, DspSlot slot,
+                               int64_t start) {
+    if (eng->dspLoad_) {
+        eng->dspLoad_->record(slot, GetMonotonicNanos() - start);
+    }
+}
+
+/*
+ * Close the buffer's load accounting; the echo canceller lost track of the
+ * far end while bypassed, so it starts over when it comes back, and so
+ * do the pitch shifter, whose line missed the input, and the dynamics
+ * processor, whose lookahead did.
+ */
+static inline void DspBufferDone(EchoAudioEngine *eng, int64_t start) {
+    if (!eng->dspLoad_) {
+        return;
+    }
+    DspSlotDone(eng, DSP_SLOT_TOTAL, start);
+    uint32_t resumed = eng->dspLoad_->endBuffer();
+    if ((resumed & (1 << DSP_SLOT_ECHO_CANCELLER)) && eng->echoCanceller_) {
+        eng->echoCanceller_->reset();
+    }
+    if (resumed & (1 << DSP_SLOT_PITCH)) {
+        eng->pitchShifter_->reset();
+    }
+    if (resumed & (1 << DSP_SLOT_DYNAMICS)) {
+        eng->dynamics_->reset();
+    }
+}
 
-    if (engine.delayEffect_) {
-        delete engine.delayEffect_;
-        engine.delayEffect_ = nullptr;
+/*
+ * Hand a pipeline point's audio to the debug observers: the PCM tap and the
+ * glitch detector. Both return right away when they are not active.
+ */
+static inline void ObservePcm(EchoAudioEngine *eng, PcmTapPoint point,
+                              sample_buf *buf, uint32_t frames) {
+    if (eng->pcmTap_) {
+        eng->pcmTap_->write(point, reinterpret_cast<int16_t *>(buf->buf_),
+                            frames);
+    }
+    if (eng->glitchDetector_) {
+        eng->glitchDetector_->analyze(point, buf, frames);
     }
 }
 
-uint32_t dbgEngineGetBufCount(void) {
-    uint32_t count = engine.player_->dbgGetDevBufCount();
-    count += engine.recorder_->dbgGetDevBufCount();
-    count += engine.freeBufQueue_->size();
-    count += engine.recBufQueue_->size();
+/*
+ * The processed buffer, before drift compensation, for the level and
+ * spectrum display and the session recording: it still has as many frames
+ * as the capture, so the recorded input and output stay aligned.
+ */
+static inline void AnalyzeOutput(EchoAudioEngine *eng, sample_buf *buf) {
+    if (eng->spectrum_) {
+        eng->spectrum_->write(reinterpret_cast<int16_t *>(buf->buf_),
+                              eng->fastPathFramesPerBuf_);
+    }
+    if (eng->sessionRecorder_) {
+        eng->sessionRecorder_->write(SESSION_STREAM_OUTPUT,
+                                     reinterpret_cast<int16_t *>(buf->buf_),
+                                     eng->fastPathFramesPerBuf_);
+    }
+}
+
+/*
+ * End of a capture buffer: buffers Java gave back go to the player first,
+ * then this one goes to Java while the exchange is on. Returns whether the
+ * recorder should queue it for the player.
+ */
+static inline bool HandOffRecorded(EchoAudioEngine *eng, sample_buf *buf) {
+    if (!eng->bufExchange_) {
+        return true;
+    }
+    eng->bufExchange_->forwardReturned(eng->recBufQueue_);
+    return !eng->bufExchange_->share(buf);
+}
+
+/*
+ * A buffer the effects do not run on (silent, or replaced by a latency
+ * measurement): the changes scheduled for it still take effect, as though
+ * due at its end, so the next buffer's commands find room.
+ */
+static void SkipSchedules(EchoAudioEngine *eng) {
+    eng->delayEffect_->skipSchedule();
+    eng->pitchShifter_->skipSchedule();
+    eng->equalizer_->skipSchedule();
+}
+
+/*
+ * The effects stay idle for a silent buffer: it leaves as digital silence,
+ * and the later tap points see that silence too so their files stay
+ * aligned.
+ */
+static void SkipSilentBuffer(EchoAudioEngine *eng, sample_buf *buf) {
+    memset(buf->buf_, 0, buf->size_);
+    if (eng->echoCanceller_) {
+        ObservePcm(eng, PCM_TAP_ECHO_CANCELLER, buf, eng->fastPathFramesPerBuf_);
+    }
+    ObservePcm(eng, PCM_TAP_CONDITIONER, buf, eng->fastPathFramesPerBuf_);
+    ObservePcm(eng, PCM_TAP_DELAY, buf, eng->fastPathFramesPerBuf_);
+}
+
+/*
+ * Last step of the capture chain: stretch or shrink the buffer by the
+ * drift ratio. buf->size_ follows, and the player plays what is in it.
+ */
+static void CompensateDrift(EchoAudioEngine *eng, sample_buf *buf,
+                            bool silent) {
+    if (!eng->drift_) {
+        return;
+    }
+    uint32_t frameBytes = eng->sampleChannels_ * (eng->bitsPerSample_ / 8);
+    uint32_t frames = eng->drift_->process(
+            reinterpret_cast<int16_t *>(buf->buf_), silent,
+            buf->cap_ / frameBytes, buf->captureTime_,
+            eng->recBufQueue_->size());
+    buf->size_ = frames * frameBytes;
+}
+
+/*
+ * Callback timing of the recorder (stream 0) or the player (stream 1):
+ *   {intervalCount, intervalP50, intervalP99, intervalP999, intervalMax,
+ *    serviceCount, serviceP50, serviceP99, serviceP999, serviceMax}
+ * in nano seconds; interval is the time between two device callbacks,
+ * service the time spent in EngineService per message. Returns null when
+ * the stream does not exist.
+ */
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getCallbackTiming(JNIEnv *env,
+                                                           jclass type,
+                                                           jlong engineHandle,
+                                                           jint stream) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    LatencySummary interval, service;
+    if (stream == CALLBACK_TIMING_RECORDER && engine->recorder_) {
+        engine->recorder_->GetTimingStats(&interval, &service);
+    } else if (stream == CALLBACK_TIMING_PLAYER && engine->player_) {
+        engine->player_->GetTimingStats(&interval, &service);
+    } else {
+        return nullptr;
+    }
+    jlong values[] = {
+            static_cast<jlong>(interval.count_), interval.p50Ns_, interval.p99Ns_,
+            interval.p999Ns_, interval.maxNs_,
+            static_cast<jlong>(service.count_), service.p50Ns_, service.p99Ns_,
+            service.p999Ns_, service.maxNs_};
+    jint count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_resetCallbackTiming(JNIEnv *env,
+                                                             jclass type,
+                                                             jlong engineHandle) {
+    EchoAudioEngine *engine = EngineFromHandle(engineHandle);
+    if (engine->recorder_) {
+        engine->recorder_->ResetTiming();
+    }
+    if (engine->player_) {
+        engine->player_->ResetTiming();
+    }
+}
+
+uint32_t dbgEngineGetBufCount(EchoAudioEngine *eng) {
+    if (!eng->player_ || !eng->recorder_) {
+        return 0;
+    }
+    uint32_t count = eng->player_->dbgGetDevBufCount();
+    count += eng->recorder_->dbgGetDevBufCount();
+    count += eng->freeBufQueue_->size();
+    count += eng->recBufQueue_->size();
+    count += eng->bufExchange_->dbgGetHeldCount();
 
     LOGE(
             "Buf Disrtibutions: PlayerDev=%d, RecDev=%d, FreeQ=%d, "
-            "RecQ=%d",
-            engine.player_->dbgGetDevBufCount(),
-            engine.recorder_->dbgGetDevBufCount(), engine.freeBufQueue_->size(),
-            engine.recBufQueue_->size());
-    if (count != engine.bufCount_) {
+            "RecQ=%d, Java=%d",
+            eng->player_->dbgGetDevBufCount(),
+            eng->recorder_->dbgGetDevBufCount(), eng->freeBufQueue_->size(),
+            eng->recBufQueue_->size(), eng->bufExchange_->dbgGetHeldCount());
+    if (count != eng->bufCount_) {
         LOGE("====Lost Bufs among the queue(supposed = %d, found = %d)", BUF_COUNT,
              count);
     }
@@ -239,19 +1740,148 @@ uint32_t dbgEngineGetBufCount(void) {
  * simple message passing for player/recorder to communicate with engine
  */
 bool EngineService(void *ctx, uint32_t msg, void *data) {
-    assert(ctx == &engine);
+    assert(ctx);
+    EchoAudioEngine *eng = static_cast<EchoAudioEngine *>(ctx);
+    // live callbacks only: renderFile() runs on the caller's thread
+    if (eng->slEngineItf_) {
+        ThreadPolicy::instance()->applyIfChanged(THREAD_ROLE_AUDIO);
+    }
     switch (msg) {
         case ENGINE_SERVICE_MSG_RETRIEVE_DUMP_BUFS: {
-            *(static_cast<uint32_t *>(data)) = dbgEngineGetBufCount();
+            *(static_cast<uint32_t *>(data)) = dbgEngineGetBufCount(eng);
             break;
         }
         case ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE: {
-            // adding audio delay effect
+            // remove the speaker echo, condition the capture (DC blocker,
+            // noise gate), then adding audio delay and pitch shift effects,
+            // equalized and limited last
+            sample_buf *buf = static_cast<sample_buf *>(data);
+            TRACE_SCOPE_SEQ("EngineService recorded", buf->seq_);
+            assert(eng->fastPathFramesPerBuf_ ==
+                   buf->size_ / eng->sampleChannels_ / (eng->bitsPerSample_ / 8));
+            int64_t begin = GetMonotonicNanos();
+            if (eng->controlQueue_) {
+                eng->controlQueue_->setFramePosition(
+                        buf->framePos_ + eng->fastPathFramesPerBuf_);
+            }
+            ObservePcm(eng, PCM_TAP_CAPTURE, buf, eng->fastPathFramesPerBuf_);
+            if (eng->sessionRecorder_) {
+                eng->sessionRecorder_->write(SESSION_STREAM_INPUT,
+                                             reinterpret_cast<int16_t *>(buf->buf_),
+                                             eng->fastPathFramesPerBuf_);
+            }
+            // before anything may skip the chain, so the queue never backs up
+            DispatchControls(eng, buf->framePos_, eng->fastPathFramesPerBuf_);
+            // a latency measurement replaces the whole chain with its
+            // signal; drift and load tracking go on, so neither is stale
+            // when it ends (and the round trip includes the resampler)
+            if (eng->latencyMeter_ &&
+                eng->latencyMeter_->process(
+                        reinterpret_cast<int16_t *>(buf->buf_),
+                        eng->fastPathFramesPerBuf_, buf->framePos_)) {
+                SkipSchedules(eng);
+                AnalyzeOutput(eng, buf);
+                CompensateDrift(eng, buf, false);
+                DspBufferDone(eng, begin);
+                return HandOffRecorded(eng, buf);
+            }
+            SilenceState silence = SILENCE_PROCESS;
+            if (eng->silenceDetector_) {
+                silence = eng->silenceDetector_->process(
+                        reinterpret_cast<int16_t *>(buf->buf_),
+                        eng->fastPathFramesPerBuf_,
+                        eng->delayEffect_->tailFrames() +
+                        eng->pitchShifter_->tailFrames() +
+                        eng->equalizer_->tailFrames() +
+                        eng->dynamics_->tailFrames());
+            }
+            if (silence == SILENCE_SKIP) {
+                SkipSchedules(eng);
+                SkipSilentBuffer(eng, buf);
+                AnalyzeOutput(eng, buf);
+                CompensateDrift(eng, buf, true);
+                DspBufferDone(eng, begin);
+                return HandOffRecorded(eng, buf);
+            }
+            if (silence == SILENCE_RESUME && eng->echoCanceller_) {
+                eng->echoCanceller_->resync();
+            }
+            if (eng->echoCanceller_ &&
+                DspSlotActive(eng, DSP_SLOT_ECHO_CANCELLER)) {
+                int64_t start = GetMonotonicNanos();
+                eng->echoCanceller_->process(
+                        reinterpret_cast<int16_t *>(buf->buf_),
+                        eng->fastPathFramesPerBuf_);
+                DspSlotDone(eng, DSP_SLOT_ECHO_CANCELLER, start);
+                ObservePcm(eng, PCM_TAP_ECHO_CANCELLER, buf,
+                           eng->fastPathFramesPerBuf_);
+            }
+            if (DspSlotActive(eng, DSP_SLOT_CONDITIONER)) {
+                int64_t start = GetMonotonicNanos();
+                eng->conditioner_->process(reinterpret_cast<int16_t *>(buf->buf_),
+                                           eng->fastPathFramesPerBuf_);
+                DspSlotDone(eng, DSP_SLOT_CONDITIONER, start);
+                ObservePcm(eng, PCM_TAP_CONDITIONER, buf, eng->fastPathFramesPerBuf_);
+            }
+            if (DspSlotActive(eng, DSP_SLOT_DELAY)) {
+                int64_t start = GetMonotonicNanos();
+                eng->delayEffect_->process(reinterpret_cast<int16_t *>(buf->buf_),
+                                           eng->fastPathFramesPerBuf_);
+                DspSlotDone(eng, DSP_SLOT_DELAY, start);
+                ObservePcm(eng, PCM_TAP_DELAY, buf, eng->fastPathFramesPerBuf_);
+            } else {
+                // bypassed: its schedule must not hold back the queue
+                eng->delayEffect_->skipSchedule();
+            }
+            if (DspSlotActive(eng, DSP_SLOT_PITCH)) {
+                int64_t start = GetMonotonicNanos();
+                eng->pitchShifter_->process(reinterpret_cast<int16_t *>(buf->buf_),
+                                            eng->fastPathFramesPerBuf_);
+                DspSlotDone(eng, DSP_SLOT_PITCH, start);
+            } else {
+                eng->pitchShifter_->skipSchedule();
+            }
+            if (DspSlotActive(eng, DSP_SLOT_EQ)) {
+                int64_t start = GetMonotonicNanos();
+                eng->equalizer_->process(reinterpret_cast<int16_t *>(buf->buf_),
+                                         eng->fastPathFramesPerBuf_);
+                DspSlotDone(eng, DSP_SLOT_EQ, start);
+            } else {
+                eng->equalizer_->skipSchedule();
+            }
+            if (eng->dynamics_->placement() == DYNAMICS_PLACEMENT_OUTPUT &&
+                DspSlotActive(eng, DSP_SLOT_DYNAMICS)) {
+                int64_t start = GetMonotonicNanos();
+                eng->dynamics_->process(reinterpret_cast<int16_t *>(buf->buf_),
+                                        eng->fastPathFramesPerBuf_);
+                DspSlotDone(eng, DSP_SLOT_DYNAMICS, start);
+            }
+            AnalyzeOutput(eng, buf);
+            CompensateDrift(eng, buf, false);
+            DspBufferDone(eng, begin);
+            return HandOffRecorded(eng, buf);
+        }
+        case ENGINE_SERVICE_MSG_PLAYED_AUDIO_AVAILABLE: {
+            // far end reference for the echo canceller
             sample_buf *buf = static_cast<sample_buf *>(data);
-            assert(engine.fastPathFramesPerBuf_ ==
-                   buf->size_ / engine.sampleChannels_ / (engine.bitsPerSample_ / 8));
-            engine.delayEffect_->process(reinterpret_cast<int16_t *>(buf->buf_),
-                                         engine.fastPathFramesPerBuf_);
+            TRACE_SCOPE_SEQ("EngineService played", buf->seq_);
+            uint32_t frames =
+                    buf->size_ / eng->sampleChannels_ / (eng->bitsPerSample_ / 8);
+            if (eng->echoCanceller_) {
+                eng->echoCanceller_->pushReference(
+                        reinterpret_cast<int16_t *>(buf->buf_), frames);
+            }
+            ObservePcm(eng, PCM_TAP_PLAYER, buf, frames);
+            if (eng->drift_) {
+                eng->drift_->onPlayed(GetMonotonicNanos(), frames);
+            }
+            break;
+        }
+        case ENGINE_SERVICE_MSG_FREE_BUFS_AVAILABLE: {
+            // player returned buffers: restart a recorder starved by it
+            if (eng->recorder_) {
+                eng->recorder_->ResumeIfStarved();
+            }
             break;
         }
         default:
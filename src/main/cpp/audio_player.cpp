@@ -15,6 +15,8 @@
  */
 #include <cstdlib>
 #include "audio_player.h"
+#include "rt_log.h"
+#include "trace.h"
 
 /*
  * Called by OpenSL SimpleBufferQueue for every audio buffer played
@@ -31,10 +33,16 @@ void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *ctx) {
   (static_cast<AudioPlayer *>(ctx))->ProcessSLCallback(bq);
 }
 void AudioPlayer::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
+  TRACE_SCOPE("play callback");
+  std::lock_guard<std::mutex> lock(stopMutex_);
+  int64_t now = GetMonotonicNanos();
+  if (prevCallbackTime_) {
+    callbackInterval_.record(now - prevCallbackTime_);
 #ifdef ENABLE_LOG
-  logFile_->logTime();
+    RTLOG("play callback %lld us\n", (now - prevCallbackTime_) / 1000);
 #endif
-  std::lock_guard<std::mutex> lock(stopMutex_);
+  }
+  prevCallbackTime_ = now;
 
   // retrieve the finished device buf and put onto the free queue
   // so recorder could re-use it
@@ -56,41 +64,129 @@ void AudioPlayer::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
   if (buf != &silentBuf_) {
     buf->size_ = 0;
     freeQueue_->push(buf);
+    TRACE_INSTANT("freeQueue push", buf->seq_);
+    CallEngine(ENGINE_SERVICE_MSG_FREE_BUFS_AVAILABLE, nullptr);
 
-    if (!playQueue_->front(&buf)) {
+    if (!playQueue_->popFront(&buf)) {
 #ifdef ENABLE_LOG
-      logFile_->log("%s", "====Warning: running out of the Audio buffers");
+      RTLOG("====Warning: running out of the Audio buffers\n");
 #endif
       return;
     }
 
+    TrackPresentation(buf);
     devShadowQueue_->push(buf);
+    TRACE_INSTANT("play enqueue", buf->seq_);
     (*bq)->Enqueue(bq, buf->buf_, buf->size_);
-    playQueue_->pop();
+    NotifyPlayed(buf);
     return;
   }
 
   if (playQueue_->size() < PLAY_KICKSTART_BUFFER_COUNT) {
     (*bq)->Enqueue(bq, buf->buf_, buf->size_);
     devShadowQueue_->push(&silentBuf_);
+    NotifyPlayed(buf);
     return;
   }
 
   assert(PLAY_KICKSTART_BUFFER_COUNT <=
          (DEVICE_SHADOW_BUFFER_QUEUE_LEN - devShadowQueue_->size()));
   for (int32_t idx = 0; idx < PLAY_KICKSTART_BUFFER_COUNT; idx++) {
-    playQueue_->front(&buf);
-    playQueue_->pop();
+    // the recorder may take back the oldest buffers when it overflows
+    if (!playQueue_->popFront(&buf)) break;
+    TrackPresentation(buf);
     devShadowQueue_->push(buf);
+    TRACE_INSTANT("play enqueue", buf->seq_);
     (*bq)->Enqueue(bq, buf->buf_, buf->size_);
+    NotifyPlayed(buf);
+  }
+}
+
+/*
+ * Tell the engine what just went to the device (silence included), e.g. as
+ * the echo canceller's reference.
+ */
+void AudioPlayer::NotifyPlayed(sample_buf *buf) {
+  CallEngine(ENGINE_SERVICE_MSG_PLAYED_AUDIO_AVAILABLE, buf);
+}
+
+void AudioPlayer::CallEngine(uint32_t msg, void *data) {
+  if (!callback_) {
+    return;
   }
+  int64_t start = GetMonotonicNanos();
+  callback_(ctx_, msg, data);
+  serviceTime_.record(GetMonotonicNanos() - start);
+}
+
+void AudioPlayer::GetTimingStats(LatencySummary *interval,
+                                 LatencySummary *service) {
+  assert(interval && service);
+  callbackInterval_.getSummary(interval);
+  serviceTime_.getSummary(service);
+}
+
+void AudioPlayer::ResetTiming(void) {
+  callbackInterval_.reset();
+  serviceTime_.reset();
+}
+
+/*
+ * Stamp the presentation time of a recorded buffer and check that it
+ * follows its predecessor: the recorder numbers buffers consecutively, so a
+ * jump in the sequence means buffers were dropped somewhere in between.
+ */
+void AudioPlayer::TrackPresentation(sample_buf *buf) {
+  buf->playTime_ = GetMonotonicNanos();
+  if (startTime_) {
+    startLatencyNs_.store(buf->playTime_ - startTime_,
+                          std::memory_order_relaxed);
+    startTime_ = 0;
+  }
+  if (seqValid_ && buf->seq_ != expectedSeq_) {
+    if (static_cast<int32_t>(buf->seq_ - expectedSeq_) > 0) {
+      gaps_.fetch_add(1, std::memory_order_relaxed);
+      lost_.fetch_add(buf->seq_ - expectedSeq_, std::memory_order_relaxed);
+    }
+    // a smaller number means the recorder was restarted: just resync
+  }
+  expectedSeq_ = buf->seq_ + 1;
+  seqValid_ = true;
+
+  if (buf->captureTime_) {
+    int64_t latency = buf->playTime_ - buf->captureTime_;
+    lastLatencyNs_.store(latency, std::memory_order_relaxed);
+    if (latency > maxLatencyNs_.load(std::memory_order_relaxed)) {
+      maxLatencyNs_.store(latency, std::memory_order_relaxed);
+    }
+  }
+  played_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioPlayer::GetStreamStats(PlayerStreamStats *stats) {
+  assert(stats);
+  stats->played_ = played_.load(std::memory_order_relaxed);
+  stats->gaps_ = gaps_.load(std::memory_order_relaxed);
+  stats->lost_ = lost_.load(std::memory_order_relaxed);
+  stats->lastLatencyNs_ = lastLatencyNs_.load(std::memory_order_relaxed);
+  stats->maxLatencyNs_ = maxLatencyNs_.load(std::memory_order_relaxed);
+  stats->startLatencyNs_ = startLatencyNs_.load(std::memory_order_relaxed);
 }
 
 AudioPlayer::AudioPlayer(SampleFormat *sampleFormat, SLEngineItf slEngine)
     : freeQueue_(nullptr),
       playQueue_(nullptr),
       devShadowQueue_(nullptr),
-      callback_(nullptr) {
+      callback_(nullptr),
+      expectedSeq_(0),
+      seqValid_(false),
+      played_(0),
+      gaps_(0),
+      lost_(0),
+      lastLatencyNs_(0),
+      maxLatencyNs_(0),
+      startLatencyNs_(0),
+      startTime_(0) {
   SLresult result;
   assert(sampleFormat);
   sampleInfo_ = *sampleFormat;
@@ -159,11 +255,13 @@ AudioPlayer::AudioPlayer(SampleFormat *sampleFormat, SLEngineItf slEngine)
   silentBuf_.buf_ = new uint8_t[silentBuf_.cap_];
   memset(silentBuf_.buf_, 0, silentBuf_.cap_);
   silentBuf_.size_ = silentBuf_.cap_;
+  // no capture metadata: silence is not part of the recorded stream
+  silentBuf_.seq_ = 0;
+  silentBuf_.framePos_ = 0;
+  silentBuf_.captureTime_ = 0;
+  silentBuf_.playTime_ = 0;
 
-#ifdef ENABLE_LOG
-  std::string name = "play";
-  logFile_ = new AndroidLog(name);
-#endif
+  prevCallbackTime_ = 0;
 }
 
 AudioPlayer::~AudioPlayer() {
@@ -175,6 +273,22 @@ AudioPlayer::~AudioPlayer() {
     (*playerObjectItf_)->Destroy(playerObjectItf_);
   }
   // Consume all non-completed audio buffers
+  ReleaseBufs();
+  delete devShadowQueue_;
+
+  // destroy output mix object, and invalidate all associated interfaces
+  if (outputMixObjectItf_) {
+    (*outputMixObjectItf_)->Destroy(outputMixObjectItf_);
+  }
+
+  delete[] silentBuf_.buf_;
+}
+
+/*
+ * Hand every buffer the player holds (device queue and not yet played
+ * recorded audio) back to the free queue. The device must be stopped.
+ */
+void AudioPlayer::ReleaseBufs(void) {
   sample_buf *buf = NULL;
   while (devShadowQueue_->front(&buf)) {
     buf->size_ = 0;
@@ -183,20 +297,11 @@ AudioPlayer::~AudioPlayer() {
       freeQueue_->push(buf);
     }
   }
-  delete devShadowQueue_;
 
-  while (playQueue_->front(&buf)) {
+  while (playQueue_->popFront(&buf)) {
     buf->size_ = 0;
-    playQueue_->pop();
     freeQueue_->push(buf);
   }
-
-  // destroy output mix object, and invalidate all associated interfaces
-  if (outputMixObjectItf_) {
-    (*outputMixObjectItf_)->Destroy(outputMixObjectItf_);
-  }
-
-  delete[] silentBuf_.buf_;
 }
 
 void AudioPlayer::SetBufQueue(AudioQueue *playQ, AudioQueue *freeQ) {
@@ -217,17 +322,23 @@ SLresult AudioPlayer::Start(void) {
   result = (*playItf_)->SetPlayState(playItf_, SL_PLAYSTATE_STOPPED);
   SLASSERT(result);
 
+  startTime_ = GetMonotonicNanos();
   result =
       (*playBufferQueueItf_)
           ->Enqueue(playBufferQueueItf_, silentBuf_.buf_, silentBuf_.size_);
   SLASSERT(result);
   devShadowQueue_->push(&silentBuf_);
+  NotifyPlayed(&silentBuf_);
 
   result = (*playItf_)->SetPlayState(playItf_, SL_PLAYSTATE_PLAYING);
   SLASSERT(result);
   return SL_BOOLEAN_TRUE;
 }
 
+/*
+ * Stop the device and return all buffers to the free queue; the realized
+ * player stays as is, so Start() can be called again right away.
+ */
 void AudioPlayer::Stop(void) {
   SLuint32 state;
 
@@ -241,13 +352,10 @@ void AudioPlayer::Stop(void) {
   result = (*playItf_)->SetPlayState(playItf_, SL_PLAYSTATE_STOPPED);
   SLASSERT(result);
   (*playBufferQueueItf_)->Clear(playBufferQueueItf_);
+  ReleaseBufs();
 
-#ifdef ENABLE_LOG
-  if (logFile_) {
-    delete logFile_;
-    logFile_ = nullptr;
-  }
-#endif
+  prevCallbackTime_ = 0;
+  startTime_ = 0;
 }
 
 void AudioPlayer::RegisterCallback(ENGINE_CALLBACK cb, void *ctx) {
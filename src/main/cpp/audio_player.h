@@ -21,6 +21,16 @@
 #include "audio_common.h"
 #include "buf_manager.h"
 #include "debug_utils.h"
+#include "latency_histogram.h"
+
+struct PlayerStreamStats {
+  uint32_t played_;       // recorded buffers handed to the device
+  uint32_t gaps_;         // discontinuities in the sequence numbers
+  uint32_t lost_;         // buffers missing across all gaps
+  int64_t lastLatencyNs_; // capture to presentation of the last buffer
+  int64_t maxLatencyNs_;  // worst capture to presentation seen
+  int64_t startLatencyNs_; // Start() to the first recorded buffer enqueued
+};
 
 class AudioPlayer {
   // buffer queue player interfaces
@@ -37,9 +47,26 @@ class AudioPlayer {
   ENGINE_CALLBACK callback_;
   void *ctx_;
   sample_buf silentBuf_;
-#ifdef ENABLE_LOG
-  AndroidLog *logFile_;
-#endif
+
+  // stream continuity, tracked from the recorder's buffer metadata
+  uint32_t expectedSeq_;
+  bool seqValid_;
+  std::atomic<uint32_t> played_;
+  std::atomic<uint32_t> gaps_;
+  std::atomic<uint32_t> lost_;
+  std::atomic<int64_t> lastLatencyNs_;
+  std::atomic<int64_t> maxLatencyNs_;
+  std::atomic<int64_t> startLatencyNs_;
+  int64_t startTime_;  // Start() time until the first recorded buffer
+  void TrackPresentation(sample_buf *buf);
+  void NotifyPlayed(sample_buf *buf);
+
+  // callback regularity and time spent in the engine per message
+  LatencyHistogram callbackInterval_;
+  LatencyHistogram serviceTime_;
+  int64_t prevCallbackTime_;
+  void CallEngine(uint32_t msg, void *data);
+  void ReleaseBufs(void);
   std::mutex stopMutex_;
 
  public:
@@ -51,6 +78,9 @@ class AudioPlayer {
   void ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq);
   uint32_t dbgGetDevBufCount(void);
   void RegisterCallback(ENGINE_CALLBACK cb, void *ctx);
+  void GetStreamStats(PlayerStreamStats *stats);
+  void GetTimingStats(LatencySummary *interval, LatencySummary *service);
+  void ResetTiming(void);
 };
 
 #endif  // NATIVE_AUDIO_AUDIO_PLAYER_H
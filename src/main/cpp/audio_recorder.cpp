@@ -16,7 +16,27 @@
 
 #include <cstring>
 #include <cstdlib>
+#include <thread>
 #include "audio_recorder.h"
+#include "rt_log.h"
+#include "trace.h"
+
+/*
+ * An audio thread's stay in the recorder. Entering and stopping are both
+ * sequentially consistent: either the audio thread sees stopped_, or
+ * Stop() sees it counted and waits for it.
+ */
+class AudioRecorder::AudioSection {
+ public:
+  explicit AudioSection(AudioRecorder *rec) : rec_(rec) {
+    rec_->audioCalls_.fetch_add(1);
+  }
+  ~AudioSection() { rec_->audioCalls_.fetch_sub(1); }
+  bool stopped(void) const { return rec_->stopped_.load(); }
+
+ private:
+  AudioRecorder *rec_;
+};
 /*
  * bqRecorderCallback(): called for every buffer is full;                                           //初見：なにやってんの？・・・
  *                       pass directly to handler
@@ -26,41 +46,187 @@ void bqRecorderCallback(SLAndroidSimpleBufferQueueItf bq, void *rec) {
 }
 
 void AudioRecorder::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
+  TRACE_SCOPE("rec callback");
+  AudioSection section(this);
+  if (section.stopped()) {
+    // a late callback while or after Stop() takes the buffers back
+    return;
+  }
+  int64_t now = GetMonotonicNanos();
+  if (prevCallbackTime_) {
+    callbackInterval_.record(now - prevCallbackTime_);
 #ifdef ENABLE_LOG
-  recLog_->logTime();
+    RTLOG("rec callback %lld us\n", (now - prevCallbackTime_) / 1000);
 #endif
+  }
+  prevCallbackTime_ = now;
   assert(bq == recBufQueueItf_);
   sample_buf *dataBuf = NULL;
-  devShadowQueue_->front(&dataBuf);
+  if (!devShadowQueue_->front(&dataBuf)) {
+    return;
+  }
   devShadowQueue_->pop();
-  dataBuf->size_ = dataBuf->cap_;  // device only calls us when it is really
-                                   // full
+  dataBuf->size_ = recBytes_;  // device only calls us when it is really
+                               // full
+  dataBuf->captureTime_ = now;
+  dataBuf->playTime_ = 0;
+  dataBuf->seq_ = seqNum_++;
+  dataBuf->framePos_ = framePos_;
+  framePos_ += framesPerBuf_;
+  ++audioBufCount;
 
-  callback_(ctx_, ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE, dataBuf);
-  recQueue_->push(dataBuf);
+  // no free buffer and nothing left in the device: the consumer is behind
+  bool starved = (devShadowQueue_->size() == 0) && (freeQueue_->size() == 0);
+  if (starved) {
+    overflows_.fetch_add(1, std::memory_order_relaxed);
+    sample_buf *oldest = nullptr;
+    switch (overflowPolicy_.load(std::memory_order_relaxed)) {
+      case RECORDER_OVERFLOW_DROP_OLDEST:
+        if (recQueue_->popFront(&oldest)) {
+          if (CallEngine(ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE, dataBuf)) {
+            recQueue_->push(dataBuf);
+          }
+          oldest->size_ = 0;
+          EnqueueToDevice(oldest);
+          droppedOldest_.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        // everything is inside the player already: fall through and
+        // sacrifice the newest one
+      case RECORDER_OVERFLOW_DROP_NEWEST:
+        dataBuf->size_ = 0;
+        EnqueueToDevice(dataBuf);
+        droppedNewest_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      default:
+        break;
+    }
+  }
+
+  // false: the engine keeps the buffer and queues it for the player later
+  if (CallEngine(ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE, dataBuf)) {
+    recQueue_->push(dataBuf);
+    TRACE_INSTANT("recQueue push", dataBuf->seq_);
+  }
 
   sample_buf *freeBuf;
   while (freeQueue_->front(&freeBuf) && devShadowQueue_->push(freeBuf)) {
     freeQueue_->pop();
-    SLresult result = (*bq)->Enqueue(bq, freeBuf->buf_, freeBuf->cap_);
+    TRACE_INSTANT("rec enqueue", -1);
+    SLresult result = (*bq)->Enqueue(bq, freeBuf->buf_, recBytes_);
     SLASSERT(result);
   }
 
-  ++audioBufCount;
-
-  // should leave the device to sleep to save power if no buffers
+  // should leave the device to sleep to save power if no buffers; it is
+  // restarted by ResumeIfStarved() when the consumer catches up
   if (devShadowQueue_->size() == 0) {
     (*recItf_)->SetRecordState(recItf_, SL_RECORDSTATE_STOPPED);
+    pauses_.fetch_add(1, std::memory_order_relaxed);
+    paused_.store(true, std::memory_order_release);
+  }
+}
+
+/*
+ * Hand a buffer to the device; the shadow queue is updated first so the
+ * completion callback always finds it there.
+ */
+void AudioRecorder::EnqueueToDevice(sample_buf *buf) {
+  devShadowQueue_->push(buf);
+  SLresult result =
+      (*recBufQueueItf_)->Enqueue(recBufQueueItf_, buf->buf_, recBytes_);
+  SLASSERT(result);
+}
+
+/*
+ * Restart a recorder which stopped itself for lack of free buffers. Called
+ * from the consumer side (player thread) after it returned buffers to the
+ * free queue; the device queue is refilled and recording restarted without
+ * re-creating anything. No-op unless the recorder is paused and at least
+ * RECORD_DEVICE_KICKSTART_BUF_COUNT free buffers are available.
+ * Lock free: the paused device has no callback in flight, the exchange
+ * makes this the only resume, and Stop() waits for it.
+ */
+bool AudioRecorder::ResumeIfStarved(void) {
+  if (!paused_.load(std::memory_order_acquire) ||
+      freeQueue_->size() < RECORD_DEVICE_KICKSTART_BUF_COUNT) {
+    return false;
+  }
+  AudioSection section(this);
+  if (section.stopped()) {
+    return false;
+  }
+  bool expected = true;
+  if (!paused_.compare_exchange_strong(expected, false,
+                                       std::memory_order_acq_rel)) {
+    return false;
+  }
+
+  sample_buf *buf;
+  while (freeQueue_->front(&buf) && devShadowQueue_->push(buf)) {
+    freeQueue_->pop();
+    SLresult result =
+        (*recBufQueueItf_)->Enqueue(recBufQueueItf_, buf->buf_, recBytes_);
+    SLASSERT(result);
   }
+  SLresult result = (*recItf_)->SetRecordState(recItf_, SL_RECORDSTATE_RECORDING);
+  SLASSERT(result);
+  resumes_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void AudioRecorder::SetOverflowPolicy(RecorderOverflowPolicy policy) {
+  overflowPolicy_.store(policy, std::memory_order_relaxed);
+}
+
+bool AudioRecorder::CallEngine(uint32_t msg, void *data) {
+  int64_t start = GetMonotonicNanos();
+  bool result = callback_(ctx_, msg, data);
+  serviceTime_.record(GetMonotonicNanos() - start);
+  return result;
+}
+
+void AudioRecorder::GetTimingStats(LatencySummary *interval,
+                                   LatencySummary *service) {
+  assert(interval && service);
+  callbackInterval_.getSummary(interval);
+  serviceTime_.getSummary(service);
+}
+
+void AudioRecorder::ResetTiming(void) {
+  callbackInterval_.reset();
+  serviceTime_.reset();
+}
+
+void AudioRecorder::GetOverflowStats(RecorderOverflowStats *stats) {
+  assert(stats);
+  stats->overflows_ = overflows_.load(std::memory_order_relaxed);
+  stats->droppedNewest_ = droppedNewest_.load(std::memory_order_relaxed);
+  stats->droppedOldest_ = droppedOldest_.load(std::memory_order_relaxed);
+  stats->pauses_ = pauses_.load(std::memory_order_relaxed);
+  stats->resumes_ = resumes_.load(std::memory_order_relaxed);
 }
 
 AudioRecorder::AudioRecorder(SampleFormat *sampleFormat, SLEngineItf slEngine)
     : freeQueue_(nullptr),
       recQueue_(nullptr),
       devShadowQueue_(nullptr),
-      callback_(nullptr) {
+      callback_(nullptr),
+      overflowPolicy_(RECORDER_OVERFLOW_PAUSE_RESUME),
+      paused_(false),
+      overflows_(0),
+      droppedNewest_(0),
+      droppedOldest_(0),
+      pauses_(0),
+      resumes_(0),
+      stopped_(true),
+      audioCalls_(0) {
   SLresult result;
   sampleInfo_ = *sampleFormat;
+  framesPerBuf_ = sampleInfo_.framesPerBuf_;
+  // buffers may be larger (drift compensation), the device fills one period
+  recBytes_ = framesPerBuf_ * sampleInfo_.channels_ * sampleInfo_.pcmFormat_ / 8;
+  seqNum_ = 0;
+  framePos_ = 0;
   SLAndroidDataFormat_PCM_EX format_pcm;
   ConvertToSLSampleFormat(&format_pcm, &sampleInfo_);
 
@@ -115,10 +281,7 @@ AudioRecorder::AudioRecorder(SampleFormat *sampleFormat, SLEngineItf slEngine)
 
   devShadowQueue_ = new AudioQueue(DEVICE_SHADOW_BUFFER_QUEUE_LEN);
   assert(devShadowQueue_);
-#ifdef ENABLE_LOG
-  std::string name = "rec";
-  recLog_ = new AndroidLog(name);
-#endif
+  prevCallbackTime_ = 0;
 }
 
 SLboolean AudioRecorder::Start(void) {
@@ -127,7 +290,11 @@ SLboolean AudioRecorder::Start(void) {
          devShadowQueue_);
     return SL_BOOLEAN_FALSE;
   }
+  std::lock_guard<std::mutex> lock(stopMutex_);
   audioBufCount = 0;
+  // seqNum_ and framePos_ carry on across a pause: they count from 0 for
+  // each recorder, i.e. per session
+  paused_.store(false, std::memory_order_release);
 
   SLresult result;
   // in case already recording, stop recording and clear buffer queue
@@ -143,36 +310,50 @@ SLboolean AudioRecorder::Start(void) {
       break;
     }
     freeQueue_->pop();
-    assert(buf->buf_ && buf->cap_ && !buf->size_);
+    assert(buf->buf_ && buf->cap_ >= recBytes_ && !buf->size_);
 
-    result = (*recBufQueueItf_)->Enqueue(recBufQueueItf_, buf->buf_, buf->cap_);
+    result = (*recBufQueueItf_)->Enqueue(recBufQueueItf_, buf->buf_, recBytes_);
     SLASSERT(result);
     devShadowQueue_->push(buf);
   }
 
+  stopped_.store(false);
   result = (*recItf_)->SetRecordState(recItf_, SL_RECORDSTATE_RECORDING);
   SLASSERT(result);
 
   return (result == SL_RESULT_SUCCESS ? SL_BOOLEAN_TRUE : SL_BOOLEAN_FALSE);
 }
 
+/*
+ * Stop recording and hand the buffers still in the device back to the free
+ * queue; the realized recorder is kept for the next Start().
+ */
 SLboolean AudioRecorder::Stop(void) {
   // in case already recording, stop recording and clear buffer queue
   SLuint32 curState;
 
+  std::lock_guard<std::mutex> lock(stopMutex_);
+  // no callback or resume is inside once this returns, and none gets in
+  stopped_.store(true);
+  while (audioCalls_.load() != 0) {
+    std::this_thread::yield();
+  }
+  paused_.store(false, std::memory_order_release);
   SLresult result = (*recItf_)->GetRecordState(recItf_, &curState);
   SLASSERT(result);
-  if (curState == SL_RECORDSTATE_STOPPED) {
-    return SL_BOOLEAN_TRUE;
+  if (curState != SL_RECORDSTATE_STOPPED) {
+    result = (*recItf_)->SetRecordState(recItf_, SL_RECORDSTATE_STOPPED);
+    SLASSERT(result);
+    result = (*recBufQueueItf_)->Clear(recBufQueueItf_);
+    SLASSERT(result);
   }
-  result = (*recItf_)->SetRecordState(recItf_, SL_RECORDSTATE_STOPPED);
-  SLASSERT(result);
-  result = (*recBufQueueItf_)->Clear(recBufQueueItf_);
-  SLASSERT(result);
-
-#ifdef ENABLE_LOG
-  recLog_->flush();
-#endif
+  sample_buf *buf = NULL;
+  while (devShadowQueue_->front(&buf)) {
+    devShadowQueue_->pop();
+    buf->size_ = 0;
+    freeQueue_->push(buf);
+  }
+  prevCallbackTime_ = 0;
 
   return SL_BOOLEAN_TRUE;
 }
@@ -191,11 +372,6 @@ AudioRecorder::~AudioRecorder() {
     }
     delete (devShadowQueue_);
   }
-#ifdef ENABLE_LOG
-  if (recLog_) {
-    delete recLog_;
-  }
-#endif
 }
 
 void AudioRecorder::SetBufQueues(AudioQueue *freeQ, AudioQueue *recQ) {
@@ -22,6 +22,31 @@
 #include "audio_common.h"
 #include "buf_manager.h"
 #include "debug_utils.h"
+#include "latency_histogram.h"
+
+/*
+ * What the recorder does when a buffer is captured and there is no free
+ * buffer left to keep the device queue going (the consumer is stalled):
+ *   DROP_NEWEST:  re-arm the device with the buffer just captured, its audio
+ *                 is lost
+ *   DROP_OLDEST:  deliver the new buffer, and take the oldest not yet played
+ *                 one back from the recorded queue to re-arm the device
+ *   PAUSE_RESUME: stop the device, and restart it from
+ *                 ResumeIfStarved() once enough free buffers came back
+ */
+enum RecorderOverflowPolicy {
+  RECORDER_OVERFLOW_DROP_NEWEST = 0,
+  RECORDER_OVERFLOW_DROP_OLDEST = 1,
+  RECORDER_OVERFLOW_PAUSE_RESUME = 2,
+};
+
+struct RecorderOverflowStats {
+  uint32_t overflows_;      // callbacks which found no free buffer
+  uint32_t droppedNewest_;  // buffers overwritten in the device
+  uint32_t droppedOldest_;  // buffers taken back from the recorded queue
+  uint32_t pauses_;         // times the device was stopped
+  uint32_t resumes_;        // times the device was restarted
+};
 
 class AudioRecorder {
   SLObjectItf recObjectItf_;
@@ -33,10 +58,39 @@ class AudioRecorder {
   AudioQueue *recQueue_;        // user
   AudioQueue *devShadowQueue_;  // owner
   uint32_t audioBufCount;
+  uint32_t seqNum_;     // sequence number for the next captured buffer
+  uint64_t framePos_;   // stream position of the next captured buffer
+  uint32_t framesPerBuf_;
+  uint32_t recBytes_;   // bytes the device fills per buffer
 
   ENGINE_CALLBACK callback_;
   void *ctx_;
 
+  std::atomic<int32_t> overflowPolicy_;
+  std::atomic<bool> paused_;
+  std::atomic<uint32_t> overflows_;
+  std::atomic<uint32_t> droppedNewest_;
+  std::atomic<uint32_t> droppedOldest_;
+  std::atomic<uint32_t> pauses_;
+  std::atomic<uint32_t> resumes_;
+
+  // callback regularity and time spent in the engine per buffer
+  LatencyHistogram callbackInterval_;
+  LatencyHistogram serviceTime_;
+  int64_t prevCallbackTime_;
+
+  // Start() and Stop() are serialized by stopMutex_; the audio threads
+  // (the capture callback, ResumeIfStarved()) take no lock. They count
+  // themselves in audioCalls_ and leave when stopped_; Stop() sets stopped_
+  // and waits for the count to drop to 0.
+  std::mutex stopMutex_;
+  std::atomic<bool> stopped_;
+  std::atomic<int32_t> audioCalls_;
+  class AudioSection;
+
+  void EnqueueToDevice(sample_buf *buf);
+  bool CallEngine(uint32_t msg, void *data);
+
  public:
   explicit AudioRecorder(SampleFormat *, SLEngineItf engineEngine);
   ~AudioRecorder();
@@ -46,10 +100,11 @@ class AudioRecorder {
   void ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq);
   void RegisterCallback(ENGINE_CALLBACK cb, void *ctx);
   int32_t dbgGetDevBufCount(void);
-
-#ifdef ENABLE_LOG
-  AndroidLog *recLog_;
-#endif
+  void SetOverflowPolicy(RecorderOverflowPolicy policy);
+  bool ResumeIfStarved(void);
+  void GetOverflowStats(RecorderOverflowStats *stats);
+  void GetTimingStats(LatencySummary *interval, LatencySummary *service);
+  void ResetTiming(void);
 };
 
 #endif  // NATIVE_AUDIO_AUDIO_RECORDER_H
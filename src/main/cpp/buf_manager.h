@@ -17,8 +17,10 @@
 #define NATIVE_AUDIO_BUF_MANAGER_H
 #include <sys/types.h>
 #include <SLES/OpenSLES.h>
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <cstring>
 #include <memory>
 #include <limits>
 
@@ -113,6 +115,28 @@ class ProducerConsumerQueue {
     });
   }
 
+  // pop the oldest item out of the queue in one step. Unlike front()/pop(),
+  // this is safe when more than one thread consumes the queue: the read
+  // pointer is advanced with compare-and-swap, so an item is handed to
+  // exactly one of the racing consumers. All consumers of such a queue must
+  // use popFront().
+  bool popFront(T* out_item) {
+    int readptr = read_.load(std::memory_order_relaxed);
+    while (true) {
+      int writeptr = write_.load(std::memory_order_acquire);
+      if ((int)(writeptr - readptr) < 1) {
+        return false;
+      }
+      T item = buffer_.get()[readptr % size_];
+      if (read_.compare_exchange_weak(readptr, readptr + 1,
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_relaxed)) {
+        *out_item = item;
+        return true;
+      }
+    }
+  }
+
   void pop(void) {
     int readptr = read_.load(std::memory_order_relaxed);
     ++readptr;
@@ -154,10 +178,97 @@ class ProducerConsumerQueue {
   alignas(CACHE_ALIGN) std::atomic<int> write_{0};
 };
 
+/*
+ * Lock-free single producer/single consumer ring for bulk transfers of
+ * plain data (samples, records...): ProducerConsumerQueue moves one item per
+ * call, this one moves as many as fit in one go. Capacity is rounded up to a
+ * power of two; read/write counters run freely and wrap.
+ */
+template <typename T>
+class RingBuffer {
+ public:
+  explicit RingBuffer(uint32_t capacity) {
+    capacity_ = 1;
+    while (capacity_ < capacity) capacity_ <<= 1;
+    mask_ = capacity_ - 1;
+    buffer_.reset(new T[capacity_]);
+  }
+
+  uint32_t capacity(void) const { return capacity_; }
+
+  uint32_t availableToRead(void) const {
+    return write_.load(std::memory_order_acquire) -
+           read_.load(std::memory_order_relaxed);
+  }
+  uint32_t availableToWrite(void) const {
+    return capacity_ - (write_.load(std::memory_order_relaxed) -
+                        read_.load(std::memory_order_acquire));
+  }
+
+  // producer: copy in up to count items, returns the number written
+  uint32_t write(const T* data, uint32_t count) {
+    uint32_t writeptr = write_.load(std::memory_order_relaxed);
+    uint32_t space =
+        capacity_ - (writeptr - read_.load(std::memory_order_acquire));
+    if (count > space) count = space;
+    uint32_t first = capacity_ - (writeptr & mask_);
+    if (first > count) first = count;
+    std::copy(data, data + first, buffer_.get() + (writeptr & mask_));
+    std::copy(data + first, data + count, buffer_.get());
+    write_.store(writeptr + count, std::memory_order_release);
+    return count;
+  }
+
+  // consumer: copy out up to count items, returns the number read
+  uint32_t read(T* data, uint32_t count) {
+    uint32_t readptr = read_.load(std::memory_order_relaxed);
+    uint32_t avail = write_.load(std::memory_order_acquire) - readptr;
+    if (count > avail) count = avail;
+    uint32_t first = capacity_ - (readptr & mask_);
+    if (first > count) first = count;
+    T* src = buffer_.get() + (readptr & mask_);
+    std::copy(src, src + first, data);
+    std::copy(buffer_.get(), buffer_.get() + (count - first), data + first);
+    read_.store(readptr + count, std::memory_order_release);
+    return count;
+  }
+
+  // consumer: copy the oldest item without removing it
+  bool peek(T* data) const {
+    uint32_t readptr = read_.load(std::memory_order_relaxed);
+    if (write_.load(std::memory_order_acquire) == readptr) return false;
+    *data = buffer_[readptr & mask_];
+    return true;
+  }
+
+  // consumer: drop up to count items without copying them
+  uint32_t skip(uint32_t count) {
+    uint32_t readptr = read_.load(std::memory_order_relaxed);
+    uint32_t avail = write_.load(std::memory_order_acquire) - readptr;
+    if (count > avail) count = avail;
+    read_.store(readptr + count, std::memory_order_release);
+    return count;
+  }
+
+ private:
+  uint32_t capacity_;
+  uint32_t mask_;
+  std::unique_ptr<T[]> buffer_;
+
+  alignas(CACHE_ALIGN) std::atomic<uint32_t> read_{0};
+  alignas(CACHE_ALIGN) std::atomic<uint32_t> write_{0};
+};
+
 struct sample_buf {
   uint8_t* buf_;   // audio sample container
   uint32_t cap_;   // buffer capacity in byte
   uint32_t size_;  // audio sample size (n buf) in byte
+
+  // stream metadata, stamped by the recorder when the buffer is captured
+  uint32_t seq_;          // capture sequence number, gaps mean lost buffers
+  uint64_t framePos_;     // stream position of the first frame in buf_
+  int64_t captureTime_;   // CLOCK_MONOTONIC ns when the capture completed
+  int64_t playTime_;      // CLOCK_MONOTONIC ns when handed to the player
 };
 
 using AudioQueue = ProducerConsumerQueue<sample_buf*>;
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "buffer_exchange.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+#include "trace.h"
+
+static const uint32_t kRingAlign = 64;
+
+BufferExchange::BufferExchange(sample_buf *bufs, uint32_t bufCount,
+                               SLmilliHertz sampleRate, uint16_t channels)
+    : bufs_(bufs), bufCount_(bufCount), heldCount_(0), invalid_(0) {
+  uint32_t ringSize = 1;
+  while (ringSize < bufCount_) {
+    ringSize <<= 1;
+  }
+  uint32_t readyOffset =
+      (sizeof(BufferExchangeHeader) + kRingAlign - 1) & ~(kRingAlign - 1);
+  uint32_t doneOffset = readyOffset + ringSize * sizeof(BufferExchangeEntry);
+  regionSize_ = doneOffset + ringSize * sizeof(int32_t);
+  region_.reset(new uint8_t[regionSize_]);
+  memset(region_.get(), 0, regionSize_);
+
+  header_ = new (region_.get()) BufferExchangeHeader();
+  header_->bufCount_ = bufCount_;
+  header_->bufBytes_ = bufCount_ ? bufs_[0].cap_ : 0;
+  header_->ringSize_ = ringSize;
+  header_->channels_ = channels;
+  header_->sampleRate_ = sampleRate / 1000;
+  header_->enabled_.store(0);
+  header_->readyOffset_ = readyOffset;
+  header_->doneOffset_ = doneOffset;
+  header_->readyWrite_.store(0);
+  header_->readyRead_.store(0);
+  header_->doneWrite_.store(0);
+  header_->doneRead_.store(0);
+  ready_ = reinterpret_cast<BufferExchangeEntry *>(region_.get() + readyOffset);
+  done_ = reinterpret_cast<int32_t *>(region_.get() + doneOffset);
+
+  held_.reset(new bool[bufCount_]);
+  std::fill(held_.get(), held_.get() + bufCount_, false);
+}
+
+BufferExchange::~BufferExchange() { header_->~BufferExchangeHeader(); }
+
+/*
+ * Only new buffers stop going out; the ones Java has are still taken back
+ * and played, late.
+ */
+void BufferExchange::setEnabled(bool enable) {
+  header_->enabled_.store(enable ? 1 : 0, std::memory_order_release);
+}
+
+bool BufferExchange::isEnabled(void) const {
+  return header_->enabled_.load(std::memory_order_acquire) != 0;
+}
+
+uint64_t BufferExchange::getInvalid(void) const {
+  return invalid_.load(std::memory_order_relaxed);
+}
+
+/*
+ * Queue the buffers Java gave back for the player, oldest first.
+ */
+void BufferExchange::forwardReturned(AudioQueue *queue) {
+  uint32_t read = header_->doneRead_.load(std::memory_order_relaxed);
+  uint32_t write = header_->doneWrite_.load(std::memory_order_acquire);
+  uint32_t mask = header_->ringSize_ - 1;
+  for (; read != write; read++) {
+    int32_t index = done_[read & mask];
+    if (index < 0 || static_cast<uint32_t>(index) >= bufCount_ ||
+        !held_[index]) {
+      invalid_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    held_[index] = false;
+    heldCount_.fetch_sub(1, std::memory_order_relaxed);
+    TRACE_INSTANT("java return", bufs_[index].seq_);
+    // the queue holds every buffer there is, so it has room
+    queue->push(&bufs_[index]);
+  }
+  header_->doneRead_.store(read, std::memory_order_release);
+}
+
+/*
+ * Hand a processed buffer to Java; false when disabled, and the caller
+ * keeps it.
+ */
+bool BufferExchange::share(sample_buf *buf) {
+  if (!isEnabled()) {
+    return false;
+  }
+  uint32_t write = header_->readyWrite_.load(std::memory_order_relaxed);
+  // Java owns at most bufCount_ buffers, so the ring cannot be full
+  assert(write - header_->readyRead_.load(std::memory_order_acquire) <
+         header_->ringSize_);
+  int32_t index = static_cast<int32_t>(buf - bufs_);
+  assert(index >= 0 && static_cast<uint32_t>(index) < bufCount_);
+  BufferExchangeEntry &entry = ready_[write & (header_->ringSize_ - 1)];
+  entry.index_ = index;
+  entry.size_ = buf->size_;
+  entry.framePos_ = static_cast<int64_t>(buf->framePos_);
+  held_[index] = true;
+  heldCount_.fetch_add(1, std::memory_order_relaxed);
+  TRACE_INSTANT("java share", buf->seq_);
+  header_->readyWrite_.store(write + 1, std::memory_order_release);
+  return true;
+}
+
+/*
+ * Take the oldest buffer handed out: its view index, or -1 when there is
+ * none.
+ */
+int32_t BufferExchange::take(uint32_t *sizeBytes, int64_t *framePos) {
+  uint32_t read = header_->readyRead_.load(std::memory_order_relaxed);
+  if (header_->readyWrite_.load(std::memory_order_acquire) == read) {
+    return -1;
+  }
+  const BufferExchangeEntry &entry = ready_[read & (header_->ringSize_ - 1)];
+  int32_t index = entry.index_;
+  *sizeBytes = entry.size_;
+  *framePos = entry.framePos_;
+  header_->readyRead_.store(read + 1, std::memory_order_release);
+  return index;
+}
+
+/*
+ * Give a taken buffer back for playing; forwardReturned() checks the index.
+ */
+void BufferExchange::giveBack(int32_t index) {
+  uint32_t write = header_->doneWrite_.load(std::memory_order_relaxed);
+  done_[write & (header_->ringSize_ - 1)] = index;
+  header_->doneWrite_.store(write + 1, std::memory_order_release);
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_BUFFER_EXCHANGE_H
+#define NATIVE_AUDIO_BUFFER_EXCHANGE_H
+#include <atomic>
+#include <memory>
+#include "audio_common.h"
+
+/*
+ * Layout of the control region, native byte order; mirrored in Java. The
+ * ready ring (ringSize_ entries) and the done ring (ringSize_ buffer
+ * indices) follow at their offsets. Each counter has one writer, and all
+ * of them run freely and wrap.
+ */
+struct BufferExchangeHeader {
+  uint32_t bufCount_;                // views 0 .. bufCount_ - 1
+  uint32_t bufBytes_;                // capacity of each view
+  uint32_t ringSize_;                // power of two >= bufCount_
+  uint32_t channels_;
+  uint32_t sampleRate_;              // Hz
+  std::atomic<uint32_t> enabled_;    // native hands buffers out
+  uint32_t readyOffset_;             // byte offsets of the rings
+  uint32_t doneOffset_;
+  std::atomic<uint32_t> readyWrite_;  // native: buffers handed to Java
+  std::atomic<uint32_t> readyRead_;   // Java: buffers taken
+  std::atomic<uint32_t> doneWrite_;   // Java: buffers given back
+  std::atomic<uint32_t> doneRead_;    // native: buffers sent on to the player
+};
+
+struct BufferExchangeEntry {
+  int32_t index_;     // view holding the audio
+  uint32_t size_;     // bytes of audio in it
+  int64_t framePos_;  // capture stream position of its first frame
+};
+
+/*
+ * Zero copy access to the capture buffers from Java.
+ *
+ * Every sample_buf of the engine is mapped once as a direct ByteBuffer (a
+ * view), and buffers change hands by index through two single producer,
+ * single consumer rings in a shared control region:
+ *   - the engine owns every buffer to begin with
+ *   - while enabled, each capture buffer, once processed, goes on the ready
+ *     ring instead of to the player; from then on Java owns it and may read
+ *     and modify its size_ bytes in place
+ *   - Java gives it back by putting its index on the done ring, in the
+ *     order it took them; on the next capture callback the engine queues it
+ *     for the player, and owns it again
+ * Java's processing thus delays the audio by at least one buffer period,
+ * and buffers Java keeps are missing from the pipeline (the recorder runs
+ * short of free buffers, as with a slow player). Indices given back which
+ * Java does not own are ignored and counted; the done ring only has room
+ * for the buffers there are, so such entries may push out real ones.
+ *
+ * share() and forwardReturned() run on the recorder's callback, the only
+ * thread which queues buffers for the player; take() and giveBack() are
+ * Java's ends, for one thread at a time. They are native so the counters
+ * are read with acquire and written with release ordering, which also
+ * orders the caller's accesses to the views after take() and before
+ * giveBack(). The region and the views stay valid until the engine is
+ * deleted.
+ */
+class BufferExchange {
+ public:
+  explicit BufferExchange(sample_buf *bufs, uint32_t bufCount,
+                          SLmilliHertz sampleRate, uint16_t channels);
+  ~BufferExchange();
+
+  void setEnabled(bool enable);
+  bool isEnabled(void) const;
+  void *region(void) const { return region_.get(); }
+  size_t regionSize(void) const { return regionSize_; }
+  sample_buf *bufs(void) const { return bufs_; }
+  uint32_t bufCount(void) const { return bufCount_; }
+  uint64_t getInvalid(void) const;
+  uint32_t dbgGetHeldCount(void) const {
+    return heldCount_.load(std::memory_order_relaxed);
+  }
+
+  void forwardReturned(AudioQueue *queue);
+  bool share(sample_buf *buf);
+
+  int32_t take(uint32_t *sizeBytes, int64_t *framePos);
+  void giveBack(int32_t index);
+
+ private:
+  sample_buf *bufs_;
+  uint32_t bufCount_;
+  std::unique_ptr<uint8_t[]> region_;
+  size_t regionSize_;
+  BufferExchangeHeader *header_;
+  BufferExchangeEntry *ready_;
+  int32_t *done_;
+  std::unique_ptr<bool[]> held_;  // by Java, per buffer
+  std::atomic<uint32_t> heldCount_;
+  std::atomic<uint64_t> invalid_;
+};
+
+#endif  // NATIVE_AUDIO_BUFFER_EXCHANGE_H
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "control_queue.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+const uint64_t ControlQueue::kMaxLeadFrames;
+
+ControlQueue::ControlQueue()
+    : pendingCount_(0), posted_(0), framePos_(0), rejected_(0) {
+  ring_.reset(new RingBuffer<ControlCommand>(kCapacity));
+  memset(latest_, 0, sizeof(latest_));
+}
+
+bool ControlQueue::post(const ControlCommand &cmd) {
+  std::lock_guard<std::mutex> lock(producerLock_);
+  if (cmd.framePos_ > getFramePosition() + kMaxLeadFrames ||
+      ring_->write(&cmd, 1) != 1) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  if (cmd.target_ >= 0 && cmd.target_ < CONTROL_TARGET_COUNT &&
+      cmd.param_ >= 0 && cmd.param_ < kControlMaxParams) {
+    LatestValue &latest = latest_[cmd.target_][cmd.param_];
+    latest.value_ = cmd.value_;
+    latest.order_ = ++posted_;
+  }
+  return true;
+}
+
+/*
+ * The last value posted for each parameter, as commands for the next buffer
+ * without ramps, in the order they were posted (a dynamics placement or a
+ * gate switch still comes after the values posted before it). Returns the
+ * count written to cmds.
+ */
+uint32_t ControlQueue::getLatest(ControlCommand *cmds, uint32_t maxCount) {
+  std::vector<std::pair<uint64_t, ControlCommand>> latest;
+  {
+    std::lock_guard<std::mutex> lock(producerLock_);
+    for (int32_t target = 0; target < CONTROL_TARGET_COUNT; target++) {
+      for (int32_t param = 0; param < kControlMaxParams; param++) {
+        const LatestValue &value = latest_[target][param];
+        if (value.order_) {
+          ControlCommand cmd = {target, param, value.value_, kControlNow, 0};
+          latest.push_back(std::make_pair(value.order_, cmd));
+        }
+      }
+    }
+  }
+  std::sort(latest.begin(), latest.end(),
+            [](const std::pair<uint64_t, ControlCommand> &a,
+               const std::pair<uint64_t, ControlCommand> &b) {
+              return a.first < b.first;
+            });
+  uint32_t count = std::min(maxCount, static_cast<uint32_t>(latest.size()));
+  for (uint32_t i = 0; i < count; i++) {
+    cmds[i] = latest[i].second;
+  }
+  return count;
+}
+
+// end of the last buffer the audio thread handled
+uint64_t ControlQueue::getFramePosition(void) const {
+  return framePos_.load(std::memory_order_relaxed);
+}
+
+uint64_t ControlQueue::getRejected(void) const {
+  return rejected_.load(std::memory_order_relaxed);
+}
+
+/*
+ * The next command due before endFramePos, the end of the buffer starting
+ * at framePos. Commands arriving now are stamped no earlier than framePos
+ * (those stamped in the past, or kControlNow, are due at once), and go in
+ * after every pending one at the same position: a parameter still ends up
+ * with the value posted last.
+ */
+bool ControlQueue::nextDue(uint64_t framePos, uint64_t endFramePos,
+                           ControlCommand *cmd) {
+  ControlCommand arrived;
+  while (pendingCount_ < kCapacity && ring_->read(&arrived, 1) == 1) {
+    arrived.framePos_ = std::max(arrived.framePos_, framePos);
+    uint32_t i = pendingCount_++;
+    for (; i > 0 && pending_[i - 1].framePos_ > arrived.framePos_; i--) {
+      pending_[i] = pending_[i - 1];
+    }
+    pending_[i] = arrived;
+  }
+  if (!pendingCount_ || pending_[0].framePos_ >= endFramePos) {
+    return false;
+  }
+  *cmd = pending_[0];
+  return true;
+}
+
+void ControlQueue::pop(void) {
+  pendingCount_--;
+  memmove(pending_, pending_ + 1, pendingCount_ * sizeof(ControlCommand));
+}
+
+void ControlQueue::setFramePosition(uint64_t framePos) {
+  framePos_.store(framePos, std::memory_order_relaxed);
+}
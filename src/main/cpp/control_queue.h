@@ -0,0 +1,268 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_CONTROL_QUEUE_H
+#define NATIVE_AUDIO_CONTROL_QUEUE_H
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "audio_common.h"
+
+/*
+ * Effects reachable through the control channel and their parameters,
+ * mirrored in MainActivity.java.
+ */
+enum ControlTarget {
+  CONTROL_TARGET_DELAY = 0,
+  CONTROL_TARGET_PITCH = 1,
+  CONTROL_TARGET_EQ = 2,
+  CONTROL_TARGET_DYNAMICS = 3,
+  CONTROL_TARGET_CONDITIONER = 4,
+  CONTROL_TARGET_ECHO_CANCELLER = 5,
+  CONTROL_TARGET_SILENCE = 6,
+  CONTROL_TARGET_DRIFT = 7,
+  CONTROL_TARGET_COUNT
+};
+
+enum DelayParam {
+  DELAY_PARAM_TIME_L_MS = 0,  // 0 .. AudioDelay::kMaxDelayMs
+  DELAY_PARAM_TIME_R_MS = 1,
+  DELAY_PARAM_FEEDBACK = 2,   // 0 .. 0.95 of the delayed signal fed back
+  DELAY_PARAM_MIX = 3,        // 0 (dry, bypassed) .. 1 (delayed only)
+  DELAY_PARAM_COUNT
+};
+
+enum PitchParam {
+  PITCH_PARAM_SEMITONES = 0,  // -12 .. 12
+  PITCH_PARAM_CENTS = 1,      // -100 .. 100, added to the semitones
+  PITCH_PARAM_MIX = 2,        // 0 (dry, bypassed) .. 1 (shifted only)
+  PITCH_PARAM_COUNT
+};
+
+// equalizer: section * EQ_SECTION_PARAMS + EQ_PARAM_*
+static const int32_t kEqMaxSections = 8;
+
+enum EqParam {
+  EQ_PARAM_TYPE = 0,     // EQ_TYPE_*
+  EQ_PARAM_FREQ_HZ = 1,  // 10 .. 0.45 * sample rate
+  EQ_PARAM_Q = 2,        // 0.1 .. 20
+  EQ_PARAM_GAIN_DB = 3,  // -24 .. 24, shelves and peaks
+  EQ_SECTION_PARAMS
+};
+
+enum EqType {
+  EQ_TYPE_OFF = 0,
+  EQ_TYPE_LOW_SHELF = 1,
+  EQ_TYPE_HIGH_SHELF = 2,
+  EQ_TYPE_PEAK = 3,
+  EQ_TYPE_HIGH_PASS = 4,
+  EQ_TYPE_LOW_PASS = 5,
+  EQ_TYPE_COUNT
+};
+
+// dynamics parameters apply from the start of the buffer they are due in,
+// without ramps: the attack and release smooth them already
+enum DynamicsParam {
+  DYNAMICS_PARAM_PLACEMENT = 0,         // DYNAMICS_PLACEMENT_*
+  DYNAMICS_PARAM_THRESHOLD_DB = 1,      // compressor, -60 .. 0
+  DYNAMICS_PARAM_RATIO = 2,             // 1 (no compression) .. 20
+  DYNAMICS_PARAM_KNEE_DB = 3,           // 0 .. 24
+  DYNAMICS_PARAM_ATTACK_MS = 4,         // 0.1 .. 100
+  DYNAMICS_PARAM_RELEASE_MS = 5,        // 10 .. 2000
+  DYNAMICS_PARAM_MAKEUP_DB = 6,         // 0 .. 24
+  DYNAMICS_PARAM_CEILING_DB = 7,        // limiter true peak ceiling, -24 .. 0
+  DYNAMICS_PARAM_LIMIT_RELEASE_MS = 8,  // 1 .. 1000
+  DYNAMICS_PARAM_COUNT
+};
+
+enum DynamicsPlacement {
+  DYNAMICS_PLACEMENT_OFF = 0,
+  DYNAMICS_PLACEMENT_OUTPUT = 1,    // end of the capture chain
+  DYNAMICS_PLACEMENT_FEEDBACK = 2,  // the delay's feedback loop
+  DYNAMICS_PLACEMENT_COUNT
+};
+
+// the targets below apply from the start of the buffer they are due in,
+// without ramps; switches are 0 (off) or 1 (on)
+enum ConditionerParam {
+  CONDITIONER_PARAM_DC_BLOCK = 0,
+  CONDITIONER_PARAM_GATE = 1,
+  CONDITIONER_PARAM_GATE_THRESHOLD_DB = 2,  // block peak opening it, <= 0
+  CONDITIONER_PARAM_ATTACK_MS = 3,          // >= 0, for all three times
+  CONDITIONER_PARAM_HOLD_MS = 4,
+  CONDITIONER_PARAM_RELEASE_MS = 5,
+  CONDITIONER_PARAM_COUNT
+};
+
+enum EchoCancellerParam {
+  ECHO_CANCELLER_PARAM_ENABLE = 0,
+  ECHO_CANCELLER_PARAM_DELAY_MS = 1,  // bulk delay, 0 .. 300
+  ECHO_CANCELLER_PARAM_COUNT
+};
+
+enum SilenceParam {
+  SILENCE_PARAM_ENABLE = 0,
+  SILENCE_PARAM_THRESHOLD_DB = 1,  // buffer peak under which it is silent, <= 0
+  SILENCE_PARAM_HOLD_MS = 2,       // >= 0
+  SILENCE_PARAM_COUNT
+};
+
+enum DriftParam {
+  DRIFT_PARAM_ENABLE = 0,
+  DRIFT_PARAM_COUNT
+};
+
+// the most parameters a target has
+static const int32_t kControlMaxParams = kEqMaxSections * EQ_SECTION_PARAMS;
+
+// frame position of a command to be applied with the next buffer
+static const uint64_t kControlNow = 0;
+
+struct ControlCommand {
+  int32_t target_;
+  int32_t param_;
+  float value_;
+  uint64_t framePos_;    // capture stream frame to apply at, or kControlNow
+  uint32_t rampFrames_;  // linear ramp from the current value, 0 to jump
+};
+
+/*
+ * Control channel from the control threads to the audio thread.
+ *
+ * post() serializes the producers with a mutex; the audio thread only reads
+ * the lock-free ring (no lock, no allocation). It moves what arrived into a
+ * pending list sorted by frame position, so a command stamped in the
+ * future waits there without holding back the ones due before it; those
+ * due at the same frame keep their posting order. Up to kCapacity
+ * commands wait there, and as many in the ring. A stamp more than
+ * kMaxLeadFrames past the stream position is rejected. Frame positions are
+ * those of the capture stream (sample_buf::framePos_): they start at 0
+ * with each session's recorder and carry on across a pause and resume.
+ *
+ * The queue also remembers the last value posted for every parameter, so
+ * another engine (the offline renderer) can be brought to the same
+ * settings with getLatest().
+ */
+class ControlQueue {
+ public:
+  static const uint32_t kCapacity = 256;
+  static const uint64_t kMaxLeadFrames = 1 << 21;  // 43 s at 48 kHz
+
+  ControlQueue();
+
+  bool post(const ControlCommand &cmd);  // false when the queue is full
+  uint32_t getLatest(ControlCommand *cmds, uint32_t maxCount);
+  uint64_t getFramePosition(void) const;
+  uint64_t getRejected(void) const;
+
+  // audio thread
+  bool nextDue(uint64_t framePos, uint64_t endFramePos, ControlCommand *cmd);
+  void pop(void);
+  void setFramePosition(uint64_t framePos);
+
+ private:
+  std::unique_ptr<RingBuffer<ControlCommand>> ring_;
+  // audio thread: commands taken off the ring, by frame position
+  ControlCommand pending_[kCapacity];
+  uint32_t pendingCount_;
+  std::mutex producerLock_;
+  // under producerLock_: last value of each parameter, with its post count
+  // (0: never posted)
+  struct LatestValue {
+    float value_;
+    uint64_t order_;
+  };
+  LatestValue latest_[CONTROL_TARGET_COUNT][kControlMaxParams];
+  uint64_t posted_;
+  std::atomic<uint64_t> framePos_;
+  std::atomic<uint64_t> rejected_;
+};
+
+/*
+ * Parameter value which moves linearly to a new target over a number of
+ * frames; next() is called once per frame by the effect.
+ */
+class RampedParam {
+ public:
+  explicit RampedParam(float value = 0.0f)
+      : value_(value), target_(value), step_(0.0f), remaining_(0) {}
+
+  void set(float target, uint32_t rampFrames) {
+    target_ = target;
+    remaining_ = rampFrames;
+    if (!rampFrames) {
+      value_ = target;
+      step_ = 0.0f;
+    } else {
+      step_ = (target - value_) / rampFrames;
+    }
+  }
+  float next(void) {
+    if (remaining_) {
+      value_ = (--remaining_) ? value_ + step_ : target_;
+    }
+    return value_;
+  }
+  float value(void) const { return value_; }
+  float target(void) const { return target_; }
+  bool isRamping(void) const { return remaining_ != 0; }
+
+ private:
+  float value_;
+  float target_;
+  float step_;
+  uint32_t remaining_;
+};
+
+struct ParamEvent {
+  int32_t param_;
+  float value_;
+  uint32_t offset_;  // frame inside the next processed buffer
+  uint32_t rampFrames_;
+};
+
+/*
+ * Parameter changes due inside the buffer an effect processes next, in
+ * buffer order: an offset before the previous event's is moved up to it
+ * (a command for "now" posted after one stamped later in the same buffer).
+ * Audio thread only.
+ */
+class ParamSchedule {
+ public:
+  static const int32_t kMaxEvents = 32;
+
+  ParamSchedule() : count_(0) {}
+  bool isFull(void) const { return count_ == kMaxEvents; }
+  void add(int32_t param, float value, uint32_t offset, uint32_t rampFrames) {
+    assert(!isFull());
+    if (count_ && offset < events_[count_ - 1].offset_) {
+      offset = events_[count_ - 1].offset_;
+    }
+    ParamEvent &event = events_[count_++];
+    event.param_ = param;
+    event.value_ = value;
+    event.offset_ = offset;
+    event.rampFrames_ = rampFrames;
+  }
+  int32_t size(void) const { return count_; }
+  const ParamEvent &operator[](int32_t idx) const { return events_[idx]; }
+  void clear(void) { count_ = 0; }
+
+ private:
+  ParamEvent events_[kMaxEvents];
+  int32_t count_;
+};
+
+#endif  // NATIVE_AUDIO_CONTROL_QUEUE_H
@@ -0,0 +1,261 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "drift_compensator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+const double DriftCompensator::kMaxDeviation = 0.01;
+
+static const double kSettleSec = 3.0;      // queues fill up after a start
+static const double kRateMinSec = 10.0;    // before the rates are trusted
+static const double kDepthTauSec = 4.0;    // queue depth smoothing
+static const double kCorrectSec = 20.0;    // one buffer of depth error is
+                                           // worked off in about this
+static const double kIntegralSec = 60.0;
+static const int64_t kGapNs = 500000000;   // longer: the stream restarted
+
+AdaptiveResampler::AdaptiveResampler(int32_t channels, int32_t maxInFrames)
+    : channels_(channels), capFrames_(kTaps + maxInFrames + 1) {
+  coefs_.resize((kPhases + 1) * kTaps);
+  for (int32_t p = 0; p <= kPhases; p++) {
+    float *row = &coefs_[p * kTaps];
+    double frac = static_cast<double>(p) / kPhases;
+    double sum = 0.0;
+    for (int32_t k = 0; k < kTaps; k++) {
+      // distance of tap k from the output position
+      double x = k - (kHalfTaps - 1) - frac;
+      double t = x / kHalfTaps;
+      double window = 0.42 + 0.5 * cos(M_PI * t) + 0.08 * cos(2.0 * M_PI * t);
+      double sinc = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+      row[k] = static_cast<float>(fabs(t) < 1.0 ? sinc * window : 0.0);
+      sum += row[k];
+    }
+    for (int32_t k = 0; k < kTaps; k++) {
+      row[k] = static_cast<float>(row[k] / sum);
+    }
+  }
+  hist_.resize(capFrames_ * channels_);
+  reset();
+}
+
+void AdaptiveResampler::reset(void) {
+  std::fill(hist_.begin(), hist_.end(), 0.0f);
+  histFrames_ = kHalfTaps - 1;
+  pos_ = kHalfTaps - 1;
+}
+
+int32_t AdaptiveResampler::process(const int16_t *in, int32_t inFrames,
+                                   int16_t *out, int32_t maxOutFrames,
+                                   double ratio) {
+  if (histFrames_ + inFrames > capFrames_) {
+    reset();  // only when the output was cut short call after call
+  }
+  float *tail = &hist_[histFrames_ * channels_];
+  if (in) {
+    for (int32_t i = 0; i < inFrames * channels_; i++) {
+      tail[i] = in[i];
+    }
+  } else {
+    memset(tail, 0, inFrames * channels_ * sizeof(float));
+  }
+  histFrames_ += inFrames;
+
+  double step = 1.0 / ratio;
+  int32_t produced = 0;
+  float coef[kTaps];
+  while (produced < maxOutFrames) {
+    int32_t center = static_cast<int32_t>(pos_);
+    if (center + kHalfTaps >= histFrames_) {
+      break;
+    }
+    int16_t *frame = out + produced * channels_;
+    if (in) {
+      double phase = (pos_ - center) * kPhases;
+      int32_t row = static_cast<int32_t>(phase);
+      float w = static_cast<float>(phase - row);
+      const float *c0 = &coefs_[row * kTaps];
+      const float *c1 = c0 + kTaps;
+      for (int32_t k = 0; k < kTaps; k++) {
+        coef[k] = c0[k] + w * (c1[k] - c0[k]);
+      }
+      const float *src = &hist_[(center - kHalfTaps + 1) * channels_];
+      for (int32_t ch = 0; ch < channels_; ch++) {
+        float acc = 0.0f;
+        for (int32_t k = 0; k < kTaps; k++) {
+          acc += coef[k] * src[k * channels_ + ch];
+        }
+        acc = std::max(-32768.0f, std::min(acc, 32767.0f));
+        frame[ch] = static_cast<int16_t>(lrintf(acc));
+      }
+    } else {
+      memset(frame, 0, channels_ * sizeof(int16_t));
+    }
+    pos_ += step;
+    produced++;
+  }
+
+  // keep what the next outputs still reach back to
+  int32_t drop = static_cast<int32_t>(pos_) - (kHalfTaps - 1);
+  if (drop > 0) {
+    drop = std::min(drop, histFrames_);
+    memmove(&hist_[0], &hist_[drop * channels_],
+            (histFrames_ - drop) * channels_ * sizeof(float));
+    histFrames_ -= drop;
+    pos_ -= drop;
+  }
+  return produced;
+}
+
+uint32_t DriftCompensator::HeadroomFrames(uint32_t framesPerBuf) {
+  return static_cast<uint32_t>(ceil(framesPerBuf * kMaxDeviation)) + 2;
+}
+
+DriftCompensator::DriftCompensator(SLmilliHertz sampleRate, int32_t channels,
+                                   uint32_t framesPerBuf)
+    : fs_(sampleRate / 1000.0),
+      channels_(channels),
+      framesPerBuf_(framesPerBuf),
+      resampler_(channels, framesPerBuf),
+      enabled_(true),
+      active_(false),
+      playedMark_(0),
+      ratio_(1.0),
+      feedForward_(1.0),
+      captureHz_(0.0),
+      playHz_(0.0),
+      depth_(0.0),
+      target_(0.0) {
+  restart(0);
+}
+
+void DriftCompensator::setEnabled(bool enable) { enabled_.store(enable); }
+
+bool DriftCompensator::isEnabled(void) const { return enabled_.load(); }
+
+void DriftCompensator::getStats(DriftStats *stats) const {
+  stats->ratio_ = ratio_.load(std::memory_order_relaxed);
+  stats->feedForward_ = feedForward_.load(std::memory_order_relaxed);
+  stats->captureHz_ = captureHz_.load(std::memory_order_relaxed);
+  stats->playHz_ = playHz_.load(std::memory_order_relaxed);
+  stats->depth_ = depth_.load(std::memory_order_relaxed);
+  stats->target_ = target_.load(std::memory_order_relaxed);
+}
+
+/*
+ * Frame count and time of the player, packed into one word so the capture
+ * thread always reads a matching pair; both halves wrap, the capture side
+ * only uses differences between successive reads.
+ */
+void DriftCompensator::onPlayed(int64_t timeNs, uint32_t frames) {
+  uint64_t mark = playedMark_.load(std::memory_order_relaxed);
+  uint32_t played = static_cast<uint32_t>(mark >> 32) + frames;
+  uint32_t us = static_cast<uint32_t>(timeNs / 1000);
+  playedMark_.store(static_cast<uint64_t>(played) << 32 | us,
+                    std::memory_order_release);
+}
+
+void DriftCompensator::restart(int64_t captureTimeNs) {
+  startNs_ = captureTimeNs;
+  lastCaptureNs_ = captureTimeNs;
+  settled_ = false;
+  refCaptureNs_ = 0;
+  capturedFrames_ = 0;
+  prevPlayedMark_ = playedMark_.load(std::memory_order_acquire);
+  playedFrames_ = 0;
+  playedUs_ = 0;
+  integral_ = 0.0;
+  depthAvg_ = -1.0;
+  resampler_.reset();
+  ratio_.store(1.0, std::memory_order_relaxed);
+  feedForward_.store(1.0, std::memory_order_relaxed);
+  captureHz_.store(0.0, std::memory_order_relaxed);
+  playHz_.store(0.0, std::memory_order_relaxed);
+}
+
+void DriftCompensator::update(int64_t captureTimeNs, uint32_t queueDepth) {
+  if (!startNs_ || captureTimeNs - lastCaptureNs_ > kGapNs) {
+    restart(captureTimeNs);  // first buffer, or resumed after a pause
+  }
+  lastCaptureNs_ = captureTimeNs;
+
+  uint64_t mark = playedMark_.load(std::memory_order_acquire);
+  uint32_t playedDelta = static_cast<uint32_t>(mark >> 32) -
+                         static_cast<uint32_t>(prevPlayedMark_ >> 32);
+  uint32_t usDelta =
+      static_cast<uint32_t>(mark) - static_cast<uint32_t>(prevPlayedMark_);
+  prevPlayedMark_ = mark;
+
+  double period = framesPerBuf_ / fs_;
+  if (depthAvg_ < 0.0) {
+    depthAvg_ = queueDepth;
+  }
+  depthAvg_ += period / kDepthTauSec * (queueDepth - depthAvg_);
+  depth_.store(depthAvg_, std::memory_order_relaxed);
+
+  if (!settled_) {
+    if ((captureTimeNs - startNs_) * 1e-9 >= kSettleSec) {
+      settled_ = true;
+      refCaptureNs_ = captureTimeNs;
+      target_.store(depthAvg_, std::memory_order_relaxed);
+    }
+    return;
+  }
+
+  capturedFrames_ += framesPerBuf_;
+  playedFrames_ += playedDelta;
+  playedUs_ += usDelta;
+  double captureSec = (captureTimeNs - refCaptureNs_) * 1e-9;
+  double feedForward = feedForward_.load(std::memory_order_relaxed);
+  if (captureSec >= kRateMinSec && playedUs_) {
+    double captureHz = capturedFrames_ / captureSec;
+    double playHz = playedFrames_ / (playedUs_ * 1e-6);
+    captureHz_.store(captureHz, std::memory_order_relaxed);
+    playHz_.store(playHz, std::memory_order_relaxed);
+    feedForward = std::max(1.0 - kMaxDeviation,
+                           std::min(playHz / captureHz, 1.0 + kMaxDeviation));
+    feedForward_.store(feedForward, std::memory_order_relaxed);
+  }
+
+  // PI on the depth error (buffers), the integral held within what the
+  // ratio can do anyway
+  double error = depthAvg_ - target_.load(std::memory_order_relaxed);
+  double gain = period / kCorrectSec;
+  double limit = kMaxDeviation / gain * kIntegralSec;
+  integral_ = std::max(-limit, std::min(integral_ + error * period, limit));
+  double correction = -(error + integral_ / kIntegralSec) * gain;
+  double ratio = feedForward * (1.0 + correction);
+  ratio = std::max(1.0 - kMaxDeviation, std::min(ratio, 1.0 + kMaxDeviation));
+  ratio_.store(ratio, std::memory_order_relaxed);
+}
+
+uint32_t DriftCompensator::process(int16_t *buf, bool silent,
+                                   uint32_t capFrames, int64_t captureTimeNs,
+                                   uint32_t queueDepth) {
+  if (!enabled_.load(std::memory_order_relaxed)) {
+    if (active_.exchange(false, std::memory_order_relaxed)) {
+      ratio_.store(1.0, std::memory_order_relaxed);
+    }
+    return framesPerBuf_;
+  }
+  if (!active_.exchange(true, std::memory_order_relaxed)) {
+    startNs_ = 0;  // start over from the next update
+  }
+  update(captureTimeNs, queueDepth);
+  return static_cast<uint32_t>(resampler_.process(
+      silent ? nullptr : buf, framesPerBuf_, buf, capFrames,
+      ratio_.load(std::memory_order_relaxed)));
+}
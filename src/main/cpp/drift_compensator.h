@@ -0,0 +1,130 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_DRIFT_COMPENSATOR_H
+#define NATIVE_AUDIO_DRIFT_COMPENSATOR_H
+#include <atomic>
+#include <vector>
+#include "audio_common.h"
+
+/*
+ * Windowed sinc (32 taps, Blackman) resampler for ratios close to 1, with
+ * the ratio free to change on every call. The fractional position is kept
+ * in double precision and the filter is interpolated between 128 phases,
+ * so any ratio is reached, not only multiples of a step.
+ * Interleaved int16 in and out; kHalfTaps frames of latency.
+ */
+class AdaptiveResampler {
+ public:
+  static const int32_t kTaps = 32;
+  static const int32_t kHalfTaps = kTaps / 2;
+  static const int32_t kPhases = 128;
+
+  explicit AdaptiveResampler(int32_t channels, int32_t maxInFrames);
+
+  // ratio is output frames per input frame; returns the frames written,
+  // at most maxOutFrames. in == nullptr stands for silence: the output is
+  // all zero and the filter is not run.
+  int32_t process(const int16_t *in, int32_t inFrames, int16_t *out,
+                  int32_t maxOutFrames, double ratio);
+  void reset(void);
+
+ private:
+  int32_t channels_;
+  int32_t capFrames_;         // hist_ size in frames
+  std::vector<float> coefs_;  // (kPhases + 1) * kTaps
+  std::vector<float> hist_;   // input frames still needed, interleaved
+  int32_t histFrames_;
+  double pos_;                // next output position in hist_ frames
+};
+
+struct DriftStats {
+  double ratio_;        // current output / input frames
+  double feedForward_;  // playback rate / capture rate from the timestamps
+  double captureHz_;    // measured rates, 0 while not known yet
+  double playHz_;
+  double depth_;        // smoothed recorded queue depth, in buffers
+  double target_;       // depth held, taken when the estimator settled
+};
+
+/*
+ * Clock drift compensation between the recorder and the player.
+ *
+ * The estimator follows two things: the rates of both streams, from frame
+ * counts against CLOCK_MONOTONIC since the streams settled (a feed forward
+ * ratio which gets more precise the longer the session runs), and the
+ * smoothed depth of the recorded queue, which a PI controller holds at the
+ * depth it had after settling. The capture path is resampled by their
+ * product, so each recorded buffer holds a few frames more or less than the
+ * device delivered; the player hands buf->size_ to the device, so the
+ * queue stays where it is without dropping or inserting whole buffers.
+ *
+ * process() runs on the capture thread, onPlayed() on the player thread,
+ * the rest anywhere.
+ */
+class DriftCompensator {
+ public:
+  static const double kMaxDeviation;  // ratio stays within 1 +- this
+
+  explicit DriftCompensator(SLmilliHertz sampleRate, int32_t channels,
+                            uint32_t framesPerBuf);
+
+  // buffer room needed on top of framesPerBuf
+  static uint32_t HeadroomFrames(uint32_t framesPerBuf);
+
+  void setEnabled(bool enable);
+  bool isEnabled(void) const;
+  void getStats(DriftStats *stats) const;
+
+  void onPlayed(int64_t timeNs, uint32_t frames);
+  // resample framesPerBuf frames in place, silent ones without running
+  // the filter; returns the frames now in buf
+  uint32_t process(int16_t *buf, bool silent, uint32_t capFrames,
+                   int64_t captureTimeNs, uint32_t queueDepth);
+
+ private:
+  double fs_;
+  int32_t channels_;
+  uint32_t framesPerBuf_;
+  AdaptiveResampler resampler_;
+
+  std::atomic<bool> enabled_;
+  std::atomic<bool> active_;          // capture side follows enabled_
+  std::atomic<uint64_t> playedMark_;  // frames << 32 | microseconds, both
+                                      // wrapping
+
+  // capture thread only
+  void update(int64_t captureTimeNs, uint32_t queueDepth);
+  void restart(int64_t captureTimeNs);
+  int64_t startNs_;          // first buffer of the current run
+  int64_t lastCaptureNs_;
+  bool settled_;
+  int64_t refCaptureNs_;     // rate reference, taken when settled
+  uint64_t capturedFrames_;  // since refCaptureNs_
+  uint64_t prevPlayedMark_;
+  uint64_t playedFrames_;    // since the reference, from playedMark_ deltas
+  uint64_t playedUs_;
+  double integral_;          // depth error * seconds
+  double depthAvg_;
+
+  std::atomic<double> ratio_;
+  std::atomic<double> feedForward_;
+  std::atomic<double> captureHz_;
+  std::atomic<double> playHz_;
+  std::atomic<double> depth_;
+  std::atomic<double> target_;
+};
+
+#endif  // NATIVE_AUDIO_DRIFT_COMPENSATOR_H
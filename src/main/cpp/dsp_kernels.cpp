@@ -0,0 +1,158 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dsp_kernels.h"
+#ifdef DSP_USE_NEON
+#include <arm_neon.h>
+#endif
+
+static inline int16_t MulQ15(int16_t x, int16_t g) {
+  int32_t v = (static_cast<int32_t>(x) * g + 0x4000) >> 15;
+  return static_cast<int16_t>(v > 32767 ? 32767 : v);
+}
+
+int16_t PeakAbsS16(const int16_t* samples, int32_t count) {
+  int32_t idx = 0;
+  int16_t peak = 0;
+#ifdef DSP_USE_NEON
+  int16x8_t vpeak = vdupq_n_s16(0);
+  for (; idx + 8 <= count; idx += 8) {
+    vpeak = vmaxq_s16(vpeak, vqabsq_s16(vld1q_s16(samples + idx)));
+  }
+  int16x4_t half = vmax_s16(vget_low_s16(vpeak), vget_high_s16(vpeak));
+  half = vpmax_s16(half, half);
+  half = vpmax_s16(half, half);
+  peak = vget_lane_s16(half, 0);
+#endif
+  for (; idx < count; idx++) {
+    int32_t v = samples[idx] < 0 ? -samples[idx] : samples[idx];
+    if (v > 32767) v = 32767;
+    if (v > peak) peak = static_cast<int16_t>(v);
+  }
+  return peak;
+}
+
+void ApplyGainRampS16(int16_t* samples, int32_t frames, int32_t channels,
+                      int16_t gainStart, int16_t gainEnd) {
+  if (frames <= 0) return;
+  // gain in Q15 with 16 extra fractional bits for the per frame step
+  // scaled by multiplying: a closing ramp has a negative step, and left
+  // shifts of negative values are undefined
+  int32_t gain = static_cast<int32_t>(gainStart) * 65536;
+  int32_t step = (static_cast<int32_t>(gainEnd) - gainStart) * 65536 / frames;
+  int32_t frame = 0;
+#ifdef DSP_USE_NEON
+  if (channels == 2) {
+    int32_t init[4] = {gain, gain + step, gain + 2 * step, gain + 3 * step};
+    int32x4_t vgain = vld1q_s32(init);
+    int32x4_t vstep = vdupq_n_s32(4 * step);
+    for (; frame + 4 <= frames; frame += 4) {
+      int16x4_t g = vshrn_n_s32(vgain, 16);
+      int16x4x2_t gg = vzip_s16(g, g);
+      int16x8_t g8 = vcombine_s16(gg.val[0], gg.val[1]);
+      int16_t* p = samples + frame * 2;
+      vst1q_s16(p, vqrdmulhq_s16(vld1q_s16(p), g8));
+      vgain = vaddq_s32(vgain, vstep);
+    }
+    gain += frame * step;
+  }
+#endif
+  for (; frame < frames; frame++) {
+    int16_t g = static_cast<int16_t>(gain >> 16);
+    int16_t* p = samples + frame * channels;
+    for (int32_t ch = 0; ch < channels; ch++) {
+      p[ch] = MulQ15(p[ch], g);
+    }
+    gain += step;
+  }
+}
+
+/*
+ * The recursion runs along time, so the vector runs across the channels:
+ * both of a stereo frame in one pass. The 64 bit product coeff * y is put
+ * together from the two 32 bit halves of y, as NEON has no 64 bit multiply.
+ */
+void DcBlockS16(int16_t* samples, int32_t frames, int32_t channels,
+                int32_t coeff, int16_t* prevIn, int64_t* prevOut) {
+#ifdef DSP_USE_NEON
+  if (channels == 2) {
+    int32x2_t xPrev = vdup_n_s32(prevIn[0]);
+    xPrev = vset_lane_s32(prevIn[1], xPrev, 1);
+    int64x2_t y = vld1q_s64(prevOut);
+    int32x2_t c = vdup_n_s32(coeff);
+    uint32x2_t cu = vdup_n_u32(static_cast<uint32_t>(coeff));
+    int64x2_t half = vdupq_n_s64(0x4000);
+    int16x4_t in = vdup_n_s16(0);
+    for (int32_t frame = 0; frame < frames; frame++) {
+      int16_t* p = samples + frame * 2;
+      in = vld1_lane_s16(p, in, 0);
+      in = vld1_lane_s16(p + 1, in, 1);
+      int32x2_t x = vget_low_s32(vmovl_s16(in));
+      int64x2_t hi = vshlq_n_s64(vmull_s32(vshrn_n_s64(y, 32), c), 32);
+      int64x2_t lo = vreinterpretq_s64_u64(
+          vmull_u32(vmovn_u64(vreinterpretq_u64_s64(y)), cu));
+      y = vaddq_s64(vshll_n_s32(vsub_s32(x, xPrev), 15),
+                    vshrq_n_s64(vaddq_s64(hi, lo), 15));
+      xPrev = x;
+      int32x2_t out = vqmovn_s64(vshrq_n_s64(vaddq_s64(y, half), 15));
+      int16x4_t out16 = vqmovn_s32(vcombine_s32(out, out));
+      vst1_lane_s16(p, out16, 0);
+      vst1_lane_s16(p + 1, out16, 1);
+    }
+    prevIn[0] = static_cast<int16_t>(vget_lane_s32(xPrev, 0));
+    prevIn[1] = static_cast<int16_t>(vget_lane_s32(xPrev, 1));
+    vst1q_s64(prevOut, y);
+    return;
+  }
+#endif
+  int32_t sampleCount = frames * channels;
+  for (int32_t ch = 0; ch < channels; ch++) {
+    int32_t in = prevIn[ch];
+    int64_t y = prevOut[ch];
+    for (int32_t idx = ch; idx < sampleCount; idx += channels) {
+      int32_t x = samples[idx];
+      y = static_cast<int64_t>(x - in) * 32768 + ((coeff * y) >> 15);
+      in = x;
+      int64_t out = (y + 0x4000) >> 15;
+      if (out > 32767) out = 32767;
+      if (out < -32768) out = -32768;
+      samples[idx] = static_cast<int16_t>(out);
+    }
+    prevIn[ch] = static_cast<int16_t>(in);
+    prevOut[ch] = y;
+  }
+}
+
+int64_t DotProductS16(const int16_t* a, const int16_t* b, int32_t count) {
+  int32_t idx = 0;
+  int64_t sum = 0;
+#ifdef DSP_USE_NEON
+  // a product fits in 31 bits but two do not: pairwise add into 64 bits
+  int64x2_t acc0 = vdupq_n_s64(0);
+  int64x2_t acc1 = vdupq_n_s64(0);
+  for (; idx + 8 <= count; idx += 8) {
+    int16x8_t va = vld1q_s16(a + idx);
+    int16x8_t vb = vld1q_s16(b + idx);
+    acc0 = vpadalq_s32(acc0, vmull_s16(vget_low_s16(va), vget_low_s16(vb)));
+    acc1 = vpadalq_s32(acc1, vmull_s16(vget_high_s16(va), vget_high_s16(vb)));
+  }
+  acc0 = vaddq_s64(acc0, acc1);
+  sum = vgetq_lane_s64(acc0, 0) + vgetq_lane_s64(acc0, 1);
+#endif
+  for (; idx < count; idx++) {
+    sum += static_cast<int32_t>(a[idx]) * b[idx];
+  }
+  return sum;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_DSP_KERNELS_H
+#define NATIVE_AUDIO_DSP_KERNELS_H
+#include <cstdint>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DSP_USE_NEON 1
+#endif
+
+/*
+ * Small int16 kernels shared by the processing stages. NEON versions are
+ * used on ARM, the plain C versions elsewhere; both give identical results.
+ */
+
+// largest |sample| in the buffer (|-32768| is reported as 32767)
+int16_t PeakAbsS16(const int16_t* samples, int32_t count);
+
+// multiply interleaved frames by a Q15 gain which moves linearly from
+// gainStart (first frame) towards gainEnd (reached after the last frame).
+// Rounding matches vqrdmulh: (x * g + 0x4000) >> 15
+void ApplyGainRampS16(int16_t* samples, int32_t frames, int32_t channels,
+                      int16_t gainStart, int16_t gainEnd);
+
+// one pole DC blocker on interleaved frames, y = x - x[-1] + coeff * y[-1]
+// with coeff in Q15. Per channel state: the last input, and the last output
+// scaled by 2^15 so the filter does not settle on a truncation error. The
+// output saturates
+void DcBlockS16(int16_t* samples, int32_t frames, int32_t channels,
+                int32_t coeff, int16_t* prevIn, int64_t* prevOut);
+
+// sum of a[i] * b[i], exact (64 bit accumulation)
+int64_t DotProductS16(const int16_t* a, const int16_t* b, int32_t count);
+
+#endif  // NATIVE_AUDIO_DSP_KERNELS_H
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dsp_load.h"
+
+static const float kSmoothing = 1.0f / 16;  // per buffer
+static const float kResumeRatio = 0.7f;
+static const int32_t kHoldOffBuffers = 64;  // let the average settle
+static const float kDefaultThreshold = 0.9f;
+
+DspLoadMeter::DspLoadMeter(SLmilliHertz sampleRate, uint32_t framesPerBuf)
+    : periodNs_(1.0e12 * framesPerBuf / sampleRate),
+      autoBypass_(false),
+      threshold_(kDefaultThreshold),
+      resetPending_(false),
+      holdOff_(0) {
+  for (int32_t i = 0; i < DSP_SLOT_COUNT; i++) {
+    current_[i].store(0.0f);
+    peak_[i].store(0.0f);
+    overruns_[i].store(0);
+    bypassed_[i].store(false);
+    bufferNs_[i] = 0;
+    savedLoad_[i] = 0.0f;
+  }
+}
+
+/*
+ * Turning auto bypass off brings every bypassed effect back on the next
+ * buffer.
+ */
+void DspLoadMeter::setAutoBypass(bool enable, float threshold) {
+  if (threshold > 0.0f) {
+    threshold_.store(threshold);
+  }
+  autoBypass_.store(enable);
+}
+
+void DspLoadMeter::getLoad(DspSlot slot, DspLoad *load) const {
+  load->current_ = current_[slot].load(std::memory_order_relaxed);
+  load->peak_ = peak_[slot].load(std::memory_order_relaxed);
+  load->overruns_ = overruns_[slot].load(std::memory_order_relaxed);
+  load->bypassed_ = bypassed_[slot].load(std::memory_order_relaxed);
+}
+
+// statistics are cleared by the capture thread on its next endBuffer()
+void DspLoadMeter::reset(void) { resetPending_.store(true); }
+
+void DspLoadMeter::record(DspSlot slot, int64_t ns) { bufferNs_[slot] += ns; }
+
+uint32_t DspLoadMeter::endBuffer(void) {
+  if (resetPending_.exchange(false)) {
+    for (int32_t i = 0; i < DSP_SLOT_COUNT; i++) {
+      current_[i].store(0.0f, std::memory_order_relaxed);
+      peak_[i].store(0.0f, std::memory_order_relaxed);
+      overruns_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  for (int32_t i = 0; i < DSP_SLOT_COUNT; i++) {
+    float load = static_cast<float>(bufferNs_[i] / periodNs_);
+    bufferNs_[i] = 0;
+    float avg = current_[i].load(std::memory_order_relaxed);
+    current_[i].store(avg + kSmoothing * (load - avg),
+                      std::memory_order_relaxed);
+    if (load > peak_[i].load(std::memory_order_relaxed)) {
+      peak_[i].store(load, std::memory_order_relaxed);
+    }
+    if (load > 1.0f) {
+      overruns_[i].fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  uint32_t resumed = 0;
+  if (!autoBypass_.load(std::memory_order_relaxed)) {
+    for (int32_t i = 0; i < DSP_SLOT_TOTAL; i++) {
+      if (bypassed_[i].load(std::memory_order_relaxed)) {
+        bypassed_[i].store(false, std::memory_order_relaxed);
+        resumed |= 1 << i;
+      }
+    }
+    return resumed;
+  }
+  if (holdOff_ > 0) {
+    --holdOff_;
+    return resumed;
+  }
+
+  float threshold = threshold_.load(std::memory_order_relaxed);
+  float total = current_[DSP_SLOT_TOTAL].load(std::memory_order_relaxed);
+  int32_t pick = -1;
+  if (total > threshold) {
+    // shed the most expensive effect still running
+    float worst = 0.0f;
+    for (int32_t i = 0; i < DSP_SLOT_TOTAL; i++) {
+      float load = current_[i].load(std::memory_order_relaxed);
+      if (!bypassed_[i].load(std::memory_order_relaxed) && load > worst) {
+        worst = load;
+        pick = i;
+      }
+    }
+    if (pick >= 0) {
+      savedLoad_[pick] = worst;
+      bypassed_[pick].store(true, std::memory_order_relaxed);
+      current_[pick].store(0.0f, std::memory_order_relaxed);
+      holdOff_ = kHoldOffBuffers;
+    }
+    return resumed;
+  }
+
+  // bring back the cheapest bypassed effect if it fits again
+  for (int32_t i = 0; i < DSP_SLOT_TOTAL; i++) {
+    if (bypassed_[i].load(std::memory_order_relaxed) &&
+        (pick < 0 || savedLoad_[i] < savedLoad_[pick])) {
+      pick = i;
+    }
+  }
+  if (pick >= 0 && total + savedLoad_[pick] < threshold * kResumeRatio) {
+    bypassed_[pick].store(false, std::memory_order_relaxed);
+    resumed |= 1 << pick;
+    holdOff_ = kHoldOffBuffers;
+  }
+  return resumed;
+}
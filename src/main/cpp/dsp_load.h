@@ -0,0 +1,85 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_DSP_LOAD_H
+#define NATIVE_AUDIO_DSP_LOAD_H
+#include <atomic>
+#include "audio_common.h"
+
+/*
+ * Effect slots of the capture chain, in processing order; DSP_SLOT_TOTAL is
+ * the whole recorded buffer handling in EngineService. Mirrored in Java.
+ */
+enum DspSlot {
+  DSP_SLOT_ECHO_CANCELLER = 0,
+  DSP_SLOT_CONDITIONER = 1,
+  DSP_SLOT_DELAY = 2,
+  DSP_SLOT_PITCH = 3,
+  DSP_SLOT_EQ = 4,
+  DSP_SLOT_DYNAMICS = 5,  // only placed on the output; in the loop it is DELAY
+  DSP_SLOT_TOTAL = 6,
+  DSP_SLOT_COUNT
+};
+
+struct DspLoad {
+  float current_;      // smoothed processing time / buffer period
+  float peak_;         // worst single buffer since reset
+  uint32_t overruns_;  // buffers that took longer than the period
+  bool bypassed_;      // switched off by the auto bypass
+};
+
+/*
+ * DSP load meter for the capture chain: processing time as a fraction of
+ * the buffer period (framesPerBuf / sampleRate), per effect slot.
+ *
+ * The capture thread times each slot with record() and closes the buffer
+ * with endBuffer(); everything else may be called from any thread.
+ *
+ * With auto bypass on, the most expensive effect is bypassed when the total
+ * smoothed load goes above the threshold, and brought back (one at a time,
+ * cheapest first) once the load it would add fits under 70% of it again.
+ */
+class DspLoadMeter {
+ public:
+  explicit DspLoadMeter(SLmilliHertz sampleRate, uint32_t framesPerBuf);
+
+  void setAutoBypass(bool enable, float threshold);
+  bool isBypassed(DspSlot slot) const {
+    return bypassed_[slot].load(std::memory_order_relaxed);
+  }
+  void getLoad(DspSlot slot, DspLoad *load) const;
+  void reset(void);
+
+  void record(DspSlot slot, int64_t ns);
+  uint32_t endBuffer(void);  // mask of slots brought back by this call
+
+ private:
+  double periodNs_;
+  std::atomic<bool> autoBypass_;
+  std::atomic<float> threshold_;
+  std::atomic<bool> resetPending_;
+
+  std::atomic<float> current_[DSP_SLOT_COUNT];
+  std::atomic<float> peak_[DSP_SLOT_COUNT];
+  std::atomic<uint32_t> overruns_[DSP_SLOT_COUNT];
+  std::atomic<bool> bypassed_[DSP_SLOT_COUNT];
+
+  // capture thread only
+  int64_t bufferNs_[DSP_SLOT_COUNT];  // time recorded for this buffer
+  float savedLoad_[DSP_SLOT_COUNT];   // load of a slot when bypassed
+  int32_t holdOff_;                   // buffers until the next decision
+};
+
+#endif  // NATIVE_AUDIO_DSP_LOAD_H
@@ -0,0 +1,461 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "dynamics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "dsp_kernels.h"
+#include "pcm_convert.h"
+#include "trace.h"
+#ifdef DSP_USE_NEON
+#include <arm_neon.h>
+#endif
+
+static const uint32_t kMsPerSec = 1000;
+static const float kLookaheadMs = 2.0f;
+static const float kMinLevel = 1e-6f;  // -120 dBFS, keeps log2() finite
+static const float kDbPerLog2 = 6.02059991f;
+static const float kLog2PerDb = 0.166096405f;
+
+// least squares fits: log2(m) on [1, 2), 2^f on [0, 1); 2e-4 / 7e-6 error
+static const float kLog2C[5] = {-2.49680584f, 4.02845046f, -2.08112845f,
+                                0.628841375f, -0.0791538161f};
+static const float kExp2C[5] = {1.00000727f, 0.692931415f, 0.241709986f,
+                                0.0516670284f, 0.0136765608f};
+
+static inline float FastLog2(float x) {
+  int32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  float e = static_cast<float>((bits >> 23) - 127);
+  bits = (bits & 0x7fffff) | 0x3f800000;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+  float p = kLog2C[4];
+  for (int32_t k = 3; k >= 0; k--) p = kLog2C[k] + p * m;
+  return e + p;
+}
+
+static inline float FastExp2(float x) {
+  x = std::max(-126.0f, std::min(x, 126.0f));
+  int32_t i = static_cast<int32_t>(x);
+  if (x < static_cast<float>(i)) i--;
+  float f = x - static_cast<float>(i);
+  float p = kExp2C[4];
+  for (int32_t k = 3; k >= 0; k--) p = kExp2C[k] + p * f;
+  int32_t bits;
+  memcpy(&bits, &p, sizeof(bits));
+  bits += i << 23;
+  memcpy(&p, &bits, sizeof(p));
+  return p;
+}
+
+#ifdef DSP_USE_NEON
+static inline float32x4_t Log2Neon(float32x4_t x) {
+  int32x4_t bits = vreinterpretq_s32_f32(x);
+  float32x4_t e = vcvtq_f32_s32(
+      vsubq_s32(vshrq_n_s32(bits, 23), vdupq_n_s32(127)));
+  float32x4_t m = vreinterpretq_f32_s32(vorrq_s32(
+      vandq_s32(bits, vdupq_n_s32(0x7fffff)), vdupq_n_s32(0x3f800000)));
+  float32x4_t p = vdupq_n_f32(kLog2C[4]);
+  for (int32_t k = 3; k >= 0; k--) p = vmlaq_f32(vdupq_n_f32(kLog2C[k]), p, m);
+  return vaddq_f32(e, p);
+}
+
+static inline float32x4_t Exp2Neon(float32x4_t x) {
+  x = vmaxq_f32(vdupq_n_f32(-126.0f), vminq_f32(x, vdupq_n_f32(126.0f)));
+  int32x4_t i = vcvtq_s32_f32(x);  // towards 0, one less below 0
+  uint32x4_t below = vcltq_f32(x, vcvtq_f32_s32(i));
+  i = vaddq_s32(i, vreinterpretq_s32_u32(below));
+  float32x4_t f = vsubq_f32(x, vcvtq_f32_s32(i));
+  float32x4_t p = vdupq_n_f32(kExp2C[4]);
+  for (int32_t k = 3; k >= 0; k--) p = vmlaq_f32(vdupq_n_f32(kExp2C[k]), p, f);
+  return vreinterpretq_f32_s32(
+      vaddq_s32(vreinterpretq_s32_f32(p), vshlq_n_s32(i, 23)));
+}
+#endif
+
+/**
+ * @param maxFrames frames processed at a time, the buffer size
+ */
+DynamicsProcessor::DynamicsProcessor(int32_t sampleRate, int32_t channelCount,
+                                     SLuint32 format, uint32_t maxFrames)
+    : AudioFormat(sampleRate, channelCount, format),
+      maxFrames_(maxFrames),
+      placement_(DYNAMICS_PLACEMENT_OFF),
+      threshold_(-18.0f),
+      ratio_(1.0f),
+      knee_(6.0f),
+      makeup_(0.0f),
+      ceiling_(powf(10.0f, -1.0f / 20.0f)),
+      compressorDb_(0.0f),
+      limiterDb_(0.0f),
+      maxDb_(0.0f) {
+  assert(format_ == SL_PCMSAMPLEFORMAT_FIXED_16 &&
+         channelCount_ <= kMaxChannels);
+  attack_ = msToCoef(5.0f);
+  release_ = msToCoef(100.0f);
+  limitRelease_ = msToCoef(50.0f);
+  // sampleRate_ is in milli Hz
+  lookFrames_ = std::max(1u, static_cast<uint32_t>(
+      kLookaheadMs * (float)sampleRate_ / kMsPerSec / kMsPerSec + 0.5f));
+
+  // windowed sinc at 1/4, 2/4 and 3/4 of the way to the next frame
+  for (int32_t k = 0; k < kTpPhases; k++) {
+    double frac = (k + 1) / 4.0;
+    double sum = 0.0;
+    for (int32_t j = 0; j < kTpTaps; j++) {
+      double d = j - (kTpTaps / 2 - 1) - frac;
+      double sinc = sin(M_PI * d) / (M_PI * d);
+      double window = 0.5 + 0.5 * cos(M_PI * d / (kTpTaps / 2));
+      tpCoefs_[k][j] = static_cast<float>(sinc * window);
+      sum += sinc * window;
+    }
+    for (int32_t j = 0; j < kTpTaps; j++) {
+      tpCoefs_[k][j] = static_cast<float>(tpCoefs_[k][j] / sum);
+    }
+  }
+
+  level_ = new float[maxFrames_];
+  peak_ = new float[maxFrames_];
+  for (int32_t ch = 0; ch < kMaxChannels; ch++) {
+    planar_[ch] = new float[kTpTaps - 1 + maxFrames_];
+  }
+  holdSize_ = lookFrames_ + 2;
+  hold_ = new HoldEntry[holdSize_];
+  box_ = new float[lookFrames_];
+  delayFrames_ = 1;
+  while (delayFrames_ <= latencyFrames()) {
+    delayFrames_ <<= 1;
+  }
+  delay_ = new float[delayFrames_ * channelCount_];
+  work_ = new float[maxFrames_ * channelCount_];
+  reset();
+}
+
+DynamicsProcessor::~DynamicsProcessor() {
+  delete[] work_;
+  delete[] delay_;
+  delete[] box_;
+  delete[] hold_;
+  for (int32_t ch = 0; ch < kMaxChannels; ch++) {
+    delete[] planar_[ch];
+  }
+  delete[] peak_;
+  delete[] level_;
+}
+
+// one pole coefficient reaching 1 - 1/e of a step in ms
+float DynamicsProcessor::msToCoef(float ms) const {
+  double frames = ms * (sampleRate_ / 1000.0) / kMsPerSec;
+  return static_cast<float>(1.0 - exp(-1.0 / std::max(frames, 1.0)));
+}
+
+void DynamicsProcessor::reset(void) {
+  env_ = kMinLevel;
+  for (int32_t ch = 0; ch < kMaxChannels; ch++) {
+    memset(planar_[ch], 0, (kTpTaps - 1) * sizeof(float));
+  }
+  prevPeak_ = 0.0f;
+  holdHead_ = 0;
+  holdCount_ = 0;
+  detectFrame_ = 0;
+  relGain_ = 1.0f;
+  std::fill(box_, box_ + lookFrames_, 1.0f);
+  boxPos_ = 0;
+  boxSum_ = lookFrames_;
+  memset(delay_, 0, delayFrames_ * channelCount_ * sizeof(float));
+  delayPos_ = 0;
+}
+
+void DynamicsProcessor::setParam(int32_t param, float value) {
+  switch (param) {
+    case DYNAMICS_PARAM_PLACEMENT: {
+      int32_t placement = std::max(0, std::min(static_cast<int32_t>(
+          lrintf(value)), DYNAMICS_PLACEMENT_COUNT - 1));
+      if (placement != placement_) {
+        placement_ = placement;
+        reset();
+      }
+      break;
+    }
+    case DYNAMICS_PARAM_THRESHOLD_DB:
+      threshold_ = std::max(-60.0f, std::min(value, 0.0f));
+      break;
+    case DYNAMICS_PARAM_RATIO:
+      ratio_ = std::max(1.0f, std::min(value, 20.0f));
+      break;
+    case DYNAMICS_PARAM_KNEE_DB:
+      knee_ = std::max(0.0f, std::min(value, 24.0f));
+      break;
+    case DYNAMICS_PARAM_ATTACK_MS:
+      attack_ = msToCoef(std::max(0.1f, std::min(value, 100.0f)));
+      break;
+    case DYNAMICS_PARAM_RELEASE_MS:
+      release_ = msToCoef(std::max(10.0f, std::min(value, 2000.0f)));
+      break;
+    case DYNAMICS_PARAM_MAKEUP_DB:
+      makeup_ = std::max(0.0f, std::min(value, 24.0f));
+      break;
+    case DYNAMICS_PARAM_CEILING_DB:
+      ceiling_ = powf(10.0f, std::max(-24.0f, std::min(value, 0.0f)) / 20.0f);
+      break;
+    case DYNAMICS_PARAM_LIMIT_RELEASE_MS:
+      limitRelease_ = msToCoef(std::max(1.0f, std::min(value, 1000.0f)));
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+ * Reduction now in each stage, and the largest total since the previous
+ * call.
+ */
+void DynamicsProcessor::getMeter(DynamicsMeter *meter) {
+  meter->compressorDb_ = compressorDb_.load(std::memory_order_relaxed);
+  meter->limiterDb_ = limiterDb_.load(std::memory_order_relaxed);
+  meter->maxDb_ = maxDb_.exchange(0.0f, std::memory_order_relaxed);
+}
+
+void DynamicsProcessor::process(int16_t *liveAudio, int32_t numFrames) {
+  TRACE_SCOPE("DynamicsProcessor::process");
+  while (numFrames > 0) {
+    int32_t frames = std::min(numFrames, static_cast<int32_t>(maxFrames_));
+    ConvertPcm(liveAudio, PCM_FORMAT_S16, PCM_LAYOUT_INTERLEAVED, work_,
+               PCM_FORMAT_FLOAT, PCM_LAYOUT_INTERLEAVED, frames, channelCount_,
+               nullptr);
+    processFloat(work_, frames);
+    ConvertPcm(work_, PCM_FORMAT_FLOAT, PCM_LAYOUT_INTERLEAVED, liveAudio,
+               PCM_FORMAT_S16, PCM_LAYOUT_INTERLEAVED, frames, channelCount_,
+               nullptr);
+    liveAudio += frames * channelCount_;
+    numFrames -= frames;
+  }
+}
+
+void DynamicsProcessor::processFloat(float *samples, int32_t numFrames) {
+  assert(numFrames <= static_cast<int32_t>(maxFrames_));
+  float total = compress(samples, numFrames);
+  detect(samples, numFrames);
+  total += limit(samples, numFrames);
+
+  float seen = maxDb_.load(std::memory_order_relaxed);
+  while (total > seen &&
+         !maxDb_.compare_exchange_weak(seen, total, std::memory_order_relaxed)) {
+  }
+}
+
+/*
+ * Compressor, in four passes over the piece: peak of the channels, the
+ * attack/release follower, the gain curve in dB (soft knee, makeup) back
+ * to linear, then the gain applied. Only the follower is serial.
+ * Returns the largest reduction in dB.
+ */
+float DynamicsProcessor::compress(float *samples, int32_t numFrames) {
+  if (ratio_ == 1.0f && makeup_ == 0.0f) {
+    compressorDb_.store(0.0f, std::memory_order_relaxed);
+    return 0.0f;
+  }
+  int32_t f = 0;
+#ifdef DSP_USE_NEON
+  if (channelCount_ == 2) {
+    for (; f + 4 <= numFrames; f += 4) {
+      float32x4x2_t v = vld2q_f32(samples + 2 * f);
+      vst1q_f32(level_ + f,
+                vmaxq_f32(vabsq_f32(v.val[0]), vabsq_f32(v.val[1])));
+    }
+  }
+#endif
+  for (; f < numFrames; f++) {
+    float peak = 0.0f;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      peak = std::max(peak, fabsf(samples[f * channelCount_ + ch]));
+    }
+    level_[f] = peak;
+  }
+
+  float env = env_;
+  for (f = 0; f < numFrames; f++) {
+    float x = level_[f];
+    env += (x > env ? attack_ : release_) * (x - env);
+    level_[f] = env;
+  }
+  env_ = std::max(env, kMinLevel);
+
+  // gain reduction in dB: 0 under the knee, (1/ratio - 1) * over above it,
+  // quadratic in between
+  float slope = 1.0f / ratio_ - 1.0f;
+  float knee = std::max(knee_, 1e-3f);
+  f = 0;
+#ifdef DSP_USE_NEON
+  {
+    float32x4_t vthreshold = vdupq_n_f32(threshold_);
+    float32x4_t vslope = vdupq_n_f32(slope);
+    float32x4_t vhalf = vdupq_n_f32(knee / 2);
+    float32x4_t vkneeScale = vdupq_n_f32(slope / (2 * knee));
+    float32x4_t vmakeup = vdupq_n_f32(makeup_);
+    for (; f + 4 <= numFrames; f += 4) {
+      float32x4_t env4 = vmaxq_f32(vld1q_f32(level_ + f), vdupq_n_f32(kMinLevel));
+      float32x4_t over = vsubq_f32(
+          vmulq_n_f32(Log2Neon(env4), kDbPerLog2), vthreshold);
+      float32x4_t t = vaddq_f32(over, vhalf);
+      float32x4_t gr = vmulq_f32(vkneeScale, vmulq_f32(t, t));
+      gr = vbslq_f32(vcgtq_f32(over, vhalf), vmulq_f32(vslope, over), gr);
+      gr = vbslq_f32(vcltq_f32(over, vnegq_f32(vhalf)), vdupq_n_f32(0.0f), gr);
+      vst1q_f32(level_ + f,
+                Exp2Neon(vmulq_n_f32(vaddq_f32(gr, vmakeup), kLog2PerDb)));
+    }
+  }
+#endif
+  for (; f < numFrames; f++) {
+    float over = FastLog2(std::max(level_[f], kMinLevel)) * kDbPerLog2 -
+                 threshold_;
+    float gr = 0.0f;
+    if (over > knee / 2) {
+      gr = slope * over;
+    } else if (over >= -knee / 2) {
+      float t = over + knee / 2;
+      gr = slope / (2 * knee) * (t * t);
+    }
+    level_[f] = FastExp2((gr + makeup_) * kLog2PerDb);
+  }
+
+  float minGain = level_[0];
+  for (f = 1; f < numFrames; f++) {
+    minGain = std::min(minGain, level_[f]);
+  }
+
+  f = 0;
+#ifdef DSP_USE_NEON
+  if (channelCount_ == 2) {
+    for (; f + 4 <= numFrames; f += 4) {
+      float32x4_t g = vld1q_f32(level_ + f);
+      float32x4x2_t v = vld2q_f32(samples + 2 * f);
+      v.val[0] = vmulq_f32(v.val[0], g);
+      v.val[1] = vmulq_f32(v.val[1], g);
+      vst2q_f32(samples + 2 * f, v);
+    }
+  }
+#endif
+  for (; f < numFrames; f++) {
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      samples[f * channelCount_ + ch] *= level_[f];
+    }
+  }
+  compressorDb_.store(makeup_ - FastLog2(level_[numFrames - 1]) * kDbPerLog2,
+                      std::memory_order_relaxed);
+  return makeup_ - FastLog2(minGain) * kDbPerLog2;
+}
+
+/*
+ * True peak detector: for each frame (kDetectDelay behind the input), the
+ * largest of its own |sample| and the three interpolated points towards
+ * the next frame, over the channels.
+ */
+void DynamicsProcessor::detect(const float *samples, int32_t numFrames) {
+  const int32_t history = kTpTaps - 1;
+  for (int32_t ch = 0; ch < channelCount_; ch++) {
+    float *xp = planar_[ch];
+    for (int32_t f = 0; f < numFrames; f++) {
+      xp[history + f] = samples[f * channelCount_ + ch];
+    }
+    int32_t f = 0;
+#ifdef DSP_USE_NEON
+    for (; f + 4 <= numFrames; f += 4) {
+      float32x4_t peak = vabsq_f32(vld1q_f32(xp + f + history / 2));
+      for (int32_t k = 0; k < kTpPhases; k++) {
+        float32x4_t acc = vmulq_n_f32(vld1q_f32(xp + f), tpCoefs_[k][0]);
+        for (int32_t j = 1; j < kTpTaps; j++) {
+          acc = vmlaq_n_f32(acc, vld1q_f32(xp + f + j), tpCoefs_[k][j]);
+        }
+        peak = vmaxq_f32(peak, vabsq_f32(acc));
+      }
+      if (ch) {
+        peak = vmaxq_f32(peak, vld1q_f32(peak_ + f));
+      }
+      vst1q_f32(peak_ + f, peak);
+    }
+#endif
+    for (; f < numFrames; f++) {
+      float peak = fabsf(xp[f + history / 2]);
+      for (int32_t k = 0; k < kTpPhases; k++) {
+        float acc = 0.0f;
+        for (int32_t j = 0; j < kTpTaps; j++) {
+          acc += tpCoefs_[k][j] * xp[f + j];
+        }
+        peak = std::max(peak, fabsf(acc));
+      }
+      peak_[f] = ch ? std::max(peak, peak_[f]) : peak;
+    }
+    memmove(xp, xp + numFrames, history * sizeof(float));
+  }
+}
+
+/*
+ * Limiter, frame by frame: the gain a frame needs (its peak and the one
+ * before, as the waveform between them counts for both), the minimum over
+ * the last lookFrames_ + 1 of them, the release, then the average of the
+ * last lookFrames_. Every value averaged is at most the gain needed by the
+ * frame leaving the delay line now. Returns the largest reduction in dB.
+ */
+float DynamicsProcessor::limit(float *samples, int32_t numFrames) {
+  uint32_t mask = delayFrames_ - 1;
+  uint32_t latency = latencyFrames();
+  float minGain = 1.0f;
+  float gain = 1.0f;
+  for (int32_t f = 0; f < numFrames; f++) {
+    float peak = std::max(peak_[f], prevPeak_);
+    prevPeak_ = peak_[f];
+    float need = peak > ceiling_ ? ceiling_ / peak : 1.0f;
+
+    // running minimum: the queue holds increasing gains, oldest first
+    int64_t frame = detectFrame_++;
+    while (holdCount_ &&
+           hold_[(holdHead_ + holdCount_ - 1) % holdSize_].gain_ >= need) {
+      holdCount_--;
+    }
+    HoldEntry &entry = hold_[(holdHead_ + holdCount_) % holdSize_];
+    entry.frame_ = frame;
+    entry.gain_ = need;
+    holdCount_++;
+    if (hold_[holdHead_].frame_ < frame - static_cast<int64_t>(lookFrames_)) {
+      holdHead_ = (holdHead_ + 1) % holdSize_;
+      holdCount_--;
+    }
+    float held = hold_[holdHead_].gain_;
+    relGain_ = held < relGain_ ? held : relGain_ + limitRelease_ * (held - relGain_);
+
+    boxSum_ += relGain_ - box_[boxPos_];
+    box_[boxPos_] = relGain_;
+    if (++boxPos_ == lookFrames_) {
+      boxPos_ = 0;
+    }
+    gain = static_cast<float>(boxSum_ / lookFrames_);
+    minGain = std::min(minGain, gain);
+
+    float *in = samples + f * channelCount_;
+    float *slot = delay_ + (delayPos_ & mask) * channelCount_;
+    const float *out = delay_ + ((delayPos_ - latency) & mask) * channelCount_;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      float x = in[ch];
+      in[ch] = out[ch] * gain;
+      slot[ch] = x;
+    }
+    delayPos_++;
+  }
+  limiterDb_.store(-20.0f * log10f(gain), std::memory_order_relaxed);
+  return -20.0f * log10f(minGain);
+}
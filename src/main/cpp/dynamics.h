@@ -0,0 +1,122 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_DYNAMICS_H
+#define NATIVE_AUDIO_DYNAMICS_H
+#include <atomic>
+#include "audio_effect.h"
+
+struct DynamicsMeter {
+  float compressorDb_;  // gain reduction now, dB >= 0
+  float limiterDb_;
+  float maxDb_;         // largest total reduction since the last read
+};
+
+/*
+ * Compressor followed by a true peak lookahead limiter, for the end of the
+ * capture chain or the delay's feedback loop (DYNAMICS_PLACEMENT_*).
+ *
+ * Compressor: feed forward, the peak of the channels through an
+ * attack/release follower, soft knee gain curve. The follower is a serial
+ * recursion; the peak detection, the dB conversion, the gain curve and
+ * applying the gain run four frames at a time with NEON.
+ *
+ * Limiter: the true peak is estimated from 4x oversampling (8 tap
+ * polyphase interpolation, four frames at a time with NEON). The gain each
+ * frame needs goes through a running minimum over the lookahead (a
+ * monotonic queue: O(1) per frame, amortized), a release and a moving
+ * average as long as the lookahead, so the gain is already down when the
+ * peak comes out. The audio is delayed by latencyFrames().
+ *
+ * setParam() and the processing are for the audio thread, getMeter() may
+ * be called from any thread.
+ */
+class DynamicsProcessor : public AudioFormat {
+ public:
+  explicit DynamicsProcessor(int32_t sampleRate, int32_t channelCount,
+                             SLuint32 format, uint32_t maxFrames);
+  ~DynamicsProcessor();
+
+  void setParam(int32_t param, float value);  // DYNAMICS_PARAM_*
+  int32_t placement(void) const { return placement_; }
+  uint32_t latencyFrames(void) const { return lookFrames_ + kDetectDelay; }
+  // frames still to come out after the input went silent
+  uint32_t tailFrames(void) const {
+    return placement_ == DYNAMICS_PLACEMENT_OFF ? 0 : latencyFrames();
+  }
+  void getMeter(DynamicsMeter *meter);
+  void reset(void);
+
+  void process(int16_t *liveAudio, int32_t numFrames);
+  // interleaved float, full scale 1.0, up to maxFrames
+  void processFloat(float *samples, int32_t numFrames);
+
+ private:
+  static const int32_t kMaxChannels = 2;
+  static const int32_t kTpTaps = 8;
+  static const int32_t kTpPhases = 3;                 // points between frames
+  static const uint32_t kDetectDelay = kTpTaps / 2;  // frames of the detector
+
+  uint32_t maxFrames_;
+  uint32_t lookFrames_;
+  int32_t placement_;
+
+  // compressor
+  float threshold_;  // dB
+  float ratio_;
+  float knee_;       // dB
+  float makeup_;     // dB
+  float attack_;     // follower coefficients
+  float release_;
+  float env_;
+  float *level_;     // maxFrames_: peak, then envelope, then gain
+
+  // limiter
+  float ceiling_;    // linear
+  float limitRelease_;
+  float tpCoefs_[kTpPhases][kTpTaps];
+  float *planar_[kMaxChannels];  // kTpTaps - 1 frames of history + block
+  float *peak_;                  // maxFrames_ detector output
+  float prevPeak_;
+  struct HoldEntry {
+    int64_t frame_;
+    float gain_;
+  };
+  HoldEntry *hold_;  // monotonic queue ring, lookFrames_ + 2
+  uint32_t holdSize_;
+  uint32_t holdHead_;
+  uint32_t holdCount_;
+  int64_t detectFrame_;  // frame the next detector output belongs to
+  float relGain_;
+  float *box_;           // lookFrames_ ring for the moving average
+  uint32_t boxPos_;
+  double boxSum_;
+  float *delay_;         // interleaved audio delay ring
+  uint32_t delayFrames_;  // power of 2
+  uint32_t delayPos_;
+
+  float *work_;  // maxFrames_ interleaved, for process()
+
+  std::atomic<float> compressorDb_;
+  std::atomic<float> limiterDb_;
+  std::atomic<float> maxDb_;
+
+  float msToCoef(float ms) const;
+  float compress(float *samples, int32_t numFrames);
+  void detect(const float *samples, int32_t numFrames);
+  float limit(float *samples, int32_t numFrames);
+};
+
+#endif  // NATIVE_AUDIO_DYNAMICS_H
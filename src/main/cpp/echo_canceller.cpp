@@ -0,0 +1,472 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "echo_canceller.h"
+#include "audio_common.h"
+#include "dsp_kernels.h"
+#include "latency_meter.h"
+#include <cmath>
+#ifdef DSP_USE_NEON
+#include <arm_neon.h>
+#endif
+
+const int32_t EchoCanceller::kBlockFrames;
+const int32_t EchoCanceller::kDefaultPartitions;
+const int32_t EchoCanceller::kMaxDelayMs;
+
+static const float kStepSize = 0.5f;      // NLMS mu
+static const float kRegularization = 1e-6f;
+static const float kPowerSmoothing = 0.98f;
+static const uint32_t kRefRingFrames = 32768;
+static const float kInt16ToFloat = 1.0f / 32768.0f;
+static const uint32_t kMsPerSec = 1000;
+
+// the estimate correlates kEstimateRefMs of reference against the mic
+static const int32_t kEstimateRefMs = 500;
+// a correlation peak this far above the rms is an echo
+static const float kMinEstimateConfidence = 8.0f;
+
+/*
+ * acc += a * b over split complex arrays
+ */
+static void ComplexMulAcc(float *accRe, float *accIm, const float *aRe,
+                          const float *aIm, const float *bRe, const float *bIm,
+                          int32_t count) {
+  int32_t k = 0;
+#ifdef DSP_USE_NEON
+  for (; k + 4 <= count; k += 4) {
+    float32x4_t ar = vld1q_f32(aRe + k), ai = vld1q_f32(aIm + k);
+    float32x4_t br = vld1q_f32(bRe + k), bi = vld1q_f32(bIm + k);
+    float32x4_t cr = vld1q_f32(accRe + k), ci = vld1q_f32(accIm + k);
+    cr = vmlsq_f32(vmlaq_f32(cr, ar, br), ai, bi);
+    ci = vmlaq_f32(vmlaq_f32(ci, ar, bi), ai, br);
+    vst1q_f32(accRe + k, cr);
+    vst1q_f32(accIm + k, ci);
+  }
+#endif
+  for (; k < count; k++) {
+    accRe[k] += aRe[k] * bRe[k] - aIm[k] * bIm[k];
+    accIm[k] += aRe[k] * bIm[k] + aIm[k] * bRe[k];
+  }
+}
+
+/*
+ * acc += conj(a) * b over split complex arrays
+ */
+static void ComplexConjMulAcc(float *accRe, float *accIm, const float *aRe,
+                              const float *aIm, const float *bRe,
+                              const float *bIm, int32_t count) {
+  int32_t k = 0;
+#ifdef DSP_USE_NEON
+  for (; k + 4 <= count; k += 4) {
+    float32x4_t ar = vld1q_f32(aRe + k), ai = vld1q_f32(aIm + k);
+    float32x4_t br = vld1q_f32(bRe + k), bi = vld1q_f32(bIm + k);
+    float32x4_t cr = vld1q_f32(accRe + k), ci = vld1q_f32(accIm + k);
+    cr = vmlaq_f32(vmlaq_f32(cr, ar, br), ai, bi);
+    ci = vmlsq_f32(vmlaq_f32(ci, ar, bi), ai, br);
+    vst1q_f32(accRe + k, cr);
+    vst1q_f32(accIm + k, ci);
+  }
+#endif
+  for (; k < count; k++) {
+    accRe[k] += aRe[k] * bRe[k] + aIm[k] * bIm[k];
+    accIm[k] += aRe[k] * bIm[k] - aIm[k] * bRe[k];
+  }
+}
+
+/**
+ * Constructor for EchoCanceller
+ * @param framesPerBuf largest buffer process()/pushReference() will see
+ * @param partitions filter length in blocks of kBlockFrames
+ */
+EchoCanceller::EchoCanceller(int32_t sampleRate, int32_t channelCount,
+                             SLuint32 format, int32_t framesPerBuf,
+                             int32_t partitions)
+    : AudioFormat(sampleRate, channelCount, format),
+      partitions_(partitions),
+      bins_(kBlockFrames + 1),
+      fft_(2 * kBlockFrames),
+      enabled_(false),
+      resetPending_(true),
+      resyncPending_(false),
+      erleDb_(0.0f),
+      delayTarget_(0),
+      delayFrames_(0),
+      delayPending_(0),
+      estimateState_(IDLE),
+      estimateRestart_(false),
+      estimateWritten_(0),
+      estimateDelay_(0),
+      haveEstimate_(false),
+      estimateConfidence_(0.0f) {
+  assert(format_ == SL_PCMSAMPLEFORMAT_FIXED_16 && partitions_ > 0);
+  refRing_.reset(new RingBuffer<float>(kRefRingFrames));
+  // half the ring stays for the player running ahead of the capture
+  int32_t framesPerMs = sampleRate_ / kMsPerSec / kMsPerSec;
+  maxDelayFrames_ = std::min<int32_t>(kMaxDelayMs * framesPerMs,
+                                      refRing_->capacity() / 2);
+  // the reference collected may sit up to maxDelayFrames_ early or late
+  int32_t refFrames = kEstimateRefMs * framesPerMs;
+  estimateFrames_ = refFrames + 2 * maxDelayFrames_;
+  estimateFrames_ += kBlockFrames - 1 - (estimateFrames_ - 1) % kBlockFrames;
+  refScratch_.resize(framesPerBuf);
+  refPrev_.resize(kBlockFrames);
+  fftIn_.resize(2 * kBlockFrames);
+  fftOut_.resize(2 * kBlockFrames);
+  micFifo_.resize(kBlockFrames + framesPerBuf);
+  outFifo_.resize(2 * kBlockFrames + framesPerBuf);
+
+  int32_t total = partitions_ * bins_;
+  xRe_.resize(total);
+  xIm_.resize(total);
+  wRe_.resize(total);
+  wIm_.resize(total);
+  xPow_.resize(bins_);
+  yRe_.resize(bins_);
+  yIm_.resize(bins_);
+  eRe_.resize(bins_);
+  eIm_.resize(bins_);
+  clearState();
+}
+
+EchoCanceller::~EchoCanceller() {}
+
+void EchoCanceller::setEnabled(bool enable) {
+  if (enable && !enabled_.load()) {
+    resetPending_.store(true, std::memory_order_release);
+  }
+  enabled_.store(enable, std::memory_order_release);
+}
+
+bool EchoCanceller::isEnabled(void) const {
+  return enabled_.load(std::memory_order_acquire);
+}
+
+/*
+ * Forget the echo path and the reference; applied by the capture thread
+ * on its next process() call.
+ */
+void EchoCanceller::reset(void) {
+  resetPending_.store(true, std::memory_order_release);
+}
+
+/*
+ * Drop the queued reference and the audio in flight but keep the learned
+ * echo path, e.g. when the streams restart after a pause on the same route.
+ */
+void EchoCanceller::resync(void) {
+  resyncPending_.store(true, std::memory_order_release);
+}
+
+float EchoCanceller::getErleDb(void) const {
+  return erleDb_.load(std::memory_order_relaxed);
+}
+
+void EchoCanceller::setDelayMs(float delayMs) {
+  float frames = delayMs * sampleRate_ / kMsPerSec / kMsPerSec;
+  frames = std::max(0.0f, std::min(frames, (float)maxDelayFrames_));
+  delayTarget_.store(static_cast<int32_t>(lrintf(frames)),
+                     std::memory_order_relaxed);
+}
+
+float EchoCanceller::getDelayMs(void) const {
+  return delayTarget_.load(std::memory_order_relaxed) *
+         (float)kMsPerSec * kMsPerSec / sampleRate_;
+}
+
+/*
+ * The collection memory is allocated by the first start and kept, as in
+ * LatencyMeter::start().
+ */
+bool EchoCanceller::startDelayEstimate(void) {
+  if (!estimateRef_) {
+    estimateRef_.reset(new float[estimateFrames_]);
+    estimateMic_.reset(new float[estimateFrames_]);
+  }
+  {
+    std::lock_guard<std::mutex> lock(estimateMutex_);
+    haveEstimate_ = false;
+  }
+  estimateRestart_.store(true, std::memory_order_release);
+  estimateState_.store(RUNNING, std::memory_order_release);
+  return true;
+}
+
+/*
+ * The correlation runs on the caller's thread once the collection is
+ * complete.
+ */
+bool EchoCanceller::getDelayEstimate(float *delayMs, float *confidence) {
+  if (estimateState_.load(std::memory_order_acquire) != DONE) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(estimateMutex_);
+  if (!haveEstimate_) {
+    analyzeEstimate();
+    haveEstimate_ = true;
+  }
+  *delayMs = getDelayMs();
+  *confidence = estimateConfidence_;
+  return true;
+}
+
+/*
+ * Where the echo of the collected reference shows up in the mic, relative
+ * to the delay it was collected with; the reference is looked for from as
+ * far before that as the delay could shrink. The new delay leaves a few
+ * blocks in front of the echo, for the jitter between player and capture.
+ */
+void EchoCanceller::analyzeEstimate(void) {
+  int32_t refFrames = estimateFrames_ - 2 * maxDelayFrames_;
+  int32_t early = std::min(estimateDelay_, maxDelayFrames_);
+  int32_t lag;
+  estimateConfidence_ =
+      EstimateDelay(estimateMic_.get(), estimateFrames_,
+                    estimateRef_.get() + early, refFrames,
+                    estimateFrames_ - refFrames, &lag);
+  if (estimateConfidence_ < kMinEstimateConfidence) {
+    return;
+  }
+  int32_t echo = estimateDelay_ + lag - early;
+  int32_t delay = std::max(echo - 2 * kBlockFrames, 0);
+  delayTarget_.store(std::min(delay, maxDelayFrames_),
+                     std::memory_order_relaxed);
+}
+
+void EchoCanceller::clearState(void) {
+  clearStream();
+  std::fill(wRe_.begin(), wRe_.end(), 0.0f);
+  std::fill(wIm_.begin(), wIm_.end(), 0.0f);
+  constrainIdx_ = 0;
+  micPow_ = 0.0f;
+  errPow_ = 0.0f;
+  erleDb_.store(0.0f, std::memory_order_relaxed);
+}
+
+// everything but the filter: reference delay line and block fifos
+void EchoCanceller::clearStream(void) {
+  std::fill(refPrev_.begin(), refPrev_.end(), 0.0f);
+  std::fill(xRe_.begin(), xRe_.end(), 0.0f);
+  std::fill(xIm_.begin(), xIm_.end(), 0.0f);
+  std::fill(xPow_.begin(), xPow_.end(), 0.0f);
+  micCount_ = 0;
+  // kBlockFrames of silence make the fifo latency constant
+  std::fill(outFifo_.begin(), outFifo_.end(), 0.0f);
+  outCount_ = kBlockFrames;
+  head_ = 0;
+  // the reference queued is dropped: the bulk delay builds up again
+  delayPending_ = delayFrames_;
+  estimateRestart_.store(true, std::memory_order_relaxed);
+}
+
+/*
+ * Player thread: queue what was handed to the device as the far end
+ * reference. Nothing is queued while the canceller is off.
+ */
+void EchoCanceller::pushReference(const int16_t *played, int32_t numFrames) {
+  if (!enabled_.load(std::memory_order_acquire)) {
+    return;
+  }
+  while (numFrames > 0) {
+    int32_t frames = std::min<int32_t>(numFrames, refScratch_.size());
+    for (int32_t i = 0; i < frames; i++) {
+      int32_t sum = 0;
+      for (int32_t ch = 0; ch < channelCount_; ch++) {
+        sum += played[i * channelCount_ + ch];
+      }
+      refScratch_[i] = sum * kInt16ToFloat / channelCount_;
+    }
+    refRing_->write(refScratch_.data(), frames);  // overflow: drop newest
+    played += frames * channelCount_;
+    numFrames -= frames;
+  }
+}
+
+void EchoCanceller::process(int16_t *liveAudio, int32_t numFrames) {
+  if (!enabled_.load(std::memory_order_acquire)) {
+    return;
+  }
+  if (resetPending_.exchange(false, std::memory_order_acq_rel)) {
+    resyncPending_.store(false, std::memory_order_relaxed);
+    clearState();
+    refRing_->skip(refRing_->availableToRead());
+  } else if (resyncPending_.exchange(false, std::memory_order_acq_rel)) {
+    clearStream();
+    refRing_->skip(refRing_->availableToRead());
+  }
+  int32_t delay = delayTarget_.load(std::memory_order_relaxed);
+  delayPending_ += delay - delayFrames_;
+  delayFrames_ = delay;
+  assert(micCount_ + numFrames <= static_cast<int32_t>(micFifo_.size()));
+
+  for (int32_t i = 0; i < numFrames; i++) {
+    int32_t sum = 0;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      sum += liveAudio[i * channelCount_ + ch];
+    }
+    micFifo_[micCount_++] = sum * kInt16ToFloat / channelCount_;
+  }
+
+  int32_t consumed = 0;
+  while (micCount_ - consumed >= kBlockFrames) {
+    processBlock(&micFifo_[consumed], &outFifo_[outCount_]);
+    consumed += kBlockFrames;
+    outCount_ += kBlockFrames;
+  }
+  std::copy(micFifo_.begin() + consumed, micFifo_.begin() + micCount_,
+            micFifo_.begin());
+  micCount_ -= consumed;
+
+  assert(outCount_ >= numFrames);
+  for (int32_t i = 0; i < numFrames; i++) {
+    float v = outFifo_[i] * 32768.0f;
+    int16_t s = static_cast<int16_t>(
+        v >= 32767.0f ? 32767 : (v <= -32768.0f ? -32768 : lrintf(v)));
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      liveAudio[i * channelCount_ + ch] = s;
+    }
+  }
+  std::copy(outFifo_.begin() + numFrames, outFifo_.begin() + outCount_,
+            outFifo_.begin());
+  outCount_ -= numFrames;
+}
+
+/*
+ * The next kBlockFrames of reference, behind the bulk delay: a longer delay
+ * holds back reference that is there and reads silence instead until the
+ * ring has filled up by the difference, a shorter one drops what is queued
+ * to catch up. Silence read because the player is behind is not held back
+ * reference, so it does not count.
+ */
+void EchoCanceller::readReference(float *ref) {
+  if (delayPending_ < 0) {
+    delayPending_ += refRing_->skip(-delayPending_);
+  }
+  int32_t ready = std::min<int32_t>(refRing_->availableToRead(), kBlockFrames);
+  int32_t held = std::min(std::max(delayPending_, 0), ready);
+  delayPending_ -= held;
+  std::fill(ref, ref + held, 0.0f);
+  uint32_t got = refRing_->read(ref + held, ready - held);
+  // player behind: assume silence
+  std::fill(ref + held + got, ref + kBlockFrames, 0.0f);
+}
+
+/*
+ * While an estimate runs: keep the reference as the filter sees it, and the
+ * mic. A delay change or a resync starts the collection over.
+ */
+void EchoCanceller::collectEstimate(const float *ref, const float *mic) {
+  if (estimateState_.load(std::memory_order_acquire) != RUNNING) {
+    return;
+  }
+  if (estimateRestart_.exchange(false, std::memory_order_acquire) ||
+      delayFrames_ != estimateDelay_) {
+    estimateWritten_ = 0;
+    estimateDelay_ = delayFrames_;
+  }
+  std::copy(ref, ref + kBlockFrames, &estimateRef_[estimateWritten_]);
+  std::copy(mic, mic + kBlockFrames, &estimateMic_[estimateWritten_]);
+  estimateWritten_ += kBlockFrames;
+  if (estimateWritten_ == estimateFrames_) {
+    estimateState_.store(DONE, std::memory_order_release);
+  }
+}
+
+/*
+ * One overlap-save block:
+ *   X    = FFT([previous ref block, current ref block]) into the delay line
+ *   y    = last half of IFFT(sum_p W_p * X_p)
+ *   e    = mic - y
+ *   W_p += mu * conj(X_p) * FFT([0, e]) / (sum_p |X_p|^2 + delta)
+ * The gradient constraint (zero the second half of w_p in time domain)
+ * costs two FFTs, so it is applied to one partition per block in turn.
+ */
+void EchoCanceller::processBlock(const float *mic, float *out) {
+  const int32_t B = kBlockFrames;
+  float *cur = &fftIn_[B];
+  readReference(cur);
+  collectEstimate(cur, mic);
+  std::copy(refPrev_.begin(), refPrev_.end(), fftIn_.begin());
+  std::copy(cur, cur + B, refPrev_.begin());
+
+  // newest reference spectrum replaces the oldest one in the delay line
+  head_ = (head_ + 1) % partitions_;
+  float *xr = &xRe_[head_ * bins_], *xi = &xIm_[head_ * bins_];
+  for (int32_t k = 0; k < bins_; k++) {
+    xPow_[k] -= xr[k] * xr[k] + xi[k] * xi[k];
+  }
+  fft_.forward(fftIn_.data(), xr, xi);
+  for (int32_t k = 0; k < bins_; k++) {
+    xPow_[k] += xr[k] * xr[k] + xi[k] * xi[k];
+  }
+  if (head_ == 0) {
+    // running sum drifts in float: rebuild it once per delay line turn
+    std::fill(xPow_.begin(), xPow_.end(), 0.0f);
+    for (int32_t p = 0; p < partitions_; p++) {
+      const float *pr = &xRe_[p * bins_], *pi = &xIm_[p * bins_];
+      for (int32_t k = 0; k < bins_; k++) {
+        xPow_[k] += pr[k] * pr[k] + pi[k] * pi[k];
+      }
+    }
+  }
+
+  // echo estimate
+  std::fill(yRe_.begin(), yRe_.end(), 0.0f);
+  std::fill(yIm_.begin(), yIm_.end(), 0.0f);
+  for (int32_t p = 0; p < partitions_; p++) {
+    int32_t slot = (head_ - p + partitions_) % partitions_;
+    ComplexMulAcc(yRe_.data(), yIm_.data(), &wRe_[p * bins_],
+                  &wIm_[p * bins_], &xRe_[slot * bins_], &xIm_[slot * bins_],
+                  bins_);
+  }
+  fft_.inverse(yRe_.data(), yIm_.data(), fftOut_.data());
+
+  float micEnergy = 0.0f, errEnergy = 0.0f;
+  std::fill(fftIn_.begin(), fftIn_.begin() + B, 0.0f);
+  for (int32_t n = 0; n < B; n++) {
+    float e = mic[n] - fftOut_[B + n];
+    out[n] = e;
+    fftIn_[B + n] = e;
+    micEnergy += mic[n] * mic[n];
+    errEnergy += e * e;
+  }
+
+  // normalized gradient, shared by all partitions
+  fft_.forward(fftIn_.data(), eRe_.data(), eIm_.data());
+  float delta = kRegularization * 2 * B * partitions_;
+  for (int32_t k = 0; k < bins_; k++) {
+    float g = kStepSize / (xPow_[k] + delta);
+    eRe_[k] *= g;
+    eIm_[k] *= g;
+  }
+  for (int32_t p = 0; p < partitions_; p++) {
+    int32_t slot = (head_ - p + partitions_) % partitions_;
+    ComplexConjMulAcc(&wRe_[p * bins_], &wIm_[p * bins_], &xRe_[slot * bins_],
+                      &xIm_[slot * bins_], eRe_.data(), eIm_.data(), bins_);
+  }
+
+  float *cr = &wRe_[constrainIdx_ * bins_], *ci = &wIm_[constrainIdx_ * bins_];
+  fft_.inverse(cr, ci, fftOut_.data());
+  std::fill(fftOut_.begin() + B, fftOut_.end(), 0.0f);
+  fft_.forward(fftOut_.data(), cr, ci);
+  constrainIdx_ = (constrainIdx_ + 1) % partitions_;
+
+  micPow_ = kPowerSmoothing * micPow_ + (1.0f - kPowerSmoothing) * micEnergy;
+  errPow_ = kPowerSmoothing * errPow_ + (1.0f - kPowerSmoothing) * errEnergy;
+  if (micPow_ > 1e-9f && errPow_ > 1e-12f) {
+    erleDb_.store(10.0f * log10f(micPow_ / errPow_),
+                  std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_ECHO_CANCELLER_H
+#define NATIVE_AUDIO_ECHO_CANCELLER_H
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "audio_effect.h"
+#include "audio_common.h"
+#include "fft.h"
+
+/**
+ * Acoustic echo canceller: partitioned block frequency domain NLMS
+ * (overlap-save), mono.
+ *   - the reference is what the player hands to the device, fed through
+ *     pushReference() from the player thread into a lock-free ring
+ *   - process() runs on the capture thread: the mic (channel average) minus
+ *     the echo estimate is written back to every channel
+ * Internally the filter works on blocks of kBlockFrames with a 2x FFT, so
+ * kBlockFrames of latency are added whatever the device buffer size is.
+ * The filter covers partitions * kBlockFrames taps of echo path.
+ *
+ * The echo comes back as late as the output and input paths of the device
+ * make it, often later than the filter reaches. The reference is therefore
+ * held back by a bulk delay first, so that only the room is left for the
+ * filter. The delay is either set (setDelayMs()) or measured on the live
+ * streams: startDelayEstimate() has the capture thread collect the
+ * reference and the mic for a while, and getDelayEstimate() cross
+ * correlates them on the caller's thread, like the latency meter, and
+ * applies what it found.
+ */
+class EchoCanceller : public AudioFormat {
+ public:
+  static const int32_t kBlockFrames = 64;
+  static const int32_t kDefaultPartitions = 32;
+  static const int32_t kMaxDelayMs = 300;  // bulk delay of the reference
+
+  explicit EchoCanceller(int32_t sampleRate, int32_t channelCount,
+                         SLuint32 format, int32_t framesPerBuf,
+                         int32_t partitions = kDefaultPartitions);
+  ~EchoCanceller();
+
+  void setEnabled(bool enable);
+  bool isEnabled(void) const;
+  void reset(void);
+  void resync(void);
+  float getErleDb(void) const;
+
+  // any thread; the capture thread moves the reference on its next block
+  void setDelayMs(float delayMs);
+  float getDelayMs(void) const;
+  /*
+   * Measure the bulk delay from the next ~1 s the canceller runs on; the
+   * far end has to play meanwhile. getDelayEstimate() returns false until
+   * then, and afterwards the delay now in use and the confidence of the
+   * correlation peak: below the minimum, no echo was found and the delay
+   * was left as it was.
+   */
+  bool startDelayEstimate(void);
+  bool getDelayEstimate(float *delayMs, float *confidence);
+
+  void pushReference(const int16_t *played, int32_t numFrames);
+  void process(int16_t *liveAudio, int32_t numFrames);
+
+ private:
+  int32_t partitions_;
+  int32_t bins_;
+  RealFft fft_;
+
+  std::atomic<bool> enabled_;
+  std::atomic<bool> resetPending_;
+  std::atomic<bool> resyncPending_;
+  std::atomic<float> erleDb_;
+  std::atomic<int32_t> delayTarget_;  // frames
+
+  // bulk delay, capture thread: the delay in use, and how many more frames
+  // of reference the ring has to hold back for it (or, below 0, how many
+  // to drop)
+  int32_t maxDelayFrames_;
+  int32_t delayFrames_;
+  int32_t delayPending_;
+
+  // delay estimate: collected on the capture thread while RUNNING
+  enum EstimateState { IDLE = 0, RUNNING = 1, DONE = 2 };
+  std::atomic<int32_t> estimateState_;
+  std::atomic<bool> estimateRestart_;
+  int32_t estimateFrames_;
+  std::unique_ptr<float[]> estimateRef_;  // the reference as filtered
+  std::unique_ptr<float[]> estimateMic_;
+  int32_t estimateWritten_;
+  int32_t estimateDelay_;  // delayFrames_ during the collection
+  std::mutex estimateMutex_;
+  bool haveEstimate_;
+  float estimateConfidence_;
+
+  std::unique_ptr<RingBuffer<float>> refRing_;
+  std::vector<float> refScratch_;  // mono conversion on the player thread
+
+  // time domain blocks
+  std::vector<float> refPrev_;     // previous reference block
+  std::vector<float> fftIn_;       // 2 * kBlockFrames
+  std::vector<float> fftOut_;
+  std::vector<float> micFifo_;
+  int32_t micCount_;
+  std::vector<float> outFifo_;
+  int32_t outCount_;
+
+  // frequency domain state, split complex, partition after partition
+  std::vector<float> xRe_, xIm_;   // reference spectra delay line
+  std::vector<float> wRe_, wIm_;   // filter partitions
+  std::vector<float> xPow_;        // sum of |X|^2 over the delay line
+  std::vector<float> yRe_, yIm_, eRe_, eIm_;
+  int32_t head_;                   // newest partition in the delay line
+  int32_t constrainIdx_;           // partition constrained next
+  float micPow_;
+  float errPow_;
+
+  void clearState(void);
+  void clearStream(void);
+  void readReference(float *ref);
+  void collectEstimate(const float *ref, const float *mic);
+  void analyzeEstimate(void);
+  void processBlock(const float *mic, float *out);
+};
+
+#endif  // NATIVE_AUDIO_ECHO_CANCELLER_H
@@ -0,0 +1,371 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "equalizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "dsp_kernels.h"
+#include "pcm_convert.h"
+#include "trace.h"
+#ifdef DSP_USE_NEON
+#include <arm_neon.h>
+#endif
+
+static const uint32_t kMsPerSec = 1000;
+static const float kMinRampMs = 10.0f;
+static const float kMinFreqHz = 10.0f;
+static const float kMaxFreqRatio = 0.45f;  // of the sample rate
+static const float kMinQ = 0.1f;
+static const float kMaxQ = 20.0f;
+static const float kMaxGainDb = 24.0f;
+static const double kSilentDb = -90.0;
+// states below this are flushed to 0 instead of decaying into denormals
+static const float kDenormalGuard = 1e-20f;
+
+/**
+ * @param maxFrames frames converted to float at a time, the buffer size
+ */
+Equalizer::Equalizer(int32_t sampleRate, int32_t channelCount,
+                     SLuint32 format, uint32_t maxFrames)
+    : AudioFormat(sampleRate, channelCount, format), maxFrames_(maxFrames) {
+  assert(format_ == SL_PCMSAMPLEFORMAT_FIXED_16 &&
+         channelCount_ <= kMaxChannels);
+  // sampleRate_ is in milli Hz
+  minRampFrames_ = static_cast<uint32_t>(
+      kMinRampMs * (float)sampleRate_ / kMsPerSec / kMsPerSec + 0.5f);
+  work_ = new float[maxFrames_ * channelCount_];
+
+  const Coefs identity = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  for (int32_t i = 0; i < kEqMaxSections; i++) {
+    Section &sec = sections_[i];
+    memset(&sec, 0, sizeof(sec));
+    sec.type_ = EQ_TYPE_OFF;
+    sec.freqHz_ = 1000.0f;
+    sec.q_ = static_cast<float>(M_SQRT1_2);
+    sec.gainDb_ = 0.0f;
+    sec.cur_ = identity;
+    sec.target_ = identity;
+  }
+}
+
+Equalizer::~Equalizer() {
+  delete[] work_;
+}
+
+/**
+ * Queue a parameter change for the next process() call, offset frames into
+ * the buffer; an offset before the previous one's is moved up to it.
+ * @return false if the schedule is full or param is unknown
+ */
+bool Equalizer::schedule(int32_t param, float value, uint32_t offset,
+                         uint32_t rampFrames) {
+  if (param < 0 || param >= kEqMaxSections * EQ_SECTION_PARAMS ||
+      schedule_.isFull()) {
+    return false;
+  }
+  schedule_.add(param, value, offset, rampFrames);
+  return true;
+}
+
+/*
+ * For a buffer the effect does not process (bypassed, or skipped as
+ * silent): the scheduled changes take effect as if stamped past its end,
+ * so the schedule is free for the next buffer.
+ */
+void Equalizer::skipSchedule(void) {
+  for (int32_t i = 0; i < schedule_.size(); i++) {
+    setParam(schedule_[i]);
+  }
+  schedule_.clear();
+}
+
+/*
+ * The cascade rings at most as long as its sections together.
+ */
+uint32_t Equalizer::tailFrames(void) const {
+  uint32_t tail = 0;
+  for (int32_t i = 0; i < kEqMaxSections; i++) {
+    if (isActive(sections_[i])) {
+      tail += sections_[i].tail_;
+    }
+  }
+  return tail;
+}
+
+/*
+ * Coefficients for the section's parameters, from the Audio EQ Cookbook,
+ * and a ramp from the current ones towards them. The tail is the time the
+ * largest pole takes to decay by kSilentDb.
+ */
+void Equalizer::design(Section *sec, uint32_t rampFrames) {
+  double fs = sampleRate_ / 1000.0;
+  double b0 = 1.0, b1 = 0.0, b2 = 0.0, a0 = 1.0, a1 = 0.0, a2 = 0.0;
+  if (sec->type_ != EQ_TYPE_OFF) {
+    double freq = std::max(static_cast<double>(kMinFreqHz),
+                           std::min(static_cast<double>(sec->freqHz_),
+                                    kMaxFreqRatio * fs));
+    double w0 = 2.0 * M_PI * freq / fs;
+    double cosw = cos(w0);
+    double alpha = sin(w0) / (2.0 * sec->q_);
+    double A = pow(10.0, sec->gainDb_ / 40.0);
+    double shelf = 2.0 * sqrt(A) * alpha;
+    switch (sec->type_) {
+      case EQ_TYPE_LOW_SHELF:
+        b0 = A * ((A + 1) - (A - 1) * cosw + shelf);
+        b1 = 2 * A * ((A - 1) - (A + 1) * cosw);
+        b2 = A * ((A + 1) - (A - 1) * cosw - shelf);
+        a0 = (A + 1) + (A - 1) * cosw + shelf;
+        a1 = -2 * ((A - 1) + (A + 1) * cosw);
+        a2 = (A + 1) + (A - 1) * cosw - shelf;
+        break;
+      case EQ_TYPE_HIGH_SHELF:
+        b0 = A * ((A + 1) + (A - 1) * cosw + shelf);
+        b1 = -2 * A * ((A - 1) + (A + 1) * cosw);
+        b2 = A * ((A + 1) + (A - 1) * cosw - shelf);
+        a0 = (A + 1) - (A - 1) * cosw + shelf;
+        a1 = 2 * ((A - 1) - (A + 1) * cosw);
+        a2 = (A + 1) - (A - 1) * cosw - shelf;
+        break;
+      case EQ_TYPE_PEAK:
+        b0 = 1 + alpha * A;
+        b1 = -2 * cosw;
+        b2 = 1 - alpha * A;
+        a0 = 1 + alpha / A;
+        a1 = -2 * cosw;
+        a2 = 1 - alpha / A;
+        break;
+      case EQ_TYPE_HIGH_PASS:
+        b0 = (1 + cosw) / 2;
+        b1 = -(1 + cosw);
+        b2 = (1 + cosw) / 2;
+        a0 = 1 + alpha;
+        a1 = -2 * cosw;
+        a2 = 1 - alpha;
+        break;
+      case EQ_TYPE_LOW_PASS:
+        b0 = (1 - cosw) / 2;
+        b1 = 1 - cosw;
+        b2 = (1 - cosw) / 2;
+        a0 = 1 + alpha;
+        a1 = -2 * cosw;
+        a2 = 1 - alpha;
+        break;
+      default:
+        break;
+    }
+  }
+  Coefs &t = sec->target_;
+  t.b0_ = static_cast<float>(b0 / a0);
+  t.b1_ = static_cast<float>(b1 / a0);
+  t.b2_ = static_cast<float>(b2 / a0);
+  t.a1_ = static_cast<float>(a1 / a0);
+  t.a2_ = static_cast<float>(a2 / a0);
+
+  sec->tail_ = 0;
+  if (sec->type_ != EQ_TYPE_OFF) {
+    double p1 = -a1 / a0, p2 = a2 / a0;  // z^2 - p1 z + p2
+    double disc = p1 * p1 - 4 * p2;
+    double radius = disc < 0 ? sqrt(p2)
+                             : (fabs(p1) + sqrt(disc)) / 2;
+    double frames = fs;  // a second at most
+    if (radius < 1.0 && radius > 0.0) {
+      frames = std::min(frames, kSilentDb / 20.0 / log10(radius));
+    }
+    sec->tail_ = static_cast<uint32_t>(ceil(frames));
+  }
+
+  if (!memcmp(&sec->cur_, &sec->target_, sizeof(Coefs))) {
+    sec->rampLeft_ = 0;
+    return;
+  }
+  sec->rampLeft_ = std::max(rampFrames, minRampFrames_);
+  float n = static_cast<float>(sec->rampLeft_);
+  sec->step_.b0_ = (t.b0_ - sec->cur_.b0_) / n;
+  sec->step_.b1_ = (t.b1_ - sec->cur_.b1_) / n;
+  sec->step_.b2_ = (t.b2_ - sec->cur_.b2_) / n;
+  sec->step_.a1_ = (t.a1_ - sec->cur_.a1_) / n;
+  sec->step_.a2_ = (t.a2_ - sec->cur_.a2_) / n;
+}
+
+void Equalizer::setParam(const ParamEvent &event) {
+  Section *sec = &sections_[event.param_ / EQ_SECTION_PARAMS];
+  float value = event.value_;
+  switch (event.param_ % EQ_SECTION_PARAMS) {
+    case EQ_PARAM_TYPE:
+      sec->type_ = std::max(0, std::min(static_cast<int32_t>(lrintf(value)),
+                                        EQ_TYPE_COUNT - 1));
+      break;
+    case EQ_PARAM_FREQ_HZ:
+      sec->freqHz_ = std::max(kMinFreqHz, value);
+      break;
+    case EQ_PARAM_Q:
+      sec->q_ = std::max(kMinQ, std::min(value, kMaxQ));
+      break;
+    case EQ_PARAM_GAIN_DB:
+      sec->gainDb_ = std::max(-kMaxGainDb, std::min(value, kMaxGainDb));
+      break;
+    default:
+      break;
+  }
+  design(sec, event.rampFrames_);
+}
+
+/*
+ * Run the buffer in pieces between the scheduled parameter changes, so each
+ * one lands on its frame.
+ */
+void Equalizer::process(int16_t *liveAudio, int32_t numFrames) {
+  TRACE_SCOPE("Equalizer::process");
+  int32_t frame = 0;
+  int32_t next = 0;
+  while (frame < numFrames) {
+    while (next < schedule_.size() &&
+           schedule_[next].offset_ <= static_cast<uint32_t>(frame)) {
+      setParam(schedule_[next++]);
+    }
+    int32_t end = numFrames;
+    if (next < schedule_.size() &&
+        schedule_[next].offset_ < static_cast<uint32_t>(numFrames)) {
+      end = schedule_[next].offset_;
+    }
+    processFrames(liveAudio + frame * channelCount_, end - frame);
+    frame = end;
+  }
+  // anything stamped past this buffer takes effect from the next one
+  while (next < schedule_.size()) {
+    setParam(schedule_[next++]);
+  }
+  schedule_.clear();
+}
+
+/*
+ * Convert to float, run the active sections one after the other over the
+ * whole piece, convert back (rounded, saturated).
+ */
+void Equalizer::processFrames(int16_t *liveAudio, int32_t numFrames) {
+  bool active = false;
+  for (int32_t i = 0; i < kEqMaxSections; i++) {
+    active = active || isActive(sections_[i]);
+  }
+  if (!active) {
+    return;
+  }
+  while (numFrames > 0) {
+    int32_t frames = std::min(numFrames, static_cast<int32_t>(maxFrames_));
+    ConvertPcm(liveAudio, PCM_FORMAT_S16, PCM_LAYOUT_INTERLEAVED, work_,
+               PCM_FORMAT_FLOAT, PCM_LAYOUT_INTERLEAVED, frames, channelCount_,
+               nullptr);
+    for (int32_t i = 0; i < kEqMaxSections; i++) {
+      Section *sec = &sections_[i];
+      if (!isActive(*sec)) {
+        continue;
+      }
+      if (sec->rampLeft_) {
+        rampSection(sec, work_, frames);
+      } else {
+        runSection(sec, work_, frames);
+      }
+      for (int32_t ch = 0; ch < channelCount_; ch++) {
+        if (fabsf(sec->s1_[ch]) < kDenormalGuard) sec->s1_[ch] = 0.0f;
+        if (fabsf(sec->s2_[ch]) < kDenormalGuard) sec->s2_[ch] = 0.0f;
+      }
+      if (!isActive(*sec)) {
+        // faded out: start from silence when it comes back
+        memset(sec->s1_, 0, sizeof(sec->s1_));
+        memset(sec->s2_, 0, sizeof(sec->s2_));
+      }
+    }
+    ConvertPcm(work_, PCM_FORMAT_FLOAT, PCM_LAYOUT_INTERLEAVED, liveAudio,
+               PCM_FORMAT_S16, PCM_LAYOUT_INTERLEAVED, frames, channelCount_,
+               nullptr);
+    liveAudio += frames * channelCount_;
+    numFrames -= frames;
+  }
+}
+
+/*
+ * Transposed direct form II with fixed coefficients:
+ *   y = b0 x + s1,  s1 = b1 x - a1 y + s2,  s2 = b2 x - a2 y
+ * Stereo runs both channels in the lanes of a NEON vector.
+ */
+void Equalizer::runSection(Section *sec, float *samples, int32_t numFrames) {
+  const Coefs &c = sec->cur_;
+#ifdef DSP_USE_NEON
+  if (channelCount_ == 2) {
+    float32x2_t b0 = vdup_n_f32(c.b0_);
+    float32x2_t b1 = vdup_n_f32(c.b1_);
+    float32x2_t b2 = vdup_n_f32(c.b2_);
+    float32x2_t a1 = vdup_n_f32(c.a1_);
+    float32x2_t a2 = vdup_n_f32(c.a2_);
+    float32x2_t s1 = vld1_f32(sec->s1_);
+    float32x2_t s2 = vld1_f32(sec->s2_);
+    for (int32_t f = 0; f < numFrames; f++) {
+      float32x2_t x = vld1_f32(samples + 2 * f);
+      float32x2_t y = vmla_f32(s1, b0, x);
+      s1 = vadd_f32(vmls_f32(vmul_f32(b1, x), a1, y), s2);
+      s2 = vmls_f32(vmul_f32(b2, x), a2, y);
+      vst1_f32(samples + 2 * f, y);
+    }
+    vst1_f32(sec->s1_, s1);
+    vst1_f32(sec->s2_, s2);
+    return;
+  }
+#endif
+  for (int32_t ch = 0; ch < channelCount_; ch++) {
+    float s1 = sec->s1_[ch];
+    float s2 = sec->s2_[ch];
+    float *p = samples + ch;
+    for (int32_t f = 0; f < numFrames; f++, p += channelCount_) {
+      float x = *p;
+      float y = c.b0_ * x + s1;
+      s1 = c.b1_ * x - c.a1_ * y + s2;
+      s2 = c.b2_ * x - c.a2_ * y;
+      *p = y;
+    }
+    sec->s1_[ch] = s1;
+    sec->s2_[ch] = s2;
+  }
+}
+
+/*
+ * Same filter while the coefficients move towards the target, one step per
+ * frame; they land exactly on it when the ramp ends.
+ */
+void Equalizer::rampSection(Section *sec, float *samples, int32_t numFrames) {
+  Coefs &c = sec->cur_;
+  const Coefs &d = sec->step_;
+  for (int32_t f = 0; f < numFrames; f++) {
+    if (sec->rampLeft_) {
+      if (--sec->rampLeft_) {
+        c.b0_ += d.b0_;
+        c.b1_ += d.b1_;
+        c.b2_ += d.b2_;
+        c.a1_ += d.a1_;
+        c.a2_ += d.a2_;
+      } else {
+        c = sec->target_;
+      }
+    }
+    float *p = samples + f * channelCount_;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      float x = p[ch];
+      float y = c.b0_ * x + sec->s1_[ch];
+      sec->s1_[ch] = c.b1_ * x - c.a1_ * y + sec->s2_[ch];
+      sec->s2_[ch] = c.b2_ * x - c.a2_ * y;
+      p[ch] = y;
+    }
+  }
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_EQUALIZER_H
+#define NATIVE_AUDIO_EQUALIZER_H
+#include "audio_effect.h"
+
+/*
+ * Parametric equalizer: up to kEqMaxSections biquads in cascade, each one a
+ * shelf, peak, high-pass or low-pass designed from frequency, Q and gain
+ * (the Audio EQ Cookbook formulas).
+ *
+ * The sections run in float, transposed direct form II, on the buffer
+ * converted with ConvertPcm(). With two channels, left and right are the
+ * two lanes of a NEON vector. A new design is not applied at once: the
+ * coefficients move to it linearly over at least 10 ms (longer when the
+ * command ramps). Stable biquads form a convex set, so every step along
+ * the way is stable too. Sections which are off cost nothing, and with all
+ * of them off process() returns right away. Audio thread only, like
+ * AudioDelay.
+ */
+class Equalizer : public AudioFormat {
+ public:
+  explicit Equalizer(int32_t sampleRate, int32_t channelCount,
+                     SLuint32 format, uint32_t maxFrames);
+  ~Equalizer();
+
+  // section * EQ_SECTION_PARAMS + EQ_PARAM_*, offset frames into the next
+  // process()
+  bool schedule(int32_t param, float value, uint32_t offset,
+                uint32_t rampFrames);
+  bool isScheduleFull(void) const { return schedule_.isFull(); }
+  void skipSchedule(void);
+  // frames the output may still ring after the input went silent
+  uint32_t tailFrames(void) const;
+  void process(int16_t *liveAudio, int32_t numFrames);
+
+ private:
+  static const int32_t kMaxChannels = 2;
+
+  struct Coefs {
+    float b0_, b1_, b2_, a1_, a2_;  // a0 normalized to 1
+  };
+  struct Section {
+    int32_t type_;
+    float freqHz_;
+    float q_;
+    float gainDb_;
+    Coefs cur_;
+    Coefs target_;
+    Coefs step_;
+    uint32_t rampLeft_;
+    uint32_t tail_;  // frames for the target's impulse response to decay
+    float s1_[kMaxChannels];
+    float s2_[kMaxChannels];
+  };
+
+  Section sections_[kEqMaxSections];
+  uint32_t minRampFrames_;
+  uint32_t maxFrames_;
+  float *work_;  // maxFrames_ interleaved float frames
+  ParamSchedule schedule_;
+
+  void design(Section *sec, uint32_t rampFrames);
+  bool isActive(const Section &sec) const {
+    return sec.type_ != EQ_TYPE_OFF || sec.rampLeft_;
+  }
+  void setParam(const ParamEvent &event);
+  void processFrames(int16_t *liveAudio, int32_t numFrames);
+  void runSection(Section *sec, float *samples, int32_t numFrames);
+  void rampSection(Section *sec, float *samples, int32_t numFrames);
+};
+
+#endif  // NATIVE_AUDIO_EQUALIZER_H
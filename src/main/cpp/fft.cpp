@@ -0,0 +1,141 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cassert>
+#include <cmath>
+#include "fft.h"
+#include "dsp_kernels.h"
+#ifdef DSP_USE_NEON
+#include <arm_neon.h>
+#endif
+
+RealFft::RealFft(int32_t size) : n_(size), half_(size / 2) {
+  assert(size >= 8 && (size & (size - 1)) == 0);
+
+  int32_t bits = 0;
+  while ((1 << bits) < half_) bits++;
+  bitrev_.resize(half_);
+  for (int32_t i = 0; i < half_; i++) {
+    int32_t r = 0;
+    for (int32_t b = 0; b < bits; b++) {
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    bitrev_[i] = r;
+  }
+
+  // stage with butterfly span h uses e^(-i*pi*k/h), k < h; stored at h - 1
+  twRe_.resize(half_);
+  twIm_.resize(half_);
+  for (int32_t h = 1; h < half_; h <<= 1) {
+    for (int32_t k = 0; k < h; k++) {
+      double a = -M_PI * k / h;
+      twRe_[h - 1 + k] = static_cast<float>(cos(a));
+      twIm_[h - 1 + k] = static_cast<float>(sin(a));
+    }
+  }
+
+  splitRe_.resize(half_);
+  splitIm_.resize(half_);
+  for (int32_t k = 0; k < half_; k++) {
+    double a = -2.0 * M_PI * k / n_;
+    splitRe_[k] = static_cast<float>(cos(a));
+    splitIm_[k] = static_cast<float>(sin(a));
+  }
+  workRe_.resize(half_);
+  workIm_.resize(half_);
+}
+
+/*
+ * In place radix-2 decimation in time, input already bit reversed.
+ * Spans of 4 and more run four butterflies per NEON instruction.
+ */
+void RealFft::complexFft(float *re, float *im) {
+  for (int32_t h = 1; h < half_; h <<= 1) {
+    const float *wr = &twRe_[h - 1];
+    const float *wi = &twIm_[h - 1];
+    for (int32_t start = 0; start < half_; start += 2 * h) {
+      float *ar = re + start, *ai = im + start;
+      float *br = ar + h, *bi = ai + h;
+      int32_t k = 0;
+#ifdef DSP_USE_NEON
+      for (; k + 4 <= h; k += 4) {
+        float32x4_t vwr = vld1q_f32(wr + k), vwi = vld1q_f32(wi + k);
+        float32x4_t vbr = vld1q_f32(br + k), vbi = vld1q_f32(bi + k);
+        float32x4_t tr = vmlsq_f32(vmulq_f32(vbr, vwr), vbi, vwi);
+        float32x4_t ti = vmlaq_f32(vmulq_f32(vbr, vwi), vbi, vwr);
+        float32x4_t var = vld1q_f32(ar + k), vai = vld1q_f32(ai + k);
+        vst1q_f32(ar + k, vaddq_f32(var, tr));
+        vst1q_f32(ai + k, vaddq_f32(vai, ti));
+        vst1q_f32(br + k, vsubq_f32(var, tr));
+        vst1q_f32(bi + k, vsubq_f32(vai, ti));
+      }
+#endif
+      for (; k < h; k++) {
+        float tr = br[k] * wr[k] - bi[k] * wi[k];
+        float ti = br[k] * wi[k] + bi[k] * wr[k];
+        br[k] = ar[k] - tr;
+        bi[k] = ai[k] - ti;
+        ar[k] += tr;
+        ai[k] += ti;
+      }
+    }
+  }
+}
+
+void RealFft::forward(const float *in, float *re, float *im) {
+  // pack even/odd samples as one complex sequence of half the size
+  for (int32_t i = 0; i < half_; i++) {
+    workRe_[bitrev_[i]] = in[2 * i];
+    workIm_[bitrev_[i]] = in[2 * i + 1];
+  }
+  complexFft(workRe_.data(), workIm_.data());
+
+  // split: X[k] = E[k] + W^k * O[k]
+  re[0] = workRe_[0] + workIm_[0];
+  im[0] = 0.0f;
+  re[half_] = workRe_[0] - workIm_[0];
+  im[half_] = 0.0f;
+  for (int32_t k = 1; k < half_; k++) {
+    float zr = workRe_[k], zi = workIm_[k];
+    float cr = workRe_[half_ - k], ci = -workIm_[half_ - k];
+    float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+    float or_ = 0.5f * (zi - ci), oi = -0.5f * (zr - cr);
+    re[k] = er + splitRe_[k] * or_ - splitIm_[k] * oi;
+    im[k] = ei + splitRe_[k] * oi + splitIm_[k] * or_;
+  }
+}
+
+void RealFft::inverse(const float *re, const float *im, float *out) {
+  // merge: Z[k] = E[k] + i * O[k], with O[k] = (X[k] - X*[half-k]) W^-k / 2
+  for (int32_t k = 0; k < half_; k++) {
+    float xr = re[k], xi = im[k];
+    float cr = re[half_ - k], ci = -im[half_ - k];
+    float er = 0.5f * (xr + cr), ei = 0.5f * (xi + ci);
+    float dr = 0.5f * (xr - cr), di = 0.5f * (xi - ci);
+    float or_ = dr * splitRe_[k] + di * splitIm_[k];
+    float oi = di * splitRe_[k] - dr * splitIm_[k];
+    // inverse transform through the forward one: swap real and imaginary
+    int32_t j = bitrev_[k];
+    workIm_[j] = er - oi;
+    workRe_[j] = ei + or_;
+  }
+  complexFft(workRe_.data(), workIm_.data());
+
+  float scale = 1.0f / half_;
+  for (int32_t i = 0; i < half_; i++) {
+    out[2 * i] = workIm_[i] * scale;
+    out[2 * i + 1] = workRe_[i] * scale;
+  }
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_FFT_H
+#define NATIVE_AUDIO_FFT_H
+#include <cstdint>
+#include <vector>
+
+/**
+ * Real FFT of a power of two size, computed as a half size complex FFT
+ * plus a split step. Spectra are in split format: size/2+1 bins as separate
+ * real and imaginary arrays, which is what the NEON butterflies and the
+ * per-bin loops of the users want.
+ *
+ * forward() is unscaled, inverse() scales by 1/size. All tables and work
+ * memory are allocated in the constructor; forward()/inverse() do not
+ * allocate and can be called from the audio thread (one caller at a time).
+ */
+class RealFft {
+ public:
+  explicit RealFft(int32_t size);
+
+  int32_t size(void) const { return n_; }
+  int32_t bins(void) const { return half_ + 1; }
+
+  void forward(const float *in, float *re, float *im);
+  void inverse(const float *re, const float *im, float *out);
+
+ private:
+  int32_t n_;
+  int32_t half_;
+  std::vector<int32_t> bitrev_;
+  std::vector<float> twRe_;    // butterfly twiddles, stage after stage
+  std::vector<float> twIm_;
+  std::vector<float> splitRe_; // e^(-2*pi*i*k/n), k < half_
+  std::vector<float> splitIm_;
+  std::vector<float> workRe_;
+  std::vector<float> workIm_;
+
+  void complexFft(float *re, float *im);
+};
+
+#endif  // NATIVE_AUDIO_FFT_H
@@ -0,0 +1,448 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "flac_encoder.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+static const uint32_t kMaxFixedOrder = 4;
+static const uint32_t kMaxPartitionOrder = 8;
+static const uint32_t kMaxRiceParameter = 30;  // 5 bit parameters
+static const uint32_t kMaxRice4Parameter = 14; // 4 bit ones, 15 is escape
+static const uint32_t kSampleBits = 16;
+
+// channel assignments of the frame header, beyond n independent channels
+static const uint32_t kLeftSide = 8;
+static const uint32_t kRightSide = 9;
+static const uint32_t kMidSide = 10;
+
+/*
+ * Big endian bit packer, 32 bits at a time. The frame bound given by
+ * maxFrameBytes() is the only overflow check.
+ */
+class FlacBitWriter {
+ public:
+  explicit FlacBitWriter(uint8_t *out) : start_(out), pos_(out), acc_(0), bits_(0) {}
+
+  // value must fit in bits (<= 32)
+  void put(uint32_t value, uint32_t bits) {
+    acc_ = (acc_ << bits) | value;
+    bits_ += bits;
+    if (bits_ >= 32) {
+      bits_ -= 32;
+      uint32_t word = static_cast<uint32_t>(acc_ >> bits_);
+      pos_[0] = static_cast<uint8_t>(word >> 24);
+      pos_[1] = static_cast<uint8_t>(word >> 16);
+      pos_[2] = static_cast<uint8_t>(word >> 8);
+      pos_[3] = static_cast<uint8_t>(word);
+      pos_ += 4;
+    }
+  }
+  void putSigned(int32_t value, uint32_t bits) {
+    put(static_cast<uint32_t>(value) & (0xFFFFFFFFu >> (32 - bits)), bits);
+  }
+  // q zeros, a one, then the k low bits
+  void putRice(uint32_t folded, uint32_t k) {
+    uint32_t q = folded >> k;
+    while (q + 1 + k > 32) {
+      uint32_t zeros = std::min(q, 32u);
+      put(0, zeros);
+      q -= zeros;
+    }
+    put((1u << k) | (folded & ((1u << k) - 1)), q + 1 + k);
+  }
+  // pad with zeros to a byte boundary and flush everything
+  void align(void) {
+    if (bits_ & 7) {
+      put(0, 8 - (bits_ & 7));
+    }
+    while (bits_ >= 8) {
+      bits_ -= 8;
+      *pos_++ = static_cast<uint8_t>(acc_ >> bits_);
+    }
+  }
+  // bytes written; aligned writers only
+  size_t size(void) const { return pos_ - start_; }
+  const uint8_t *start(void) const { return start_; }
+
+ private:
+  uint8_t *start_;
+  uint8_t *pos_;
+  uint64_t acc_;
+  uint32_t bits_;  // pending in acc_, < 32 between calls
+};
+
+/*
+ * CRC-8 (x^8 + x^2 + x + 1) of frame headers and CRC-16 (x^16 + x^15 +
+ * x^2 + 1) of whole frames, both MSB first from 0
+ */
+struct FlacCrcTables {
+  uint8_t crc8_[256];
+  uint16_t crc16_[256];
+  FlacCrcTables() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c8 = i;
+      uint32_t c16 = i << 8;
+      for (uint32_t bit = 0; bit < 8; bit++) {
+        c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+        c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+      }
+      crc8_[i] = static_cast<uint8_t>(c8);
+      crc16_[i] = static_cast<uint16_t>(c16);
+    }
+  }
+};
+
+static const FlacCrcTables &CrcTables(void) {
+  static const FlacCrcTables tables;
+  return tables;
+}
+
+static uint8_t Crc8(const uint8_t *data, size_t size) {
+  const FlacCrcTables &tables = CrcTables();
+  uint8_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc = tables.crc8_[crc ^ data[i]];
+  }
+  return crc;
+}
+
+static uint16_t Crc16(const uint8_t *data, size_t size) {
+  const FlacCrcTables &tables = CrcTables();
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; i++) {
+    crc = static_cast<uint16_t>((crc << 8) ^ tables.crc16_[(crc >> 8) ^ data[i]]);
+  }
+  return crc;
+}
+
+/*
+ * Rice parameter with the smallest estimated cost, count * (k + 1) +
+ * (sum >> k), for count folded residuals adding up to sum
+ */
+static inline uint32_t RiceParameter(uint64_t sum, uint32_t count) {
+  uint32_t k = 0;
+  while (k < kMaxRiceParameter &&
+         (static_cast<uint64_t>(count) << (k + 1)) < sum) {
+    k++;
+  }
+  return k;
+}
+
+static inline uint64_t RiceBits(uint64_t sum, uint32_t count, uint32_t k) {
+  return static_cast<uint64_t>(count) * (k + 1) + (sum >> k);
+}
+
+// signed to unsigned, interleaving: 0, -1, 1, -2 ... to 0, 1, 2, 3 ...
+static inline uint32_t Fold(int32_t residual) {
+  return (static_cast<uint32_t>(residual) << 1) ^
+         static_cast<uint32_t>(residual >> 31);
+}
+
+FlacEncoder::FlacEncoder(uint16_t channels) : channels_(channels) {
+  CrcTables();
+  signal_.resize(channels_ == 2 ? 4 : channels_);
+  for (auto &signal : signal_) {
+    signal.resize(kMaxBlockFrames);
+  }
+  residual_.resize(kMaxBlockFrames);
+  partitionSums_.resize((2u << kMaxPartitionOrder) - 1);
+}
+
+/*
+ * A subframe never takes more than its verbatim form; side samples are 17
+ * bits. Frame header (at most 16 bytes) and footer on top.
+ */
+size_t FlacEncoder::maxFrameBytes(uint32_t frames) const {
+  return 16 + channels_ * (1 + (static_cast<size_t>(frames) * 17 + 7) / 8) + 2;
+}
+
+/*
+ * Pick the fixed predictor order for a channel: the one with the smallest
+ * sum of absolute residuals. Returns the estimated size of its subframe.
+ */
+uint64_t FlacEncoder::estimateBits(const int32_t *x, uint32_t frames,
+                                   uint32_t *order) const {
+  if (frames <= kMaxFixedOrder) {
+    *order = 0;
+    return static_cast<uint64_t>(frames) * (kSampleBits + 1);
+  }
+  uint64_t sum[kMaxFixedOrder + 1] = {0, 0, 0, 0, 0};
+  for (uint32_t i = kMaxFixedOrder; i < frames; i++) {
+    int32_t e0 = x[i];
+    int32_t e1 = e0 - x[i - 1];
+    int32_t e2 = e1 - (x[i - 1] - x[i - 2]);
+    int32_t e3 = e2 - (x[i - 1] - 2 * x[i - 2] + x[i - 3]);
+    int32_t e4 = e3 - (x[i - 1] - 3 * x[i - 2] + 3 * x[i - 3] - x[i - 4]);
+    sum[0] += std::abs(e0);
+    sum[1] += std::abs(e1);
+    sum[2] += std::abs(e2);
+    sum[3] += std::abs(e3);
+    sum[4] += std::abs(e4);
+  }
+  uint32_t best = 0;
+  for (uint32_t o = 1; o <= kMaxFixedOrder; o++) {
+    if (sum[o] < sum[best]) {
+      best = o;
+    }
+  }
+  *order = best;
+  // folding doubles the magnitudes
+  uint32_t count = frames - kMaxFixedOrder;
+  return RiceBits(2 * sum[best], count, RiceParameter(2 * sum[best], count)) +
+         best * (kSampleBits + 1);
+}
+
+void FlacEncoder::encodeSubframe(const int32_t *x, uint32_t frames,
+                                 uint32_t bps, uint32_t order,
+                                 FlacBitWriter *writer) {
+  // header: zero pad bit, 6 bit type, no wasted bits
+  if (std::all_of(x + 1, x + frames, [x](int32_t s) { return s == x[0]; })) {
+    writer->put(0x00, 8);
+    writer->putSigned(x[0], bps);
+    return;
+  }
+
+  int32_t *res = residual_.data();
+  switch (order) {
+    case 0:
+      std::copy(x, x + frames, res);
+      break;
+    case 1:
+      for (uint32_t i = 1; i < frames; i++) {
+        res[i - 1] = x[i] - x[i - 1];
+      }
+      break;
+    case 2:
+      for (uint32_t i = 2; i < frames; i++) {
+        res[i - 2] = x[i] - 2 * x[i - 1] + x[i - 2];
+      }
+      break;
+    case 3:
+      for (uint32_t i = 3; i < frames; i++) {
+        res[i - 3] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+      }
+      break;
+    default:
+      for (uint32_t i = 4; i < frames; i++) {
+        res[i - 4] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+      }
+      break;
+  }
+
+  // partition sums at the finest order the block allows, then merged
+  // pairwise down to a single partition; order p is at (1 << p) - 1
+  uint32_t maxOrder = 0;
+  while (maxOrder < kMaxPartitionOrder && !(frames & (1u << maxOrder)) &&
+         (frames >> (maxOrder + 1)) > order) {
+    maxOrder++;
+  }
+  uint64_t *sums = partitionSums_.data() + (1u << maxOrder) - 1;
+  uint32_t partSize = frames >> maxOrder;
+  const int32_t *r = res;
+  for (uint32_t p = 0; p < (1u << maxOrder); p++) {
+    uint32_t n = p ? partSize : partSize - order;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      sum += Fold(r[i]);
+    }
+    sums[p] = sum;
+    r += n;
+  }
+  for (uint32_t po = maxOrder; po > 0; po--) {
+    uint64_t *fine = partitionSums_.data() + (1u << po) - 1;
+    uint64_t *coarse = partitionSums_.data() + (1u << (po - 1)) - 1;
+    for (uint32_t p = 0; p < (1u << (po - 1)); p++) {
+      coarse[p] = fine[2 * p] + fine[2 * p + 1];
+    }
+  }
+  uint32_t bestOrder = 0;
+  uint64_t bestBits = ~0ull;
+  for (uint32_t po = 0; po <= maxOrder; po++) {
+    const uint64_t *level = partitionSums_.data() + (1u << po) - 1;
+    uint64_t bits = 0;
+    for (uint32_t p = 0; p < (1u << po); p++) {
+      uint32_t n = (frames >> po) - (p ? 0 : order);
+      bits += 5 + RiceBits(level[p], n, RiceParameter(level[p], n));
+    }
+    if (bits < bestBits) {
+      bestBits = bits;
+      bestOrder = po;
+    }
+  }
+
+  // exact size with the chosen parameters, against verbatim
+  const uint64_t *level = partitionSums_.data() + (1u << bestOrder) - 1;
+  uint32_t partitions = 1u << bestOrder;
+  uint32_t params[1u << kMaxPartitionOrder];
+  uint32_t paramBits = 4;
+  uint64_t bits = 8 + order * bps + 6;
+  r = res;
+  for (uint32_t p = 0; p < partitions; p++) {
+    uint32_t n = (frames >> bestOrder) - (p ? 0 : order);
+    uint32_t k = RiceParameter(level[p], n);
+    params[p] = k;
+    if (k > kMaxRice4Parameter) {
+      paramBits = 5;
+    }
+    bits += static_cast<uint64_t>(n) * (k + 1);
+    for (uint32_t i = 0; i < n; i++) {
+      bits += Fold(r[i]) >> k;
+    }
+    r += n;
+  }
+  bits += partitions * paramBits;
+  if (bits >= 8 + static_cast<uint64_t>(frames) * bps) {
+    writer->put(0x01 << 1, 8);
+    for (uint32_t i = 0; i < frames; i++) {
+      writer->putSigned(x[i], bps);
+    }
+    return;
+  }
+
+  writer->put((0x08 | order) << 1, 8);
+  for (uint32_t i = 0; i < order; i++) {
+    writer->putSigned(x[i], bps);
+  }
+  writer->put(paramBits == 5 ? 1 : 0, 2);
+  writer->put(bestOrder, 4);
+  r = res;
+  for (uint32_t p = 0; p < partitions; p++) {
+    uint32_t n = (frames >> bestOrder) - (p ? 0 : order);
+    writer->put(params[p], paramBits);
+    for (uint32_t i = 0; i < n; i++) {
+      writer->putRice(Fold(r[i]), params[p]);
+    }
+    r += n;
+  }
+}
+
+size_t FlacEncoder::encodeFrame(const int16_t *samples, uint32_t frames,
+                                uint32_t frameNumber, uint8_t *out) {
+  assert(frames > 0 && frames <= kMaxBlockFrames);
+  uint32_t assignment = channels_ - 1u;
+  uint32_t order[4] = {0, 0, 0, 0};
+  if (channels_ == 2) {
+    int32_t *left = signal_[0].data();
+    int32_t *right = signal_[1].data();
+    int32_t *mid = signal_[2].data();
+    int32_t *side = signal_[3].data();
+    for (uint32_t i = 0; i < frames; i++) {
+      left[i] = samples[2 * i];
+      right[i] = samples[2 * i + 1];
+      mid[i] = (left[i] + right[i]) >> 1;
+      side[i] = left[i] - right[i];
+    }
+    uint64_t bits[4];
+    for (uint32_t ch = 0; ch < 4; ch++) {
+      bits[ch] = estimateBits(signal_[ch].data(), frames, &order[ch]);
+    }
+    uint64_t best = bits[0] + bits[1];
+    if (bits[0] + bits[3] < best) {
+      best = bits[0] + bits[3];
+      assignment = kLeftSide;
+    }
+    if (bits[3] + bits[1] < best) {
+      best = bits[3] + bits[1];
+      assignment = kRightSide;
+    }
+    if (bits[2] + bits[3] < best) {
+      assignment = kMidSide;
+    }
+  } else {
+    for (uint32_t ch = 0; ch < channels_; ch++) {
+      int32_t *signal = signal_[ch].data();
+      for (uint32_t i = 0; i < frames; i++) {
+        signal[i] = samples[i * channels_ + ch];
+      }
+    }
+  }
+
+  // header: sync and fixed blocking, block size in 16 bits at the end,
+  // sample rate from STREAMINFO, 16 bit samples
+  FlacBitWriter writer(out);
+  writer.put(0xFFF8, 16);
+  writer.put(0x70, 8);
+  writer.put((assignment << 4) | (0x4 << 1), 8);
+  // the frame number, UTF-8 coded
+  if (frameNumber < 0x80) {
+    writer.put(frameNumber, 8);
+  } else {
+    uint32_t extra = frameNumber < 0x800 ? 1 : frameNumber < 0x10000 ? 2 :
+                     frameNumber < 0x200000 ? 3 : frameNumber < 0x4000000 ? 4 : 5;
+    uint32_t lead = (0xFF00u >> (extra + 1)) & 0xFF;
+    writer.put(lead | (frameNumber >> (6 * extra)), 8);
+    for (uint32_t i = extra; i > 0; i--) {
+      writer.put(0x80 | ((frameNumber >> (6 * (i - 1))) & 0x3F), 8);
+    }
+  }
+  writer.put(frames - 1, 16);
+  writer.align();
+  writer.put(Crc8(writer.start(), writer.size()), 8);
+
+  switch (assignment) {
+    case kLeftSide:
+      encodeSubframe(signal_[0].data(), frames, kSampleBits, order[0], &writer);
+      encodeSubframe(signal_[3].data(), frames, kSampleBits + 1, order[3], &writer);
+      break;
+    case kRightSide:
+      encodeSubframe(signal_[3].data(), frames, kSampleBits + 1, order[3], &writer);
+      encodeSubframe(signal_[1].data(), frames, kSampleBits, order[1], &writer);
+      break;
+    case kMidSide:
+      encodeSubframe(signal_[2].data(), frames, kSampleBits, order[2], &writer);
+      encodeSubframe(signal_[3].data(), frames, kSampleBits + 1, order[3], &writer);
+      break;
+    default:
+      for (uint32_t ch = 0; ch < channels_; ch++) {
+        uint32_t chOrder = order[ch];
+        if (channels_ != 2) {
+          estimateBits(signal_[ch].data(), frames, &chOrder);
+        }
+        encodeSubframe(signal_[ch].data(), frames, kSampleBits, chOrder, &writer);
+      }
+      break;
+  }
+
+  writer.align();
+  writer.put(Crc16(writer.start(), writer.size()), 16);
+  writer.align();
+  assert(writer.size() <= maxFrameBytes(frames));
+  return writer.size();
+}
+
+void FlacEncoder::writeStreamHeader(const FlacStreamInfo &info, uint8_t *out) {
+  FlacBitWriter writer(out);
+  writer.put(0x664C6143, 32);  // "fLaC"
+  // metadata block header: last block, STREAMINFO, 34 bytes
+  writer.put(0x80, 8);
+  writer.put(34, 24);
+  writer.put(info.blockFrames_, 16);
+  writer.put(info.blockFrames_, 16);
+  writer.put(info.minFrameBytes_ & 0xFFFFFF, 24);
+  writer.put(info.maxFrameBytes_ & 0xFFFFFF, 24);
+  writer.put(info.sampleRate_, 20);
+  writer.put(info.channels_ - 1u, 3);
+  writer.put(kSampleBits - 1, 5);
+  writer.put(static_cast<uint32_t>(info.totalFrames_ >> 32) & 0xF, 4);
+  writer.put(static_cast<uint32_t>(info.totalFrames_), 32);
+  for (uint32_t i = 0; i < 4; i++) {
+    writer.put(0, 32);  // MD5 not computed
+  }
+  writer.align();
+  assert(writer.size() == kStreamHeaderBytes);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_FLAC_ENCODER_H
+#define NATIVE_AUDIO_FLAC_ENCODER_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class FlacBitWriter;
+
+/*
+ * What the STREAMINFO block says about a stream. Zero frame sizes and a
+ * zero totalFrames_ mean "unknown", which is what a stream still being
+ * written carries.
+ */
+struct FlacStreamInfo {
+  uint32_t sampleRate_;     // Hz
+  uint16_t channels_;       // 1 .. 8
+  uint16_t blockFrames_;    // of every frame but the last
+  uint32_t minFrameBytes_;
+  uint32_t maxFrameBytes_;
+  uint64_t totalFrames_;
+};
+
+/*
+ * Minimal FLAC encoder for 16 bit PCM, tuned for speed over size (about
+ * what "flac -1" does):
+ *   - fixed blocking, one FLAC frame per call, up to kMaxBlockFrames
+ *   - per channel, the fixed polynomial predictor of order 0 .. 4 with the
+ *     smallest residual; constant and verbatim subframes where they win
+ *   - stereo as left/right, left/side, right/side or mid/side, whichever
+ *     the residuals say is cheapest
+ *   - residuals Rice coded, with the partition order (0 .. 8) and the
+ *     parameter of each partition chosen from their estimated cost
+ * The output decodes with any FLAC decoder. No LPC, no MD5 (left zero, "not
+ * computed"). All work memory is allocated in the constructor; one caller
+ * at a time.
+ */
+class FlacEncoder {
+ public:
+  static const uint32_t kMaxBlockFrames = 4096;
+  static const uint32_t kStreamHeaderBytes = 42;  // "fLaC" and STREAMINFO
+
+  explicit FlacEncoder(uint16_t channels);
+
+  /*
+   * Upper bound of what encodeFrame() writes for the given frames
+   */
+  size_t maxFrameBytes(uint32_t frames) const;
+
+  /*
+   * Encode frames (1 .. kMaxBlockFrames) of interleaved samples as frame
+   * number frameNumber of the stream, into out; returns the bytes written.
+   */
+  size_t encodeFrame(const int16_t *samples, uint32_t frames,
+                     uint32_t frameNumber, uint8_t *out);
+
+  /*
+   * The kStreamHeaderBytes a FLAC file starts with
+   */
+  static void writeStreamHeader(const FlacStreamInfo &info, uint8_t *out);
+
+ private:
+  uint16_t channels_;
+  // the block per channel, deinterleaved; for stereo left, right, mid
+  // and side, which needs 17 bits
+  std::vector<std::vector<int32_t>> signal_;
+  std::vector<int32_t> residual_;
+  std::vector<uint64_t> partitionSums_;  // every partition order, 0 first
+
+  uint64_t estimateBits(const int32_t *signal, uint32_t frames,
+                        uint32_t *order) const;
+  void encodeSubframe(const int32_t *signal, uint32_t frames, uint32_t bps,
+                      uint32_t order, FlacBitWriter *writer);
+};
+
+#endif  // NATIVE_AUDIO_FLAC_ENCODER_H
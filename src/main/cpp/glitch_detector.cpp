@@ -0,0 +1,197 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "glitch_detector.h"
+
+static const int32_t kFullScale = 32767;
+static const int32_t kAudibleLevel = 328;   // -40 dBFS
+static const int32_t kMinJump = 2048;       // -24 dBFS
+static const int32_t kJumpRatio = 8;        // against the mean |2nd diff|
+static const int32_t kMinZeroRunFrames = 16;
+
+GlitchDetector::GlitchDetector(SLmilliHertz sampleRate, uint16_t channels)
+    : channels_(channels), enabled_(false), dropped_(0) {
+  assert(channels_ && channels_ <= kMaxChannels);
+  minZeroRun_ = std::max<uint32_t>(sampleRate / 1000 / 1000, kMinZeroRunFrames);
+  memset(state_, 0, sizeof(state_));
+  for (uint32_t i = 0; i < PCM_TAP_POINT_COUNT; i++) {
+    resetPending_[i].store(false);
+    events_[i].reset(new RingBuffer<GlitchEvent>(kEventsPerPoint));
+  }
+  for (uint32_t i = 0; i < GLITCH_TYPE_COUNT; i++) {
+    counts_[i].store(0);
+  }
+}
+
+GlitchDetector::~GlitchDetector() {}
+
+void GlitchDetector::setEnabled(bool enable) {
+  if (enable && !enabled_.load()) {
+    // nothing seen while disabled may be compared against
+    reset();
+  }
+  enabled_.store(enable);
+}
+
+bool GlitchDetector::isEnabled(void) const { return enabled_.load(); }
+
+/*
+ * The per point state belongs to the audio threads: it is cleared by the
+ * next analyze() of each point. Counters are cleared right away.
+ */
+void GlitchDetector::reset(void) {
+  for (uint32_t i = 0; i < PCM_TAP_POINT_COUNT; i++) {
+    resetPending_[i].store(true, std::memory_order_release);
+  }
+  for (uint32_t i = 0; i < GLITCH_TYPE_COUNT; i++) {
+    counts_[i].store(0, std::memory_order_relaxed);
+  }
+  dropped_.store(0, std::memory_order_relaxed);
+}
+
+void GlitchDetector::report(PcmTapPoint point, GlitchType type,
+                            uint64_t framePos, int32_t value) {
+  GlitchEvent event;
+  event.time_ = GetMonotonicNanos();
+  event.framePos_ = framePos;
+  event.point_ = point;
+  event.type_ = type;
+  event.value_ = value;
+  counts_[type].fetch_add(1, std::memory_order_relaxed);
+  if (events_[point]->write(&event, 1) != 1) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void GlitchDetector::analyze(PcmTapPoint point, const sample_buf *buf,
+                             uint32_t frames) {
+  if (!enabled_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  PointState &st = state_[point];
+  if (resetPending_[point].exchange(false, std::memory_order_acquire)) {
+    memset(&st, 0, sizeof(st));
+  }
+
+  // only recorded buffers carry a sequence number (silence fill does not)
+  if (point == PCM_TAP_PLAYER && buf->captureTime_) {
+    int32_t missing = static_cast<int32_t>(buf->seq_ - st.expectedSeq_);
+    if (st.seqValid_ && missing > 0) {
+      report(point, GLITCH_SEQUENCE_GAP, buf->framePos_, missing);
+    }
+    st.expectedSeq_ = buf->seq_ + 1;
+    st.seqValid_ = true;
+  }
+  if (!frames) {
+    return;
+  }
+
+  const int16_t *samples = reinterpret_cast<const int16_t *>(buf->buf_);
+  const uint32_t ch = channels_;
+
+  int32_t jump = 0;
+  if (st.primed_) {
+    for (uint32_t c = 0; c < ch; c++) {
+      int32_t predicted = 2 * st.prev1_[c] - st.prev2_[c];
+      jump = std::max(jump, abs(samples[c] - predicted));
+    }
+  }
+
+  int64_t sumD2 = 0;
+  for (uint32_t f = 0; f < frames; f++) {
+    const int16_t *frame = samples + f * ch;
+    int32_t frameAbs = 0;
+    for (uint32_t c = 0; c < ch; c++) {
+      frameAbs = std::max(frameAbs, abs(frame[c]));
+    }
+    if (f >= 2) {
+      const int16_t *prev1 = frame - ch;
+      const int16_t *prev2 = prev1 - ch;
+      for (uint32_t c = 0; c < ch; c++) {
+        sumD2 += abs(frame[c] - 2 * prev1[c] + prev2[c]);
+      }
+    }
+
+    if (frameAbs == 0) {
+      if (!st.zeroRun_) st.preRunLevel_ = st.level_;
+      st.zeroRun_++;
+    } else {
+      if (st.zeroRun_ >= minZeroRun_ && st.preRunLevel_ >= kAudibleLevel) {
+        report(point, GLITCH_ZERO_RUN, buf->framePos_ + f - st.zeroRun_,
+               static_cast<int32_t>(st.zeroRun_));
+      }
+      st.zeroRun_ = 0;
+    }
+
+    if (frameAbs >= kFullScale) {
+      if (++st.clipRun_ == kClipBurstFrames) {
+        report(point, GLITCH_CLIPPING, buf->framePos_ + f + 1 - kClipBurstFrames,
+               kClipBurstFrames);
+      }
+    } else {
+      st.clipRun_ = 0;
+    }
+
+    // peak envelope with a 256 frame decay
+    if (frameAbs >= st.level_) {
+      st.level_ = frameAbs;
+    } else {
+      st.level_ = std::max(0, st.level_ - (st.level_ >> 8) - 1);
+    }
+  }
+
+  int32_t meanD2 = st.meanD2_;
+  if (frames > 2) {
+    meanD2 = static_cast<int32_t>(sumD2 / ((frames - 2) * ch));
+  }
+  if (st.primed_ &&
+      jump > std::max(kMinJump, kJumpRatio * std::max(meanD2, st.meanD2_))) {
+    report(point, GLITCH_DISCONTINUITY, buf->framePos_, jump);
+  }
+
+  for (uint32_t c = 0; c < ch; c++) {
+    st.prev2_[c] = frames > 1 ? samples[(frames - 2) * ch + c] : st.prev1_[c];
+    st.prev1_[c] = samples[(frames - 1) * ch + c];
+  }
+  st.meanD2_ = meanD2;
+  st.primed_ = true;
+}
+
+/*
+ * Collect pending events of all points, oldest first.
+ */
+uint32_t GlitchDetector::getEvents(GlitchEvent *events, uint32_t maxCount) {
+  std::lock_guard<std::mutex> lock(readMutex_);
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < PCM_TAP_POINT_COUNT && count < maxCount; i++) {
+    count += events_[i]->read(events + count, maxCount - count);
+  }
+  std::sort(events, events + count,
+            [](const GlitchEvent &a, const GlitchEvent &b) {
+              return a.time_ < b.time_;
+            });
+  return count;
+}
+
+uint64_t GlitchDetector::getCount(GlitchType type) const {
+  return counts_[type].load(std::memory_order_relaxed);
+}
+
+uint64_t GlitchDetector::getDropped(void) const {
+  return dropped_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_GLITCH_DETECTOR_H
+#define NATIVE_AUDIO_GLITCH_DETECTOR_H
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "audio_common.h"
+#include "pcm_tap.h"
+
+enum GlitchType {
+  GLITCH_DISCONTINUITY = 0,  // jump at a buffer boundary
+  GLITCH_ZERO_RUN = 1,       // dropout: exact zeros inside audible audio
+  GLITCH_CLIPPING = 2,       // run of full scale samples
+  GLITCH_SEQUENCE_GAP = 3,   // recorded buffers missing at the player
+  GLITCH_TYPE_COUNT
+};
+
+struct GlitchEvent {
+  int64_t time_;       // CLOCK_MONOTONIC ns of the detection
+  uint64_t framePos_;  // stream position (recorder frames) of the glitch
+  int32_t point_;      // PcmTapPoint the audio was analyzed at
+  int32_t type_;       // GlitchType
+  int32_t value_;      // jump size, run length in frames or buffers lost
+};
+
+/*
+ * Real time glitch analysis at the same pipeline points the PCM taps use.
+ *
+ * analyze() makes a single integer pass over a buffer and keeps a little
+ * state per point between buffers, so runs and jumps spanning buffers are
+ * caught too:
+ *   - discontinuity: the first frame of a buffer is compared with a linear
+ *     prediction from the end of the previous one; the error has to be
+ *     large in absolute terms and against the buffers' own average second
+ *     difference, so loud high frequency content does not trigger it
+ *   - zero run: at least ~1 ms of exact zero frames right after audible
+ *     audio (a gate fading out does not count, an abrupt dropout does)
+ *   - clipping: kClipBurstFrames consecutive frames at full scale
+ *   - sequence gap (player point only): recorded buffers skipped
+ * Events go to a lock-free ring per point (one audio thread each) and are
+ * collected by getEvents(); running totals per type are kept as well.
+ */
+class GlitchDetector {
+ public:
+  static const uint32_t kEventsPerPoint = 64;
+  static const uint32_t kMaxChannels = 8;
+  static const int32_t kClipBurstFrames = 8;
+
+  explicit GlitchDetector(SLmilliHertz sampleRate, uint16_t channels);
+  ~GlitchDetector();
+
+  void setEnabled(bool enable);
+  bool isEnabled(void) const;
+  void reset(void);
+
+  void analyze(PcmTapPoint point, const sample_buf *buf, uint32_t frames);
+
+  uint32_t getEvents(GlitchEvent *events, uint32_t maxCount);
+  uint64_t getCount(GlitchType type) const;
+  uint64_t getDropped(void) const;
+
+ private:
+  struct PointState {
+    bool primed_;                  // prev samples below are valid
+    int32_t prev1_[kMaxChannels];  // last sample of the previous buffer
+    int32_t prev2_[kMaxChannels];  // the one before
+    int32_t meanD2_;               // average |2nd difference|, last buffer
+    int32_t level_;                // peak envelope, ~5 ms decay
+    int32_t preRunLevel_;          // envelope when the zero run started
+    uint32_t zeroRun_;             // zero frames so far
+    uint32_t clipRun_;             // full scale frames so far
+    bool seqValid_;
+    uint32_t expectedSeq_;
+  };
+
+  uint16_t channels_;
+  uint32_t minZeroRun_;  // frames
+  std::atomic<bool> enabled_;
+  std::atomic<bool> resetPending_[PCM_TAP_POINT_COUNT];
+  PointState state_[PCM_TAP_POINT_COUNT];
+  std::unique_ptr<RingBuffer<GlitchEvent>> events_[PCM_TAP_POINT_COUNT];
+  std::atomic<uint64_t> counts_[GLITCH_TYPE_COUNT];
+  std::atomic<uint64_t> dropped_;
+  std::mutex readMutex_;  // getEvents() is the single consumer
+
+  void report(PcmTapPoint point, GlitchType type, uint64_t framePos,
+              int32_t value);
+};
+
+#endif  // NATIVE_AUDIO_GLITCH_DETECTOR_H
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "input_conditioner.h"
+#include "audio_common.h"
+#include "dsp_kernels.h"
+#include <algorithm>
+#include <cmath>
+
+static const uint32_t kMsPerSec = 1000;
+static const float kDcCutoffHz = 20.0f;
+static const int16_t kUnityGainQ15 = 32767;
+
+// defaults: gate at -60 dBFS, fast attack, long enough hold for speech pauses
+static const float kDefaultGateThresholdDb = -60.0f;
+static const float kDefaultAttackMs = 1.0f;
+static const float kDefaultHoldMs = 50.0f;
+static const float kDefaultReleaseMs = 100.0f;
+
+/**
+ * Constructor for InputConditioner
+ * @param sampleRate in milli Hz (as OpenSL SLmilliHertz)
+ * @param channelCount
+ * @param format
+ */
+InputConditioner::InputConditioner(int32_t sampleRate, int32_t channelCount,
+                                   SLuint32 format)
+    : AudioFormat(sampleRate, channelCount, format) {
+  assert(channelCount_ <= kMaxChannels && format_ == SL_PCMSAMPLEFORMAT_FIXED_16);
+  float fs = (float)sampleRate_ / kMsPerSec;
+  float r = 1.0f - 2.0f * (float)M_PI * kDcCutoffHz / fs;
+  dcCoeff_ = static_cast<int32_t>(r * 32768.0f + 0.5f);
+  setParam(CONDITIONER_PARAM_GATE_THRESHOLD_DB, kDefaultGateThresholdDb);
+  setParam(CONDITIONER_PARAM_ATTACK_MS, kDefaultAttackMs);
+  setParam(CONDITIONER_PARAM_HOLD_MS, kDefaultHoldMs);
+  setParam(CONDITIONER_PARAM_RELEASE_MS, kDefaultReleaseMs);
+  gain_ = kUnityGainQ15;
+}
+
+InputConditioner::~InputConditioner() {}
+
+/**
+ * Range check of a gate configuration, for the control threads
+ * @param thresholdDb block peak (dBFS) opening the gate; it closes 6 dB lower
+ * @param attackMs time to ramp from closed to fully open
+ * @param holdMs time the gate stays open after the signal fell below
+ * @param releaseMs time to ramp from fully open to closed
+ */
+bool InputConditioner::isValidGate(float thresholdDb, float attackMs,
+                                   float holdMs, float releaseMs) {
+  return thresholdDb <= 0.0f && attackMs >= 0.0f && holdMs >= 0.0f &&
+         releaseMs >= 0.0f;
+}
+
+int32_t InputConditioner::msToFrames(float ms) const {
+  float framesPerMs = (float)sampleRate_ / kMsPerSec / kMsPerSec;
+  return static_cast<int32_t>(std::max(ms, 0.0f) * framesPerMs + 0.5f);
+}
+
+void InputConditioner::setParam(int32_t param, float value) {
+  switch (param) {
+    case CONDITIONER_PARAM_DC_BLOCK:
+      if (value != 0.0f && !dcEnabled_) {
+        memset(dcPrevIn_, 0, sizeof(dcPrevIn_));
+        memset(dcPrevOut_, 0, sizeof(dcPrevOut_));
+      }
+      dcEnabled_ = value != 0.0f;
+      break;
+    case CONDITIONER_PARAM_GATE:
+      gateEnabled_ = value != 0.0f;
+      if (!gateEnabled_) {
+        gain_ = kUnityGainQ15;
+        gateOpen_ = false;
+        holdLeft_ = 0;
+      }
+      break;
+    case CONDITIONER_PARAM_GATE_THRESHOLD_DB: {
+      float open = 32767.0f * powf(10.0f, std::min(value, 0.0f) / 20.0f);
+      gateOpenLevel_ = static_cast<int16_t>(open + 0.5f);
+      gateCloseLevel_ = static_cast<int16_t>(open * 0.5f + 0.5f);
+      break;
+    }
+    case CONDITIONER_PARAM_ATTACK_MS:
+      attackFrames_ = msToFrames(value);
+      break;
+    case CONDITIONER_PARAM_HOLD_MS:
+      holdFrames_ = msToFrames(value);
+      break;
+    case CONDITIONER_PARAM_RELEASE_MS:
+      releaseFrames_ = msToFrames(value);
+      break;
+    default:
+      break;
+  }
+}
+
+void InputConditioner::process(int16_t *liveAudio, int32_t numFrames) {
+  if (dcEnabled_) {
+    dcBlock(liveAudio, numFrames);
+  }
+  if (gateEnabled_) {
+    gate(liveAudio, numFrames);
+  }
+}
+
+/*
+ * The output is kept with 15 extra fractional bits, so the filter does not
+ * get stuck on a truncation limit cycle; DcBlockS16() runs the channels
+ * side by side.
+ */
+void InputConditioner::dcBlock(int16_t *liveAudio, int32_t numFrames) {
+  DcBlockS16(liveAudio, numFrames, channelCount_, dcCoeff_, dcPrevIn_,
+             dcPrevOut_);
+}
+
+/*
+ * Gate state advances once per block from the block peak: above the open
+ * level (re)starts the hold, between the close and open levels extends an
+ * open gate, below the close level lets the hold run out. The gain then
+ * moves towards open/closed at the attack/release rate and is ramped
+ * across the block. A fully open gate leaves the audio untouched.
+ */
+void InputConditioner::gate(int16_t *liveAudio, int32_t numFrames) {
+  int16_t peak = PeakAbsS16(liveAudio, numFrames * channelCount_);
+  // a block is open while it has signal, and for as long after as the hold
+  // lasts: a hold shorter than a block keeps just the next block open, no
+  // hold none
+  if (peak >= gateOpenLevel_ || (peak >= gateCloseLevel_ && gateOpen_)) {
+    gateOpen_ = true;
+    holdLeft_ = holdFrames_;
+  } else if (holdLeft_ > 0) {
+    holdLeft_ = holdLeft_ > numFrames ? holdLeft_ - numFrames : 0;
+  } else {
+    gateOpen_ = false;
+  }
+
+  int32_t target = gateOpen_ ? kUnityGainQ15 : 0;
+  int32_t gain = gain_;
+  if (target > gain) {
+    gain = attackFrames_ ? gain + kUnityGainQ15 * numFrames / attackFrames_
+                         : target;
+    if (gain > target) gain = target;
+  } else if (target < gain) {
+    gain = releaseFrames_ ? gain - kUnityGainQ15 * numFrames / releaseFrames_
+                          : target;
+    if (gain < target) gain = target;
+  }
+
+  if (gain_ != kUnityGainQ15 || gain != kUnityGainQ15) {
+    ApplyGainRampS16(liveAudio, numFrames, channelCount_, gain_,
+                     static_cast<int16_t>(gain));
+  }
+  gain_ = static_cast<int16_t>(gain);
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_INPUT_CONDITIONER_H
+#define NATIVE_AUDIO_INPUT_CONDITIONER_H
+#include "audio_effect.h"
+#include "control_queue.h"
+
+/**
+ * Capture conditioning, run before the effects:
+ *   - one-pole DC blocking high-pass: y[n] = x[n] - x[n-1] + R * y[n-1]
+ *   - noise gate with attack/hold/release; the envelope is the block peak,
+ *     the gain ramps linearly across each block
+ * Everything is in fixed point (Q15 coefficients and gains). Parameters
+ * (CONDITIONER_PARAM_*) come through the control queue: setParam() and
+ * process() are both for the audio thread.
+ */
+class InputConditioner : public AudioFormat {
+ public:
+  explicit InputConditioner(int32_t sampleRate, int32_t channelCount,
+                            SLuint32 format);
+  ~InputConditioner();
+
+  static bool isValidGate(float thresholdDb, float attackMs, float holdMs,
+                          float releaseMs);
+  void setParam(int32_t param, float value);
+  void process(int16_t *liveAudio, int32_t numFrames);
+
+ private:
+  static const int32_t kMaxChannels = 2;
+
+  bool dcEnabled_ = true;
+  int32_t dcCoeff_;                       // R in Q15
+  int16_t dcPrevIn_[kMaxChannels] = {};
+  int64_t dcPrevOut_[kMaxChannels] = {};  // y scaled by 2^15
+
+  bool gateEnabled_ = true;
+  int16_t gateOpenLevel_;    // block peak opening the gate
+  int16_t gateCloseLevel_;   // block peak under which hold starts
+  int32_t attackFrames_;
+  int32_t holdFrames_;
+  int32_t releaseFrames_;
+  bool gateOpen_ = false;    // gain heading for unity
+  int32_t holdLeft_ = 0;     // frames of hold remaining
+  int16_t gain_ = 0;         // current gain, Q15
+
+  int32_t msToFrames(float ms) const;
+  void dcBlock(int16_t *liveAudio, int32_t numFrames);
+  void gate(int16_t *liveAudio, int32_t numFrames);
+};
+
+#endif  // NATIVE_AUDIO_INPUT_CONDITIONER_H
@@ -22,31 +22,255 @@
 extern "C" {
 #endif
 
-JNIEXPORT void JNICALL Java_com_google_sample_echo_MainActivity_createSLEngine(
+JNIEXPORT jlong JNICALL Java_com_google_sample_echo_MainActivity_createSLEngine(
     JNIEnv *env, jclass, jint, jint, jlong delayRInMs,jlong delayLInMs);                                              //, jfloat decay
 JNIEXPORT void JNICALL Java_com_google_sample_echo_MainActivity_deleteSLEngine(
-    JNIEnv *env, jclass type);
+    JNIEnv *env, jclass type, jlong engineHandle);
 JNIEXPORT jboolean JNICALL
 Java_com_google_sample_echo_MainActivity_createSLBufferQueueAudioPlayer(
-    JNIEnv *env, jclass);
+    JNIEnv *env, jclass, jlong engineHandle);
 JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_deleteSLBufferQueueAudioPlayer(
-    JNIEnv *env, jclass type);
+    JNIEnv *env, jclass type, jlong engineHandle);
 
 JNIEXPORT jboolean JNICALL
 Java_com_google_sample_echo_MainActivity_createAudioRecorder(JNIEnv *env,
-                                                             jclass type);
+                                                             jclass type,
+                                                             jlong engineHandle);
 JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_deleteAudioRecorder(JNIEnv *env,
-                                                             jclass type);
+                                                             jclass type,
+                                                             jlong engineHandle);
 JNIEXPORT void JNICALL
-Java_com_google_sample_echo_MainActivity_startPlay(JNIEnv *env, jclass type);
+Java_com_google_sample_echo_MainActivity_startPlay(JNIEnv *env, jclass type,
+                                                   jlong engineHandle);
 JNIEXPORT void JNICALL
-Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type);
+Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type,
+                                                  jlong engineHandle);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_pausePlay(JNIEnv *env, jclass type,
+                                                   jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_resumePlay(JNIEnv *env, jclass type,
+                                                    jlong engineHandle);
 JNIEXPORT jboolean JNICALL
 Java_com_google_sample_echo_MainActivity_configureEcho(JNIEnv *env, jclass type,
+                                                       jlong engineHandle,
                                                        jint delayLInMs,jint delayRInMs
                                                        );
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configurePitchShift(JNIEnv *env,
+                                                             jclass type,
+                                                             jlong engineHandle,
+                                                             jfloat semitones,
+                                                             jfloat cents,
+                                                             jfloat mix);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configureEqSection(JNIEnv *env,
+                                                            jclass type,
+                                                            jlong engineHandle,
+                                                            jint section,
+                                                            jint eqType,
+                                                            jfloat freqHz,
+                                                            jfloat q,
+                                                            jfloat gainDb,
+                                                            jint rampFrames);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configureDynamics(
+    JNIEnv *env, jclass type, jlong engineHandle, jint placement,
+    jfloat thresholdDb, jfloat ratio, jfloat kneeDb, jfloat attackMs,
+    jfloat releaseMs, jfloat makeupDb, jfloat ceilingDb, jfloat limitReleaseMs);
+JNIEXPORT jfloatArray JNICALL
+Java_com_google_sample_echo_MainActivity_getDynamicsMeter(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_renderFile(JNIEnv *env, jclass type,
+                                                    jlong engineHandle,
+                                                    jstring inPath,
+                                                    jstring outPath);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_setRecorderOverflowPolicy(
+    JNIEnv *env, jclass type, jlong engineHandle, jint policy);
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getRecorderOverflowStats(
+    JNIEnv *env, jclass type, jlong engineHandle);
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getPlayerStreamStats(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configureInputConditioner(
+    JNIEnv *env, jclass type, jlong engineHandle, jboolean dcBlock,
+    jboolean gate, jfloat gateThresholdDb, jfloat attackMs, jfloat holdMs,
+    jfloat releaseMs);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_enableEchoCanceller(JNIEnv *env,
+                                                             jclass type,
+                                                             jlong engineHandle,
+                                                             jboolean enable);
+JNIEXPORT jfloat JNICALL
+Java_com_google_sample_echo_MainActivity_getEchoCancellerErle(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_setEchoCancellerDelay(
+    JNIEnv *env, jclass type, jlong engineHandle, jfloat delayMs);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startEchoDelayEstimate(
+    JNIEnv *env, jclass type, jlong engineHandle);
+JNIEXPORT jfloatArray JNICALL
+Java_com_google_sample_echo_MainActivity_getEchoDelayEstimate(
+    JNIEnv *env, jclass type, jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startPcmTap(JNIEnv *env, jclass type,
+                                                     jlong engineHandle,
+                                                     jstring pathPrefix,
+                                                     jint pointMask,
+                                                     jint maxSeconds);
+JNIEXPORT jlong JNICALL
+Java_com_google_sample_echo_MainActivity_stopPcmTap(JNIEnv *env, jclass type,
+                                                    jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startSessionRecording(JNIEnv *env,
+                                                               jclass type,
+                                                               jlong engineHandle,
+                                                               jstring pathPrefix,
+                                                               jint streamMask);
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getSessionRecordingStats(
+    JNIEnv *env, jclass type, jlong engineHandle);
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_stopSessionRecording(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startSpectrum(JNIEnv *env, jclass type,
+                                                       jlong engineHandle,
+                                                       jint fftSize,
+                                                       jint framesPerSecond);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_stopSpectrum(JNIEnv *env, jclass type,
+                                                      jlong engineHandle);
+JNIEXPORT jobject JNICALL
+Java_com_google_sample_echo_MainActivity_getSpectrumBuffer(JNIEnv *env,
+                                                           jclass type,
+                                                           jlong engineHandle);
+JNIEXPORT jint JNICALL
+Java_com_google_sample_echo_MainActivity_readSpectrum(JNIEnv *env, jclass type,
+                                                      jlong engineHandle,
+                                                      jfloatArray levels,
+                                                      jfloatArray magnitudesDb);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_enableBufferExchange(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle,
+                                                              jboolean enable);
+JNIEXPORT jobject JNICALL
+Java_com_google_sample_echo_MainActivity_getBufferExchange(JNIEnv *env,
+                                                           jclass type,
+                                                           jlong engineHandle);
+JNIEXPORT jobjectArray JNICALL
+Java_com_google_sample_echo_MainActivity_getBufferViews(JNIEnv *env,
+                                                        jclass type,
+                                                        jlong engineHandle);
+JNIEXPORT jint JNICALL
+Java_com_google_sample_echo_MainActivity_takeSharedBuffer(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong engineHandle,
+                                                          jlongArray info);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_returnSharedBuffer(JNIEnv *env,
+                                                            jclass type,
+                                                            jlong engineHandle,
+                                                            jint index);
+JNIEXPORT jlong JNICALL
+Java_com_google_sample_echo_MainActivity_getBufferExchangeErrors(
+    JNIEnv *env, jclass type, jlong engineHandle);
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getCallbackTiming(JNIEnv *env,
+                                                           jclass type,
+                                                           jlong engineHandle,
+                                                           jint stream);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_resetCallbackTiming(JNIEnv *env,
+                                                             jclass type,
+                                                             jlong engineHandle);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_enableGlitchDetector(JNIEnv *env,
+                                                              jclass type,
+                                                              jlong engineHandle,
+                                                              jboolean enable);
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getGlitchEvents(JNIEnv *env,
+                                                         jclass type,
+                                                         jlong engineHandle);
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getGlitchCounts(JNIEnv *env,
+                                                         jclass type,
+                                                         jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startLatencyMeasurement(
+    JNIEnv *env, jclass type, jlong engineHandle, jint bursts);
+JNIEXPORT jdoubleArray JNICALL
+Java_com_google_sample_echo_MainActivity_getLatencyResult(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startTrace(JNIEnv *env, jclass type);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_stopTrace(JNIEnv *env, jclass type);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_exportTrace(JNIEnv *env, jclass type,
+                                                     jstring path);
+JNIEXPORT jfloatArray JNICALL
+Java_com_google_sample_echo_MainActivity_getDspLoad(JNIEnv *env, jclass type,
+                                                    jlong engineHandle);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_resetDspLoad(JNIEnv *env,
+                                                      jclass type,
+                                                      jlong engineHandle);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_setDspAutoBypass(JNIEnv *env,
+                                                          jclass type,
+                                                          jlong engineHandle,
+                                                          jboolean enable,
+                                                          jfloat threshold);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_postControl(JNIEnv *env, jclass type,
+                                                     jlong engineHandle,
+                                                     jint target, jint param,
+                                                     jfloat value,
+                                                     jlong framePos,
+                                                     jint rampFrames);
+JNIEXPORT jlong JNICALL
+Java_com_google_sample_echo_MainActivity_getControlFramePosition(
+    JNIEnv *env, jclass type, jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_configureSilenceBypass(
+    JNIEnv *env, jclass type, jlong engineHandle, jboolean enable,
+    jfloat thresholdDb, jfloat holdMs);
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getSilenceStats(JNIEnv *env,
+                                                         jclass type,
+                                                         jlong engineHandle);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_enableDriftCompensation(
+    JNIEnv *env, jclass type, jlong engineHandle, jboolean enable);
+JNIEXPORT jdoubleArray JNICALL
+Java_com_google_sample_echo_MainActivity_getDriftStats(JNIEnv *env,
+                                                       jclass type,
+                                                       jlong engineHandle);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_setThreadPolicy(JNIEnv *env,
+                                                         jclass type,
+                                                         jint role, jint sched,
+                                                         jint fifoPriority,
+                                                         jint nice,
+                                                         jlong cpuMask);
+JNIEXPORT jlongArray JNICALL
+Java_com_google_sample_echo_MainActivity_getThreadPolicyReport(JNIEnv *env,
+                                                               jclass type);
 #ifdef __cplusplus
 }
 #endif
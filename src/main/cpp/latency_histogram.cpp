@@ -0,0 +1,109 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "latency_histogram.h"
+
+LatencyHistogram::LatencyHistogram() { reset(); }
+
+/*
+ * Values below kSubBuckets map 1:1; above, the bucket is the exponent of
+ * the highest set bit followed by the next kSubBucketBits bits.
+ */
+int32_t LatencyHistogram::bucketIndex(int64_t ns) {
+  if (ns < kSubBuckets) {
+    return ns < 0 ? 0 : static_cast<int32_t>(ns);
+  }
+  uint64_t v = static_cast<uint64_t>(ns);
+  int32_t exp = 63 - __builtin_clzll(v);
+  if (exp > kMaxExponent) {
+    return kBucketCount - 1;
+  }
+  int32_t sub = static_cast<int32_t>(v >> (exp - kSubBucketBits)) &
+                (kSubBuckets - 1);
+  return (exp - kSubBucketBits + 1) * kSubBuckets + sub;
+}
+
+int64_t LatencyHistogram::bucketUpperBound(int32_t idx) {
+  if (idx < kSubBuckets) {
+    return idx;
+  }
+  int32_t exp = idx / kSubBuckets + kSubBucketBits - 1;
+  int64_t sub = idx % kSubBuckets;
+  int32_t shift = exp - kSubBucketBits;
+  return ((kSubBuckets + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t ns) {
+  buckets_[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  if (ns > max_.load(std::memory_order_relaxed)) {
+    max_.store(ns, std::memory_order_relaxed);
+  }
+}
+
+/*
+ * Not atomic as a whole: a record() running at the same time may survive
+ * the reset, which only skews the next readout by one sample.
+ */
+void LatencyHistogram::reset(void) {
+  for (int32_t i = 0; i < kBucketCount; i++) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getCount(void) const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::getMax(void) const {
+  return max_.load(std::memory_order_relaxed);
+}
+
+/*
+ * Upper bound of the bucket holding the given percentile (0 - 100), capped
+ * by the real maximum; 0 when nothing was recorded.
+ */
+int64_t LatencyHistogram::getPercentile(double percent) const {
+  uint64_t total = 0;
+  for (int32_t i = 0; i < kBucketCount; i++) {
+    total += buckets_[i].load(std::memory_order_relaxed);
+  }
+  if (!total) {
+    return 0;
+  }
+  uint64_t target = static_cast<uint64_t>(percent / 100.0 * total + 0.5);
+  if (target < 1) target = 1;
+  if (target > total) target = total;
+
+  uint64_t seen = 0;
+  int32_t idx = 0;
+  for (; idx < kBucketCount; idx++) {
+    seen += buckets_[idx].load(std::memory_order_relaxed);
+    if (seen >= target) break;
+  }
+  int64_t bound = bucketUpperBound(idx < kBucketCount ? idx : kBucketCount - 1);
+  int64_t maxNs = getMax();
+  return bound < maxNs ? bound : maxNs;
+}
+
+void LatencyHistogram::getSummary(LatencySummary *summary) const {
+  summary->count_ = getCount();
+  summary->p50Ns_ = getPercentile(50.0);
+  summary->p99Ns_ = getPercentile(99.0);
+  summary->p999Ns_ = getPercentile(99.9);
+  summary->maxNs_ = getMax();
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_LATENCY_HISTOGRAM_H
+#define NATIVE_AUDIO_LATENCY_HISTOGRAM_H
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free log-linear histogram of nano second durations.
+ *
+ * Every power of two range is split into kSubBuckets linear buckets, so a
+ * value is known within 1/kSubBuckets (~6%) from 16 ns up to ~18 minutes
+ * with a fixed, small table. record() is wait free and meant for the audio
+ * callbacks (one writer); the readers and reset() may run on any thread.
+ */
+struct LatencySummary {
+  uint64_t count_;
+  int64_t p50Ns_;
+  int64_t p99Ns_;
+  int64_t p999Ns_;
+  int64_t maxNs_;
+};
+
+class LatencyHistogram {
+ public:
+  static const int32_t kSubBucketBits = 4;
+  static const int32_t kSubBuckets = 1 << kSubBucketBits;
+  static const int32_t kMaxExponent = 40;
+  static const int32_t kBucketCount =
+      (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+  LatencyHistogram();
+
+  void record(int64_t ns);
+  void reset(void);
+
+  uint64_t getCount(void) const;
+  int64_t getMax(void) const;
+  int64_t getPercentile(double percent) const;
+  void getSummary(LatencySummary *summary) const;
+
+ private:
+  std::atomic<uint32_t> buckets_[kBucketCount];
+  std::atomic<uint64_t> count_;
+  std::atomic<int64_t> max_;
+
+  static int32_t bucketIndex(int64_t ns);
+  static int64_t bucketUpperBound(int32_t idx);
+};
+
+#endif  // NATIVE_AUDIO_LATENCY_HISTOGRAM_H
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "fft.h"
+#include "latency_meter.h"
+
+// a burst counts when its correlation peak stands this far above the rms
+static const float kMinConfidence = 8.0f;
+
+LatencyMeter::LatencyMeter(int32_t sampleRateHz, int32_t channels,
+                           float amplitude)
+    : sampleRate_(sampleRateHz),
+      channels_(channels),
+      state_(IDLE),
+      restart_(false),
+      bursts_(0),
+      origin_(0),
+      written_(0),
+      total_(0),
+      haveResult_(false) {
+  // Fibonacci LFSR for x^11 + x^9 + 1, a primitive polynomial: every
+  // non-zero state is visited once per 2^11 - 1 steps
+  int32_t length = (1 << kMlsOrder) - 1;
+  int16_t level = static_cast<int16_t>(amplitude * 32767.0f);
+  uint32_t reg = 1;
+  mls_.resize(length);
+  for (int32_t i = 0; i < length; i++) {
+    uint32_t bit = ((reg >> (kMlsOrder - 1)) ^ (reg >> (kMlsOrder - 3))) & 1;
+    mls_[i] = (reg & 1) ? level : static_cast<int16_t>(-level);
+    reg = ((reg << 1) | bit) & ((1u << kMlsOrder) - 1);
+  }
+  maxLag_ = sampleRate_ * kMaxLatencyMs / 1000;
+  period_ = maxLag_ + 2 * length;
+  memset(&result_, 0, sizeof(result_));
+}
+
+LatencyMeter::~LatencyMeter() {}
+
+/*
+ * The capture memory is allocated by the first start() and kept: a
+ * restarted measurement is picked up by the capture thread on its next
+ * buffer, which never sees the memory change under it.
+ */
+bool LatencyMeter::start(int32_t bursts) {
+  if (bursts < 1 || bursts > kMaxBursts) {
+    return false;
+  }
+  if (!capture_) {
+    capture_.reset(new float[static_cast<size_t>(kMaxBursts) * period_]);
+  }
+  {
+    std::lock_guard<std::mutex> lock(resultMutex_);
+    haveResult_ = false;
+  }
+  bursts_.store(bursts, std::memory_order_relaxed);
+  restart_.store(true, std::memory_order_release);
+  state_.store(RUNNING, std::memory_order_release);
+  return true;
+}
+
+bool LatencyMeter::isRunning(void) const {
+  return state_.load(std::memory_order_acquire) == RUNNING;
+}
+
+bool LatencyMeter::isDone(void) const {
+  return state_.load(std::memory_order_acquire) == DONE;
+}
+
+bool LatencyMeter::process(int16_t *samples, uint32_t frames,
+                           uint64_t framePos) {
+  if (state_.load(std::memory_order_acquire) != RUNNING) {
+    return false;
+  }
+  if (restart_.exchange(false, std::memory_order_acquire) ||
+      framePos < origin_) {
+    // new measurement, or the recorder restarted its frame count
+    origin_ = framePos;
+    written_ = 0;
+    total_ = static_cast<uint64_t>(bursts_.load(std::memory_order_relaxed)) *
+             period_;
+  }
+  uint64_t rel = framePos - origin_;
+  // frames that never reached us (dropped buffers) are left silent
+  while (written_ < rel && written_ < total_) {
+    capture_[written_++] = 0.0f;
+  }
+
+  const int32_t mlsLen = static_cast<int32_t>(mls_.size());
+  for (uint32_t f = 0; f < frames; f++) {
+    int16_t *frame = samples + f * channels_;
+    if (rel + f == written_ && written_ < total_) {
+      int32_t sum = 0;
+      for (int32_t c = 0; c < channels_; c++) sum += frame[c];
+      capture_[written_++] = sum / (32768.0f * channels_);
+    }
+    uint64_t pos = rel + f;
+    int32_t phase = static_cast<int32_t>(pos % period_);
+    int16_t out = (pos < total_ && phase < mlsLen) ? mls_[phase] : 0;
+    for (int32_t c = 0; c < channels_; c++) frame[c] = out;
+  }
+
+  if (written_ >= total_) {
+    state_.store(DONE, std::memory_order_release);
+  }
+  return true;
+}
+
+void LatencyMeter::analyze(void) {
+  const int32_t mlsLen = static_cast<int32_t>(mls_.size());
+  std::vector<float> ref(mlsLen);
+  for (int32_t i = 0; i < mlsLen; i++) ref[i] = mls_[i] / 32768.0f;
+
+  int32_t bursts = bursts_.load(std::memory_order_relaxed);
+  std::vector<double> delaysMs;
+  for (int32_t k = 0; k < bursts; k++) {
+    int32_t delay;
+    float confidence = EstimateDelay(capture_.get() + k * period_, period_,
+                                     ref.data(), mlsLen, maxLag_, &delay);
+    if (confidence >= kMinConfidence) {
+      delaysMs.push_back(1000.0 * delay / sampleRate_);
+    }
+  }
+
+  memset(&result_, 0, sizeof(result_));
+  result_.bursts_ = bursts;
+  result_.valid_ = static_cast<int32_t>(delaysMs.size());
+  if (delaysMs.empty()) {
+    return;
+  }
+  double sum = 0.0;
+  for (double d : delaysMs) sum += d;
+  result_.meanMs_ = sum / delaysMs.size();
+  double var = 0.0;
+  for (double d : delaysMs) var += (d - result_.meanMs_) * (d - result_.meanMs_);
+  result_.stdDevMs_ = sqrt(var / delaysMs.size());
+  result_.minMs_ = *std::min_element(delaysMs.begin(), delaysMs.end());
+  result_.maxMs_ = *std::max_element(delaysMs.begin(), delaysMs.end());
+}
+
+/*
+ * The correlation runs on the caller's thread once the capture is complete.
+ */
+bool LatencyMeter::getResult(LatencyResult *result) {
+  if (!isDone()) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(resultMutex_);
+  if (!haveResult_) {
+    analyze();
+    haveResult_ = true;
+  }
+  *result = result_;
+  return true;
+}
+
+float EstimateDelay(const float *signal, int32_t signalLen, const float *ref,
+                    int32_t refLen, int32_t maxLag, int32_t *delay) {
+  *delay = 0;
+  maxLag = std::min(maxLag, signalLen - refLen);
+  if (maxLag < 0 || refLen <= 0) {
+    return 0.0f;
+  }
+  int32_t n = 8;
+  while (n < signalLen + refLen) n <<= 1;
+
+  RealFft fft(n);
+  int32_t bins = fft.bins();
+  std::vector<float> buf(n, 0.0f);
+  std::vector<float> sRe(bins), sIm(bins), rRe(bins), rIm(bins);
+  std::copy(signal, signal + signalLen, buf.begin());
+  fft.forward(buf.data(), sRe.data(), sIm.data());
+  std::fill(buf.begin(), buf.end(), 0.0f);
+  std::copy(ref, ref + refLen, buf.begin());
+  fft.forward(buf.data(), rRe.data(), rIm.data());
+
+  // S * conj(R): correlation of the signal against the reference
+  for (int32_t k = 0; k < bins; k++) {
+    float re = sRe[k] * rRe[k] + sIm[k] * rIm[k];
+    float im = sIm[k] * rRe[k] - sRe[k] * rIm[k];
+    sRe[k] = re;
+    sIm[k] = im;
+  }
+  fft.inverse(sRe.data(), sIm.data(), buf.data());
+
+  // the device path may invert the polarity: look at the magnitude
+  double energy = 0.0;
+  float peak = 0.0f;
+  for (int32_t lag = 0; lag <= maxLag; lag++) {
+    float v = fabsf(buf[lag]);
+    energy += static_cast<double>(v) * v;
+    if (v > peak) {
+      peak = v;
+      *delay = lag;
+    }
+  }
+  double rms = sqrt(energy / (maxLag + 1));
+  return rms > 0.0 ? static_cast<float>(peak / rms) : 0.0f;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_LATENCY_METER_H
+#define NATIVE_AUDIO_LATENCY_METER_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct LatencyResult {
+  int32_t bursts_;     // bursts played
+  int32_t valid_;      // bursts found in the capture
+  double meanMs_;      // round trip latency
+  double stdDevMs_;
+  double minMs_;
+  double maxMs_;
+};
+
+/*
+ * Round trip latency measurement with a maximum length sequence.
+ *
+ * While a measurement runs, process() takes the place of the effect chain:
+ * the captured audio is stored and the buffer is overwritten with the test
+ * signal, so the player sends MLS bursts instead of the mic audio. Burst k
+ * starts at frame k * period of the stream and the capture is correlated
+ * against the MLS to find where it came back. Positions come from the
+ * recorder's frame counter, so buffers dropped on the way only leave a hole
+ * in the capture instead of shifting the result.
+ *
+ * The measured latency covers everything the echo goes through: the app's
+ * own queueing plus the output and input paths of the device.
+ *
+ * No OpenSL ES or Android dependency: any 16 bit stream and a delayed copy
+ * of it (e.g. a simulated loopback) can be run through it on the host.
+ */
+class LatencyMeter {
+ public:
+  static const int32_t kMlsOrder = 11;  // 2047 samples
+  static const int32_t kMaxBursts = 16;
+  static const int32_t kMaxLatencyMs = 500;
+
+  explicit LatencyMeter(int32_t sampleRateHz, int32_t channels,
+                        float amplitude = 0.25f);
+  ~LatencyMeter();
+
+  bool start(int32_t bursts);
+  bool isRunning(void) const;
+  bool isDone(void) const;
+  bool getResult(LatencyResult *result);
+
+  // capture thread: returns false (buffer untouched) unless measuring
+  bool process(int16_t *samples, uint32_t frames, uint64_t framePos);
+
+ private:
+  enum State { IDLE = 0, RUNNING = 1, DONE = 2 };
+
+  int32_t sampleRate_;
+  int32_t channels_;
+  std::vector<int16_t> mls_;      // one period, scaled
+  int32_t maxLag_;                // frames
+  int32_t period_;                // frames between burst starts
+
+  std::atomic<int32_t> state_;
+  std::atomic<bool> restart_;
+  std::atomic<int32_t> bursts_;
+
+  // owned by the capture thread while RUNNING
+  std::unique_ptr<float[]> capture_;
+  uint64_t origin_;               // framePos of the first buffer
+  uint64_t written_;              // frames stored so far
+  uint64_t total_;                // frames to store
+
+  std::mutex resultMutex_;
+  bool haveResult_;
+  LatencyResult result_;
+
+  void analyze(void);
+};
+
+/*
+ * Delay (in samples, 0 .. maxLag) at which ref shows up in signal, by FFT
+ * cross correlation. Returns the peak to rms ratio of the correlation as a
+ * confidence, 0 when there is nothing to correlate.
+ */
+float EstimateDelay(const float *signal, int32_t signalLen, const float *ref,
+                    int32_t refLen, int32_t maxLag, int32_t *delay);
+
+#endif  // NATIVE_AUDIO_LATENCY_METER_H
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include "offline_render.h"
+#include "wav_header.h"
+
+/*
+ * Minimal RIFF/WAVE reader: walk the chunk list for "fmt " and "data".
+ * Only little endian PCM is supported (which is what Android devices and
+ * every common tool produce).
+ */
+static uint32_t ReadLE32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+static uint16_t ReadLE16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static bool ParseWav(const uint8_t* file, size_t size, WavInfo* info) {
+  if (size < 12 || memcmp(file, "RIFF", 4) || memcmp(file + 8, "WAVE", 4)) {
+    return false;
+  }
+  memset(info, 0, sizeof(*info));
+  bool haveFmt = false;
+  size_t pos = 12;
+  while (pos + 8 <= size) {
+    const uint8_t* chunk = file + pos;
+    uint32_t chunkSize = ReadLE32(chunk + 4);
+    size_t body = pos + 8;
+    if (!memcmp(chunk, "fmt ", 4) && chunkSize >= 16 && body + 16 <= size) {
+      info->format_ = ReadLE16(file + body);
+      info->channels_ = ReadLE16(file + body + 2);
+      info->sampleRate_ = ReadLE32(file + body + 4);
+      info->bitsPerSample_ = ReadLE16(file + body + 14);
+      haveFmt = true;
+    } else if (!memcmp(chunk, "data", 4)) {
+      // tolerate truncated recordings: clip to what is really in the file
+      size_t avail = size - body;
+      info->data_ = file + body;
+      info->dataSize_ = static_cast<uint32_t>(
+          chunkSize < avail ? chunkSize : avail);
+      return haveFmt;
+    }
+    pos = body + chunkSize + (chunkSize & 1);  // chunks are word aligned
+  }
+  return false;
+}
+
+bool OfflineRenderWav(const char* inPath, const char* outPath,
+                      const SampleFormat* format, ENGINE_CALLBACK cb,
+                      void* ctx, OfflineRenderStats* stats) {
+  assert(inPath && outPath && format && cb);
+  uint64_t startTick = GetSystemTicks();
+
+  int inFd = open(inPath, O_RDONLY);
+  if (inFd < 0) {
+    LOGE("====failed to open %s for rendering", inPath);
+    return false;
+  }
+  struct stat st;
+  if (fstat(inFd, &st) || st.st_size <= 0) {
+    close(inFd);
+    return false;
+  }
+  size_t inSize = static_cast<size_t>(st.st_size);
+  void* inMap = mmap(nullptr, inSize, PROT_READ, MAP_PRIVATE, inFd, 0);
+  close(inFd);
+  if (inMap == MAP_FAILED) {
+    LOGE("====failed to map %s", inPath);
+    return false;
+  }
+  madvise(inMap, inSize, MADV_SEQUENTIAL);
+
+  WavInfo info;
+  if (!ParseWav(static_cast<uint8_t*>(inMap), inSize, &info) ||
+      info.format_ != kWavFormatPcm ||
+      info.bitsPerSample_ != format->pcmFormat_ ||
+      info.channels_ != format->channels_ ||
+      info.sampleRate_ * 1000 != format->sampleRate_) {
+    LOGE("====%s: unsupported wav format (need %d bit, %d ch, %d Hz)", inPath,
+         format->pcmFormat_, format->channels_, format->sampleRate_ / 1000);
+    munmap(inMap, inSize);
+    return false;
+  }
+
+  uint32_t bytePerFrame = info.channels_ * (info.bitsPerSample_ >> 3);
+  uint32_t totalFrames = info.dataSize_ / bytePerFrame;
+  info.dataSize_ = totalFrames * bytePerFrame;
+
+  // preallocate the whole output file and render straight into the mapping
+  size_t outSize = kWavHeaderSize + info.dataSize_;
+  int outFd = open(outPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (outFd < 0 || ftruncate(outFd, static_cast<off_t>(outSize))) {
+    LOGE("====failed to create %s", outPath);
+    if (outFd >= 0) close(outFd);
+    munmap(inMap, inSize);
+    return false;
+  }
+  void* outMap =
+      mmap(nullptr, outSize, PROT_READ | PROT_WRITE, MAP_SHARED, outFd, 0);
+  close(outFd);
+  if (outMap == MAP_FAILED) {
+    LOGE("====failed to map %s", outPath);
+    munmap(inMap, inSize);
+    return false;
+  }
+  madvise(outMap, outSize, MADV_SEQUENTIAL);
+
+  uint8_t* out = static_cast<uint8_t*>(outMap);
+  WriteWavHeader(out, info);
+  out += kWavHeaderSize;
+
+  uint32_t blockBytes = format->framesPerBuf_ * bytePerFrame;
+  uint32_t fullBytes = (info.dataSize_ / blockBytes) * blockBytes;
+  memcpy(out, info.data_, fullBytes);
+
+  // full blocks are processed in place, inside the output mapping
+  sample_buf buf;
+  memset(&buf, 0, sizeof(buf));
+  uint64_t blocks = 0;
+  for (uint32_t offset = 0; offset < fullBytes; offset += blockBytes) {
+    buf.buf_ = out + offset;
+    buf.cap_ = blockBytes;
+    buf.size_ = blockBytes;
+    buf.seq_ = static_cast<uint32_t>(blocks);
+    buf.framePos_ = offset / bytePerFrame;
+    cb(ctx, ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE, &buf);
+    ++blocks;
+  }
+
+  // the tail goes through a zero padded block; only the valid part is kept
+  uint32_t tailBytes = info.dataSize_ - fullBytes;
+  if (tailBytes) {
+    buf.buf_ = new uint8_t[blockBytes];
+    buf.cap_ = blockBytes;
+    buf.size_ = blockBytes;
+    memset(buf.buf_, 0, blockBytes);
+    memcpy(buf.buf_, info.data_ + fullBytes, tailBytes);
+    buf.seq_ = static_cast<uint32_t>(blocks);
+    buf.framePos_ = fullBytes / bytePerFrame;
+    cb(ctx, ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE, &buf);
+    memcpy(out + fullBytes, buf.buf_, tailBytes);
+    delete[] buf.buf_;
+    ++blocks;
+  }
+
+  munmap(outMap, outSize);
+  munmap(inMap, inSize);
+
+  if (stats) {
+    stats->frames_ = totalFrames;
+    stats->blocks_ = blocks;
+    stats->elapsedUs_ = GetSystemTicks() - startTick;
+  }
+  return true;
+}
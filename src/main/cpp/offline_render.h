@@ -0,0 +1,47 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_OFFLINE_RENDER_H
+#define NATIVE_AUDIO_OFFLINE_RENDER_H
+#include <cstdint>
+#include "audio_common.h"
+
+/*
+ * Offline (file to file) rendering through the engine's processing code.
+ *
+ * The input WAV file is memory mapped, the output WAV file is preallocated
+ * and memory mapped; every block of framesPerBuf_ frames is copied into the
+ * output mapping and handed to the engine callback with
+ * ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE, exactly the way AudioRecorder
+ * hands over a freshly captured buffer. Given the same input, block size
+ * and settings, the output is what the live chain would produce from effects
+ * at rest, as long as the live chain has no effect bypassed for load and
+ * nothing the callback leaves out (renderFile: the echo canceller, drift
+ * compensation).
+ *
+ * Only the engine's own format is accepted (16 bit PCM, same channel count
+ * and sample rate); no conversion is done here.
+ */
+struct OfflineRenderStats {
+  uint64_t frames_;      // frames rendered
+  uint64_t blocks_;      // callback invocations
+  uint64_t elapsedUs_;   // wall time spent rendering
+};
+
+bool OfflineRenderWav(const char* inPath, const char* outPath,
+                      const SampleFormat* format, ENGINE_CALLBACK cb,
+                      void* ctx, OfflineRenderStats* stats);
+
+#endif  // NATIVE_AUDIO_OFFLINE_RENDER_H
@@ -0,0 +1,608 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "pcm_convert.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "dsp_kernels.h"
+#ifdef DSP_USE_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+ * Every conversion goes through float in blocks of kBlockSamples: the
+ * integer formats are exact in float up to 24 bits, and the scale factors
+ * are powers of two, so scaling never rounds (and a fused multiply-add
+ * gives the same result as separate ones). S32 to S16 and S24 is the
+ * exception: float would round S32 to 24 bits before the conversion rounds
+ * again, so it stays in integers.
+ */
+static const int32_t kBlockSamples = 256;
+
+static const int32_t kFormatBytes[PCM_FORMAT_COUNT] = {2, 3, 4, 4};
+// resolution deciding whether a conversion narrows (float counts as wider
+// than 24 bit: it has finer steps near zero)
+static const int32_t kFormatBits[PCM_FORMAT_COUNT] = {16, 24, 32, 32};
+
+static const float kS16Scale = 32768.0f;
+static const float kS24Scale = 8388608.0f;
+static const float kS32Scale = 2147483648.0f;
+static const float kS32Max = 2147483520.0f;  // largest float below 2^31
+
+int32_t PcmFormatBytes(PcmFormat format) {
+  return (format >= 0 && format < PCM_FORMAT_COUNT) ? kFormatBytes[format] : 0;
+}
+
+PcmFormat PcmFormatFromSampleFormat(const SampleFormat *format) {
+  switch (format->representation_) {
+    case SL_ANDROID_PCM_REPRESENTATION_FLOAT:
+      return format->pcmFormat_ == SL_PCMSAMPLEFORMAT_FIXED_32
+                 ? PCM_FORMAT_FLOAT : PCM_FORMAT_INVALID;
+    case 0:
+    case SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT:
+      switch (format->pcmFormat_) {
+        case SL_PCMSAMPLEFORMAT_FIXED_16:
+          return PCM_FORMAT_S16;
+        case SL_PCMSAMPLEFORMAT_FIXED_24:
+          return PCM_FORMAT_S24_PACKED;
+        case SL_PCMSAMPLEFORMAT_FIXED_32:
+          return PCM_FORMAT_S32;
+        default:
+          return PCM_FORMAT_INVALID;
+      }
+    default:
+      return PCM_FORMAT_INVALID;
+  }
+}
+
+void PcmDitherInit(PcmDither *dither, uint32_t seed) {
+  for (int32_t lane = 0; lane < 4; lane++) {
+    // xorshift must not start at 0
+    uint32_t state = seed + 0x9E3779B9u * (lane + 1);
+    dither->state_[lane] = state ? state : 1;
+  }
+}
+
+static inline uint32_t Xorshift32(uint32_t *state) {
+  uint32_t s = *state;
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  *state = s;
+  return s;
+}
+
+// two 24 bit uniform values: triangular in (-1, 1) LSB
+static inline float Tpdf(PcmDither *dither, int32_t lane) {
+  int32_t a = static_cast<int32_t>(Xorshift32(&dither->state_[lane]) >> 8);
+  int32_t b = static_cast<int32_t>(Xorshift32(&dither->state_[lane]) >> 8);
+  return static_cast<float>(a - b) * (1.0f / 16777216.0f);
+}
+
+static inline float Clamp(float v, float lo, float hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static inline int32_t LoadS24(const uint8_t *p) {
+  return static_cast<int32_t>(static_cast<uint32_t>(p[0]) << 8 |
+                              static_cast<uint32_t>(p[1]) << 16 |
+                              static_cast<uint32_t>(p[2]) << 24) >> 8;
+}
+
+static inline void StoreS24(uint8_t *p, int32_t v) {
+  p[0] = static_cast<uint8_t>(v);
+  p[1] = static_cast<uint8_t>(v >> 8);
+  p[2] = static_cast<uint8_t>(v >> 16);
+}
+
+// Tpdf() in units of the S32 source of a conversion dropping shift bits
+static inline int32_t TpdfS32(PcmDither *dither, int32_t lane, int32_t shift) {
+  int32_t a = static_cast<int32_t>(Xorshift32(&dither->state_[lane]) >> 8);
+  int32_t b = static_cast<int32_t>(Xorshift32(&dither->state_[lane]) >> 8);
+  return (a - b) >> (24 - shift);
+}
+
+// dither, round to nearest (ties up) and clamp one S32 sample
+static inline int32_t NarrowS32(int32_t in, int32_t shift, int32_t lane,
+                                PcmDither *dither) {
+  int64_t v = in;
+  if (dither) v += TpdfS32(dither, lane, shift);
+  v = (v + (INT64_C(1) << (shift - 1))) >> shift;
+  int64_t hi = (INT64_C(1) << (31 - shift)) - 1;
+  return static_cast<int32_t>(v > hi ? hi : (v < -hi - 1 ? -hi - 1 : v));
+}
+
+/*
+ * Plain C kernels; the NEON ones below run their loop over whole vectors
+ * and finish the tail with these, starting at sample idx.
+ */
+static void S16ToFloatC(const void *src, float *dst, int32_t idx,
+                        int32_t count) {
+  const int16_t *in = static_cast<const int16_t *>(src);
+  for (; idx < count; idx++) {
+    dst[idx] = in[idx] * (1.0f / kS16Scale);
+  }
+}
+
+static void S24ToFloatC(const void *src, float *dst, int32_t idx,
+                        int32_t count) {
+  const uint8_t *in = static_cast<const uint8_t *>(src);
+  for (; idx < count; idx++) {
+    dst[idx] = LoadS24(in + 3 * idx) * (1.0f / kS24Scale);
+  }
+}
+
+static void S32ToFloatC(const void *src, float *dst, int32_t idx,
+                        int32_t count) {
+  const int32_t *in = static_cast<const int32_t *>(src);
+  for (; idx < count; idx++) {
+    dst[idx] = static_cast<float>(in[idx]) * (1.0f / kS32Scale);
+  }
+}
+
+static void FloatToS16C(const float *src, void *dst, int32_t idx,
+                        int32_t count, PcmDither *dither) {
+  int16_t *out = static_cast<int16_t *>(dst);
+  for (; idx < count; idx++) {
+    float v = src[idx] * kS16Scale;
+    if (dither) v += Tpdf(dither, idx & 3);
+    out[idx] = static_cast<int16_t>(lrintf(Clamp(v, -kS16Scale, 32767.0f)));
+  }
+}
+
+static void FloatToS24C(const float *src, void *dst, int32_t idx,
+                        int32_t count, PcmDither *dither) {
+  uint8_t *out = static_cast<uint8_t *>(dst);
+  for (; idx < count; idx++) {
+    float v = src[idx] * kS24Scale;
+    if (dither) v += Tpdf(dither, idx & 3);
+    StoreS24(out + 3 * idx,
+             static_cast<int32_t>(lrintf(Clamp(v, -kS24Scale, 8388607.0f))));
+  }
+}
+
+static void FloatToS32C(const float *src, void *dst, int32_t idx,
+                        int32_t count, PcmDither *) {
+  int32_t *out = static_cast<int32_t *>(dst);
+  for (; idx < count; idx++) {
+    out[idx] = static_cast<int32_t>(
+        lrintf(Clamp(src[idx] * kS32Scale, -kS32Scale, kS32Max)));
+  }
+}
+
+static void S32ToS16C(const int32_t *src, void *dst, int32_t idx,
+                      int32_t count, PcmDither *dither) {
+  int16_t *out = static_cast<int16_t *>(dst);
+  for (; idx < count; idx++) {
+    out[idx] = static_cast<int16_t>(NarrowS32(src[idx], 16, idx & 3, dither));
+  }
+}
+
+static void S32ToS24C(const int32_t *src, void *dst, int32_t idx,
+                      int32_t count, PcmDither *dither) {
+  uint8_t *out = static_cast<uint8_t *>(dst);
+  for (; idx < count; idx++) {
+    StoreS24(out + 3 * idx, NarrowS32(src[idx], 8, idx & 3, dither));
+  }
+}
+
+static void FloatToFloat(const void *src, float *dst, int32_t idx,
+                         int32_t count) {
+  memcpy(dst + idx, static_cast<const float *>(src) + idx,
+         (count - idx) * sizeof(float));
+}
+
+static void FloatFromFloat(const float *src, void *dst, int32_t idx,
+                           int32_t count, PcmDither *) {
+  memcpy(static_cast<float *>(dst) + idx, src + idx,
+         (count - idx) * sizeof(float));
+}
+
+static void S16ToFloatRef(const void *src, float *dst, int32_t count) {
+  S16ToFloatC(src, dst, 0, count);
+}
+static void S24ToFloatRef(const void *src, float *dst, int32_t count) {
+  S24ToFloatC(src, dst, 0, count);
+}
+static void S32ToFloatRef(const void *src, float *dst, int32_t count) {
+  S32ToFloatC(src, dst, 0, count);
+}
+static void FloatToFloatRef(const void *src, float *dst, int32_t count) {
+  FloatToFloat(src, dst, 0, count);
+}
+static void FloatToS16Ref(const float *src, void *dst, int32_t count,
+                          PcmDither *dither) {
+  FloatToS16C(src, dst, 0, count, dither);
+}
+static void FloatToS24Ref(const float *src, void *dst, int32_t count,
+                          PcmDither *dither) {
+  FloatToS24C(src, dst, 0, count, dither);
+}
+static void FloatToS32Ref(const float *src, void *dst, int32_t count,
+                          PcmDither *dither) {
+  FloatToS32C(src, dst, 0, count, dither);
+}
+static void FloatFromFloatRef(const float *src, void *dst, int32_t count,
+                              PcmDither *dither) {
+  FloatFromFloat(src, dst, 0, count, dither);
+}
+static void S32ToS16Ref(const int32_t *src, void *dst, int32_t count,
+                        PcmDither *dither) {
+  S32ToS16C(src, dst, 0, count, dither);
+}
+static void S32ToS24Ref(const int32_t *src, void *dst, int32_t count,
+                        PcmDither *dither) {
+  S32ToS24C(src, dst, 0, count, dither);
+}
+
+#ifdef DSP_USE_NEON
+static void S16ToFloatNeon(const void *src, float *dst, int32_t count) {
+  const int16_t *in = static_cast<const int16_t *>(src);
+  int32_t idx = 0;
+  for (; idx + 8 <= count; idx += 8) {
+    int16x8_t v = vld1q_s16(in + idx);
+    vst1q_f32(dst + idx, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))),
+                                     1.0f / kS16Scale));
+    vst1q_f32(dst + idx + 4,
+              vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))),
+                          1.0f / kS16Scale));
+  }
+  S16ToFloatC(src, dst, idx, count);
+}
+
+static void S24ToFloatNeon(const void *src, float *dst, int32_t count) {
+  const uint8_t *in = static_cast<const uint8_t *>(src);
+  int32_t idx = 0;
+  for (; idx + 8 <= count; idx += 8) {
+    uint8x8x3_t b = vld3_u8(in + 3 * idx);
+    uint16x8_t lo = vorrq_u16(vmovl_u8(b.val[0]), vshll_n_u8(b.val[1], 8));
+    int16x8_t hi = vmovl_s8(vreinterpret_s8_u8(b.val[2]));
+    int32x4_t v0 = vorrq_s32(vshll_n_s16(vget_low_s16(hi), 16),
+                             vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lo))));
+    int32x4_t v1 = vorrq_s32(vshll_n_s16(vget_high_s16(hi), 16),
+                             vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(lo))));
+    vst1q_f32(dst + idx, vmulq_n_f32(vcvtq_f32_s32(v0), 1.0f / kS24Scale));
+    vst1q_f32(dst + idx + 4, vmulq_n_f32(vcvtq_f32_s32(v1), 1.0f / kS24Scale));
+  }
+  S24ToFloatC(src, dst, idx, count);
+}
+
+static void S32ToFloatNeon(const void *src, float *dst, int32_t count) {
+  const int32_t *in = static_cast<const int32_t *>(src);
+  int32_t idx = 0;
+  for (; idx + 4 <= count; idx += 4) {
+    vst1q_f32(dst + idx, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(in + idx)),
+                                     1.0f / kS32Scale));
+  }
+  S32ToFloatC(src, dst, idx, count);
+}
+
+static const uint32_t kZeroState[4] = {0, 0, 0, 0};
+
+static inline uint32x4_t Xorshift32x4(uint32x4_t s) {
+  s = veorq_u32(s, vshlq_n_u32(s, 13));
+  s = veorq_u32(s, vshrq_n_u32(s, 17));
+  return veorq_u32(s, vshlq_n_u32(s, 5));
+}
+
+// 8 samples in the low 24 bits of v0, v1 to packed S24
+static inline void StoreS24x8(uint8_t *out, int32x4_t v0, int32x4_t v1) {
+  uint8x8x3_t b;
+  b.val[0] = vmovn_u16(vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(v0)),
+                                    vmovn_u32(vreinterpretq_u32_s32(v1))));
+  v0 = vshrq_n_s32(v0, 8);
+  v1 = vshrq_n_s32(v1, 8);
+  b.val[1] = vmovn_u16(vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(v0)),
+                                    vmovn_u32(vreinterpretq_u32_s32(v1))));
+  v0 = vshrq_n_s32(v0, 8);
+  v1 = vshrq_n_s32(v1, 8);
+  b.val[2] = vmovn_u16(vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(v0)),
+                                    vmovn_u32(vreinterpretq_u32_s32(v1))));
+  vst3_u8(out, b);
+}
+
+/*
+ * NarrowS32() for lanes 0..3 at once, before the clamp: the saturating
+ * add only differs from the C sum where the result is clamped anyway, and
+ * the rounding shift does not overflow.
+ */
+template <int kShift>
+static inline int32x4_t NarrowS32x4(const int32_t *src, uint32x4_t *state,
+                                    bool dither) {
+  int32x4_t v = vld1q_s32(src);
+  if (dither) {
+    *state = Xorshift32x4(*state);
+    int32x4_t a = vreinterpretq_s32_u32(vshrq_n_u32(*state, 8));
+    *state = Xorshift32x4(*state);
+    int32x4_t b = vreinterpretq_s32_u32(vshrq_n_u32(*state, 8));
+    v = vqaddq_s32(v, vshrq_n_s32(vsubq_s32(a, b), 24 - kShift));
+  }
+  return vrshrq_n_s32(v, kShift);
+}
+
+static void S32ToS16Neon(const int32_t *src, void *dst, int32_t count,
+                         PcmDither *dither) {
+  int16_t *out = static_cast<int16_t *>(dst);
+  uint32x4_t state = vld1q_u32(dither ? dither->state_ : kZeroState);
+  int32_t idx = 0;
+  for (; idx + 4 <= count; idx += 4) {
+    vst1_s16(out + idx,
+             vqmovn_s32(NarrowS32x4<16>(src + idx, &state, dither != nullptr)));
+  }
+  if (dither) vst1q_u32(dither->state_, state);
+  S32ToS16C(src, dst, idx, count, dither);
+}
+
+static void S32ToS24Neon(const int32_t *src, void *dst, int32_t count,
+                         PcmDither *dither) {
+  uint8_t *out = static_cast<uint8_t *>(dst);
+  uint32x4_t state = vld1q_u32(dither ? dither->state_ : kZeroState);
+  const int32x4_t lo = vdupq_n_s32(-8388608);
+  const int32x4_t hi = vdupq_n_s32(8388607);
+  int32_t idx = 0;
+  for (; idx + 8 <= count; idx += 8) {
+    int32x4_t v0 = NarrowS32x4<8>(src + idx, &state, dither != nullptr);
+    int32x4_t v1 = NarrowS32x4<8>(src + idx + 4, &state, dither != nullptr);
+    StoreS24x8(out + 3 * idx, vminq_s32(vmaxq_s32(v0, lo), hi),
+               vminq_s32(vmaxq_s32(v1, lo), hi));
+  }
+  if (dither) vst1q_u32(dither->state_, state);
+  S32ToS24C(src, dst, idx, count, dither);
+}
+#endif
+
+#if defined(DSP_USE_NEON) && defined(__aarch64__)
+
+// Tpdf() for lanes 0..3 at once
+static inline float32x4_t Tpdfx4(uint32x4_t *state) {
+  *state = Xorshift32x4(*state);
+  int32x4_t a = vreinterpretq_s32_u32(vshrq_n_u32(*state, 8));
+  *state = Xorshift32x4(*state);
+  int32x4_t b = vreinterpretq_s32_u32(vshrq_n_u32(*state, 8));
+  return vmulq_n_f32(vcvtq_f32_s32(vsubq_s32(a, b)), 1.0f / 16777216.0f);
+}
+
+// scale, dither, clamp and round 4 samples
+static inline int32x4_t QuantizeX4(const float *src, float scale, float lo,
+                                   float hi, uint32x4_t *state, bool dither) {
+  float32x4_t v = vmulq_n_f32(vld1q_f32(src), scale);
+  if (dither) v = vaddq_f32(v, Tpdfx4(state));
+  v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(lo)), vdupq_n_f32(hi));
+  return vcvtnq_s32_f32(v);
+}
+
+static void FloatToS16Neon(const float *src, void *dst, int32_t count,
+                           PcmDither *dither) {
+  int16_t *out = static_cast<int16_t *>(dst);
+  uint32x4_t state = vld1q_u32(dither ? dither->state_ : kZeroState);
+  int32_t idx = 0;
+  for (; idx + 4 <= count; idx += 4) {
+    int32x4_t v = QuantizeX4(src + idx, kS16Scale, -kS16Scale, 32767.0f,
+                             &state, dither != nullptr);
+    vst1_s16(out + idx, vmovn_s32(v));
+  }
+  if (dither) vst1q_u32(dither->state_, state);
+  FloatToS16C(src, dst, idx, count, dither);
+}
+
+static void FloatToS24Neon(const float *src, void *dst, int32_t count,
+                           PcmDither *dither) {
+  uint8_t *out = static_cast<uint8_t *>(dst);
+  uint32x4_t state = vld1q_u32(dither ? dither->state_ : kZeroState);
+  int32_t idx = 0;
+  for (; idx + 8 <= count; idx += 8) {
+    int32x4_t v0 = QuantizeX4(src + idx, kS24Scale, -kS24Scale, 8388607.0f,
+                              &state, dither != nullptr);
+    int32x4_t v1 = QuantizeX4(src + idx + 4, kS24Scale, -kS24Scale,
+                              8388607.0f, &state, dither != nullptr);
+    StoreS24x8(out + 3 * idx, v0, v1);
+  }
+  if (dither) vst1q_u32(dither->state_, state);
+  FloatToS24C(src, dst, idx, count, dither);
+}
+
+static void FloatToS32Neon(const float *src, void *dst, int32_t count,
+                           PcmDither *dither) {
+  int32_t *out = static_cast<int32_t *>(dst);
+  int32_t idx = 0;
+  for (; idx + 4 <= count; idx += 4) {
+    vst1q_s32(out + idx, QuantizeX4(src + idx, kS32Scale, -kS32Scale, kS32Max,
+                                    nullptr, false));
+  }
+  FloatToS32C(src, dst, idx, count, dither);
+}
+#endif
+
+typedef void (*ToFloatFn)(const void *src, float *dst, int32_t count);
+typedef void (*FromFloatFn)(const float *src, void *dst, int32_t count,
+                            PcmDither *dither);
+typedef void (*FromS32Fn)(const int32_t *src, void *dst, int32_t count,
+                          PcmDither *dither);
+
+struct PcmKernels {
+  ToFloatFn toFloat_[PCM_FORMAT_COUNT];
+  FromFloatFn fromFloat_[PCM_FORMAT_COUNT];
+  FromS32Fn s32ToS16_;
+  FromS32Fn s32ToS24_;
+};
+
+static const PcmKernels kReferenceKernels = {
+    {S16ToFloatRef, S24ToFloatRef, S32ToFloatRef, FloatToFloatRef},
+    {FloatToS16Ref, FloatToS24Ref, FloatToS32Ref, FloatFromFloatRef},
+    S32ToS16Ref,
+    S32ToS24Ref,
+};
+
+static const PcmKernels kKernels = {
+#ifdef DSP_USE_NEON
+    {S16ToFloatNeon, S24ToFloatNeon, S32ToFloatNeon, FloatToFloatRef},
+#else
+    {S16ToFloatRef, S24ToFloatRef, S32ToFloatRef, FloatToFloatRef},
+#endif
+#if defined(DSP_USE_NEON) && defined(__aarch64__)
+    {FloatToS16Neon, FloatToS24Neon, FloatToS32Neon, FloatFromFloatRef},
+#else
+    {FloatToS16Ref, FloatToS24Ref, FloatToS32Ref, FloatFromFloatRef},
+#endif
+#ifdef DSP_USE_NEON
+    S32ToS16Neon,
+    S32ToS24Neon,
+#else
+    S32ToS16Ref,
+    S32ToS24Ref,
+#endif
+};
+
+// same format, other layout: move the samples as they are
+static void Transpose(const uint8_t *src, PcmLayout srcLayout, uint8_t *dst,
+                      int32_t frames, int32_t channels, int32_t bytes) {
+  for (int32_t ch = 0; ch < channels; ch++) {
+    for (int32_t f = 0; f < frames; f++) {
+      int32_t interleaved = (f * channels + ch) * bytes;
+      int32_t planar = (ch * frames + f) * bytes;
+      if (srcLayout == PCM_LAYOUT_INTERLEAVED) {
+        memcpy(dst + planar, src + interleaved, bytes);
+      } else {
+        memcpy(dst + interleaved, src + planar, bytes);
+      }
+    }
+  }
+}
+
+/*
+ * S32 to S16 or S24, in the same blocks as the float path with the samples
+ * staying S32 in between.
+ */
+static void ConvertFromS32(FromS32Fn narrow, const int32_t *in,
+                           PcmLayout srcLayout, uint8_t *out, int32_t dstBytes,
+                           PcmLayout dstLayout, int32_t frames,
+                           int32_t channels, PcmDither *dither) {
+  if (srcLayout == dstLayout) {
+    narrow(in, out, frames * channels, dither);
+    return;
+  }
+  int32_t block[kBlockSamples];
+  int32_t plane[kBlockSamples];
+  int32_t blockFrames = kBlockSamples / channels;
+  for (int32_t f0 = 0; f0 < frames; f0 += blockFrames) {
+    int32_t count = std::min(blockFrames, frames - f0);
+    if (srcLayout == PCM_LAYOUT_INTERLEAVED) {
+      for (int32_t ch = 0; ch < channels; ch++) {
+        for (int32_t f = 0; f < count; f++) {
+          plane[f] = in[(f0 + f) * channels + ch];
+        }
+        narrow(plane, out + (ch * frames + f0) * dstBytes, count, dither);
+      }
+    } else {
+      for (int32_t ch = 0; ch < channels; ch++) {
+        for (int32_t f = 0; f < count; f++) {
+          block[f * channels + ch] = in[ch * frames + f0 + f];
+        }
+      }
+      narrow(block, out + f0 * channels * dstBytes, count * channels, dither);
+    }
+  }
+}
+
+static bool Convert(const PcmKernels &kernels, const void *src,
+                    PcmFormat srcFormat, PcmLayout srcLayout, void *dst,
+                    PcmFormat dstFormat, PcmLayout dstLayout, int32_t frames,
+                    int32_t channels, PcmDither *dither) {
+  if (!src || !dst || frames < 0 || channels <= 0 ||
+      channels > kBlockSamples || !PcmFormatBytes(srcFormat) ||
+      !PcmFormatBytes(dstFormat)) {
+    return false;
+  }
+  const uint8_t *in = static_cast<const uint8_t *>(src);
+  uint8_t *out = static_cast<uint8_t *>(dst);
+  int32_t srcBytes = kFormatBytes[srcFormat];
+  int32_t dstBytes = kFormatBytes[dstFormat];
+  if (channels == 1) {
+    srcLayout = dstLayout;
+  }
+  if (srcFormat == dstFormat) {
+    if (srcLayout == dstLayout) {
+      memcpy(out, in, static_cast<size_t>(frames) * channels * srcBytes);
+    } else {
+      Transpose(in, srcLayout, out, frames, channels, srcBytes);
+    }
+    return true;
+  }
+  if (kFormatBits[srcFormat] <= kFormatBits[dstFormat]) {
+    dither = nullptr;  // widening is exact, nothing to dither
+  }
+  if (srcFormat == PCM_FORMAT_S32 && dstFormat != PCM_FORMAT_FLOAT) {
+    ConvertFromS32(
+        dstFormat == PCM_FORMAT_S16 ? kernels.s32ToS16_ : kernels.s32ToS24_,
+        static_cast<const int32_t *>(src), srcLayout, out, dstBytes,
+        dstLayout, frames, channels, dither);
+    return true;
+  }
+
+  ToFloatFn toFloat = kernels.toFloat_[srcFormat];
+  FromFloatFn fromFloat = kernels.fromFloat_[dstFormat];
+  float block[kBlockSamples];
+  if (srcLayout == dstLayout) {
+    int32_t total = frames * channels;
+    for (int32_t idx = 0; idx < total; idx += kBlockSamples) {
+      int32_t count = std::min(kBlockSamples, total - idx);
+      toFloat(in + idx * srcBytes, block, count);
+      fromFloat(block, out + idx * dstBytes, count, dither);
+    }
+    return true;
+  }
+
+  // layout change: transpose in float between the two conversions
+  float plane[kBlockSamples];
+  int32_t blockFrames = kBlockSamples / channels;
+  for (int32_t f0 = 0; f0 < frames; f0 += blockFrames) {
+    int32_t count = std::min(blockFrames, frames - f0);
+    if (srcLayout == PCM_LAYOUT_INTERLEAVED) {
+      toFloat(in + f0 * channels * srcBytes, block, count * channels);
+      for (int32_t ch = 0; ch < channels; ch++) {
+        for (int32_t f = 0; f < count; f++) {
+          plane[f] = block[f * channels + ch];
+        }
+        fromFloat(plane, out + (ch * frames + f0) * dstBytes, count, dither);
+      }
+    } else {
+      for (int32_t ch = 0; ch < channels; ch++) {
+        toFloat(in + (ch * frames + f0) * srcBytes, plane, count);
+        for (int32_t f = 0; f < count; f++) {
+          block[f * channels + ch] = plane[f];
+        }
+      }
+      fromFloat(block, out + f0 * channels * dstBytes, count * channels,
+                dither);
+    }
+  }
+  return true;
+}
+
+bool ConvertPcm(const void *src, PcmFormat srcFormat, PcmLayout srcLayout,
+                void *dst, PcmFormat dstFormat, PcmLayout dstLayout,
+                int32_t frames, int32_t channels, PcmDither *dither) {
+  return Convert(kKernels, src, srcFormat, srcLayout, dst, dstFormat,
+                 dstLayout, frames, channels, dither);
+}
+
+bool ConvertPcmReference(const void *src, PcmFormat srcFormat,
+                         PcmLayout srcLayout, void *dst, PcmFormat dstFormat,
+                         PcmLayout dstLayout, int32_t frames, int32_t channels,
+                         PcmDither *dither) {
+  return Convert(kReferenceKernels, src, srcFormat, srcLayout, dst, dstFormat,
+                 dstLayout, frames, channels, dither);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_PCM_CONVERT_H
+#define NATIVE_AUDIO_PCM_CONVERT_H
+#include <cstdint>
+#include "audio_common.h"
+
+/*
+ * Sample formats, all little endian:
+ *   S16:        int16
+ *   S24_PACKED: 3 bytes per sample, no padding
+ *   S32:        int32
+ *   FLOAT:      float, full scale is [-1.0, 1.0)
+ */
+enum PcmFormat {
+  PCM_FORMAT_S16 = 0,
+  PCM_FORMAT_S24_PACKED = 1,
+  PCM_FORMAT_S32 = 2,
+  PCM_FORMAT_FLOAT = 3,
+  PCM_FORMAT_COUNT,
+  PCM_FORMAT_INVALID = -1
+};
+
+/*
+ * INTERLEAVED: frame after frame
+ * PLANAR:      all frames of channel 0, then all of channel 1, ...
+ */
+enum PcmLayout {
+  PCM_LAYOUT_INTERLEAVED = 0,
+  PCM_LAYOUT_PLANAR = 1,
+};
+
+int32_t PcmFormatBytes(PcmFormat format);
+// format of an OpenSL buffer queue described by ConvertToSLSampleFormat()
+PcmFormat PcmFormatFromSampleFormat(const SampleFormat *format);
+
+/*
+ * TPDF dither for the conversions to S16 and S24: the difference of two
+ * uniform values, +-1 LSB of the destination, added before rounding.
+ * Four xorshift32 generators take turns sample by sample, so the NEON code
+ * runs one per lane and gives the same noise as the scalar code.
+ */
+struct PcmDither {
+  uint32_t state_[4];
+};
+void PcmDitherInit(PcmDither *dither, uint32_t seed);
+
+/*
+ * Convert frames * channels samples between any two formats and layouts.
+ * Float input is clamped to full scale, integers narrowing to fewer bits
+ * are rounded to nearest, with dither when one is given (it is ignored for
+ * S32 and FLOAT destinations). From float ties round to even, from S32
+ * (which is shifted, not converted through float) ties round up. src and
+ * dst must not overlap.
+ *
+ * ConvertPcm() uses NEON where available (float to integer only on
+ * AArch64, which rounds like lrintf); ConvertPcmReference() is the plain
+ * C version, bit exact with it.
+ */
+bool ConvertPcm(const void *src, PcmFormat srcFormat, PcmLayout srcLayout,
+                void *dst, PcmFormat dstFormat, PcmLayout dstLayout,
+                int32_t frames, int32_t channels, PcmDither *dither);
+bool ConvertPcmReference(const void *src, PcmFormat srcFormat,
+                         PcmLayout srcLayout, void *dst, PcmFormat dstFormat,
+                         PcmLayout dstLayout, int32_t frames, int32_t channels,
+                         PcmDither *dither);
+
+#endif  // NATIVE_AUDIO_PCM_CONVERT_H
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include "pcm_tap.h"
+#include "thread_policy.h"
+#include "wav_header.h"
+
+static const int32_t kDrainIntervalMs = 10;
+static const uint32_t kRingSeconds = 1;
+static const uint32_t kMaxDataSize = 0x7FFFFFFF;
+
+static const char *const kTapPointName[PCM_TAP_POINT_COUNT] = {
+    "capture", "aec", "conditioner", "delay", "player"};
+
+PcmTap::PcmTap(SLmilliHertz sampleRate, uint16_t channels)
+    : sampleRate_(sampleRate / 1000),
+      channels_(channels),
+      running_(false),
+      dropped_(0) {
+  for (uint32_t i = 0; i < PCM_TAP_POINT_COUNT; i++) {
+    active_[i].store(false);
+    files_[i].fd_ = -1;
+    files_[i].map_ = nullptr;
+  }
+}
+
+PcmTap::~PcmTap() { stop(); }
+
+/*
+ * Rings are allocated on the first start() of a point and kept until the
+ * tap is deleted: an audio thread may still be inside write() when a point
+ * is deactivated.
+ */
+bool PcmTap::start(const char *pathPrefix, uint32_t pointMask,
+                   uint32_t maxSeconds) {
+  if (running_.load() || !pathPrefix || !maxSeconds ||
+      !(pointMask & ((1 << PCM_TAP_POINT_COUNT) - 1))) {
+    return false;
+  }
+  for (uint32_t i = 0; i < PCM_TAP_POINT_COUNT; i++) {
+    if (!(pointMask & (1 << i))) continue;
+    std::string path = std::string(pathPrefix) + "_" + kTapPointName[i] + ".wav";
+    if (!openFile(static_cast<PcmTapPoint>(i), path, maxSeconds)) {
+      for (uint32_t k = 0; k < i; k++) {
+        closeFile(static_cast<PcmTapPoint>(k));
+      }
+      return false;
+    }
+    if (!rings_[i]) {
+      rings_[i].reset(
+          new RingBuffer<int16_t>(sampleRate_ * channels_ * kRingSeconds));
+    }
+    // leftovers of a write() that raced with the previous stop()
+    rings_[i]->skip(rings_[i]->availableToRead());
+  }
+
+  dropped_.store(0);
+  running_.store(true);
+  writer_ = std::thread(&PcmTap::writerLoop, this);
+  for (uint32_t i = 0; i < PCM_TAP_POINT_COUNT; i++) {
+    if (files_[i].map_) {
+      active_[i].store(true, std::memory_order_release);
+    }
+  }
+  return true;
+}
+
+void PcmTap::stop(void) {
+  for (uint32_t i = 0; i < PCM_TAP_POINT_COUNT; i++) {
+    active_[i].store(false, std::memory_order_release);
+  }
+  if (!running_.exchange(false)) {
+    return;
+  }
+  writer_.join();
+  for (uint32_t i = 0; i < PCM_TAP_POINT_COUNT; i++) {
+    closeFile(static_cast<PcmTapPoint>(i));
+  }
+  if (dropped_.load()) {
+    LOGW("====pcm tap dropped %llu buffers",
+         (unsigned long long)dropped_.load());
+  }
+}
+
+bool PcmTap::isRunning(void) const { return running_.load(); }
+
+uint64_t PcmTap::getDropped(void) const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+/*
+ * Audio thread side: one producer per tap point. Buffers are never split,
+ * so the ring only ever holds whole frames.
+ */
+void PcmTap::write(PcmTapPoint point, const int16_t *samples,
+                   uint32_t frames) {
+  if (!active_[point].load(std::memory_order_acquire)) {
+    return;
+  }
+  uint32_t count = frames * channels_;
+  RingBuffer<int16_t> *ring = rings_[point].get();
+  if (ring->availableToWrite() < count) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring->write(samples, count);
+}
+
+bool PcmTap::openFile(PcmTapPoint point, const std::string &path,
+                      uint32_t maxSeconds) {
+  TapFile &file = files_[point];
+  uint32_t bytePerFrame = channels_ * sizeof(int16_t);
+  uint64_t dataCap =
+      static_cast<uint64_t>(maxSeconds) * sampleRate_ * bytePerFrame;
+  dataCap = std::min<uint64_t>(dataCap, kMaxDataSize - kWavHeaderSize);
+  file.dataCap_ = static_cast<uint32_t>(dataCap / bytePerFrame * bytePerFrame);
+  file.mapSize_ = kWavHeaderSize + file.dataCap_;
+  file.writePos_ = 0;
+  file.wrapped_ = false;
+
+  // reserve the blocks up front: running out of space while the file is
+  // mapped would fault the writer thread instead of failing here
+  file.fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (file.fd_ < 0 ||
+      posix_fallocate(file.fd_, 0, static_cast<off_t>(file.mapSize_))) {
+    LOGE("====failed to create pcm tap file %s", path.c_str());
+    if (file.fd_ >= 0) close(file.fd_);
+    file.fd_ = -1;
+    return false;
+  }
+  void *map = mmap(nullptr, file.mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   file.fd_, 0);
+  if (map == MAP_FAILED) {
+    LOGE("====failed to map pcm tap file %s", path.c_str());
+    close(file.fd_);
+    file.fd_ = -1;
+    return false;
+  }
+  madvise(map, file.mapSize_, MADV_SEQUENTIAL);
+  file.map_ = static_cast<uint8_t *>(map);
+  updateHeader(point);
+  return true;
+}
+
+/*
+ * Put a wrapped file back in chronological order, finalize the header and
+ * cut the file down to what was actually recorded.
+ */
+void PcmTap::closeFile(PcmTapPoint point) {
+  TapFile &file = files_[point];
+  if (!file.map_) {
+    return;
+  }
+  uint8_t *data = file.map_ + kWavHeaderSize;
+  if (file.wrapped_) {
+    std::rotate(data, data + file.writePos_, data + file.dataCap_);
+    file.writePos_ = file.dataCap_;
+    file.wrapped_ = false;
+  }
+  updateHeader(point);
+  msync(file.map_, file.mapSize_, MS_SYNC);
+  munmap(file.map_, file.mapSize_);
+  if (ftruncate(file.fd_, static_cast<off_t>(kWavHeaderSize + file.writePos_))) {
+    LOGW("====failed to trim pcm tap file");
+  }
+  close(file.fd_);
+  file.map_ = nullptr;
+  file.fd_ = -1;
+}
+
+void PcmTap::updateHeader(PcmTapPoint point) {
+  TapFile &file = files_[point];
+  WavInfo info;
+  memset(&info, 0, sizeof(info));
+  info.format_ = kWavFormatPcm;
+  info.channels_ = channels_;
+  info.sampleRate_ = sampleRate_;
+  info.bitsPerSample_ = 16;
+  info.dataSize_ = file.wrapped_ ? file.dataCap_ : file.writePos_;
+  WriteWavHeader(file.map_, info);
+}
+
+/*
+ * Move everything queued for a point into its mapping; the data chunk
+ * starts at an even offset, so samples are read straight into the file.
+ */
+void PcmTap::drain(PcmTapPoint point) {
+  TapFile &file = files_[point];
+  RingBuffer<int16_t> *ring = rings_[point].get();
+  uint32_t avail;
+  while ((avail = ring->availableToRead()) > 0) {
+    uint32_t room = (file.dataCap_ - file.writePos_) / sizeof(int16_t);
+    uint32_t count = ring->read(
+        reinterpret_cast<int16_t *>(file.map_ + kWavHeaderSize +
+                                    file.writePos_),
+        std::min(avail, room));
+    file.writePos_ += count * sizeof(int16_t);
+    if (file.writePos_ == file.dataCap_) {
+      file.writePos_ = 0;
+      file.wrapped_ = true;
+    }
+  }
+  updateHeader(point);
+}
+
+void PcmTap::writerLoop(void) {
+  bool running = true;
+  while (running) {
+    // one last pass after stop() for what was queued before it
+    running = running_.load(std::memory_order_acquire);
+    ThreadPolicy::instance()->applyIfChanged(THREAD_ROLE_WORKER);
+    for (uint32_t i = 0; i < PCM_TAP_POINT_COUNT; i++) {
+      if (files_[i].map_) {
+        drain(static_cast<PcmTapPoint>(i));
+      }
+    }
+    if (running) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(kDrainIntervalMs));
+    }
+  }
+}
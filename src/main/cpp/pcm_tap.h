@@ -0,0 +1,90 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_PCM_TAP_H
+#define NATIVE_AUDIO_PCM_TAP_H
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include "audio_common.h"
+
+/*
+ * Points of the pipeline audio can be tapped at; the values are bit
+ * positions of the mask given to PcmTap::start() (and mirrored in Java)
+ */
+enum PcmTapPoint {
+  PCM_TAP_CAPTURE = 0,         // raw capture, before any processing
+  PCM_TAP_ECHO_CANCELLER = 1,  // after the echo canceller
+  PCM_TAP_CONDITIONER = 2,     // after the DC blocker / noise gate
+  PCM_TAP_DELAY = 3,           // after the delay effect
+  PCM_TAP_PLAYER = 4,          // what the player hands to the device
+  PCM_TAP_POINT_COUNT
+};
+
+/*
+ * Debug capture of 16 bit PCM at several pipeline points at once.
+ *
+ * write() is called on the audio threads: it copies the buffer into a
+ * lock-free ring of the tap point and returns; a full ring drops the whole
+ * buffer and counts it. A background thread drains the rings straight into
+ * memory mapped, preallocated WAV files, one file per point:
+ *     <pathPrefix>_<point>.wav
+ * Every file holds up to maxSeconds of audio; once full it wraps around and
+ * keeps the most recent maxSeconds (the data is put back in order when the
+ * tap is stopped). The header is kept current while recording, so a crash
+ * still leaves a playable file.
+ */
+class PcmTap {
+ public:
+  explicit PcmTap(SLmilliHertz sampleRate, uint16_t channels);
+  ~PcmTap();
+
+  bool start(const char *pathPrefix, uint32_t pointMask, uint32_t maxSeconds);
+  void stop(void);
+  bool isRunning(void) const;
+  uint64_t getDropped(void) const;
+
+  void write(PcmTapPoint point, const int16_t *samples, uint32_t frames);
+
+ private:
+  struct TapFile {
+    int fd_;
+    uint8_t *map_;
+    size_t mapSize_;
+    uint32_t dataCap_;   // byte, whole frames
+    uint32_t writePos_;  // byte offset into the data chunk
+    bool wrapped_;
+  };
+
+  uint32_t sampleRate_;  // Hz
+  uint16_t channels_;
+
+  std::unique_ptr<RingBuffer<int16_t>> rings_[PCM_TAP_POINT_COUNT];
+  std::atomic<bool> active_[PCM_TAP_POINT_COUNT];
+  TapFile files_[PCM_TAP_POINT_COUNT];
+  std::atomic<bool> running_;
+  std::atomic<uint64_t> dropped_;
+  std::thread writer_;
+
+  bool openFile(PcmTapPoint point, const std::string &path,
+                uint32_t maxSeconds);
+  void closeFile(PcmTapPoint point);
+  void drain(PcmTapPoint point);
+  void updateHeader(PcmTapPoint point);
+  void writerLoop(void);
+};
+
+#endif  // NATIVE_AUDIO_PCM_TAP_H
@@ -0,0 +1,337 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "pitch_shifter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "dsp_kernels.h"
+#include "trace.h"
+
+const float PitchShifter::kDefaultSearchMs = 2.5f;
+// keeps the delay at +12 semitones (search + 10 ms) under 20 ms
+const float PitchShifter::kMaxSearchMs = 7.5f;
+
+static const uint32_t kMsPerSec = 1000;
+static const float kHopMs = 5.0f;
+static const float kMaxSemitones = 12.0f;
+static const float kMaxCents = 100.0f;
+static const double kMaxRatio = 2.0;  // kMaxSemitones up
+
+static inline int16_t SaturateS16(float sample) {
+  if (sample >= 32767.0f) return 32767;
+  if (sample <= -32768.0f) return -32768;
+  return static_cast<int16_t>(lrintf(sample));
+}
+
+/**
+ * @param searchMs how far a grain may move to line up with the previous
+ *        one, 0 .. kMaxSearchMs; each ms adds 1 ms of delay
+ */
+PitchShifter::PitchShifter(int32_t sampleRate, int32_t channelCount,
+                           SLuint32 format, float searchMs)
+    : AudioFormat(sampleRate, channelCount, format),
+      written_(0),
+      hopPos_(0),
+      active_(false),
+      semitones_(0.0f),
+      cents_(0.0f),
+      mix_(0.0f) {
+  assert(format_ == SL_PCMSAMPLEFORMAT_FIXED_16);
+  // sampleRate_ is in milli Hz
+  float framesPerMs = (float)sampleRate_ / kMsPerSec / kMsPerSec;
+  searchMs = std::max(0.0f, std::min(searchMs, kMaxSearchMs));
+  hopFrames_ = static_cast<int32_t>(roundf(kHopMs * framesPerMs));
+  corrFrames_ = hopFrames_;
+  searchFrames_ = static_cast<int32_t>(roundf(searchMs * framesPerMs));
+
+  fadeIn_ = new float[hopFrames_];
+  for (int32_t i = 0; i < hopFrames_; i++) {
+    fadeIn_[i] = 0.5f - 0.5f * cosf(static_cast<float>(M_PI) * i / hopFrames_);
+  }
+
+  // as far back as a grain or the search may look, plus the cubic's 4
+  int32_t reach = delayFrames(kMaxRatio) + searchFrames_ + 2 * hopFrames_ +
+                  corrFrames_ + 4;
+  lineFrames_ = 1;
+  while (lineFrames_ < reach) {
+    lineFrames_ <<= 1;
+  }
+  line_ = new int16_t[lineFrames_ * channelCount_];
+  mono_ = new int16_t[2 * lineFrames_];
+  reset();
+}
+
+PitchShifter::~PitchShifter() {
+  delete[] mono_;
+  delete[] line_;
+  delete[] fadeIn_;
+}
+
+/**
+ * Queue a parameter change for the next process() call, offset frames into
+ * the buffer; an offset before the previous one's is moved up to it.
+ * @return false if the schedule is full or param is unknown
+ */
+bool PitchShifter::schedule(int32_t param, float value, uint32_t offset,
+                            uint32_t rampFrames) {
+  if (param < 0 || param >= PITCH_PARAM_COUNT || schedule_.isFull()) {
+    return false;
+  }
+  schedule_.add(param, value, offset, rampFrames);
+  return true;
+}
+
+/*
+ * For a buffer the effect does not process (bypassed, or skipped as
+ * silent): the scheduled changes take effect as if stamped past its end,
+ * so the schedule is free for the next buffer.
+ */
+void PitchShifter::skipSchedule(void) {
+  for (int32_t i = 0; i < schedule_.size(); i++) {
+    setParam(schedule_[i]);
+  }
+  schedule_.clear();
+}
+
+/*
+ * The furthest back a grain reads: the delay at the highest ratio, the
+ * search, and the two hops a grain lasts (read at half speed, at worst).
+ * Nothing once only the dry signal is heard.
+ */
+uint32_t PitchShifter::tailFrames(void) const {
+  if (!active_ && mix_.target() == 0.0f) {
+    return 0;
+  }
+  return delayFrames(kMaxRatio) + searchFrames_ + 2 * hopFrames_;
+}
+
+uint32_t PitchShifter::latencyFrames(float semitones) const {
+  return delayFrames(pow(2.0, semitones / 12.0));
+}
+
+void PitchShifter::reset(void) {
+  memset(line_, 0, lineFrames_ * channelCount_ * sizeof(int16_t));
+  memset(mono_, 0, 2 * lineFrames_ * sizeof(int16_t));
+  prev_.valid_ = false;
+  cur_.valid_ = false;
+  hopPos_ = 0;
+}
+
+/*
+ * Distance behind the newest frame of a grain's nominal start, so that
+ * wherever the search puts it:
+ *   - the compared segment is already written
+ *   - reading faster than the input, the grain never reaches the input
+ *     (the cubic looks 2 frames ahead)
+ *   - the segment the next grain is compared with is written when it starts
+ */
+int32_t PitchShifter::delayFrames(double ratio) const {
+  int32_t delay = corrFrames_ - 1;
+  if (ratio > 1.0) {
+    double over = ratio - 1.0;
+    delay = std::max(delay, static_cast<int32_t>(
+                                ceil(2.0 + (2 * hopFrames_ - 1) * over)));
+    delay = std::max(delay, static_cast<int32_t>(
+                                ceil(hopFrames_ * over + corrFrames_ - 1)));
+  }
+  return searchFrames_ + delay;
+}
+
+/*
+ * Offset from nominal, within +-searchFrames_, where the mono line matches
+ * the segment at reference best: the largest corr * |corr| / energy, i.e.
+ * the squared normalized correlation with its sign. The candidate energy
+ * slides along, one frame in and one out. 0 when nothing correlates.
+ */
+int32_t PitchShifter::search(int64_t reference, int64_t nominal) const {
+  int64_t oldest = written_ - lineFrames_;
+  if (reference < oldest || reference + corrFrames_ > written_ ||
+      nominal - searchFrames_ < oldest) {
+    return 0;
+  }
+  int32_t mask = lineFrames_ - 1;
+  // the mono line is doubled, so both segments are contiguous
+  const int16_t *ref = mono_ + (reference & mask);
+  const int16_t *cand = mono_ + ((nominal - searchFrames_) & mask);
+  int64_t energy = DotProductS16(cand, cand, corrFrames_);
+  double best = 0.0;
+  int32_t bestShift = 0;
+  for (int32_t k = 0; k <= 2 * searchFrames_; k++) {
+    int64_t corr = DotProductS16(ref, cand + k, corrFrames_);
+    if (corr > 0) {
+      double score = static_cast<double>(corr) * corr /
+                     std::max<int64_t>(energy, 1);
+      if (score > best) {
+        best = score;
+        bestShift = k - searchFrames_;
+      }
+    }
+    if (k < 2 * searchFrames_) {
+      int32_t out = cand[k];
+      int32_t in = cand[k + corrFrames_];
+      energy += in * in - out * out;
+    }
+  }
+  return bestShift;
+}
+
+/*
+ * At a hop boundary, right after the newest frame was written: the current
+ * grain fades out from here and a new one, at the current pitch, fades in.
+ * It lines up with where the current grain would have gone on reading.
+ */
+void PitchShifter::startGrain(void) {
+  float semitones = semitones_.value() + cents_.value() / kMaxCents;
+  semitones = std::max(-kMaxSemitones, std::min(semitones, kMaxSemitones));
+  double ratio = pow(2.0, semitones / 12.0);
+  int64_t nominal = written_ - 1 - delayFrames(ratio);
+  double start = static_cast<double>(nominal);
+  if (cur_.valid_) {
+    // the search matches whole frames; the new grain keeps the fraction of
+    // where the current one would have gone on, or every splice would drop
+    // it and flatten the pitch
+    double next = cur_.start_ + hopFrames_ * cur_.ratio_;
+    double whole = floor(next);
+    start += search(static_cast<int64_t>(whole), nominal) + (next - whole);
+  }
+  prev_ = cur_;
+  cur_.start_ = start;
+  cur_.ratio_ = ratio;
+  cur_.valid_ = true;
+}
+
+// Catmull-Rom between the line frames around pos
+float PitchShifter::readLine(double pos, int32_t ch) const {
+  int64_t whole = static_cast<int64_t>(floor(pos));
+  float f = static_cast<float>(pos - whole);
+  int32_t mask = lineFrames_ - 1;
+  float xm1 = line_[((whole - 1) & mask) * channelCount_ + ch];
+  float x0 = line_[(whole & mask) * channelCount_ + ch];
+  if (f == 0.0f) {
+    return x0;
+  }
+  float x1 = line_[((whole + 1) & mask) * channelCount_ + ch];
+  float x2 = line_[((whole + 2) & mask) * channelCount_ + ch];
+  return x0 + 0.5f * f * (x1 - xm1 +
+                          f * (2.0f * xm1 - 5.0f * x0 + 4.0f * x1 - x2 +
+                               f * (3.0f * (x0 - x1) + x2 - xm1)));
+}
+
+void PitchShifter::setParam(const ParamEvent &event) {
+  float value = event.value_;
+  switch (event.param_) {
+    case PITCH_PARAM_SEMITONES:
+      semitones_.set(std::max(-kMaxSemitones, std::min(value, kMaxSemitones)),
+                     event.rampFrames_);
+      break;
+    case PITCH_PARAM_CENTS:
+      cents_.set(std::max(-kMaxCents, std::min(value, kMaxCents)),
+                 event.rampFrames_);
+      break;
+    case PITCH_PARAM_MIX:
+      mix_.set(std::max(0.0f, std::min(value, 1.0f)), event.rampFrames_);
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+ * Run the buffer in pieces between the scheduled parameter changes, so each
+ * one lands on its frame.
+ */
+void PitchShifter::process(int16_t *liveAudio, int32_t numFrames) {
+  TRACE_SCOPE("PitchShifter::process");
+  int32_t frame = 0;
+  int32_t next = 0;
+  while (frame < numFrames) {
+    while (next < schedule_.size() &&
+           schedule_[next].offset_ <= static_cast<uint32_t>(frame)) {
+      setParam(schedule_[next++]);
+    }
+    int32_t end = numFrames;
+    if (next < schedule_.size() &&
+        schedule_[next].offset_ < static_cast<uint32_t>(numFrames)) {
+      end = schedule_[next].offset_;
+    }
+    processFrames(liveAudio + frame * channelCount_, end - frame);
+    frame = end;
+  }
+  // anything stamped past this buffer takes effect from the next one
+  while (next < schedule_.size()) {
+    setParam(schedule_[next++]);
+  }
+  schedule_.clear();
+}
+
+/*
+ * Per frame: the input goes into the line (and its mono copy); while the
+ * mix is above 0, the output is the fading out grain plus the fading in
+ * one, mixed with the input by mix_. Grains start over from silence each
+ * time the mix leaves 0.
+ */
+void PitchShifter::processFrames(int16_t *liveAudio, int32_t numFrames) {
+  int32_t mask = lineFrames_ - 1;
+  for (int32_t f = 0; f < numFrames; f++) {
+    float mix = mix_.next();
+    semitones_.next();
+    cents_.next();
+
+    int32_t pos = static_cast<int32_t>(written_ & mask);
+    int16_t *line = line_ + pos * channelCount_;
+    int32_t sum = 0;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      line[ch] = liveAudio[ch];
+      sum += ch < 2 ? liveAudio[ch] : 0;
+    }
+    int16_t mono = static_cast<int16_t>(channelCount_ > 1 ? sum >> 1 : sum);
+    mono_[pos] = mono;
+    mono_[pos + lineFrames_] = mono;
+    written_++;
+
+    if (!active_) {
+      if (mix == 0.0f) {
+        liveAudio += channelCount_;
+        continue;
+      }
+      active_ = true;
+      prev_.valid_ = false;
+      cur_.valid_ = false;
+      hopPos_ = 0;
+    }
+    if (hopPos_ == 0) {
+      startGrain();
+    }
+    float fadeIn = fadeIn_[hopPos_];
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      float wet = fadeIn * readLine(cur_.start_ + hopPos_ * cur_.ratio_, ch);
+      if (prev_.valid_) {
+        wet += (1.0f - fadeIn) *
+               readLine(prev_.start_ + (hopFrames_ + hopPos_) * prev_.ratio_,
+                        ch);
+      }
+      float dry = liveAudio[ch];
+      liveAudio[ch] = SaturateS16(dry + mix * (wet - dry));
+    }
+    liveAudio += channelCount_;
+    if (++hopPos_ == hopFrames_) {
+      hopPos_ = 0;
+    }
+    if (mix == 0.0f && !mix_.isRamping()) {
+      active_ = false;
+    }
+  }
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_PITCH_SHIFTER_H
+#define NATIVE_AUDIO_PITCH_SHIFTER_H
+#include "audio_effect.h"
+
+/*
+ * WSOLA pitch shifter, -12 .. +12 semitones.
+ *
+ * Like AudioDelay, the input goes into a line allocated up front. The
+ * output is made of grains of two hops (5 ms each) crossfaded with a Hann
+ * window at 50% overlap. Each grain reads the line at the pitch ratio
+ * (cubic interpolation), so it resamples while the grain spacing keeps
+ * the duration. Before a grain starts, it is moved within +-searchMs to
+ * the position where the input best matches what the previous grain would
+ * have continued with: the peak of the normalized cross-correlation on a
+ * mono copy of the line (DotProductS16, NEON on ARM).
+ *
+ * Grains only read frames already written, so the result does not depend
+ * on the buffer size. The delay behind the input is smallest without a
+ * shift or shifting down (7.5 ms with the default search) and at most
+ * 12.5 ms at +12 semitones; latencyFrames() tells. Pitch changes are
+ * picked up at the next grain; the mix ramps per frame. Audio thread only,
+ * like AudioDelay.
+ */
+class PitchShifter : public AudioFormat {
+ public:
+  static const float kDefaultSearchMs;
+  static const float kMaxSearchMs;
+
+  explicit PitchShifter(int32_t sampleRate, int32_t channelCount,
+                        SLuint32 format, float searchMs = kDefaultSearchMs);
+  ~PitchShifter();
+
+  // PITCH_PARAM_* change offset frames into the next process()
+  bool schedule(int32_t param, float value, uint32_t offset,
+                uint32_t rampFrames);
+  bool isScheduleFull(void) const { return schedule_.isFull(); }
+  void skipSchedule(void);
+  // frames the output may still be audible after the input went silent
+  uint32_t tailFrames(void) const;
+  // frames a grain starts behind the input at a shift of semitones
+  uint32_t latencyFrames(float semitones) const;
+  // forget the input, e.g. after being bypassed
+  void reset(void);
+  void process(int16_t *liveAudio, int32_t numFrames);
+
+ private:
+  int32_t hopFrames_;
+  int32_t corrFrames_;    // length of the compared segments
+  int32_t searchFrames_;  // grain moves by up to +-this
+  float *fadeIn_;         // hopFrames_ of the Hann window's rising half
+
+  int16_t *line_;  // interleaved input
+  int16_t *mono_;  // mono copy, written twice: [pos] and [pos + lineFrames_]
+  int32_t lineFrames_;  // power of 2
+  int64_t written_;     // frames written so far
+
+  struct Grain {
+    double start_;  // line position (written_ based) of the first frame
+    double ratio_;  // line frames read per output frame
+    bool valid_;
+  };
+  Grain prev_;
+  Grain cur_;
+  int32_t hopPos_;  // output frame within the current hop
+  bool active_;
+
+  RampedParam semitones_;
+  RampedParam cents_;
+  RampedParam mix_;
+  ParamSchedule schedule_;
+
+  int32_t delayFrames(double ratio) const;
+  int32_t search(int64_t reference, int64_t nominal) const;
+  void startGrain(void);
+  float readLine(double pos, int32_t ch) const;
+  void setParam(const ParamEvent &event);
+  void processFrames(int16_t *liveAudio, int32_t numFrames);
+};
+
+#endif  // NATIVE_AUDIO_PITCH_SHIFTER_H
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "rt_log.h"
+#include "thread_policy.h"
+
+static const int32_t kFlushIntervalMs = 20;
+static const uint32_t kDrainBatch = 64;
+static const size_t kMaxLineSize = 512;
+
+RtLogger *RtLogger::instance(void) {
+  static RtLogger logger;
+  return &logger;
+}
+
+RtLogger::RtLogger() : released_(0), running_(false), dropped_(0) {
+  for (uint32_t i = 0; i < kRtLogMaxThreads; i++) {
+    claimed_[i].store(false);
+  }
+}
+
+RtLogger::~RtLogger() { stop(); }
+
+/*
+ * Rings are allocated here, never on the audio thread, and are kept for the
+ * life of the process: a callback thread may still hold on to its slot.
+ */
+bool RtLogger::start(void) {
+  if (running_.load()) {
+    return true;
+  }
+  for (uint32_t i = 0; i < kRtLogMaxThreads; i++) {
+    if (!rings_[i]) {
+      rings_[i].reset(new RingBuffer<RtLogRecord>(kRtLogRingRecords));
+    }
+  }
+  running_.store(true, std::memory_order_release);
+  flusher_ = std::thread(&RtLogger::flushLoop, this);
+  return true;
+}
+
+void RtLogger::stop(void) {
+  if (!running_.exchange(false)) {
+    return;
+  }
+  if (flusher_.joinable()) {
+    flusher_.join();
+  }
+}
+
+bool RtLogger::isRunning(void) const {
+  return running_.load(std::memory_order_acquire);
+}
+
+uint64_t RtLogger::getDropped(void) const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+/*
+ * A thread's claim on a ring, given back when the thread exits. Records it
+ * left in the ring are still flushed; the next thread to claim the slot
+ * appends after them. A thread which found every slot taken only looks
+ * again once some slot was given back.
+ */
+struct RtLogger::ThreadSlot {
+  RtLogger *owner_ = nullptr;
+  int32_t index_ = -1;
+  uint32_t released_ = 0;  // owner's count at the last failed claim
+
+  ~ThreadSlot() {
+    if (index_ >= 0) {
+      owner_->claimed_[index_].store(false, std::memory_order_release);
+      owner_->released_.fetch_add(1, std::memory_order_release);
+    }
+  }
+};
+
+/*
+ * The calling thread's ring; a slot is claimed with compare-and-swap the
+ * first time a thread logs and cached in a thread local afterwards.
+ */
+RingBuffer<RtLogRecord> *RtLogger::threadRing(void) {
+  static thread_local ThreadSlot slot;
+  if (slot.index_ < 0) {
+    uint32_t released = released_.load(std::memory_order_acquire);
+    if (slot.owner_ && slot.released_ == released) {
+      return nullptr;
+    }
+    slot.owner_ = this;
+    slot.released_ = released;
+    for (uint32_t i = 0; i < kRtLogMaxThreads; i++) {
+      bool expected = false;
+      if (claimed_[i].compare_exchange_strong(expected, true,
+                                              std::memory_order_acquire)) {
+        slot.index_ = i;
+        break;
+      }
+    }
+    if (slot.index_ < 0) {
+      return nullptr;
+    }
+  }
+  return rings_[slot.index_].get();
+}
+
+void RtLogger::write(const char *fmt, const RtLogArg *args,
+                     uint32_t argCount) {
+  if (!running_.load(std::memory_order_acquire)) {
+    return;
+  }
+  RtLogRecord record;
+  record.time_ = GetMonotonicNanos();
+  record.fmt_ = fmt;
+  record.argCount_ = argCount;
+  memcpy(record.args_, args, argCount * sizeof(RtLogArg));
+
+  RingBuffer<RtLogRecord> *ring = threadRing();
+  if (!ring || ring->write(&record, 1) != 1) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+/*
+ * printf style formatting of a record: every conversion consumes the next
+ * argument, integer conversions are widened to long long whatever length
+ * modifier the format carries (so PRIu64 and friends work too).
+ */
+static void FormatRecord(const RtLogRecord &record, char *out, size_t size) {
+  size_t len = 0;
+  uint32_t argIdx = 0;
+  const char *p = record.fmt_;
+  int n = snprintf(out, size, "[%lld.%06lld] ",
+                   (long long)(record.time_ / 1000000000),
+                   (long long)((record.time_ / 1000) % 1000000));
+  len = n > 0 ? n : 0;
+
+  while (*p && len + 1 < size) {
+    if (*p != '%') {
+      out[len++] = *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[len++] = '%';
+      p += 2;
+      continue;
+    }
+    // copy flags/width/precision, skip length modifiers
+    char spec[32];
+    size_t specLen = 0;
+    spec[specLen++] = *p++;
+    while (*p && strchr("-+ #0123456789.", *p) && specLen < sizeof(spec) - 4) {
+      spec[specLen++] = *p++;
+    }
+    while (*p && strchr("hlLqjzt", *p)) p++;
+    char conv = *p ? *p++ : 'd';
+
+    RtLogArg arg;
+    arg.i_ = 0;
+    if (argIdx < record.argCount_) {
+      arg = record.args_[argIdx];
+    }
+    argIdx++;
+
+    if (strchr("diouxXc", conv)) {
+      spec[specLen++] = 'l';
+      spec[specLen++] = 'l';
+      spec[specLen++] = conv == 'c' ? 'd' : conv;
+      spec[specLen] = 0;
+      n = snprintf(out + len, size - len, spec, (long long)arg.i_);
+    } else if (strchr("feEgGaA", conv)) {
+      spec[specLen++] = conv;
+      spec[specLen] = 0;
+      n = snprintf(out + len, size - len, spec, arg.d_);
+    } else if (conv == 's') {
+      spec[specLen++] = 's';
+      spec[specLen] = 0;
+      n = snprintf(out + len, size - len, spec, arg.s_ ? arg.s_ : "(null)");
+    } else {
+      n = 0;
+    }
+    if (n > 0) {
+      len += static_cast<size_t>(n);
+      if (len >= size) len = size - 1;
+    }
+  }
+  out[len] = 0;
+}
+
+uint32_t RtLogger::drain(AndroidLog *out) {
+  RtLogRecord records[kDrainBatch];
+  char line[kMaxLineSize];
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < kRtLogMaxThreads; i++) {
+    if (!rings_[i]) continue;
+    uint32_t count;
+    while ((count = rings_[i]->read(records, kDrainBatch)) > 0) {
+      for (uint32_t r = 0; r < count; r++) {
+        FormatRecord(records[r], line, sizeof(line));
+        out->log("%s", line);
+      }
+      total += count;
+    }
+  }
+  return total;
+}
+
+void RtLogger::flushLoop(void) {
+  std::string name = "rt";
+  AndroidLog out(name);
+  uint64_t reportedDrops = 0;
+  bool running = true;
+  while (running) {
+    // one last pass after stop() so nothing logged before it is lost
+    running = running_.load(std::memory_order_acquire);
+    ThreadPolicy::instance()->applyIfChanged(THREAD_ROLE_WORKER);
+    drain(&out);
+    uint64_t drops = dropped_.load(std::memory_order_relaxed);
+    if (drops != reportedDrops) {
+      out.log("====%llu log records dropped\n",
+              (unsigned long long)(drops - reportedDrops));
+      reportedDrops = drops;
+    }
+    if (running) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(kFlushIntervalMs));
+    }
+  }
+  out.flush();
+}
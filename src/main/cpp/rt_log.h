@@ -0,0 +1,115 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_RT_LOG_H
+#define NATIVE_AUDIO_RT_LOG_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include "audio_common.h"
+
+/*
+ * Real-time safe logging for the audio callbacks.
+ *
+ * RTLOG(fmt, ...) does not format, lock, allocate or touch files: it copies
+ * a fixed size binary record (timestamp, format pointer, up to
+ * kRtLogMaxArgs integer/float/literal string arguments) into a lock-free
+ * ring owned by the calling thread. A background thread formats the
+ * records printf style and writes them through AndroidLog. When a ring is
+ * full the record is dropped and counted.
+ *
+ * fmt and %s arguments must be string literals (only the pointer is kept).
+ */
+static const uint32_t kRtLogMaxArgs = 4;
+static const uint32_t kRtLogMaxThreads = 8;
+static const uint32_t kRtLogRingRecords = 1024;
+
+union RtLogArg {
+  int64_t i_;
+  double d_;
+  const char *s_;
+};
+
+struct RtLogRecord {
+  int64_t time_;  // CLOCK_MONOTONIC ns
+  const char *fmt_;
+  uint32_t argCount_;
+  RtLogArg args_[kRtLogMaxArgs];
+};
+
+class RtLogger {
+ public:
+  static RtLogger *instance(void);
+
+  bool start(void);
+  void stop(void);
+  bool isRunning(void) const;
+  uint64_t getDropped(void) const;
+
+  void write(const char *fmt, const RtLogArg *args, uint32_t argCount);
+
+ private:
+  RtLogger();
+  ~RtLogger();
+
+  struct ThreadSlot;
+
+  RingBuffer<RtLogRecord> *threadRing(void);
+  void flushLoop(void);
+  uint32_t drain(AndroidLog *out);
+
+  std::unique_ptr<RingBuffer<RtLogRecord>> rings_[kRtLogMaxThreads];
+  std::atomic<bool> claimed_[kRtLogMaxThreads];
+  std::atomic<uint32_t> released_;  // slots given back so far
+  std::atomic<bool> running_;
+  std::atomic<uint64_t> dropped_;
+  std::thread flusher_;
+};
+
+template <typename T>
+static inline typename std::enable_if<std::is_integral<T>::value ||
+                                          std::is_enum<T>::value,
+                                      RtLogArg>::type
+RtLogMakeArg(T v) {
+  RtLogArg a;
+  a.i_ = static_cast<int64_t>(v);
+  return a;
+}
+template <typename T>
+static inline typename std::enable_if<std::is_floating_point<T>::value,
+                                      RtLogArg>::type
+RtLogMakeArg(T v) {
+  RtLogArg a;
+  a.d_ = static_cast<double>(v);
+  return a;
+}
+static inline RtLogArg RtLogMakeArg(const char *v) {
+  RtLogArg a;
+  a.s_ = v;
+  return a;
+}
+
+template <typename... Args>
+static inline void RtLog(const char *fmt, Args... args) {
+  static_assert(sizeof...(args) <= kRtLogMaxArgs, "too many RTLOG arguments");
+  RtLogArg packed[sizeof...(args) + 1] = {RtLogMakeArg(args)...};
+  RtLogger::instance()->write(fmt, packed, sizeof...(args));
+}
+
+#define RTLOG(...) RtLog(__VA_ARGS__)
+
+#endif  // NATIVE_AUDIO_RT_LOG_H
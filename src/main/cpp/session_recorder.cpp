@@ -0,0 +1,305 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include "session_recorder.h"
+#include "thread_policy.h"
+#include "trace.h"
+
+// a block is 85 ms at 48 kHz: waking every 40 ms keeps the ring short
+// without waking much more often than there is something to encode
+static const int32_t kDrainIntervalMs = 40;
+static const int32_t kSyncIntervalMs = 1000;
+static const uint32_t kRingSeconds = 2;
+static const uint32_t kOutFrames = 8;  // encoded frames per write()
+
+static const char *const kStreamName[SESSION_STREAM_COUNT] = {"input",
+                                                              "output"};
+
+SessionRecorder::SessionRecorder(SLmilliHertz sampleRate, uint16_t channels)
+    : sampleRate_(sampleRate / 1000),
+      channels_(channels),
+      running_(false),
+      dropped_(0),
+      outSize_(0) {
+  for (uint32_t i = 0; i < SESSION_STREAM_COUNT; i++) {
+    active_[i].store(false);
+    files_[i].fd_ = -1;
+    files_[i].frames_.store(0);
+    files_[i].bytes_.store(0);
+  }
+}
+
+SessionRecorder::~SessionRecorder() { stop(); }
+
+/*
+ * Rings and the encoder are allocated on the first start() and kept until
+ * the recorder is deleted: an audio thread may still be inside write()
+ * when a stream is deactivated.
+ */
+bool SessionRecorder::start(const char *pathPrefix, uint32_t streamMask) {
+  if (running_.load() || !pathPrefix ||
+      !(streamMask & ((1 << SESSION_STREAM_COUNT) - 1))) {
+    return false;
+  }
+  if (!encoder_) {
+    encoder_.reset(new FlacEncoder(channels_));
+    out_.resize(kOutFrames * encoder_->maxFrameBytes(kBlockFrames));
+  }
+  for (uint32_t i = 0; i < SESSION_STREAM_COUNT; i++) {
+    if (!(streamMask & (1 << i))) continue;
+    std::string path = std::string(pathPrefix) + "_" + kStreamName[i] + ".flac";
+    if (!openFile(static_cast<SessionStream>(i), path)) {
+      for (uint32_t k = 0; k < i; k++) {
+        closeFile(static_cast<SessionStream>(k));
+      }
+      return false;
+    }
+    if (!rings_[i]) {
+      rings_[i].reset(
+          new RingBuffer<int16_t>(sampleRate_ * channels_ * kRingSeconds));
+    }
+    // leftovers of a write() that raced with the previous stop()
+    rings_[i]->skip(rings_[i]->availableToRead());
+  }
+
+  dropped_.store(0);
+  running_.store(true);
+  writer_ = std::thread(&SessionRecorder::writerLoop, this);
+  for (uint32_t i = 0; i < SESSION_STREAM_COUNT; i++) {
+    if (files_[i].fd_ >= 0) {
+      active_[i].store(true, std::memory_order_release);
+    }
+  }
+  return true;
+}
+
+void SessionRecorder::stop(void) {
+  for (uint32_t i = 0; i < SESSION_STREAM_COUNT; i++) {
+    active_[i].store(false, std::memory_order_release);
+  }
+  if (!running_.exchange(false)) {
+    return;
+  }
+  writer_.join();
+  for (uint32_t i = 0; i < SESSION_STREAM_COUNT; i++) {
+    closeFile(static_cast<SessionStream>(i));
+  }
+  if (dropped_.load()) {
+    LOGW("====session recorder dropped %llu buffers",
+         (unsigned long long)dropped_.load());
+  }
+}
+
+bool SessionRecorder::isRunning(void) const { return running_.load(); }
+
+uint64_t SessionRecorder::getDropped(void) const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+void SessionRecorder::getStats(SessionStream stream,
+                               SessionStreamStats *stats) const {
+  stats->frames_ = files_[stream].frames_.load(std::memory_order_relaxed);
+  stats->bytes_ = files_[stream].bytes_.load(std::memory_order_relaxed);
+}
+
+/*
+ * Audio thread side: one producer per stream. Buffers are never split, so
+ * the ring only ever holds whole frames.
+ */
+void SessionRecorder::write(SessionStream stream, const int16_t *samples,
+                            uint32_t frames) {
+  if (!active_[stream].load(std::memory_order_acquire)) {
+    return;
+  }
+  uint32_t count = frames * channels_;
+  RingBuffer<int16_t> *ring = rings_[stream].get();
+  if (ring->availableToWrite() < count) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring->write(samples, count);
+}
+
+/*
+ * The header goes out and down to the disk before any audio, so the file
+ * is valid from the start.
+ */
+bool SessionRecorder::openFile(SessionStream stream, const std::string &path) {
+  StreamFile &file = files_[stream];
+  file.block_.resize(kBlockFrames * channels_);
+  file.blockFrames_ = 0;
+  file.frameNumber_ = 0;
+  file.minFrameBytes_ = 0;
+  file.maxFrameBytes_ = 0;
+  file.unsynced_ = false;
+  file.frames_.store(0);
+  file.bytes_.store(0);
+  file.fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (file.fd_ < 0 || !writeStreamHeader(stream) || fdatasync(file.fd_)) {
+    LOGE("====failed to create session file %s", path.c_str());
+    if (file.fd_ >= 0) close(file.fd_);
+    file.fd_ = -1;
+    return false;
+  }
+  file.bytes_.store(FlacEncoder::kStreamHeaderBytes);
+  return true;
+}
+
+/*
+ * Encode what is left, then put the length and frame sizes into the
+ * header.
+ */
+void SessionRecorder::closeFile(SessionStream stream) {
+  StreamFile &file = files_[stream];
+  if (file.fd_ < 0) {
+    return;
+  }
+  if ((file.blockFrames_ && !encodeBlock(stream)) || !flush(stream) ||
+      !writeStreamHeader(stream) || fdatasync(file.fd_)) {
+    LOGW("====failed to finalize session file %s", kStreamName[stream]);
+  }
+  outSize_ = 0;
+  close(file.fd_);
+  file.fd_ = -1;
+}
+
+bool SessionRecorder::writeStreamHeader(SessionStream stream) {
+  StreamFile &file = files_[stream];
+  FlacStreamInfo info;
+  info.sampleRate_ = sampleRate_;
+  info.channels_ = channels_;
+  info.blockFrames_ = kBlockFrames;
+  info.minFrameBytes_ = file.minFrameBytes_;
+  info.maxFrameBytes_ = file.maxFrameBytes_;
+  info.totalFrames_ = file.frames_.load(std::memory_order_relaxed);
+  uint8_t header[FlacEncoder::kStreamHeaderBytes];
+  FlacEncoder::writeStreamHeader(info, header);
+  return pwrite(file.fd_, header, sizeof(header), 0) ==
+         static_cast<ssize_t>(sizeof(header));
+}
+
+/*
+ * The block being filled becomes one FLAC frame, queued in out_; out_ is
+ * written out first when it has no room left. False when that failed.
+ */
+bool SessionRecorder::encodeBlock(SessionStream stream) {
+  StreamFile &file = files_[stream];
+  if (outSize_ + encoder_->maxFrameBytes(kBlockFrames) > out_.size() &&
+      !flush(stream)) {
+    return false;
+  }
+  TRACE_SCOPE("SessionRecorder::encodeBlock");
+  uint32_t size = static_cast<uint32_t>(
+      encoder_->encodeFrame(file.block_.data(), file.blockFrames_,
+                            file.frameNumber_++, out_.data() + outSize_));
+  outSize_ += size;
+  file.minFrameBytes_ =
+      file.minFrameBytes_ ? std::min(file.minFrameBytes_, size) : size;
+  file.maxFrameBytes_ = std::max(file.maxFrameBytes_, size);
+  file.frames_.fetch_add(file.blockFrames_, std::memory_order_relaxed);
+  file.blockFrames_ = 0;
+  return true;
+}
+
+/*
+ * Append the queued frames to the file
+ */
+bool SessionRecorder::flush(SessionStream stream) {
+  StreamFile &file = files_[stream];
+  const uint8_t *data = out_.data();
+  size_t left = outSize_;
+  off_t offset = static_cast<off_t>(file.bytes_.load(std::memory_order_relaxed));
+  while (left) {
+    ssize_t written = pwrite(file.fd_, data, left, offset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    left -= written;
+    offset += written;
+    file.bytes_.store(static_cast<uint64_t>(offset), std::memory_order_relaxed);
+  }
+  if (outSize_) {
+    file.unsynced_ = true;
+  }
+  outSize_ = 0;
+  return true;
+}
+
+/*
+ * Move everything queued for a stream into its block, encoding the block
+ * each time it is full, and write the frames out. A stream the disk
+ * refuses is closed as it is.
+ */
+void SessionRecorder::drain(SessionStream stream) {
+  StreamFile &file = files_[stream];
+  RingBuffer<int16_t> *ring = rings_[stream].get();
+  bool ok = true;
+  uint32_t count;
+  while (ok &&
+         (count = ring->read(file.block_.data() + file.blockFrames_ * channels_,
+                             (kBlockFrames - file.blockFrames_) * channels_)) >
+             0) {
+    file.blockFrames_ += count / channels_;
+    if (file.blockFrames_ == kBlockFrames) {
+      ok = encodeBlock(stream);
+    }
+  }
+  if (!ok || !flush(stream)) {
+    LOGE("====session file %s: write failed (%d), recording stopped",
+         kStreamName[stream], errno);
+    active_[stream].store(false, std::memory_order_release);
+    outSize_ = 0;
+    close(file.fd_);
+    file.fd_ = -1;
+  }
+}
+
+void SessionRecorder::writerLoop(void) {
+  auto lastSync = std::chrono::steady_clock::now();
+  bool running = true;
+  while (running) {
+    // one last pass after stop() for what was queued before it
+    running = running_.load(std::memory_order_acquire);
+    ThreadPolicy::instance()->applyIfChanged(THREAD_ROLE_WORKER);
+    for (uint32_t i = 0; i < SESSION_STREAM_COUNT; i++) {
+      if (files_[i].fd_ >= 0) {
+        drain(static_cast<SessionStream>(i));
+      }
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastSync >= std::chrono::milliseconds(kSyncIntervalMs)) {
+      lastSync = now;
+      for (uint32_t i = 0; i < SESSION_STREAM_COUNT; i++) {
+        StreamFile &file = files_[i];
+        if (file.fd_ >= 0 && file.unsynced_) {
+          fdatasync(file.fd_);
+          file.unsynced_ = false;
+        }
+      }
+    }
+    if (running) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(kDrainIntervalMs));
+    }
+  }
+}
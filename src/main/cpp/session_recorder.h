@@ -0,0 +1,111 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_SESSION_RECORDER_H
+#define NATIVE_AUDIO_SESSION_RECORDER_H
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "audio_common.h"
+#include "flac_encoder.h"
+
+/*
+ * Streams a session can record; the values are bit positions of the mask
+ * given to SessionRecorder::start() (and mirrored in Java)
+ */
+enum SessionStream {
+  SESSION_STREAM_INPUT = 0,   // raw capture
+  SESSION_STREAM_OUTPUT = 1,  // the processed capture, before drift compensation
+  SESSION_STREAM_COUNT
+};
+
+struct SessionStreamStats {
+  uint64_t frames_;  // encoded so far
+  uint64_t bytes_;   // of the file, header included
+};
+
+/*
+ * Lossless recording of whole sessions, one FLAC file per stream:
+ *     <pathPrefix>_input.flac, <pathPrefix>_output.flac
+ *
+ * write() is called on the audio thread: it copies the buffer into a
+ * lock-free ring of the stream and returns; a full ring drops the whole
+ * buffer and counts it. A background thread drains the rings, encodes every
+ * kBlockFrames into a FLAC frame (FlacEncoder) and appends the frames to the
+ * file with plain write()s, fdatasync()ing once a second. Unlike the PCM
+ * taps there is no length limit and nothing is kept in memory.
+ *
+ * Crash safety: the stream header goes to disk before any audio and claims
+ * an unknown length, and every frame carries its own sync code and CRC, so
+ * a file cut anywhere decodes up to its last whole frame: at most about a
+ * second is lost, plus what was still in the ring. stop() encodes the last
+ * partial block and rewrites the header with the length and frame sizes.
+ * A stream whose writes fail is closed and the others carry on.
+ */
+class SessionRecorder {
+ public:
+  static const uint32_t kBlockFrames = 4096;
+
+  explicit SessionRecorder(SLmilliHertz sampleRate, uint16_t channels);
+  ~SessionRecorder();
+
+  bool start(const char *pathPrefix, uint32_t streamMask);
+  void stop(void);
+  bool isRunning(void) const;
+  uint64_t getDropped(void) const;
+  void getStats(SessionStream stream, SessionStreamStats *stats) const;
+
+  void write(SessionStream stream, const int16_t *samples, uint32_t frames);
+
+ private:
+  struct StreamFile {
+    int fd_;
+    std::vector<int16_t> block_;  // the block being filled, interleaved
+    uint32_t blockFrames_;
+    uint32_t frameNumber_;
+    uint32_t minFrameBytes_;
+    uint32_t maxFrameBytes_;
+    bool unsynced_;               // written since the last fdatasync()
+    std::atomic<uint64_t> frames_;
+    std::atomic<uint64_t> bytes_;
+  };
+
+  uint32_t sampleRate_;  // Hz
+  uint16_t channels_;
+
+  std::unique_ptr<RingBuffer<int16_t>> rings_[SESSION_STREAM_COUNT];
+  std::atomic<bool> active_[SESSION_STREAM_COUNT];
+  StreamFile files_[SESSION_STREAM_COUNT];
+  std::atomic<bool> running_;
+  std::atomic<uint64_t> dropped_;
+  std::thread writer_;
+
+  // writer thread state
+  std::unique_ptr<FlacEncoder> encoder_;
+  std::vector<uint8_t> out_;  // encoded frames waiting for write()
+  size_t outSize_;
+
+  bool openFile(SessionStream stream, const std::string &path);
+  void closeFile(SessionStream stream);
+  bool writeStreamHeader(SessionStream stream);
+  bool encodeBlock(SessionStream stream);
+  bool flush(SessionStream stream);
+  void drain(SessionStream stream);
+  void writerLoop(void);
+};
+
+#endif  // NATIVE_AUDIO_SESSION_RECORDER_H
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "silence_detector.h"
+#include <algorithm>
+#include <cmath>
+#include "dsp_kernels.h"
+
+static const uint32_t kMsPerSec = 1000;
+
+// defaults: under the noise gate's closing level (-66 dBFS), so skipping
+// never takes away anything the gate would have let through
+static const float kDefaultThresholdDb = -70.0f;
+static const float kDefaultHoldMs = 200.0f;
+
+SilenceDetector::SilenceDetector(SLmilliHertz sampleRate, int32_t channels)
+    : sampleRate_(sampleRate),
+      channels_(channels),
+      enabled_(false),
+      threshold_(0),
+      holdFrames_(0),
+      quietFrames_(0),
+      skipping_(false),
+      buffers_(0),
+      skipped_(0),
+      resumes_(0),
+      skippingFlag_(false) {
+  setParam(SILENCE_PARAM_ENABLE, 1.0f);
+  setParam(SILENCE_PARAM_THRESHOLD_DB, kDefaultThresholdDb);
+  setParam(SILENCE_PARAM_HOLD_MS, kDefaultHoldMs);
+}
+
+/**
+ * Range check for the control threads
+ * @param thresholdDb buffer peak (dBFS) under which the input is silent
+ * @param holdMs silence needed, on top of the effect tails, before skipping
+ */
+bool SilenceDetector::isValid(float thresholdDb, float holdMs) {
+  return thresholdDb <= 0.0f && holdMs >= 0.0f;
+}
+
+void SilenceDetector::setParam(int32_t param, float value) {
+  switch (param) {
+    case SILENCE_PARAM_ENABLE:
+      enabled_ = value != 0.0f;
+      break;
+    case SILENCE_PARAM_THRESHOLD_DB:
+      threshold_ = static_cast<int32_t>(
+          32767.0f * powf(10.0f, std::min(value, 0.0f) / 20.0f) + 0.5f);
+      break;
+    case SILENCE_PARAM_HOLD_MS:
+      holdFrames_ = static_cast<uint32_t>(
+          std::max(value, 0.0f) * (float)sampleRate_ / kMsPerSec / kMsPerSec +
+          0.5f);
+      break;
+    default:
+      break;
+  }
+}
+
+void SilenceDetector::getStats(SilenceStats *stats) const {
+  stats->buffers_ = buffers_.load(std::memory_order_relaxed);
+  stats->skipped_ = skipped_.load(std::memory_order_relaxed);
+  stats->resumes_ = resumes_.load(std::memory_order_relaxed);
+  stats->skipping_ = skippingFlag_.load(std::memory_order_relaxed);
+}
+
+SilenceState SilenceDetector::process(const int16_t *samples, int32_t frames,
+                                      uint32_t tailFrames) {
+  buffers_.fetch_add(1, std::memory_order_relaxed);
+  bool silent =
+      enabled_ && PeakAbsS16(samples, frames * channels_) < threshold_;
+  if (!silent) {
+    quietFrames_ = 0;
+    if (!skipping_) {
+      return SILENCE_PROCESS;
+    }
+    skipping_ = false;
+    skippingFlag_.store(false, std::memory_order_relaxed);
+    resumes_.fetch_add(1, std::memory_order_relaxed);
+    return SILENCE_RESUME;
+  }
+
+  // quietFrames_ counts the silent frames the effects already ran on
+  if (!skipping_ && quietFrames_ >= holdFrames_ + (uint64_t)tailFrames) {
+    skipping_ = true;
+    skippingFlag_.store(true, std::memory_order_relaxed);
+  }
+  quietFrames_ += frames;
+  if (!skipping_) {
+    return SILENCE_PROCESS;
+  }
+  skipped_.fetch_add(1, std::memory_order_relaxed);
+  return SILENCE_SKIP;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_SILENCE_DETECTOR_H
+#define NATIVE_AUDIO_SILENCE_DETECTOR_H
+#include <atomic>
+#include "audio_common.h"
+#include "control_queue.h"
+
+/*
+ * What the capture chain does with a buffer:
+ *   PROCESS: run the effects as usual
+ *   SKIP:    the input is silent and every effect tail has died out, the
+ *            buffer is replaced by silence without running the effects
+ *   RESUME:  first buffer with signal after skipping; run the effects, the
+ *            ones following a stream (echo canceller) resynchronize first
+ */
+enum SilenceState {
+  SILENCE_PROCESS = 0,
+  SILENCE_SKIP = 1,
+  SILENCE_RESUME = 2,
+};
+
+struct SilenceStats {
+  uint64_t buffers_;  // buffers looked at
+  uint64_t skipped_;  // buffers the effects did not run for
+  uint64_t resumes_;  // times signal came back while skipping
+  bool skipping_;
+};
+
+/*
+ * Silence detector at the head of the capture chain. One peak pass over the
+ * buffer (PeakAbsS16, NEON on ARM) decides: the chain is skipped once the
+ * peak stayed below the threshold for the hold time plus the tail the
+ * effects report, and resumes on the first buffer above it.
+ *
+ * Parameters (SILENCE_PARAM_*) come through the control queue: setParam()
+ * and process() are for the capture thread, getStats() may be called from
+ * any thread.
+ */
+class SilenceDetector {
+ public:
+  explicit SilenceDetector(SLmilliHertz sampleRate, int32_t channels);
+
+  static bool isValid(float thresholdDb, float holdMs);
+  void setParam(int32_t param, float value);
+  void getStats(SilenceStats *stats) const;
+
+  // tailFrames: frames the effects keep sounding after their input stopped
+  SilenceState process(const int16_t *samples, int32_t frames,
+                       uint32_t tailFrames);
+
+ private:
+  SLmilliHertz sampleRate_;
+  int32_t channels_;
+
+  // capture thread only
+  bool enabled_;
+  int32_t threshold_;  // peak below which a buffer is silent
+  uint32_t holdFrames_;
+  uint64_t quietFrames_;
+  bool skipping_;
+
+  std::atomic<uint64_t> buffers_;
+  std::atomic<uint64_t> skipped_;
+  std::atomic<uint64_t> resumes_;
+  std::atomic<bool> skippingFlag_;  // skipping_ for getStats()
+};
+
+#endif  // NATIVE_AUDIO_SILENCE_DETECTOR_H
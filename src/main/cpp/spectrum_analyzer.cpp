@@ -0,0 +1,270 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "spectrum_analyzer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include "thread_policy.h"
+#include "trace.h"
+
+const uint32_t SpectrumAnalyzer::kMaxLevelChannels;
+
+static const uint32_t kRingSeconds = 1;
+static const uint32_t kChunkFrames = 1024;
+static const float kFloorDb = -140.0f;
+static const float kS16Scale = 32768.0f;
+// copies read() tries before it gives up on a frame being replaced
+static const int32_t kReadAttempts = 3;
+
+static inline size_t SlotBytes(uint32_t bins) {
+  size_t size = sizeof(SpectrumSlot) + bins * sizeof(float);
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+static inline float *SlotBins(SpectrumSlot *slot) {
+  return reinterpret_cast<float *>(slot + 1);
+}
+
+static inline const float *SlotBins(const SpectrumSlot *slot) {
+  return reinterpret_cast<const float *>(slot + 1);
+}
+
+static inline float LevelDb(double level) {
+  return level > 0.0 ? std::max(kFloorDb, static_cast<float>(20.0 * log10(level)))
+                     : kFloorDb;
+}
+
+SpectrumAnalyzer::SpectrumAnalyzer(SLmilliHertz sampleRate, uint16_t channels)
+    : sampleRate_(sampleRate / 1000),
+      channels_(channels),
+      active_(false),
+      running_(false),
+      dropped_(0),
+      intervalUs_(0) {
+  size_t slotBytes = SlotBytes(kMaxFftSize / 2 + 1);
+  regionSize_ = sizeof(SpectrumHeader) + 2 * slotBytes;
+  region_.reset(new uint8_t[regionSize_]);
+  memset(region_.get(), 0, regionSize_);
+  header_ = new (region_.get()) SpectrumHeader();
+  header_->sequence_.store(0);
+  header_->sampleRate_ = sampleRate_;
+  header_->slotOffset_[0] = sizeof(SpectrumHeader);
+  header_->slotOffset_[1] = static_cast<uint32_t>(sizeof(SpectrumHeader) + slotBytes);
+  header_->channels_ = std::min<uint32_t>(channels_, kMaxLevelChannels);
+  for (uint32_t slot = 0; slot < 2; slot++) {
+    new (region_.get() + header_->slotOffset_[slot]) SpectrumSlot();
+  }
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer() {
+  stop();
+  header_->~SpectrumHeader();
+}
+
+/*
+ * fftSize is a power of two within kMinFftSize .. kMaxFftSize. The header
+ * changes only here, while nothing is published; the sequence goes on from
+ * where it was, so a reader notices the restart.
+ */
+bool SpectrumAnalyzer::start(uint32_t fftSize, uint32_t framesPerSecond) {
+  if (running_.load() || fftSize < kMinFftSize || fftSize > kMaxFftSize ||
+      (fftSize & (fftSize - 1)) || !framesPerSecond ||
+      framesPerSecond > kMaxFramesPerSecond) {
+    return false;
+  }
+  if (!fft_ || fft_->size() != static_cast<int32_t>(fftSize)) {
+    fft_.reset(new RealFft(fftSize));
+    history_.assign(fftSize, 0.0f);
+    fftIn_.assign(fftSize, 0.0f);
+    re_.assign(fftSize / 2 + 1, 0.0f);
+    im_.assign(fftSize / 2 + 1, 0.0f);
+    window_.resize(fftSize);
+    double sum = 0.0;
+    for (uint32_t i = 0; i < fftSize; i++) {
+      window_[i] = static_cast<float>(0.5 - 0.5 * cos(2.0 * M_PI * i / fftSize));
+      sum += window_[i];
+    }
+    // a sine of amplitude A peaks at A * sum / 2
+    windowScale_ = static_cast<float>(2.0 / sum);
+  } else {
+    std::fill(history_.begin(), history_.end(), 0.0f);
+  }
+  if (!ring_) {
+    ring_.reset(new RingBuffer<int16_t>(sampleRate_ * channels_ * kRingSeconds));
+    chunk_.resize(kChunkFrames * channels_);
+  }
+  // leftovers of a write() that raced with the previous stop()
+  ring_->skip(ring_->availableToRead());
+
+  historyPos_ = 0;
+  framePos_ = 0;
+  for (uint32_t ch = 0; ch < kMaxLevelChannels; ch++) {
+    peak_[ch] = 0.0f;
+    sumSquares_[ch] = 0.0;
+  }
+  levelFrames_ = 0;
+  intervalUs_ = 1000000 / framesPerSecond;
+  header_->fftSize_ = fftSize;
+  header_->bins_ = fftSize / 2 + 1;
+  header_->dropped_ = 0;
+  dropped_.store(0);
+
+  running_.store(true);
+  worker_ = std::thread(&SpectrumAnalyzer::workerLoop, this);
+  active_.store(true, std::memory_order_release);
+  return true;
+}
+
+void SpectrumAnalyzer::stop(void) {
+  active_.store(false, std::memory_order_release);
+  if (!running_.exchange(false)) {
+    return;
+  }
+  worker_.join();
+}
+
+bool SpectrumAnalyzer::isRunning(void) const { return running_.load(); }
+
+/*
+ * Audio thread: a copy and nothing else; a buffer that does not fit is
+ * dropped whole.
+ */
+void SpectrumAnalyzer::write(const int16_t *samples, uint32_t frames) {
+  if (!active_.load(std::memory_order_acquire)) {
+    return;
+  }
+  uint32_t count = frames * channels_;
+  if (ring_->availableToWrite() < count) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring_->write(samples, count);
+}
+
+/*
+ * Everything queued goes into the history (mono) and the level
+ * accumulators (per channel).
+ */
+void SpectrumAnalyzer::drain(void) {
+  uint32_t size = static_cast<uint32_t>(history_.size());
+  uint32_t levelChannels = header_->channels_;
+  uint32_t count;
+  while ((count = ring_->read(chunk_.data(),
+                              static_cast<uint32_t>(chunk_.size()))) > 0) {
+    uint32_t frames = count / channels_;
+    const int16_t *frame = chunk_.data();
+    for (uint32_t f = 0; f < frames; f++, frame += channels_) {
+      float sum = 0.0f;
+      for (uint32_t ch = 0; ch < levelChannels; ch++) {
+        float sample = frame[ch] / kS16Scale;
+        peak_[ch] = std::max(peak_[ch], fabsf(sample));
+        sumSquares_[ch] += sample * sample;
+        sum += sample;
+      }
+      history_[historyPos_] = sum / levelChannels;
+      historyPos_ = (historyPos_ + 1) & (size - 1);
+    }
+    framePos_ += frames;
+    levelFrames_ += frames;
+  }
+}
+
+/*
+ * Fill the slot not shown with the newest window and levels, then make it
+ * the shown one.
+ */
+void SpectrumAnalyzer::publish(void) {
+  TRACE_SCOPE("SpectrumAnalyzer::publish");
+  uint32_t size = static_cast<uint32_t>(history_.size());
+  for (uint32_t i = 0; i < size; i++) {
+    fftIn_[i] = window_[i] * history_[(historyPos_ + i) & (size - 1)];
+  }
+  fft_->forward(fftIn_.data(), re_.data(), im_.data());
+
+  uint32_t sequence = header_->sequence_.load(std::memory_order_relaxed) + 1;
+  SpectrumSlot *slot = reinterpret_cast<SpectrumSlot *>(
+      region_.get() + header_->slotOffset_[sequence & 1]);
+  // the slot held the frame before the shown one: a reader still copying
+  // it must see the sequence moved on once it sees any of what follows
+  std::atomic_thread_fence(std::memory_order_release);
+  float *bins = SlotBins(slot);
+  float scale = windowScale_ * windowScale_;
+  for (uint32_t k = 0; k <= size / 2; k++) {
+    float power = (re_[k] * re_[k] + im_[k] * im_[k]) * scale;
+    bins[k] = power > 0.0f ? std::max(kFloorDb, 10.0f * log10f(power))
+                           : kFloorDb;
+  }
+  for (uint32_t ch = 0; ch < kMaxLevelChannels; ch++) {
+    bool given = ch < header_->channels_ && levelFrames_;
+    slot->peakDb_[ch] = given ? LevelDb(peak_[ch]) : kFloorDb;
+    slot->rmsDb_[ch] =
+        given ? LevelDb(sqrt(sumSquares_[ch] / levelFrames_)) : kFloorDb;
+    peak_[ch] = 0.0f;
+    sumSquares_[ch] = 0.0;
+  }
+  levelFrames_ = 0;
+  slot->framePos_ = framePos_;
+  slot->sequence_ = sequence;
+  header_->dropped_ = dropped_.load(std::memory_order_relaxed);
+  header_->sequence_.store(sequence, std::memory_order_release);
+}
+
+int32_t SpectrumAnalyzer::read(float *peakDb, float *rmsDb,
+                               float *magnitudesDb, uint32_t maxBins,
+                               uint32_t *bins) const {
+  for (int32_t attempt = 0; attempt < kReadAttempts; attempt++) {
+    uint32_t sequence = header_->sequence_.load(std::memory_order_acquire);
+    if (sequence == 0) {
+      return -1;
+    }
+    const SpectrumSlot *slot = reinterpret_cast<const SpectrumSlot *>(
+        region_.get() + header_->slotOffset_[sequence & 1]);
+    *bins = std::min(header_->bins_, maxBins);
+    memcpy(peakDb, slot->peakDb_, sizeof(slot->peakDb_));
+    memcpy(rmsDb, slot->rmsDb_, sizeof(slot->rmsDb_));
+    memcpy(magnitudesDb, SlotBins(slot), *bins * sizeof(float));
+    // the copy before the check: a slot written over meanwhile shows as a
+    // newer sequence
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header_->sequence_.load(std::memory_order_relaxed) == sequence) {
+      return static_cast<int32_t>(sequence);
+    }
+  }
+  return -1;
+}
+
+/*
+ * One frame per interval, on a fixed schedule; nothing is published while
+ * no audio comes in, so the display keeps the last frame.
+ */
+void SpectrumAnalyzer::workerLoop(void) {
+  auto next = std::chrono::steady_clock::now();
+  while (running_.load(std::memory_order_acquire)) {
+    ThreadPolicy::instance()->applyIfChanged(THREAD_ROLE_WORKER);
+    drain();
+    if (levelFrames_) {
+      publish();
+    }
+    next += std::chrono::microseconds(intervalUs_);
+    auto now = std::chrono::steady_clock::now();
+    if (next < now) {
+      next = now;  // fell behind: skip the missed frames
+    }
+    std::this_thread::sleep_until(next);
+  }
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_SPECTRUM_ANALYZER_H
+#define NATIVE_AUDIO_SPECTRUM_ANALYZER_H
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "audio_common.h"
+#include "fft.h"
+
+/*
+ * Layout of the shared region, native byte order; mirrored in Java. The
+ * region holds the header and two slots; the newest frame is in slot
+ * sequence_ & 1 and the writer only ever fills the other one.
+ */
+struct SpectrumHeader {
+  std::atomic<uint32_t> sequence_;  // frames published so far
+  uint32_t fftSize_;
+  uint32_t bins_;                   // fftSize_ / 2 + 1
+  uint32_t sampleRate_;             // Hz
+  uint32_t slotOffset_[2];          // byte offsets of the slots
+  uint32_t channels_;               // levels given, up to 2
+  uint32_t dropped_;                // buffers the ring had no room for
+};
+
+struct SpectrumSlot {
+  uint32_t sequence_;  // the frame it holds, equal to the header's once done
+  uint32_t reserved_;
+  int64_t framePos_;   // frames analyzed up to the end of the window
+  float peakDb_[2];    // per channel, since the previous frame
+  float rmsDb_[2];
+  // bins_ floats of magnitude in dB follow; 0 dB is a full scale sine
+};
+
+/*
+ * Live level and spectrum of the processed audio, for displays.
+ *
+ * write() is called on the audio thread at the end of the capture chain:
+ * it copies the buffer into a lock-free ring and returns, dropping the
+ * buffer when the ring is full. A background thread wakes framesPerSecond
+ * times a second, drains the ring, takes a Hann windowed FFT of the last
+ * fftSize frames (channels mixed down) and the peak and RMS level of each
+ * channel, and publishes them into the region: the slot not shown, then
+ * the sequence. A slot is refilled one frame after it was published, so a
+ * reader who copies it out within a frame period gets a whole frame, and
+ * can tell by the sequences whether it did. read() is that reader, with the
+ * fences the check needs.
+ *
+ * The region is sized for kMaxFftSize and lives as long as the analyzer,
+ * so Java can hold it as a direct ByteBuffer across start() and stop().
+ */
+class SpectrumAnalyzer {
+ public:
+  static const uint32_t kMinFftSize = 256;
+  static const uint32_t kMaxFftSize = 4096;
+  static const uint32_t kMaxFramesPerSecond = 120;
+
+  explicit SpectrumAnalyzer(SLmilliHertz sampleRate, uint16_t channels);
+  ~SpectrumAnalyzer();
+
+  bool start(uint32_t fftSize, uint32_t framesPerSecond);
+  void stop(void);
+  bool isRunning(void) const;
+
+  void *region(void) const { return region_.get(); }
+  size_t regionSize(void) const { return regionSize_; }
+  /*
+   * Copy the newest frame out, from any thread: the peak and RMS levels of
+   * two channels, and up to maxBins magnitudes (*bins tells how many).
+   * Returns the frame's sequence, or -1 when there is none yet or it was
+   * replaced every time it was being copied.
+   */
+  int32_t read(float *peakDb, float *rmsDb, float *magnitudesDb,
+               uint32_t maxBins, uint32_t *bins) const;
+
+  void write(const int16_t *samples, uint32_t frames);
+
+ private:
+  static const uint32_t kMaxLevelChannels = 2;
+
+  uint32_t sampleRate_;  // Hz
+  uint16_t channels_;
+
+  std::unique_ptr<uint8_t[]> region_;
+  size_t regionSize_;
+  SpectrumHeader *header_;
+
+  std::unique_ptr<RingBuffer<int16_t>> ring_;
+  std::atomic<bool> active_;
+  std::atomic<bool> running_;
+  std::atomic<uint32_t> dropped_;
+  std::thread worker_;
+  uint32_t intervalUs_;
+
+  // worker state
+  std::unique_ptr<RealFft> fft_;
+  std::vector<int16_t> chunk_;
+  std::vector<float> history_;  // fftSize mono frames, circular
+  uint32_t historyPos_;
+  std::vector<float> window_;
+  float windowScale_;           // magnitude to full scale sine
+  std::vector<float> fftIn_;
+  std::vector<float> re_;
+  std::vector<float> im_;
+  int64_t framePos_;
+  float peak_[kMaxLevelChannels];
+  double sumSquares_[kMaxLevelChannels];
+  uint32_t levelFrames_;
+
+  void drain(void);
+  void publish(void);
+  void workerLoop(void);
+};
+
+#endif  // NATIVE_AUDIO_SPECTRUM_ANALYZER_H
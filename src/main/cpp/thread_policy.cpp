@@ -0,0 +1,229 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "thread_policy.h"
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "android_debug.h"
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+
+static const int32_t kMaxCpus = 64;  // cpuMask_ width
+static const int32_t kAudioFifoPriority = 2;
+static const int32_t kAudioNice = -16;  // ANDROID_PRIORITY_AUDIO
+
+// role generation this thread applied last, 0 for never
+static thread_local uint32_t appliedGeneration[THREAD_ROLE_COUNT];
+// this thread was made real-time by the policy, not by the system
+static thread_local bool raisedRealtime;
+
+ThreadPolicy *ThreadPolicy::instance(void) {
+  static ThreadPolicy policy;
+  return &policy;
+}
+
+/*
+ * The audio callbacks ask for SCHED_FIFO on the big cores by default, the
+ * workers are left alone.
+ */
+ThreadPolicy::ThreadPolicy() : resultCount_(0), bigCores_(BigCoreMask()) {
+  config_[THREAD_ROLE_AUDIO] = {THREAD_SCHED_FIFO, kAudioFifoPriority,
+                                kAudioNice, kThreadCpusBigCores};
+  config_[THREAD_ROLE_WORKER] = {THREAD_SCHED_DEFAULT, 0, 0, kThreadCpusAny};
+  for (int32_t i = 0; i < THREAD_ROLE_COUNT; i++) {
+    generation_[i].store(1);
+  }
+  memset(results_, 0, sizeof(results_));
+}
+
+uint64_t ThreadPolicy::BigCoreMask(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_CONF);
+  if (cpus > kMaxCpus) {
+    cpus = kMaxCpus;
+  }
+  uint64_t mask = 0;
+  long best = 0;
+  for (long cpu = 0; cpu < cpus; cpu++) {
+    char path[96];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%ld/cpufreq/cpuinfo_max_freq", cpu);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+      continue;
+    }
+    long freq = 0;
+    if (fscanf(file, "%ld", &freq) == 1 && freq >= best) {
+      if (freq > best) {
+        best = freq;
+        mask = 0;
+      }
+      mask |= 1ULL << cpu;
+    }
+    fclose(file);
+  }
+  return mask;
+}
+
+bool ThreadPolicy::configure(ThreadRole role, const ThreadPolicyConfig &config) {
+  if (role < 0 || role >= THREAD_ROLE_COUNT ||
+      config.sched_ < THREAD_SCHED_DEFAULT ||
+      config.sched_ > THREAD_SCHED_FIFO ||
+      (config.sched_ == THREAD_SCHED_FIFO &&
+       (config.fifoPriority_ < 1 || config.fifoPriority_ > 99)) ||
+      config.nice_ < -20 || config.nice_ > 19 ||
+      config.cpuMask_ < kThreadCpusBigCores) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(lock_);
+  config_[role] = config;
+  generation_[role].fetch_add(1, std::memory_order_release);
+  return true;
+}
+
+void ThreadPolicy::getConfig(ThreadRole role, ThreadPolicyConfig *config) {
+  std::lock_guard<std::mutex> lock(lock_);
+  *config = config_[role];
+}
+
+void ThreadPolicy::applyIfChanged(ThreadRole role) {
+  uint32_t generation = generation_[role].load(std::memory_order_acquire);
+  if (appliedGeneration[role] != generation) {
+    appliedGeneration[role] = generation;
+    apply(role);
+  }
+}
+
+/*
+ * Runs on the thread itself, once per policy change: the system calls and
+ * the logging here are not real-time safe, but are off the steady state.
+ */
+void ThreadPolicy::apply(ThreadRole role) {
+  ThreadPolicyConfig config;
+  getConfig(role, &config);
+  pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+
+  int current = sched_getscheduler(0);
+  bool realtime = (current & ~SCHED_RESET_ON_FORK) == SCHED_FIFO ||
+                  (current & ~SCHED_RESET_ON_FORK) == SCHED_RR;
+  // a thread the system runs real-time keeps at least its own priority
+  int32_t floor = 0;
+  if (realtime && !raisedRealtime) {
+    struct sched_param param;
+    if (!sched_getparam(0, &param)) {
+      floor = param.sched_priority;
+    }
+  }
+  if (config.sched_ == THREAD_SCHED_FIFO && config.fifoPriority_ > floor) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config.fifoPriority_;
+    if (!sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param)) {
+      raisedRealtime = raisedRealtime || !realtime;
+    } else {
+      LOGW("====thread %d: SCHED_FIFO %d refused (%s), using nice %d", tid,
+           config.fifoPriority_, strerror(errno), config.nice_);
+      if (!realtime) {
+        config.sched_ = THREAD_SCHED_NICE;
+      }
+    }
+  }
+  if (config.sched_ == THREAD_SCHED_NICE && realtime && raisedRealtime) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    if (!sched_setscheduler(0, SCHED_OTHER, &param)) {
+      raisedRealtime = false;
+      realtime = false;
+    }
+  }
+  if (config.sched_ == THREAD_SCHED_NICE && !realtime) {
+    // per thread on Linux
+    if (setpriority(PRIO_PROCESS, tid, config.nice_)) {
+      LOGW("====thread %d: nice %d refused (%s)", tid, config.nice_,
+           strerror(errno));
+    }
+  }
+
+  uint64_t mask = config.cpuMask_ == kThreadCpusBigCores
+                      ? bigCores_
+                      : static_cast<uint64_t>(config.cpuMask_);
+  cpu_set_t cpus;
+  if (mask) {
+    CPU_ZERO(&cpus);
+    for (int32_t cpu = 0; cpu < kMaxCpus; cpu++) {
+      if (mask & (1ULL << cpu)) {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+    if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+      LOGW("====thread %d: affinity 0x%llx refused (%s)", tid,
+           (unsigned long long)mask, strerror(errno));
+    }
+  }
+
+  ThreadPolicyResult result;
+  memset(&result, 0, sizeof(result));
+  result.tid_ = tid;
+  result.role_ = role;
+  result.policy_ = sched_getscheduler(0) & ~SCHED_RESET_ON_FORK;
+  struct sched_param param;
+  if (!sched_getparam(0, &param)) {
+    result.priority_ = param.sched_priority;
+  }
+  errno = 0;
+  result.nice_ = getpriority(PRIO_PROCESS, tid);
+  if (!sched_getaffinity(0, sizeof(cpus), &cpus)) {
+    for (int32_t cpu = 0; cpu < kMaxCpus; cpu++) {
+      if (CPU_ISSET(cpu, &cpus)) {
+        result.cpuMask_ |= 1ULL << cpu;
+      }
+    }
+  }
+  storeResult(result);
+}
+
+/*
+ * One entry per thread, the oldest one replaced when the table is full
+ * (callback threads come and go with the player and recorder).
+ */
+void ThreadPolicy::storeResult(const ThreadPolicyResult &result) {
+  std::lock_guard<std::mutex> lock(lock_);
+  uint32_t idx = 0;
+  while (idx < resultCount_ && results_[idx].tid_ != result.tid_) {
+    idx++;
+  }
+  if (idx == kMaxThreads) {
+    memmove(&results_[0], &results_[1], sizeof(results_[0]) * (kMaxThreads - 1));
+    idx = kMaxThreads - 1;
+  } else if (idx == resultCount_) {
+    resultCount_++;
+  }
+  results_[idx] = result;
+}
+
+uint32_t ThreadPolicy::getReport(ThreadPolicyResult *results, uint32_t count) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (count > resultCount_) {
+    count = resultCount_;
+  }
+  memcpy(results, results_, sizeof(results_[0]) * count);
+  return count;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_THREAD_POLICY_H
+#define NATIVE_AUDIO_THREAD_POLICY_H
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+/*
+ * Threads the policy knows about, mirrored in MainActivity.java:
+ *   AUDIO:  the OpenSL ES callback threads running EngineService
+ *   WORKER: background threads of the engine (pcm tap writer, log flusher)
+ */
+enum ThreadRole {
+  THREAD_ROLE_AUDIO = 0,
+  THREAD_ROLE_WORKER = 1,
+  THREAD_ROLE_COUNT
+};
+
+/*
+ * Scheduling asked for a role. FIFO falls back to NICE when the process is
+ * not allowed real-time scheduling, NICE to leaving the thread alone.
+ */
+enum ThreadSched {
+  THREAD_SCHED_DEFAULT = 0,  // do not touch the scheduling
+  THREAD_SCHED_NICE = 1,     // SCHED_OTHER at nice_
+  THREAD_SCHED_FIFO = 2,     // SCHED_FIFO at fifoPriority_
+};
+
+// cpuMask_ values besides a plain mask of cpus
+static const int64_t kThreadCpusAny = 0;       // no pinning
+static const int64_t kThreadCpusBigCores = -1;  // fastest cores, see below
+
+struct ThreadPolicyConfig {
+  int32_t sched_;         // ThreadSched
+  int32_t fifoPriority_;  // 1 .. 99
+  int32_t nice_;          // -20 .. 19
+  int64_t cpuMask_;       // bit n for cpu n, or kThreadCpus*
+};
+
+/*
+ * What a thread actually got, read back after applying its policy.
+ */
+struct ThreadPolicyResult {
+  int32_t tid_;
+  int32_t role_;
+  int32_t policy_;    // SCHED_* in effect
+  int32_t priority_;  // real-time priority, 0 for SCHED_OTHER
+  int32_t nice_;
+  uint64_t cpuMask_;  // affinity in effect, 0 if unknown
+};
+
+/*
+ * Process wide scheduling and cpu placement policy per ThreadRole.
+ *
+ * configure() may be called from any thread; each thread picks its role's
+ * policy up itself with applyIfChanged(), which only costs a load and a
+ * compare while nothing changed, so the audio callbacks call it on every
+ * buffer. Nothing fails hard: whatever the kernel refuses (no permission
+ * for SCHED_FIFO or negative nice, cpus not online) is logged once per
+ * change and shows up in the report.
+ *
+ * Threads the policy raised to SCHED_FIFO get SCHED_RESET_ON_FORK. Threads
+ * which already ran real-time before (Android's fast mixer callbacks) are
+ * never lowered: not to nice, and not below the priority they had.
+ */
+class ThreadPolicy {
+ public:
+  static const uint32_t kMaxThreads = 8;
+
+  static ThreadPolicy *instance(void);
+
+  bool configure(ThreadRole role, const ThreadPolicyConfig &config);
+  void getConfig(ThreadRole role, ThreadPolicyConfig *config);
+  void applyIfChanged(ThreadRole role);
+  uint32_t getReport(ThreadPolicyResult *results, uint32_t count);
+
+  // cpus with the highest cpuinfo_max_freq, 0 when cpufreq is not readable
+  static uint64_t BigCoreMask(void);
+
+ private:
+  ThreadPolicy();
+
+  void apply(ThreadRole role);
+  void storeResult(const ThreadPolicyResult &result);
+
+  std::mutex lock_;
+  ThreadPolicyConfig config_[THREAD_ROLE_COUNT];
+  std::atomic<uint32_t> generation_[THREAD_ROLE_COUNT];
+  ThreadPolicyResult results_[kMaxThreads];
+  uint32_t resultCount_;
+  uint64_t bigCores_;
+};
+
+#endif  // NATIVE_AUDIO_THREAD_POLICY_H
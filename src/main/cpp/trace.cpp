@@ -0,0 +1,208 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdio>
+#include <mutex>
+#include "trace.h"
+#ifdef __ANDROID__
+#include <dlfcn.h>
+#endif
+
+/*
+ * ATrace_* are API 23+ NDK functions: looked up at run time so the library
+ * still loads on older devices (and tracing then stays app internal).
+ */
+typedef void (*ATraceBeginSectionFn)(const char *sectionName);
+typedef void (*ATraceEndSectionFn)(void);
+typedef bool (*ATraceIsEnabledFn)(void);
+
+static ATraceBeginSectionFn atraceBegin = nullptr;
+static ATraceEndSectionFn atraceEnd = nullptr;
+static ATraceIsEnabledFn atraceIsEnabled = nullptr;
+
+static void LoadATrace(void) {
+#ifdef __ANDROID__
+  void *lib = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+  if (!lib) {
+    return;
+  }
+  atraceBegin = reinterpret_cast<ATraceBeginSectionFn>(
+      dlsym(lib, "ATrace_beginSection"));
+  atraceEnd =
+      reinterpret_cast<ATraceEndSectionFn>(dlsym(lib, "ATrace_endSection"));
+  atraceIsEnabled =
+      reinterpret_cast<ATraceIsEnabledFn>(dlsym(lib, "ATrace_isEnabled"));
+  if (!atraceBegin || !atraceEnd || !atraceIsEnabled) {
+    atraceBegin = nullptr;
+    atraceEnd = nullptr;
+    atraceIsEnabled = nullptr;
+  }
+#endif
+}
+
+// start() and exportChromeJson() are the rings' consumers
+static std::mutex consumerMutex;
+
+Tracer *Tracer::instance(void) {
+  static Tracer tracer;
+  return &tracer;
+}
+
+/*
+ * Rings are allocated up front and never freed: a thread holds its slot
+ * until it exits, and the events it left are exported after that.
+ */
+Tracer::Tracer() : released_(0), enabled_(false), dropped_(0) {
+  for (uint32_t i = 0; i < kTraceMaxThreads; i++) {
+    slots_[i].ring_.reset(new RingBuffer<TraceEvent>(kTraceRingEvents));
+    slots_[i].claimed_.store(false);
+  }
+  LoadATrace();
+}
+
+Tracer::~Tracer() {}
+
+void Tracer::start(void) {
+  std::lock_guard<std::mutex> lock(consumerMutex);
+  for (uint32_t i = 0; i < kTraceMaxThreads; i++) {
+    RingBuffer<TraceEvent> *ring = slots_[i].ring_.get();
+    ring->skip(ring->availableToRead());
+  }
+  dropped_.store(0);
+  enabled_.store(true);
+}
+
+void Tracer::stop(void) { enabled_.store(false); }
+
+uint64_t Tracer::getDropped(void) const {
+  return dropped_.load(std::memory_order_relaxed);
+}
+
+/*
+ * A thread's claim on a slot, given back when the thread exits; the next
+ * thread to claim it appends to the same ring. A thread which found every
+ * slot taken only looks again once some slot was given back.
+ */
+struct Tracer::ThreadClaim {
+  Tracer *owner_ = nullptr;
+  int32_t index_ = -1;
+  int32_t tid_ = 0;
+  uint32_t released_ = 0;  // owner's count at the last failed claim
+
+  ~ThreadClaim() {
+    if (index_ >= 0) {
+      owner_->slots_[index_].claimed_.store(false, std::memory_order_release);
+      owner_->released_.fetch_add(1, std::memory_order_release);
+    }
+  }
+};
+
+Tracer::ThreadClaim *Tracer::threadClaim(void) {
+  static thread_local ThreadClaim claim;
+  if (claim.index_ < 0) {
+    uint32_t released = released_.load(std::memory_order_acquire);
+    if (!claim.owner_) {
+      claim.owner_ = this;
+      claim.tid_ = static_cast<int32_t>(syscall(__NR_gettid));
+    } else if (claim.released_ == released) {
+      return nullptr;
+    }
+    claim.released_ = released;
+    for (uint32_t i = 0; i < kTraceMaxThreads; i++) {
+      bool expected = false;
+      if (slots_[i].claimed_.compare_exchange_strong(
+              expected, true, std::memory_order_acquire)) {
+        claim.index_ = i;
+        break;
+      }
+    }
+    if (claim.index_ < 0) {
+      return nullptr;
+    }
+  }
+  return &claim;
+}
+
+void Tracer::record(char phase, const char *name, int64_t seq) {
+  if (atraceIsEnabled && atraceIsEnabled()) {
+    if (phase == 'E') {
+      atraceEnd();
+    } else {
+      char section[64];
+      if (seq >= 0) {
+        snprintf(section, sizeof(section), "%s #%lld", name, (long long)seq);
+      }
+      atraceBegin(seq >= 0 ? section : name);
+      if (phase == 'i') atraceEnd();
+    }
+  }
+
+  if (!enabled_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  TraceEvent event;
+  event.time_ = GetMonotonicNanos();
+  event.name_ = name;
+  event.seq_ = seq;
+  event.phase_ = phase;
+  ThreadClaim *claim = threadClaim();
+  event.tid_ = claim ? claim->tid_ : 0;
+  if (!claim || slots_[claim->index_].ring_->write(&event, 1) != 1) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+/*
+ * Drain every ring into a Chrome trace event JSON file. Timestamps are
+ * CLOCK_MONOTONIC micro seconds, the same clock systrace uses.
+ */
+bool Tracer::exportChromeJson(const char *path) {
+  std::lock_guard<std::mutex> lock(consumerMutex);
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    LOGE("====failed to open trace file %s", path);
+    return false;
+  }
+  int32_t pid = static_cast<int32_t>(getpid());
+  bool first = true;
+  fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (uint32_t i = 0; i < kTraceMaxThreads; i++) {
+    TraceEvent event;
+    while (slots_[i].ring_->read(&event, 1)) {
+      fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+              "\"pid\":%d,\"tid\":%d",
+              first ? "" : ",\n", event.name_, event.phase_,
+              event.time_ / 1000.0, pid, event.tid_);
+      if (event.phase_ == 'i') {
+        fprintf(fp, ",\"s\":\"t\"");
+      }
+      if (event.seq_ >= 0) {
+        fprintf(fp, ",\"args\":{\"seq\":%lld}", (long long)event.seq_);
+      }
+      fprintf(fp, "}");
+      first = false;
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  bool ok = !ferror(fp);
+  fclose(fp);
+  if (dropped_.load()) {
+    LOGW("====trace: %llu events dropped (rings full)",
+         (unsigned long long)dropped_.load());
+  }
+  return ok;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_TRACE_H
+#define NATIVE_AUDIO_TRACE_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "audio_common.h"
+
+/*
+ * Pipeline event tracing (enable with ENABLE_TRACE in audio_common.h).
+ *
+ *   TRACE_SCOPE(name)            begin/end event around the enclosing scope
+ *   TRACE_SCOPE_SEQ(name, seq)   same, tagged with a buffer sequence number
+ *   TRACE_INSTANT(name, seq)     single point event, e.g. a queue handoff
+ *
+ * Events are appended to a lock-free ring owned by the calling thread
+ * (timestamp, name pointer, seq, phase; no formatting, no allocation) and
+ * mirrored to ATrace when systrace/perfetto is capturing on the device.
+ * Tracer::exportChromeJson() writes what was collected in the Chrome trace
+ * event format, which chrome://tracing and ui.perfetto.dev open.
+ *
+ * name must be a string literal. Without ENABLE_TRACE the macros expand to
+ * nothing and their arguments are not evaluated.
+ */
+static const uint32_t kTraceMaxThreads = 8;
+static const uint32_t kTraceRingEvents = 8192;
+
+struct TraceEvent {
+  int64_t time_;      // CLOCK_MONOTONIC ns
+  const char *name_;
+  int64_t seq_;       // -1 when untagged
+  int32_t tid_;
+  char phase_;        // 'B', 'E' or 'i'
+};
+
+class Tracer {
+ public:
+  static Tracer *instance(void);
+
+  void start(void);
+  void stop(void);
+  bool isEnabled(void) const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  uint64_t getDropped(void) const;
+  bool exportChromeJson(const char *path);
+
+  void record(char phase, const char *name, int64_t seq);
+
+ private:
+  Tracer();
+  ~Tracer();
+
+  struct ThreadSlot {
+    std::unique_ptr<RingBuffer<TraceEvent>> ring_;
+    std::atomic<bool> claimed_;
+  };
+  struct ThreadClaim;
+  ThreadClaim *threadClaim(void);
+
+  ThreadSlot slots_[kTraceMaxThreads];
+  std::atomic<uint32_t> released_;  // slots given back so far
+  std::atomic<bool> enabled_;
+  std::atomic<uint64_t> dropped_;
+};
+
+class TraceScope {
+ public:
+  TraceScope(const char *name, int64_t seq) : name_(name), seq_(seq) {
+    Tracer::instance()->record('B', name_, seq_);
+  }
+  ~TraceScope() { Tracer::instance()->record('E', name_, seq_); }
+
+ private:
+  const char *name_;
+  int64_t seq_;
+};
+
+#ifdef ENABLE_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) \
+  TraceScope TRACE_CONCAT(traceScope_, __LINE__)((name), -1)
+#define TRACE_SCOPE_SEQ(name, seq) \
+  TraceScope TRACE_CONCAT(traceScope_, __LINE__)((name), (seq))
+#define TRACE_INSTANT(name, seq) \
+  Tracer::instance()->record('i', (name), (seq))
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_SCOPE_SEQ(name, seq)
+#define TRACE_INSTANT(name, seq)
+#endif
+
+#endif  // NATIVE_AUDIO_TRACE_H
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_WAV_HEADER_H
+#define NATIVE_AUDIO_WAV_HEADER_H
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Canonical 44 byte RIFF/WAVE header for little endian PCM, shared by the
+ * offline renderer and the PCM taps.
+ */
+static const uint32_t kWavHeaderSize = 44;
+static const uint16_t kWavFormatPcm = 1;
+
+struct WavInfo {
+  uint16_t format_;
+  uint16_t channels_;
+  uint32_t sampleRate_;  // Hz
+  uint16_t bitsPerSample_;
+  const uint8_t* data_;
+  uint32_t dataSize_;    // byte
+};
+
+static inline void WriteLE32(uint8_t* p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = (v >> 24) & 0xFF;
+}
+static inline void WriteLE16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+}
+
+static inline void WriteWavHeader(uint8_t* hdr, const WavInfo& info) {
+  uint32_t bytePerFrame = info.channels_ * (info.bitsPerSample_ >> 3);
+  memcpy(hdr, "RIFF", 4);
+  WriteLE32(hdr + 4, kWavHeaderSize - 8 + info.dataSize_);
+  memcpy(hdr + 8, "WAVE", 4);
+  memcpy(hdr + 12, "fmt ", 4);
+  WriteLE32(hdr + 16, 16);
+  WriteLE16(hdr + 20, kWavFormatPcm);
+  WriteLE16(hdr + 22, info.channels_);
+  WriteLE32(hdr + 24, info.sampleRate_);
+  WriteLE32(hdr + 28, info.sampleRate_ * bytePerFrame);
+  WriteLE16(hdr + 32, static_cast<uint16_t>(bytePerFrame));
+  WriteLE16(hdr + 34, info.bitsPerSample_);
+  memcpy(hdr + 36, "data", 4);
+  WriteLE32(hdr + 40, info.dataSize_);
+}
+
+#endif  // NATIVE_AUDIO_WAV_HEADER_H
@@ -36,6 +36,7 @@ import android.widget.SeekBar;
 import android.widget.TextView;
 import android.widget.Toast;
 
+import java.nio.ByteBuffer;
 import java.util.Locale;
 
 public class MainActivity extends Activity
@@ -56,7 +57,9 @@ public class MainActivity extends Activity
     private int echoDelayProgress_R;
 
     private boolean supportRecording;
+    private long engineHandle;  // native engine instance, see createSLEngine()
     private Boolean isPlaying = false;
+    private boolean isPaused = false;
 
     @Override
     protected void onCreate(Bundle savedInstanceState) {
@@ -77,7 +80,7 @@ public class MainActivity extends Activity
                 curDelayTV_L.setText(str);                                                        //算出した位置情報をmainクラスの遅延時間として表示する。
                 echoDelayProgress_L = progress;                                                     // progressがdelaySeekBar_L.getMax()と同じならechoDelayProgress_Lは1000になる。最大は1秒＝1000ms　単位はms
                 if (echoDelayProgress_L == 0) echoDelayProgress_L = 4;                             //48khz/バッファ192Sample=4ms <= bufSizeL_ || bufSizeR_ 　で遅延用バッファの処理がキャンセルされるから0s設定時には最小値4msで対応させる。
-                configureEcho(echoDelayProgress_L,echoDelayProgress_R);
+                configureEcho(engineHandle, echoDelayProgress_L,echoDelayProgress_R);
             }
             @Override
             public void onStartTrackingTouch(SeekBar seekBar) {}
@@ -96,7 +99,7 @@ public class MainActivity extends Activity
                 curDelayTV_R.setText(str);                                                        //算出した位置情報をmainクラスの遅延時間として表示する。
                 echoDelayProgress_R = progress;
                 if (echoDelayProgress_R == 0) echoDelayProgress_R = 4;                                         // ディレイ用のバッファサイズはframesPerBuf　よりも大きくないといけない。　とりあえず最小値を10msと指定しておく。本当はframesPerBufを設定したほうがよい。
-                configureEcho(echoDelayProgress_L,echoDelayProgress_R);
+                configureEcho(engineHandle, echoDelayProgress_L,echoDelayProgress_R);
             }
             @Override
             public void onStartTrackingTouch(SeekBar seekBar) {}
@@ -114,7 +117,7 @@ public class MainActivity extends Activity
         updateNativeAudioUI();
 
         if (supportRecording) {                                                                         //どこでsupportRecording真偽値ONにしてる？
-            createSLEngine(
+            engineHandle = createSLEngine(
                     Integer.parseInt(nativeSampleRate),
                     Integer.parseInt(nativeSampleBufSize),
                     echoDelayProgress_L,
@@ -125,13 +128,38 @@ public class MainActivity extends Activity
 
 
 
+    /*
+     * Backgrounding only pauses the echo: the native player, recorder and
+     * effects stay ready so it comes back within a few callbacks.
+     */
+    @Override
+    protected void onPause() {
+        if (supportRecording && isPlaying && !isPaused) {
+            pausePlay(engineHandle);
+            isPaused = true;
+        }
+        super.onPause();
+    }
+
+    @Override
+    protected void onResume() {
+        super.onResume();
+        if (isPaused) {
+            isPaused = false;
+            if (!resumePlay(engineHandle)) {
+                statusView.setText(getString(R.string.player_error_msg));
+            }
+        }
+    }
+
     @Override
     protected void onDestroy() {
         if (supportRecording) {
             if (isPlaying) {
-                stopPlay();
+                stopPlay(engineHandle);
             }
-            deleteSLEngine();
+            deleteSLEngine(engineHandle);
+            engineHandle = 0;
             isPlaying = false;
         }
         super.onDestroy();
@@ -164,22 +192,22 @@ public class MainActivity extends Activity
             return;
         }
         if (!isPlaying) {
-            if(!createSLBufferQueueAudioPlayer()) {
+            if(!createSLBufferQueueAudioPlayer(engineHandle)) {
                 statusView.setText(getString(R.string.player_error_msg));
                 return;
             }
-            if(!createAudioRecorder()) {
-                deleteSLBufferQueueAudioPlayer();
+            if(!createAudioRecorder(engineHandle)) {
+                deleteSLBufferQueueAudioPlayer(engineHandle);
                 statusView.setText(getString(R.string.recorder_error_msg));
                 return;
             }
-            startPlay();                                                                            // startPlay() triggers startRecording()   ここ？？？？
+            startPlay(engineHandle);                                                                            // startPlay() triggers startRecording()   ここ？？？？
             statusView.setText(getString(R.string.echoing_status_msg));
         } else {
-            stopPlay();  // stopPlay() triggers stopRecording()
+            stopPlay(engineHandle);  // stopPlay() triggers stopRecording()
             updateNativeAudioUI();
-            deleteAudioRecorder();
-            deleteSLBufferQueueAudioPlayer();
+            deleteAudioRecorder(engineHandle);
+            deleteSLBufferQueueAudioPlayer(engineHandle);
         }
         isPlaying = !isPlaying;
         controlButton.setText(getString(isPlaying ?
@@ -282,16 +310,312 @@ public class MainActivity extends Activity
     /*
      * jni function declarations
      */
-    static native void createSLEngine(int rate, int framesPerBuf,
+    static native long createSLEngine(int rate, int framesPerBuf,
                                       long delayRInMs,long delayLInMs);                                              //, float decay
-    static native void deleteSLEngine();
-    static native boolean configureEcho(int delayLInMs,int delayRInMs);                                             //バーの位置echoDelayProgressを受け取り真偽値返す
-    static native boolean createSLBufferQueueAudioPlayer();
-    static native void deleteSLBufferQueueAudioPlayer();
-
-    static native boolean createAudioRecorder();
-    static native void deleteAudioRecorder();
-    static native void startPlay();
-    static native void stopPlay();
+    static native void deleteSLEngine(long engineHandle);
+    static native boolean configureEcho(long engineHandle, int delayLInMs,int delayRInMs);                                             //バーの位置echoDelayProgressを受け取り真偽値返す
+    /*
+     * pitch shift of the echo, semitones + cents within -12 .. 12 semitones;
+     * mix 0 (dry) .. 1 (shifted only), 0 bypasses it
+     */
+    static native boolean configurePitchShift(long engineHandle, float semitones, float cents,
+                                              float mix);
+    /*
+     * equalizer section 0 .. EQ_MAX_SECTIONS - 1 of the cascade; gainDb is
+     * for shelves and peaks, the change glides over rampFrames (10 ms at least)
+     */
+    static final int EQ_MAX_SECTIONS = 8;
+    static final int EQ_TYPE_OFF = 0;
+    static final int EQ_TYPE_LOW_SHELF = 1;
+    static final int EQ_TYPE_HIGH_SHELF = 2;
+    static final int EQ_TYPE_PEAK = 3;
+    static final int EQ_TYPE_HIGH_PASS = 4;
+    static final int EQ_TYPE_LOW_PASS = 5;
+    static native boolean configureEqSection(long engineHandle, int section, int type,
+                                             float freqHz, float q, float gainDb,
+                                             int rampFrames);
+    /*
+     * compressor + true peak lookahead limiter, after the equalizer or in the
+     * delay's feedback loop; ratio 1 leaves the limiter only.
+     * getDynamicsMeter() returns {compressorDb, limiterDb, maxDb} of gain
+     * reduction, maxDb the largest since the previous call
+     */
+    static final int DYNAMICS_PLACEMENT_OFF = 0;
+    static final int DYNAMICS_PLACEMENT_OUTPUT = 1;
+    static final int DYNAMICS_PLACEMENT_FEEDBACK = 2;
+    static native boolean configureDynamics(long engineHandle, int placement,
+                                            float thresholdDb, float ratio, float kneeDb,
+                                            float attackMs, float releaseMs, float makeupDb,
+                                            float ceilingDb, float limitReleaseMs);
+    static native float[] getDynamicsMeter(long engineHandle);
+    static native boolean createSLBufferQueueAudioPlayer(long engineHandle);
+    static native void deleteSLBufferQueueAudioPlayer(long engineHandle);
+
+    static native boolean createAudioRecorder(long engineHandle);
+    static native void deleteAudioRecorder(long engineHandle);
+    static native void startPlay(long engineHandle);
+    static native void stopPlay(long engineHandle);
+    static native void pausePlay(long engineHandle);
+    static native boolean resumePlay(long engineHandle);
+    static native boolean renderFile(long engineHandle, String inPath, String outPath);
+
+    /*
+     * recorder policy when the player falls behind and no free buffer is left
+     */
+    static final int RECORDER_OVERFLOW_DROP_NEWEST = 0;
+    static final int RECORDER_OVERFLOW_DROP_OLDEST = 1;
+    static final int RECORDER_OVERFLOW_PAUSE_RESUME = 2;
+    static native void setRecorderOverflowPolicy(long engineHandle, int policy);
+    static native long[] getRecorderOverflowStats(long engineHandle);
+    static native long[] getPlayerStreamStats(long engineHandle);
+    static native boolean configureInputConditioner(long engineHandle,
+                                                    boolean dcBlock, boolean gate,
+                                                    float gateThresholdDb, float attackMs,
+                                                    float holdMs, float releaseMs);
+    static native void enableEchoCanceller(long engineHandle, boolean enable);
+    static native float getEchoCancellerErle(long engineHandle);
+    static native boolean setEchoCancellerDelay(long engineHandle, float delayMs);
+    static native boolean startEchoDelayEstimate(long engineHandle);
+    static native float[] getEchoDelayEstimate(long engineHandle);
+
+    /*
+     * PCM tap points, OR them together for startPcmTap()
+     */
+    static final int PCM_TAP_CAPTURE = 1 << 0;
+    static final int PCM_TAP_ECHO_CANCELLER = 1 << 1;
+    static final int PCM_TAP_CONDITIONER = 1 << 2;
+    static final int PCM_TAP_DELAY = 1 << 3;
+    static final int PCM_TAP_PLAYER = 1 << 4;
+    static native boolean startPcmTap(long engineHandle, String pathPrefix, int pointMask,
+                                      int maxSeconds);
+    static native long stopPcmTap(long engineHandle);
+
+    /*
+     * session recording streams, OR them together for startSessionRecording();
+     * files are <pathPrefix>_input.flac and <pathPrefix>_output.flac. Stats are
+     * {inputFrames, inputBytes, outputFrames, outputBytes, droppedBuffers}.
+     */
+    static final int SESSION_STREAM_INPUT = 1 << 0;
+    static final int SESSION_STREAM_OUTPUT = 1 << 1;
+    static native boolean startSessionRecording(long engineHandle, String pathPrefix,
+                                                int streamMask);
+    static native long[] getSessionRecordingStats(long engineHandle);
+    static native long[] stopSessionRecording(long engineHandle);
+
+    /*
+     * level and spectrum of the processed audio; getSpectrumBuffer() maps the
+     * analyzer's region, valid as long as the engine, in native byte order:
+     *   header: sequence, fftSize, bins, sampleRate, slot offsets 0 and 1,
+     *           channels, dropped (ints)
+     *   slot:   sequence, reserved (ints), framePos (long), peakDb[2],
+     *           rmsDb[2], magnitudeDb[bins] (floats, 0 dB a full scale sine)
+     * the newest frame is in slot sequence & 1; read it with readSpectrum(),
+     * which orders the copy against the writer
+     */
+    static final int SPECTRUM_SEQUENCE = 0;
+    static final int SPECTRUM_FFT_SIZE = 4;
+    static final int SPECTRUM_BINS = 8;
+    static final int SPECTRUM_SAMPLE_RATE = 12;
+    static final int SPECTRUM_SLOT_OFFSETS = 16;
+    static final int SPECTRUM_CHANNELS = 24;
+    static final int SPECTRUM_DROPPED = 28;
+    static final int SPECTRUM_SLOT_SEQUENCE = 0;
+    static final int SPECTRUM_SLOT_FRAME_POS = 8;
+    static final int SPECTRUM_SLOT_PEAK_DB = 16;
+    static final int SPECTRUM_SLOT_RMS_DB = 24;
+    static final int SPECTRUM_SLOT_MAGNITUDE_DB = 32;
+    static native boolean startSpectrum(long engineHandle, int fftSize, int framesPerSecond);
+    static native void stopSpectrum(long engineHandle);
+    static native ByteBuffer getSpectrumBuffer(long engineHandle);
+
+    /*
+     * Copy the newest frame out of the region: levels gets {peakL, peakR,
+     * rmsL, rmsR} in dB, magnitudesDb as many bins as it holds. Returns the
+     * frame's sequence, or -1 when there is none yet or it kept being
+     * replaced meanwhile (poll again). Native, so the copy is ordered
+     * against the analyzer thread; plain ByteBuffer reads are not.
+     */
+    static native int readSpectrum(long engineHandle, float[] levels, float[] magnitudesDb);
+
+    /*
+     * zero copy access to the capture buffers: getBufferViews() maps every
+     * engine buffer once, getBufferExchange() the control region (native
+     * byte order):
+     *   header: bufCount, bufBytes, ringSize, channels, sampleRate, enabled,
+     *           readyOffset, doneOffset, readyWrite, readyRead, doneWrite,
+     *           doneRead (ints)
+     *   ready ring entry: index, sizeBytes (ints), framePos (long)
+     *   done ring entry: index (int)
+     * While enabled, each processed capture buffer is put on the ready ring
+     * and belongs to Java until its index goes back on the done ring, in the
+     * order taken; it is played after that, so processing adds latency.
+     * takeSharedBuffer() and returnSharedBuffer() are the two ends.
+     */
+    static final int BUFEX_BUF_COUNT = 0;
+    static final int BUFEX_BUF_BYTES = 4;
+    static final int BUFEX_RING_SIZE = 8;
+    static final int BUFEX_CHANNELS = 12;
+    static final int BUFEX_SAMPLE_RATE = 16;
+    static final int BUFEX_ENABLED = 20;
+    static final int BUFEX_READY_OFFSET = 24;
+    static final int BUFEX_DONE_OFFSET = 28;
+    static final int BUFEX_READY_WRITE = 32;
+    static final int BUFEX_READY_READ = 36;
+    static final int BUFEX_DONE_WRITE = 40;
+    static final int BUFEX_DONE_READ = 44;
+    static final int BUFEX_ENTRY_INDEX = 0;
+    static final int BUFEX_ENTRY_SIZE = 4;
+    static final int BUFEX_ENTRY_FRAME_POS = 8;
+    static final int BUFEX_ENTRY_BYTES = 16;
+    static native void enableBufferExchange(long engineHandle, boolean enable);
+    static native ByteBuffer getBufferExchange(long engineHandle);
+    static native ByteBuffer[] getBufferViews(long engineHandle);
+    static native long getBufferExchangeErrors(long engineHandle);
+
+    /*
+     * Take the oldest buffer the engine handed out: returns its view index,
+     * or -1 when there is none; info gets {sizeBytes, framePos}. Native, so
+     * the counters are read with acquire and written with release ordering,
+     * which ByteBuffer accesses cannot express before VarHandle (API 33).
+     */
+    static native int takeSharedBuffer(long engineHandle, long[] info);
+
+    /*
+     * Give a buffer back for playing, once done with its view.
+     */
+    static native void returnSharedBuffer(long engineHandle, int index);
+
+    /*
+     * getCallbackTiming() streams; results are
+     * {intervalCount, p50, p99, p99.9, max, serviceCount, p50, p99, p99.9, max} in ns
+     */
+    static final int CALLBACK_TIMING_RECORDER = 0;
+    static final int CALLBACK_TIMING_PLAYER = 1;
+    static native long[] getCallbackTiming(long engineHandle, int stream);
+    static native void resetCallbackTiming(long engineHandle);
+
+    /*
+     * glitch detector; events come as {timeNs, point, type, framePos, value}
+     * where point is the PCM_TAP_* bit position
+     */
+    static final int GLITCH_DISCONTINUITY = 0;
+    static final int GLITCH_ZERO_RUN = 1;
+    static final int GLITCH_CLIPPING = 2;
+    static final int GLITCH_SEQUENCE_GAP = 3;
+    static native void enableGlitchDetector(long engineHandle, boolean enable);
+    static native long[] getGlitchEvents(long engineHandle);
+    static native long[] getGlitchCounts(long engineHandle);
+
+    /*
+     * round trip latency: result is {bursts, validBursts, meanMs, stdDevMs, minMs, maxMs}
+     */
+    static native boolean startLatencyMeasurement(long engineHandle, int bursts);
+    static native double[] getLatencyResult(long engineHandle);
+
+    /*
+     * pipeline tracing, only available when the library is built with ENABLE_TRACE
+     */
+    static native boolean startTrace();
+    static native void stopTrace();
+    static native boolean exportTrace(String path);
+
+    /*
+     * DSP load per slot; getDspLoad() returns {current, peak, overruns, bypassed}
+     * for each slot, current/peak as a fraction of the buffer period
+     */
+    static final int DSP_SLOT_ECHO_CANCELLER = 0;
+    static final int DSP_SLOT_CONDITIONER = 1;
+    static final int DSP_SLOT_DELAY = 2;
+    static final int DSP_SLOT_PITCH = 3;
+    static final int DSP_SLOT_EQ = 4;
+    static final int DSP_SLOT_DYNAMICS = 5;
+    static final int DSP_SLOT_TOTAL = 6;
+    static native float[] getDspLoad(long engineHandle);
+    static native void resetDspLoad(long engineHandle);
+    static native void setDspAutoBypass(long engineHandle, boolean enable, float threshold);
+
+    /*
+     * sample accurate parameter changes: framePos is a capture stream frame
+     * (see getControlFramePosition()), or CONTROL_NOW for the next buffer;
+     * rampFrames > 0 moves to the value linearly
+     */
+    static final int CONTROL_TARGET_DELAY = 0;
+    static final int DELAY_PARAM_TIME_L_MS = 0;
+    static final int DELAY_PARAM_TIME_R_MS = 1;
+    static final int DELAY_PARAM_FEEDBACK = 2;
+    static final int DELAY_PARAM_MIX = 3;
+    static final int CONTROL_TARGET_PITCH = 1;
+    static final int PITCH_PARAM_SEMITONES = 0;
+    static final int PITCH_PARAM_CENTS = 1;
+    static final int PITCH_PARAM_MIX = 2;
+    static final int CONTROL_TARGET_EQ = 2;  // param: section * EQ_SECTION_PARAMS + EQ_PARAM_*
+    static final int EQ_PARAM_TYPE = 0;
+    static final int EQ_PARAM_FREQ_HZ = 1;
+    static final int EQ_PARAM_Q = 2;
+    static final int EQ_PARAM_GAIN_DB = 3;
+    static final int EQ_SECTION_PARAMS = 4;
+    static final int CONTROL_TARGET_DYNAMICS = 3;  // applied at buffer start, no ramp
+    static final int DYNAMICS_PARAM_PLACEMENT = 0;
+    static final int DYNAMICS_PARAM_THRESHOLD_DB = 1;
+    static final int DYNAMICS_PARAM_RATIO = 2;
+    static final int DYNAMICS_PARAM_KNEE_DB = 3;
+    static final int DYNAMICS_PARAM_ATTACK_MS = 4;
+    static final int DYNAMICS_PARAM_RELEASE_MS = 5;
+    static final int DYNAMICS_PARAM_MAKEUP_DB = 6;
+    static final int DYNAMICS_PARAM_CEILING_DB = 7;
+    static final int DYNAMICS_PARAM_LIMIT_RELEASE_MS = 8;
+    // the targets below apply at buffer start, no ramp; switches are 0 or 1
+    static final int CONTROL_TARGET_CONDITIONER = 4;
+    static final int CONDITIONER_PARAM_DC_BLOCK = 0;
+    static final int CONDITIONER_PARAM_GATE = 1;
+    static final int CONDITIONER_PARAM_GATE_THRESHOLD_DB = 2;
+    static final int CONDITIONER_PARAM_ATTACK_MS = 3;
+    static final int CONDITIONER_PARAM_HOLD_MS = 4;
+    static final int CONDITIONER_PARAM_RELEASE_MS = 5;
+    static final int CONTROL_TARGET_ECHO_CANCELLER = 5;
+    static final int ECHO_CANCELLER_PARAM_ENABLE = 0;
+    static final int CONTROL_TARGET_SILENCE = 6;
+    static final int SILENCE_PARAM_ENABLE = 0;
+    static final int SILENCE_PARAM_THRESHOLD_DB = 1;
+    static final int SILENCE_PARAM_HOLD_MS = 2;
+    static final int CONTROL_TARGET_DRIFT = 7;
+    static final int DRIFT_PARAM_ENABLE = 0;
+    static final long CONTROL_NOW = 0;
+    static native boolean postControl(long engineHandle, int target, int param, float value,
+                                      long framePos, int rampFrames);
+    static native long getControlFramePosition(long engineHandle);
+
+    /*
+     * silence bypass: the effects are skipped once the capture peak stayed
+     * under thresholdDb for holdMs plus the delay's tail;
+     * getSilenceStats() returns {buffers, skipped, resumes, skipping}
+     */
+    static native boolean configureSilenceBypass(long engineHandle, boolean enable,
+                                                 float thresholdDb, float holdMs);
+    static native long[] getSilenceStats(long engineHandle);
+
+    /*
+     * clock drift compensation between recorder and player, on by default;
+     * getDriftStats() returns {ratio, feedForward, captureHz, playHz, depth,
+     * targetDepth}
+     */
+    static native void enableDriftCompensation(long engineHandle, boolean enable);
+    static native double[] getDriftStats(long engineHandle);
+
+    /*
+     * process wide thread policy: audio callbacks default to SCHED_FIFO on
+     * the big cores, falling back to nice when not permitted; the report is
+     * {tid, role, policy, priority, nice, cpuMask} per thread as granted
+     */
+    static final int THREAD_ROLE_AUDIO = 0;
+    static final int THREAD_ROLE_WORKER = 1;
+    static final int THREAD_SCHED_DEFAULT = 0;
+    static final int THREAD_SCHED_NICE = 1;
+    static final int THREAD_SCHED_FIFO = 2;
+    static final long THREAD_CPUS_ANY = 0;
+    static final long THREAD_CPUS_BIG_CORES = -1;
+    static native boolean setThreadPolicy(int role, int sched, int fifoPriority, int nice,
+                                          long cpuMask);
+    static native long[] getThreadPolicyReport();
 }
 //, echoDecayProgress
\ No newline at end of file
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "buffer_exchange.h"
+#include "test_util.h"
+
+/*
+ * BufferExchange between a capture callback and a Java thread, each on
+ * its own thread: the callback fills a buffer and shares it, Java takes
+ * it, checks and inverts every byte in place and gives it back, and the
+ * callback checks the inverted audio arrives. A buffer seen half written
+ * by either side shows as a wrong byte.
+ */
+static const uint32_t kBufCount = 4;
+static const uint32_t kBufBytes = 960;
+static const uint32_t kBuffers = 20000;
+
+static bool Filled(const sample_buf *buf, uint8_t value) {
+  for (uint32_t i = 0; i < buf->size_; i++) {
+    if (buf->buf_[i] != value) return false;
+  }
+  return true;
+}
+
+int main() {
+  uint32_t bufCount = kBufCount;
+  sample_buf *bufs = allocateSampleBufs(bufCount, kBufBytes);
+  BufferExchange exchange(bufs, bufCount, 48000 * 1000, 2);
+  AudioQueue playQueue(bufCount);
+  CHECK(!exchange.share(&bufs[0]));
+  exchange.setEnabled(true);
+
+  std::atomic<bool> done(false);
+  uint32_t taken = 0, takenBad = 0;
+  std::thread java([&] {
+    int64_t expectPos = 0;
+    while (!done.load()) {
+      uint32_t size;
+      int64_t framePos;
+      int32_t index = exchange.take(&size, &framePos);
+      if (index < 0) {
+        std::this_thread::yield();
+        continue;
+      }
+      sample_buf *buf = &bufs[index];
+      if (size != kBufBytes || framePos != expectPos ||
+          !Filled(buf, static_cast<uint8_t>(taken))) {
+        takenBad++;
+      }
+      for (uint32_t i = 0; i < size; i++) {
+        buf->buf_[i] = static_cast<uint8_t>(~buf->buf_[i]);
+      }
+      exchange.giveBack(index);
+      expectPos += kBufBytes / 4;
+      taken++;
+    }
+  });
+
+  // the callback, with the buffers not out as its free pool
+  std::vector<sample_buf *> free;
+  for (uint32_t i = 0; i < bufCount; i++) free.push_back(&bufs[i]);
+  uint32_t shared = 0, played = 0, playedBad = 0;
+  while (played < kBuffers) {
+    exchange.forwardReturned(&playQueue);
+    sample_buf *buf;
+    while (playQueue.front(&buf)) {
+      playQueue.pop();
+      if (!Filled(buf, static_cast<uint8_t>(~played))) playedBad++;
+      played++;
+      free.push_back(buf);
+    }
+    if (!free.empty() && shared < kBuffers) {
+      buf = free.back();
+      free.pop_back();
+      buf->size_ = kBufBytes;
+      buf->framePos_ = static_cast<uint64_t>(shared) * kBufBytes / 4;
+      memset(buf->buf_, static_cast<uint8_t>(shared), kBufBytes);
+      CHECK(exchange.share(buf));
+      shared++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  done.store(true);
+  java.join();
+
+  printf("buffer exchange: %u taken, %u played, %u/%u bad\n", taken, played,
+         takenBad, playedBad);
+  CHECK(taken == kBuffers);
+  CHECK(takenBad == 0 && playedBad == 0);
+  CHECK(exchange.getInvalid() == 0);
+  CHECK(exchange.dbgGetHeldCount() == 0);
+
+  // an index Java does not own is counted, not played
+  exchange.giveBack(static_cast<int32_t>(kBufCount));
+  exchange.forwardReturned(&playQueue);
+  CHECK(exchange.getInvalid() == 1);
+  CHECK(playQueue.size() == 0);
+  releaseSampleBufs(bufs, bufCount);
+  return TestResult();
+}
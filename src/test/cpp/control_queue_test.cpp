@@ -0,0 +1,117 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vector>
+#include "control_queue.h"
+#include "test_util.h"
+
+/*
+ * ControlQueue as the audio thread sees it, one 192 frame buffer at a time:
+ * every command comes out in the buffer holding its frame, whatever was
+ * posted before it.
+ */
+static const uint32_t kFrames = 192;
+
+static ControlCommand Command(int32_t param, float value, uint64_t framePos) {
+  ControlCommand cmd = {CONTROL_TARGET_DELAY, param, value, framePos, 0};
+  return cmd;
+}
+
+// the commands due in the buffer at framePos, popped
+static std::vector<ControlCommand> Due(ControlQueue *queue,
+                                       uint64_t framePos) {
+  std::vector<ControlCommand> due;
+  ControlCommand cmd;
+  while (queue->nextDue(framePos, framePos + kFrames, &cmd)) {
+    due.push_back(cmd);
+    queue->pop();
+  }
+  queue->setFramePosition(framePos + kFrames);
+  return due;
+}
+
+/*
+ * A command stamped far ahead does not hold back the ones due before it,
+ * and comes out in its own buffer
+ */
+static void TestFutureDoesNotBlock(void) {
+  ControlQueue queue;
+  CHECK(queue.post(Command(DELAY_PARAM_MIX, 1.0f, 48000)));
+  CHECK(queue.post(Command(DELAY_PARAM_FEEDBACK, 0.5f, kControlNow)));
+  CHECK(queue.post(Command(DELAY_PARAM_TIME_L_MS, 100.0f, 500)));
+  std::vector<ControlCommand> due = Due(&queue, 0);
+  CHECK(due.size() == 1 && due[0].param_ == DELAY_PARAM_FEEDBACK);
+  due = Due(&queue, kFrames);
+  CHECK(due.empty());
+  due = Due(&queue, 2 * kFrames);
+  CHECK(due.size() == 1 && due[0].framePos_ == 500);
+  for (uint64_t pos = 3 * kFrames; pos < 48000 - kFrames; pos += kFrames) {
+    CHECK(Due(&queue, pos).empty());
+  }
+  due = Due(&queue, 48000 / kFrames * kFrames);
+  CHECK(due.size() == 1 && due[0].param_ == DELAY_PARAM_MIX &&
+        due[0].framePos_ == 48000);
+}
+
+/*
+ * Commands due in the same buffer come out by frame; stamped in the past
+ * or kControlNow, in posting order, so the last one posted wins
+ */
+static void TestOrder(void) {
+  ControlQueue queue;
+  Due(&queue, 0);
+  CHECK(queue.post(Command(DELAY_PARAM_MIX, 0.1f, kFrames + 150)));
+  CHECK(queue.post(Command(DELAY_PARAM_MIX, 0.2f, kFrames + 20)));
+  CHECK(queue.post(Command(DELAY_PARAM_MIX, 0.3f, 10)));
+  CHECK(queue.post(Command(DELAY_PARAM_MIX, 0.4f, kControlNow)));
+  std::vector<ControlCommand> due = Due(&queue, kFrames);
+  CHECK(due.size() == 4);
+  if (due.size() == 4) {
+    CHECK(due[0].value_ == 0.3f && due[0].framePos_ == kFrames);
+    CHECK(due[1].value_ == 0.4f && due[1].framePos_ == kFrames);
+    CHECK(due[2].value_ == 0.2f);
+    CHECK(due[3].value_ == 0.1f);
+  }
+}
+
+/*
+ * A stamp beyond kMaxLeadFrames is rejected, and the queue stays usable
+ */
+static void TestFarFutureRejected(void) {
+  ControlQueue queue;
+  Due(&queue, 0);
+  uint64_t now = queue.getFramePosition();
+  CHECK(!queue.post(Command(DELAY_PARAM_MIX, 1.0f,
+                            now + ControlQueue::kMaxLeadFrames + 1)));
+  CHECK(queue.getRejected() == 1);
+  CHECK(queue.post(Command(DELAY_PARAM_MIX, 1.0f,
+                           now + ControlQueue::kMaxLeadFrames)));
+  // a ring's worth of future commands waits in the pending list, with
+  // room for one more
+  for (uint32_t i = 0; i < ControlQueue::kCapacity - 2; i++) {
+    CHECK(queue.post(Command(DELAY_PARAM_MIX, 0.5f, now + 100000 + i)));
+  }
+  CHECK(Due(&queue, now).empty());
+  CHECK(queue.post(Command(DELAY_PARAM_FEEDBACK, 0.5f, kControlNow)));
+  std::vector<ControlCommand> due = Due(&queue, now + kFrames);
+  CHECK(due.size() == 1 && due[0].param_ == DELAY_PARAM_FEEDBACK);
+}
+
+int main() {
+  TestFutureDoesNotBlock();
+  TestOrder();
+  TestFarFutureRejected();
+  return TestResult();
+}
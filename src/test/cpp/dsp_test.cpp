@@ -0,0 +1,578 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "control_queue.h"
+#include "dynamics.h"
+#include "equalizer.h"
+#include "input_conditioner.h"
+#include "pcm_convert.h"
+#include "pitch_shifter.h"
+#include "test_util.h"
+
+/*
+ * Signal processing blocks on synthetic input, one function per block, and
+ * benchmarks of the NEON kernels against their plain C references (both
+ * are the C code unless built for ARM).
+ */
+static const int32_t kRate = 48000;
+static const SLmilliHertz kRateMilliHz = kRate * 1000;
+static const int32_t kChannels = 2;
+static const int32_t kBlockFrames = 192;
+
+static std::vector<int16_t> Constant(int16_t value, int32_t frames) {
+  return std::vector<int16_t>(frames * kChannels, value);
+}
+
+static uint32_t testSeed = 1;
+static uint32_t Random(void) {
+  testSeed = testSeed * 1664525 + 1013904223;
+  return testSeed;
+}
+
+static bool AllEqual(const std::vector<int16_t> &pcm, int16_t value) {
+  for (int16_t sample : pcm) {
+    if (sample != value) return false;
+  }
+  return true;
+}
+
+/*
+ * Gate with instant attack and release: a block with signal opens it, the
+ * quiet blocks after it pass for the hold, rounded up to whole blocks, and
+ * the next one ramps down to closed. Opening again ramps up across a block.
+ */
+static void TestGateHold(float holdMs, int32_t openQuietBlocks) {
+  InputConditioner gate(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16);
+  gate.setParam(CONDITIONER_PARAM_DC_BLOCK, 0.0f);
+  gate.setParam(CONDITIONER_PARAM_GATE_THRESHOLD_DB, -40.0f);
+  gate.setParam(CONDITIONER_PARAM_ATTACK_MS, 0.0f);
+  gate.setParam(CONDITIONER_PARAM_HOLD_MS, holdMs);
+  gate.setParam(CONDITIONER_PARAM_RELEASE_MS, 0.0f);
+
+  for (int32_t round = 0; round < 2; round++) {
+    std::vector<int16_t> loud = Constant(10000, kBlockFrames);
+    gate.process(loud.data(), kBlockFrames);
+    if (round == 0) {
+      CHECK(AllEqual(loud, 10000));  // starts open
+    } else {
+      CHECK(loud.front() == 0 && loud.back() >= 9900);
+    }
+    for (int32_t block = 0; block < openQuietBlocks + 2; block++) {
+      std::vector<int16_t> quiet = Constant(10, kBlockFrames);
+      gate.process(quiet.data(), kBlockFrames);
+      if (block < openQuietBlocks) {
+        CHECK(AllEqual(quiet, 10));
+      } else if (block == openQuietBlocks) {
+        CHECK(quiet.front() == 10 && quiet.back() <= 1);
+      } else {
+        CHECK(AllEqual(quiet, 0));
+      }
+    }
+  }
+}
+
+/*
+ * Random samples of a format, with full scale and rounding ties mixed in
+ */
+static std::vector<uint8_t> RandomPcm(PcmFormat format, int32_t samples) {
+  static const int32_t kS32Edges[] = {INT32_MIN, INT32_MAX, 0x8000, -0x8000,
+                                      0x7FFF,    0x80,      -0x80,  0x17F80};
+  std::vector<uint8_t> pcm(samples * PcmFormatBytes(format));
+  for (int32_t i = 0; i < samples; i++) {
+    uint32_t r = Random();
+    if (format == PCM_FORMAT_FLOAT) {
+      float v = (static_cast<int32_t>(r) / 2147483648.0f) * 1.1f;
+      memcpy(&pcm[i * 4], &v, 4);
+    } else if (format == PCM_FORMAT_S32 && (r & 7) == 0) {
+      memcpy(&pcm[i * 4], &kS32Edges[(r >> 3) & 7], 4);
+    } else {
+      for (int32_t b = 0; b < PcmFormatBytes(format); b++) {
+        pcm[i * PcmFormatBytes(format) + b] =
+            static_cast<uint8_t>(r >> 8 * b);
+      }
+    }
+  }
+  return pcm;
+}
+
+/*
+ * ConvertPcm() against ConvertPcmReference(): every format and layout
+ * pair, with and without dither, odd lengths for the vector tails.
+ */
+static void TestPcmConvertMatchesReference(void) {
+  const PcmLayout kLayouts[] = {PCM_LAYOUT_INTERLEAVED, PCM_LAYOUT_PLANAR};
+  for (int32_t channels = 1; channels <= 3; channels++) {
+    const int32_t frames = 1001;
+    const int32_t samples = frames * channels;
+    for (int32_t from = 0; from < PCM_FORMAT_COUNT; from++) {
+      PcmFormat srcFormat = static_cast<PcmFormat>(from);
+      std::vector<uint8_t> src = RandomPcm(srcFormat, samples);
+      for (int32_t to = 0; to < PCM_FORMAT_COUNT; to++) {
+        PcmFormat dstFormat = static_cast<PcmFormat>(to);
+        for (PcmLayout srcLayout : kLayouts) {
+          for (PcmLayout dstLayout : kLayouts) {
+            for (int32_t dithered = 0; dithered < 2; dithered++) {
+              size_t bytes = samples * PcmFormatBytes(dstFormat);
+              std::vector<uint8_t> fast(bytes), reference(bytes);
+              PcmDither fastDither, referenceDither;
+              PcmDitherInit(&fastDither, 5);
+              PcmDitherInit(&referenceDither, 5);
+              CHECK(ConvertPcm(src.data(), srcFormat, srcLayout, fast.data(),
+                               dstFormat, dstLayout, frames, channels,
+                               dithered ? &fastDither : nullptr));
+              CHECK(ConvertPcmReference(
+                  src.data(), srcFormat, srcLayout, reference.data(),
+                  dstFormat, dstLayout, frames, channels,
+                  dithered ? &referenceDither : nullptr));
+              CHECK(fast == reference);
+              CHECK(!memcmp(fastDither.state_, referenceDither.state_,
+                            sizeof(fastDither.state_)));
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+/*
+ * S32 narrowing is a rounding shift (ties up) and a clamp, not a trip
+ * through float
+ */
+static void TestS32Narrowing(void) {
+  const int32_t in[] = {INT32_MAX, INT32_MIN, 0x8000,     -0x8000, 0x7FFF,
+                        0x18000,   0x80,      0x7FFFFF7F, 0x01234567};
+  const int16_t s16[] = {32767, -32768, 1, 0, 0, 2, 0, 32767, 0x0123};
+  const int32_t s24[] = {8388607, -8388608, 0x80, -0x80, 0x80,
+                         0x180,   1,        0x7FFFFF, 0x012345};
+  const int32_t count = sizeof(in) / sizeof(in[0]);
+  int16_t out16[count];
+  uint8_t out24[count * 3];
+  CHECK(ConvertPcm(in, PCM_FORMAT_S32, PCM_LAYOUT_INTERLEAVED, out16,
+                   PCM_FORMAT_S16, PCM_LAYOUT_INTERLEAVED, count, 1, nullptr));
+  CHECK(ConvertPcm(in, PCM_FORMAT_S32, PCM_LAYOUT_INTERLEAVED, out24,
+                   PCM_FORMAT_S24_PACKED, PCM_LAYOUT_INTERLEAVED, count, 1,
+                   nullptr));
+  for (int32_t i = 0; i < count; i++) {
+    CHECK(out16[i] == s16[i]);
+    const uint8_t *p = out24 + 3 * i;
+    int32_t v = static_cast<int32_t>(static_cast<uint32_t>(p[0]) << 8 |
+                                     static_cast<uint32_t>(p[1]) << 16 |
+                                     static_cast<uint32_t>(p[2]) << 24) >> 8;
+    CHECK(v == s24[i]);
+  }
+}
+
+/*
+ * Throughput of each conversion over a second of stereo, bytes read plus
+ * bytes written, against the reference
+ */
+static void BenchPcmConvert(void) {
+  const int32_t frames = kRate;
+  const int32_t channels = 2;
+  const PcmLayout I = PCM_LAYOUT_INTERLEAVED, P = PCM_LAYOUT_PLANAR;
+  const struct {
+    PcmFormat from_;
+    PcmLayout fromLayout_;
+    PcmFormat to_;
+    PcmLayout toLayout_;
+    const char *name_;
+  } kCases[] = {
+      {PCM_FORMAT_S16, I, PCM_FORMAT_FLOAT, I, "S16 -> float"},
+      {PCM_FORMAT_S16, I, PCM_FORMAT_FLOAT, P, "S16 -> float planar"},
+      {PCM_FORMAT_FLOAT, I, PCM_FORMAT_S16, I, "float -> S16 dithered"},
+      {PCM_FORMAT_FLOAT, P, PCM_FORMAT_S16, I, "float planar -> S16 dith."},
+      {PCM_FORMAT_S24_PACKED, I, PCM_FORMAT_FLOAT, I, "S24 -> float"},
+      {PCM_FORMAT_S24_PACKED, I, PCM_FORMAT_S16, I, "S24 -> S16 dithered"},
+      {PCM_FORMAT_S24_PACKED, P, PCM_FORMAT_S16, I, "S24 planar -> S16 dith."},
+      {PCM_FORMAT_S32, I, PCM_FORMAT_S16, I, "S32 -> S16 dithered"},
+      {PCM_FORMAT_S32, I, PCM_FORMAT_S24_PACKED, I, "S32 -> S24 dithered"},
+      {PCM_FORMAT_S16, P, PCM_FORMAT_S16, I, "S16 planar -> interleaved"},
+  };
+  for (const auto &c : kCases) {
+    std::vector<uint8_t> src = RandomPcm(c.from_, frames * channels);
+    size_t dstBytes = frames * channels * PcmFormatBytes(c.to_);
+    std::vector<uint8_t> dst(dstBytes);
+    double bytes = static_cast<double>(src.size() + dstBytes);
+    PcmDither dither;
+    PcmDitherInit(&dither, 1);
+    double fast = NsPerCall([&] {
+      ConvertPcm(src.data(), c.from_, c.fromLayout_, dst.data(), c.to_,
+                 c.toLayout_, frames, channels, &dither);
+    });
+    double reference = NsPerCall([&] {
+      ConvertPcmReference(src.data(), c.from_, c.fromLayout_, dst.data(),
+                          c.to_, c.toLayout_, frames, channels, &dither);
+    });
+    // bytes per ns is GB/s
+    printf("pcm_convert %-26s %6.2f GB/s (reference %6.2f GB/s)\n", c.name_,
+           bytes / fast, bytes / reference);
+  }
+}
+
+static std::vector<int16_t> Sine(float hz, float amplitude, int32_t frames) {
+  std::vector<int16_t> pcm(frames * kChannels);
+  for (int32_t i = 0; i < frames; i++) {
+    float phase = 2.0f * static_cast<float>(M_PI) * hz * i / kRate;
+    float v = amplitude * sinf(phase);
+    for (int32_t ch = 0; ch < kChannels; ch++) {
+      pcm[i * kChannels + ch] = static_cast<int16_t>(lrintf(v));
+    }
+  }
+  return pcm;
+}
+
+/*
+ * Frequency of channel 0 from its rising zero crossings, interpolated
+ * between samples, from frame from to the end
+ */
+static double MeasureHz(const std::vector<int16_t> &pcm, int32_t from) {
+  double first = -1.0, last = -1.0;
+  int32_t crossings = 0;
+  int32_t frames = static_cast<int32_t>(pcm.size()) / kChannels;
+  for (int32_t i = from + 1; i < frames; i++) {
+    int32_t a = pcm[(i - 1) * kChannels], b = pcm[i * kChannels];
+    if (a < 0 && b >= 0) {
+      double t = i - 1 + static_cast<double>(-a) / (b - a);
+      if (first < 0) first = t;
+      last = t;
+      crossings++;
+    }
+  }
+  return crossings > 1 ? (crossings - 1) * kRate / (last - first) : 0.0;
+}
+
+// run pcm through fn in blocks of kBlockFrames, the last one shorter
+template <typename Fn>
+static void ProcessBlocks(std::vector<int16_t> *pcm, Fn fn) {
+  int32_t frames = static_cast<int32_t>(pcm->size()) / kChannels;
+  for (int32_t f = 0; f < frames; f += kBlockFrames) {
+    fn(pcm->data() + f * kChannels, std::min(kBlockFrames, frames - f));
+  }
+}
+
+/*
+ * A shifted sine comes out at the shifted frequency, within 3 cents
+ */
+static void TestPitchAccuracy(float semitones, float cents) {
+  PitchShifter shifter(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16);
+  CHECK(shifter.schedule(PITCH_PARAM_SEMITONES, semitones, 0, 0));
+  CHECK(shifter.schedule(PITCH_PARAM_CENTS, cents, 0, 0));
+  CHECK(shifter.schedule(PITCH_PARAM_MIX, 1.0f, 0, 0));
+  const float inHz = 440.0f;
+  std::vector<int16_t> pcm = Sine(inHz, 12000.0f, kRate);
+  ProcessBlocks(&pcm, [&](int16_t *block, int32_t frames) {
+    shifter.process(block, frames);
+  });
+  double expected = inHz * pow(2.0, (semitones + cents / 100.0) / 12.0);
+  double measured = MeasureHz(pcm, kRate / 2);
+  double errorCents = 1200.0 * log2(measured / expected);
+  printf("pitch %+5.1f st %+4.0f ct: expected %7.2f Hz, measured %7.2f Hz "
+         "(%+.2f cents)\n", semitones, cents, expected, measured, errorCents);
+  CHECK(fabs(errorCents) < 3.0);
+}
+
+/*
+ * Cost per block and added delay against the search window, at +5
+ * semitones; the delay at +12 is the worst case
+ */
+static void BenchPitchShifter(void) {
+  const float kSearchMs[] = {0.0f, 1.0f, PitchShifter::kDefaultSearchMs, 5.0f,
+                             PitchShifter::kMaxSearchMs};
+  for (float searchMs : kSearchMs) {
+    PitchShifter shifter(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16,
+                         searchMs);
+    shifter.schedule(PITCH_PARAM_SEMITONES, 5.0f, 0, 0);
+    shifter.schedule(PITCH_PARAM_MIX, 1.0f, 0, 0);
+    std::vector<int16_t> pcm = Sine(440.0f, 12000.0f, kBlockFrames);
+    double ns = NsPerCall([&] {
+      shifter.process(pcm.data(), kBlockFrames);
+    });
+    printf("pitch shifter +5 st, search %4.1f ms: %7.0f ns per %d frames, "
+           "delay %5.2f ms (%5.2f ms at +12 st)\n", searchMs, ns,
+           kBlockFrames, shifter.latencyFrames(5.0f) * 1000.0 / kRate,
+           shifter.latencyFrames(12.0f) * 1000.0 / kRate);
+    CHECK(shifter.latencyFrames(12.0f) * 1000 < 20 * kRate);
+  }
+}
+
+// level of channel ch in dB, from frame from to the end
+static double LevelDb(const std::vector<int16_t> &pcm, int32_t ch,
+                      int32_t from) {
+  double energy = 0.0;
+  int32_t frames = static_cast<int32_t>(pcm.size()) / kChannels;
+  for (int32_t i = from; i < frames; i++) {
+    double v = pcm[i * kChannels + ch];
+    energy += v * v;
+  }
+  return 10.0 * log10(energy / std::max(frames - from, 1));
+}
+
+/*
+ * DC blocker: an offset is gone after a few time constants, and a 1 kHz
+ * tone, two decades above the corner, comes out at its level
+ */
+static void TestDcBlock(void) {
+  InputConditioner dc(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16);
+  dc.setParam(CONDITIONER_PARAM_DC_BLOCK, 1.0f);
+  dc.setParam(CONDITIONER_PARAM_GATE, 0.0f);
+  std::vector<int16_t> pcm = Sine(1000.0f, 8000.0f, kRate);
+  for (size_t i = 0; i < pcm.size(); i++) {
+    pcm[i] = static_cast<int16_t>(pcm[i] + (i % kChannels ? -3000 : 3000));
+  }
+  ProcessBlocks(&pcm, [&](int16_t *block, int32_t frames) {
+    dc.process(block, frames);
+  });
+  for (int32_t ch = 0; ch < kChannels; ch++) {
+    double sum = 0.0;
+    for (int32_t i = kRate / 2; i < kRate; i++) sum += pcm[i * kChannels + ch];
+    double mean = sum / (kRate / 2);
+    printf("dc block: channel %d mean %+.2f from %+d\n", ch, mean,
+           ch ? -3000 : 3000);
+    CHECK(fabs(mean) < 1.0);
+  }
+
+  InputConditioner tone(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16);
+  tone.setParam(CONDITIONER_PARAM_DC_BLOCK, 1.0f);
+  tone.setParam(CONDITIONER_PARAM_GATE, 0.0f);
+  std::vector<int16_t> in = Sine(1000.0f, 8000.0f, kRate / 4);
+  std::vector<int16_t> out = in;
+  ProcessBlocks(&out, [&](int16_t *block, int32_t frames) {
+    tone.process(block, frames);
+  });
+  for (int32_t ch = 0; ch < kChannels; ch++) {
+    CHECK(fabs(LevelDb(out, ch, kRate / 8) - LevelDb(in, ch, kRate / 8)) <
+          0.01);
+  }
+  CHECK(fabs(MeasureHz(out, kRate / 8) - 1000.0) < 0.1);
+}
+
+/*
+ * Conditioner cost per block, DC blocker and an open gate, against the
+ * block's duration
+ */
+static void BenchInputConditioner(void) {
+  InputConditioner cond(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16);
+  cond.setParam(CONDITIONER_PARAM_DC_BLOCK, 1.0f);
+  cond.setParam(CONDITIONER_PARAM_GATE, 1.0f);
+  std::vector<int16_t> pcm = Sine(440.0f, 8000.0f, kBlockFrames);
+  std::vector<int16_t> block = pcm;
+  double ns = NsPerCall([&] {
+    memcpy(block.data(), pcm.data(), pcm.size() * sizeof(int16_t));
+    cond.process(block.data(), kBlockFrames);
+  });
+  double periodNs = 1e9 * kBlockFrames / kRate;
+  printf("input conditioner: %7.0f ns per %d frames (%.3f%% of the block "
+         "period)\n", ns, kBlockFrames, 100.0 * ns / periodNs);
+}
+
+/*
+ * Gain of one EQ section at hz, once its coefficient ramp and the filter
+ * transient are over
+ */
+static double EqGainDb(int32_t type, float freqHz, float q, float gainDb,
+                       float hz) {
+  Equalizer eq(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16,
+               kBlockFrames);
+  CHECK(eq.schedule(EQ_PARAM_TYPE, static_cast<float>(type), 0, 0));
+  CHECK(eq.schedule(EQ_PARAM_FREQ_HZ, freqHz, 0, 0));
+  CHECK(eq.schedule(EQ_PARAM_Q, q, 0, 0));
+  CHECK(eq.schedule(EQ_PARAM_GAIN_DB, gainDb, 0, 0));
+  std::vector<int16_t> in = Sine(hz, 4000.0f, kRate / 2);
+  std::vector<int16_t> out = in;
+  ProcessBlocks(&out, [&](int16_t *block, int32_t frames) {
+    eq.process(block, frames);
+  });
+  double gain = LevelDb(out, 0, kRate / 4) - LevelDb(in, 0, kRate / 4);
+  CHECK(fabs(LevelDb(out, 1, kRate / 4) - LevelDb(out, 0, kRate / 4)) < 0.01);
+  return gain;
+}
+
+static void CheckEqGain(const char *name, int32_t type, float freqHz,
+                        float q, float gainDb, float hz, double expectedDb) {
+  double measured = EqGainDb(type, freqHz, q, gainDb, hz);
+  printf("eq %-10s %5.0f Hz: expected %+6.2f dB, measured %+6.2f dB\n", name,
+         hz, expectedDb, measured);
+  CHECK(fabs(measured - expectedDb) < 0.2);
+}
+
+/*
+ * Landmarks of the cookbook responses: a peak has its gain at the center
+ * frequency, a shelf half of it, and a high or low pass Q (-3 dB at Q
+ * 0.707); far from the center the response is flat, or falls by 12 dB an
+ * octave beyond the corner of a pass filter.
+ */
+static void TestEqResponse(void) {
+  CheckEqGain("peak", EQ_TYPE_PEAK, 1000.0f, 2.0f, 9.0f, 1000.0f, 9.0);
+  CheckEqGain("peak", EQ_TYPE_PEAK, 1000.0f, 2.0f, 9.0f, 100.0f, 0.0);
+  CheckEqGain("peak", EQ_TYPE_PEAK, 1000.0f, 2.0f, -12.0f, 1000.0f, -12.0);
+  CheckEqGain("low shelf", EQ_TYPE_LOW_SHELF, 500.0f, 0.707f, 6.0f, 500.0f,
+              3.0);
+  CheckEqGain("low shelf", EQ_TYPE_LOW_SHELF, 500.0f, 0.707f, 6.0f, 30.0f,
+              6.0);
+  CheckEqGain("low shelf", EQ_TYPE_LOW_SHELF, 500.0f, 0.707f, 6.0f, 10000.0f,
+              0.0);
+  CheckEqGain("high shelf", EQ_TYPE_HIGH_SHELF, 4000.0f, 0.707f, -8.0f,
+              4000.0f, -4.0);
+  CheckEqGain("high shelf", EQ_TYPE_HIGH_SHELF, 4000.0f, 0.707f, -8.0f,
+              18000.0f, -8.0);
+  CheckEqGain("high shelf", EQ_TYPE_HIGH_SHELF, 4000.0f, 0.707f, -8.0f,
+              200.0f, 0.0);
+  CheckEqGain("high pass", EQ_TYPE_HIGH_PASS, 1000.0f, 0.7071f, 0.0f,
+              1000.0f, -3.01);
+  CheckEqGain("high pass", EQ_TYPE_HIGH_PASS, 1000.0f, 0.7071f, 0.0f,
+              125.0f, 20.0 * log10(1.0 / 64.0));
+  CheckEqGain("low pass", EQ_TYPE_LOW_PASS, 1000.0f, 2.0f, 0.0f, 1000.0f,
+              20.0 * log10(2.0));
+  CheckEqGain("low pass", EQ_TYPE_LOW_PASS, 1000.0f, 0.7071f, 0.0f, 100.0f,
+              0.0);
+}
+
+/*
+ * Cost per frame against the number of active sections, once their
+ * coefficient ramps are over
+ */
+static void BenchEqualizer(void) {
+  for (int32_t sections = 1; sections <= kEqMaxSections; sections++) {
+    Equalizer eq(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16,
+                 kBlockFrames);
+    for (int32_t sec = 0; sec < sections; sec++) {
+      int32_t base = sec * EQ_SECTION_PARAMS;
+      eq.schedule(base + EQ_PARAM_TYPE, EQ_TYPE_PEAK, 0, 0);
+      eq.schedule(base + EQ_PARAM_FREQ_HZ, 100.0f * (sec + 1), 0, 0);
+      eq.schedule(base + EQ_PARAM_Q, 1.0f, 0, 0);
+      eq.schedule(base + EQ_PARAM_GAIN_DB, 3.0f, 0, 0);
+    }
+    std::vector<int16_t> pcm = Sine(440.0f, 4000.0f, kBlockFrames);
+    for (int32_t block = 0; block < kRate / kBlockFrames; block++) {
+      eq.process(pcm.data(), kBlockFrames);
+    }
+    double ns = NsPerCall([&] {
+      eq.process(pcm.data(), kBlockFrames);
+    });
+    printf("equalizer %d peak%s: %6.2f ns per frame\n", sections,
+           sections > 1 ? "s" : " ", ns / kBlockFrames);
+  }
+}
+
+static DynamicsProcessor *NewLimiter(float ceilingDb) {
+  DynamicsProcessor *dyn = new DynamicsProcessor(
+      kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16, kBlockFrames);
+  dyn->setParam(DYNAMICS_PARAM_PLACEMENT, DYNAMICS_PLACEMENT_OUTPUT);
+  dyn->setParam(DYNAMICS_PARAM_RATIO, 1.0f);
+  dyn->setParam(DYNAMICS_PARAM_CEILING_DB, ceilingDb);
+  dyn->setParam(DYNAMICS_PARAM_LIMIT_RELEASE_MS, 50.0f);
+  return dyn;
+}
+
+/*
+ * Limiter alone, on full scale input: bursts out of silence, a square wave
+ * and white noise. No sample comes out above the ceiling, not even at the
+ * onset of a burst; a signal below it only comes out delayed.
+ */
+static void TestLimiterCeiling(float ceilingDb) {
+  DynamicsProcessor *dyn = NewLimiter(ceilingDb);
+  std::vector<int16_t> pcm(kRate * kChannels, 0);
+  int32_t frames = kRate;
+  for (int32_t i = 0; i < frames; i++) {
+    int16_t v = 0;
+    if (i < frames / 4) {
+      v = (i / 480) % 4 == 3 ? 32767 : 0;  // 10 ms bursts
+    } else if (i < frames / 2) {
+      v = (i / 24) % 2 ? 32767 : -32768;   // 1 kHz square
+    } else {
+      v = static_cast<int16_t>(Random() >> 16);
+    }
+    for (int32_t ch = 0; ch < kChannels; ch++) {
+      pcm[i * kChannels + ch] = ch ? -v : v;
+    }
+  }
+  ProcessBlocks(&pcm, [&](int16_t *block, int32_t blockFrames) {
+    dyn->process(block, blockFrames);
+  });
+  int32_t peak = 0;
+  for (int16_t sample : pcm) {
+    peak = std::max(peak, abs(static_cast<int32_t>(sample)));
+  }
+  double ceiling = 32767.0 * pow(10.0, ceilingDb / 20.0);
+  printf("limiter %+5.1f dB: ceiling %5.0f, peak %5d\n", ceilingDb, ceiling,
+         peak);
+  CHECK(peak <= lrint(ceiling));
+  DynamicsMeter meter;
+  dyn->getMeter(&meter);
+  CHECK(meter.maxDb_ >= -ceilingDb);
+  delete dyn;
+
+  // 3 dB under the ceiling: only delayed
+  dyn = NewLimiter(ceilingDb);
+  std::vector<int16_t> in =
+      Sine(997.0f, static_cast<float>(ceiling * 0.7), kRate / 4);
+  std::vector<int16_t> out = in;
+  ProcessBlocks(&out, [&](int16_t *block, int32_t blockFrames) {
+    dyn->process(block, blockFrames);
+  });
+  int32_t latency = dyn->latencyFrames();
+  int32_t maxDiff = 0;
+  for (size_t i = latency * kChannels; i < out.size(); i++) {
+    maxDiff = std::max(maxDiff, abs(out[i] - in[i - latency * kChannels]));
+  }
+  CHECK(maxDiff <= 1);
+  delete dyn;
+}
+
+static void BenchLimiter(void) {
+  DynamicsProcessor *dyn = NewLimiter(-1.0f);
+  std::vector<int16_t> pcm(kBlockFrames * kChannels);
+  for (int16_t &sample : pcm) {
+    sample = static_cast<int16_t>(Random() >> 16);
+  }
+  std::vector<int16_t> block = pcm;
+  double ns = NsPerCall([&] {
+    memcpy(block.data(), pcm.data(), pcm.size() * sizeof(int16_t));
+    dyn->process(block.data(), kBlockFrames);
+  });
+  printf("limiter: %7.0f ns per %d frames\n", ns, kBlockFrames);
+  delete dyn;
+}
+
+int main() {
+  TestGateHold(0.0f, 0);
+  TestGateHold(2.0f, 1);   // 96 frames
+  TestGateHold(4.0f, 1);   // exactly one block
+  TestGateHold(10.0f, 3);  // 480 frames
+  TestPcmConvertMatchesReference();
+  TestS32Narrowing();
+  BenchPcmConvert();
+  TestPitchAccuracy(0.0f, 0.0f);
+  TestPitchAccuracy(7.0f, 0.0f);
+  TestPitchAccuracy(-5.0f, 0.0f);
+  TestPitchAccuracy(12.0f, 0.0f);
+  TestPitchAccuracy(-12.0f, 0.0f);
+  TestPitchAccuracy(3.0f, 50.0f);
+  BenchPitchShifter();
+  TestDcBlock();
+  BenchInputConditioner();
+  TestEqResponse();
+  BenchEqualizer();
+  TestLimiterCeiling(0.0f);
+  TestLimiterCeiling(-1.0f);
+  TestLimiterCeiling(-12.0f);
+  BenchLimiter();
+  return TestResult();
+}
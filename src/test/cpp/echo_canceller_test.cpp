@@ -0,0 +1,241 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cmath>
+#include <vector>
+#include "echo_canceller.h"
+#include "test_util.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * EchoCanceller on a simulated room: what the player hands over comes back
+ * into the mic through a bulk delay and a decaying echo path, with a little
+ * noise. The far end is white noise.
+ */
+static const int32_t kRate = 48000;
+static const SLmilliHertz kRateMilliHz = kRate * 1000;
+static const int32_t kChannels = 2;
+static const int32_t kFramesPerBuf = 192;
+static const int32_t kPathTaps = 512;
+
+class Room {
+ public:
+  explicit Room(int32_t lagFrames) : lag_(lagFrames) {
+    // a direct path and a diffuse tail decaying by 60 dB over the taps
+    path_.resize(kPathTaps);
+    for (int32_t i = 0; i < kPathTaps; i++) {
+      path_[i] = 0.3f * Noise() * powf(10.0f, -3.0f * i / kPathTaps);
+    }
+    path_[0] = 0.5f;
+    played_.assign(lag_ + kPathTaps, 0.0f);
+  }
+
+  // the next buffer the player hands to the device
+  void play(int16_t *out) {
+    for (int32_t i = 0; i < kFramesPerBuf; i++) {
+      int16_t v = static_cast<int16_t>(lrintf(8000.0f * Noise()));
+      for (int32_t ch = 0; ch < kChannels; ch++) {
+        out[i * kChannels + ch] = v;
+      }
+      played_.push_back(v);
+    }
+  }
+
+  // what the mic picks up meanwhile
+  void capture(int16_t *in) {
+    size_t end = played_.size();
+    for (int32_t i = 0; i < kFramesPerBuf; i++) {
+      size_t now = end - kFramesPerBuf + i - lag_;
+      float echo = 0.0f;
+      for (int32_t k = 0; k < kPathTaps; k++) {
+        echo += path_[k] * played_[now - k];
+      }
+      int16_t v = static_cast<int16_t>(lrintf(echo + 3.0f * Noise()));
+      for (int32_t ch = 0; ch < kChannels; ch++) {
+        in[i * kChannels + ch] = v;
+      }
+    }
+    // keep what the echo path may still reach
+    size_t keep = lag_ + kPathTaps + kFramesPerBuf;
+    if (played_.size() > 4 * keep) {
+      played_.erase(played_.begin(), played_.end() - keep);
+    }
+  }
+
+ private:
+  int32_t lag_;
+  std::vector<float> path_;
+  std::vector<float> played_;
+  uint32_t seed_ = 5;
+
+  // uniform in -1 .. 1, unit-ish power for the tail
+  float Noise(void) {
+    seed_ = seed_ * 1664525 + 1013904223;
+    return static_cast<int32_t>(seed_) / 2147483648.0f;
+  }
+};
+
+// one buffer period of the session: play, capture, cancel
+static void RunBuffers(Room *room, EchoCanceller *ec, int32_t buffers) {
+  std::vector<int16_t> played(kFramesPerBuf * kChannels);
+  std::vector<int16_t> captured(kFramesPerBuf * kChannels);
+  for (int32_t n = 0; n < buffers; n++) {
+    room->play(played.data());
+    ec->pushReference(played.data(), kFramesPerBuf);
+    room->capture(captured.data());
+    ec->process(captured.data(), kFramesPerBuf);
+  }
+}
+
+static int32_t Buffers(float seconds) {
+  return static_cast<int32_t>(seconds * kRate / kFramesPerBuf);
+}
+
+/*
+ * An echo within the filter's reach converges without a bulk delay
+ */
+static void TestConvergence(void) {
+  Room room(480);
+  EchoCanceller ec(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16,
+                   kFramesPerBuf);
+  ec.setEnabled(true);
+  RunBuffers(&room, &ec, Buffers(0.5f));
+  float early = ec.getErleDb();
+  RunBuffers(&room, &ec, Buffers(2.5f));
+  printf("echo 10 ms: ERLE %.1f dB after 0.5 s, %.1f dB after 3 s\n", early,
+         ec.getErleDb());
+  CHECK(ec.getErleDb() > 25.0f);
+}
+
+/*
+ * An echo 2500 frames late is out of the filter's reach (2048 frames), and
+ * nothing is cancelled. With the bulk delay the estimate finds, or set by
+ * hand, it converges as though the device had no latency.
+ */
+static void TestBulkDelay(void) {
+  const int32_t lag = 2500;
+  {
+    Room room(lag);
+    EchoCanceller ec(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16,
+                     kFramesPerBuf);
+    ec.setEnabled(true);
+    RunBuffers(&room, &ec, Buffers(3.0f));
+    printf("echo %d frames, no delay: ERLE %.1f dB\n", lag, ec.getErleDb());
+    CHECK(ec.getErleDb() < 6.0f);
+  }
+  {
+    Room room(lag);
+    EchoCanceller ec(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16,
+                     kFramesPerBuf);
+    ec.setEnabled(true);
+    ec.setDelayMs(2300.0f * 1000 / kRate);
+    RunBuffers(&room, &ec, Buffers(3.0f));
+    printf("echo %d frames, 2300 frames delay: ERLE %.1f dB\n", lag,
+           ec.getErleDb());
+    CHECK(ec.getErleDb() > 25.0f);
+  }
+  // estimated, starting from no delay and from one too long
+  for (float startMs : {0.0f, 150.0f}) {
+    Room room(lag);
+    EchoCanceller ec(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16,
+                     kFramesPerBuf);
+    ec.setEnabled(true);
+    ec.setDelayMs(startMs);
+    float delayMs = -1.0f, confidence = 0.0f;
+    CHECK(!ec.getDelayEstimate(&delayMs, &confidence));
+    CHECK(ec.startDelayEstimate());
+    int32_t buffers = 0;
+    while (!ec.getDelayEstimate(&delayMs, &confidence) &&
+           buffers < Buffers(3.0f)) {
+      RunBuffers(&room, &ec, 1);
+      buffers++;
+    }
+    RunBuffers(&room, &ec, Buffers(3.0f));
+    printf("echo %d frames, from %.0f ms: estimate %.2f ms (confidence "
+           "%.0f) after %.2f s, ERLE %.1f dB\n",
+           lag, startMs, delayMs, confidence,
+           buffers * kFramesPerBuf / static_cast<float>(kRate),
+           ec.getErleDb());
+    CHECK(confidence >= 8.0f);
+    // 2 blocks ahead of the echo
+    CHECK(fabsf(delayMs - (lag - 128) * 1000.0f / kRate) < 0.05f);
+    CHECK(ec.getErleDb() > 25.0f);
+  }
+}
+
+/*
+ * Without a far end there is nothing to correlate: the delay stays
+ */
+static void TestEstimateWithoutEcho(void) {
+  EchoCanceller ec(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16,
+                   kFramesPerBuf);
+  ec.setEnabled(true);
+  ec.setDelayMs(20.0f);
+  CHECK(ec.startDelayEstimate());
+  std::vector<int16_t> quiet(kFramesPerBuf * kChannels, 0);
+  float delayMs = -1.0f, confidence = 1.0f;
+  for (int32_t n = 0; n < Buffers(3.0f); n++) {
+    ec.process(quiet.data(), kFramesPerBuf);
+    if (ec.getDelayEstimate(&delayMs, &confidence)) break;
+  }
+  CHECK(confidence < 8.0f);
+  CHECK(delayMs == 20.0f);
+}
+
+/*
+ * Cost of one kBlockFrames block with the default filter length
+ */
+static void BenchBlock(void) {
+  const int32_t frames = EchoCanceller::kBlockFrames;
+  EchoCanceller ec(kRateMilliHz, kChannels, SL_PCMSAMPLEFORMAT_FIXED_16,
+                   frames);
+  ec.setEnabled(true);
+  std::vector<int16_t> played(frames * kChannels);
+  std::vector<int16_t> mic(frames * kChannels);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < played.size(); i++) {
+    seed = seed * 1664525 + 1013904223;
+    played[i] = static_cast<int16_t>(seed >> 20);
+    mic[i] = played[i] / 2;
+  }
+  std::vector<int16_t> buf = mic;
+  auto block = [&] {
+    ec.pushReference(played.data(), frames);
+    buf = mic;
+    ec.process(buf.data(), frames);
+  };
+  double ns = NsPerCall(block);
+#if defined(__x86_64__) || defined(__i386__)
+  const int32_t blocks = 1000;
+  uint64_t start = __rdtsc();
+  for (int32_t i = 0; i < blocks; i++) block();
+  double cycles = static_cast<double>(__rdtsc() - start) / blocks;
+  printf("echo canceller, %d partitions: %.0f ns, %.0f TSC cycles per %d "
+         "frames\n", EchoCanceller::kDefaultPartitions, ns, cycles, frames);
+#else
+  printf("echo canceller, %d partitions: %.0f ns per %d frames\n",
+         EchoCanceller::kDefaultPartitions, ns, frames);
+#endif
+}
+
+int main() {
+  TestConvergence();
+  TestBulkDelay();
+  TestEstimateWithoutEcho();
+  BenchBlock();
+  return TestResult();
+}
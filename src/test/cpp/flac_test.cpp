@@ -0,0 +1,453 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "flac_encoder.h"
+#include "session_recorder.h"
+#include "test_util.h"
+
+/*
+ * FlacEncoder and SessionRecorder against a decoder written from the FLAC
+ * format description alone. It knows only what the encoder may write
+ * (16 bit, fixed blocking, fixed predictors, Rice partitions) and checks
+ * every CRC, so the round trip tests the bit stream, not just the encoder
+ * agreeing with itself.
+ */
+static const int32_t kRate = 48000;
+
+class BitReader {
+ public:
+  BitReader(const uint8_t *data, size_t bytes) : data_(data), bytes_(bytes) {}
+
+  // 0 once past the end, and overrun() tells
+  uint32_t get(uint32_t bits) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < bits; i++) {
+      if (pos_ / 8 >= bytes_) {
+        overrun_ = true;
+        return 0;
+      }
+      value = (value << 1) | ((data_[pos_ / 8] >> (7 - pos_ % 8)) & 1);
+      pos_++;
+    }
+    return value;
+  }
+  int32_t getSigned(uint32_t bits) {
+    uint32_t value = get(bits);
+    if (bits && bits < 32 && (value >> (bits - 1))) {
+      value |= ~0u << bits;
+    }
+    return static_cast<int32_t>(value);
+  }
+  void align(void) { pos_ = (pos_ + 7) & ~static_cast<size_t>(7); }
+  size_t bytePos(void) const { return pos_ / 8; }
+  bool overrun(void) const { return overrun_; }
+
+ private:
+  const uint8_t *data_;
+  size_t bytes_;
+  size_t pos_ = 0;
+  bool overrun_ = false;
+};
+
+static uint8_t Crc8(const uint8_t *data, size_t bytes) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < bytes; i++) {
+    crc ^= data[i];
+    for (int32_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static uint16_t Crc16(const uint8_t *data, size_t bytes) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < bytes; i++) {
+    crc ^= data[i] << 8;
+    for (int32_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static bool DecodeSubframe(BitReader *reader, uint32_t bps, uint32_t frames,
+                           int32_t *out) {
+  if (reader->get(1)) return false;  // padding
+  uint32_t type = reader->get(6);
+  if (reader->get(1)) return false;  // wasted bits
+  if (type == 0) {
+    std::fill(out, out + frames, reader->getSigned(bps));
+    return !reader->overrun();
+  }
+  if (type == 1) {
+    for (uint32_t i = 0; i < frames; i++) {
+      out[i] = reader->getSigned(bps);
+    }
+    return !reader->overrun();
+  }
+  uint32_t order = type & 0x07;
+  if ((type & 0x38) != 0x08 || order > 4) return false;
+  for (uint32_t i = 0; i < order; i++) {
+    out[i] = reader->getSigned(bps);
+  }
+  uint32_t method = reader->get(2);
+  if (method > 1) return false;
+  uint32_t paramBits = method ? 5 : 4;
+  uint32_t partOrder = reader->get(4);
+  uint32_t i = order;
+  for (uint32_t part = 0; part < (1u << partOrder); part++) {
+    uint32_t k = reader->get(paramBits);
+    if (k == (1u << paramBits) - 1) return false;  // escape, never written
+    uint32_t count = (frames >> partOrder) - (part ? 0 : order);
+    for (uint32_t j = 0; j < count; j++, i++) {
+      uint32_t q = 0;
+      while (!reader->get(1)) {
+        if (reader->overrun()) return false;
+        q++;
+      }
+      uint32_t folded = (q << k) | reader->get(k);
+      int32_t e = static_cast<int32_t>(folded >> 1) ^ -(int32_t)(folded & 1);
+      int32_t *x = out + i;
+      switch (order) {
+        case 0: x[0] = e; break;
+        case 1: x[0] = e + x[-1]; break;
+        case 2: x[0] = e + 2 * x[-1] - x[-2]; break;
+        case 3: x[0] = e + 3 * x[-1] - 3 * x[-2] + x[-3]; break;
+        default: x[0] = e + 4 * x[-1] - 6 * x[-2] + 4 * x[-3] - x[-4]; break;
+      }
+    }
+  }
+  return i == frames && !reader->overrun();
+}
+
+struct DecodedFlac {
+  uint32_t sampleRate_;
+  uint32_t channels_;
+  uint64_t totalFrames_;  // from STREAMINFO, 0 for unknown
+  std::vector<int16_t> pcm_;
+  bool complete_;         // every byte was part of a whole frame
+};
+
+/*
+ * Decode a file image up to its end, or up to the first frame which is cut
+ * short or corrupt; false if even the header is not FLAC as written here.
+ */
+static bool DecodeFlac(const std::vector<uint8_t> &file, DecodedFlac *out) {
+  if (file.size() < FlacEncoder::kStreamHeaderBytes ||
+      memcmp(file.data(), "fLaC", 4)) {
+    return false;
+  }
+  BitReader info(file.data() + 8, 34);
+  info.get(16 + 16 + 24 + 24);  // block and frame sizes
+  out->sampleRate_ = info.get(20);
+  out->channels_ = info.get(3) + 1;
+  uint32_t bps = info.get(5) + 1;
+  out->totalFrames_ = static_cast<uint64_t>(info.get(4)) << 32;
+  out->totalFrames_ |= info.get(32);
+  if (bps != 16 || out->channels_ > 2) return false;
+  out->pcm_.clear();
+  out->complete_ = false;
+
+  std::vector<int32_t> sub[2];
+  size_t pos = FlacEncoder::kStreamHeaderBytes;
+  for (uint32_t number = 0; pos < file.size(); number++) {
+    BitReader reader(file.data() + pos, file.size() - pos);
+    if (reader.get(16) != 0xFFF8) return true;  // sync, fixed blocking
+    uint32_t sizeCode = reader.get(4);
+    uint32_t rateCode = reader.get(4);
+    uint32_t assignment = reader.get(4);
+    uint32_t sizeBits = reader.get(3);
+    reader.get(1);
+    // the frame number, UTF-8 style
+    uint32_t lead = reader.get(8);
+    uint32_t more = 0;
+    while (more < 6 && (lead & (0x40 >> more)) && (lead & 0x80)) more++;
+    uint32_t frameNumber = lead & (0x7F >> (more ? more + 1 : 0));
+    for (uint32_t i = 0; i < more; i++) {
+      frameNumber = (frameNumber << 6) | (reader.get(8) & 0x3F);
+    }
+    if (frameNumber != number || sizeCode != 7 || rateCode != 0 ||
+        sizeBits != 4) {
+      return true;
+    }
+    uint32_t frames = reader.get(16) + 1;
+    size_t headerBytes = reader.bytePos();
+    if (reader.overrun() ||
+        Crc8(file.data() + pos, headerBytes) != reader.get(8)) {
+      return true;
+    }
+    uint32_t channels = assignment < 8 ? assignment + 1 : 2;
+    if (channels != out->channels_ || assignment > 10) return true;
+    for (uint32_t ch = 0; ch < channels; ch++) {
+      // the side channel has one more bit
+      bool side = (assignment == 8 && ch == 1) ||
+                  (assignment == 9 && ch == 0) ||
+                  (assignment == 10 && ch == 1);
+      sub[ch].resize(frames);
+      if (!DecodeSubframe(&reader, side ? 17 : 16, frames, sub[ch].data())) {
+        return true;
+      }
+    }
+    reader.align();
+    size_t frameBytes = reader.bytePos();
+    if (Crc16(file.data() + pos, frameBytes) != reader.get(16) ||
+        reader.overrun()) {
+      return true;
+    }
+    for (uint32_t i = 0; i < frames; i++) {
+      int32_t a = sub[0][i];
+      int32_t b = channels > 1 ? sub[1][i] : 0;
+      int32_t left = a, right = b;
+      if (assignment == 8) {
+        right = a - b;
+      } else if (assignment == 9) {
+        left = a + b;
+      } else if (assignment == 10) {
+        int32_t mid = (a << 1) | (b & 1);
+        left = (mid + b) >> 1;
+        right = (mid - b) >> 1;
+      }
+      out->pcm_.push_back(static_cast<int16_t>(left));
+      if (channels > 1) out->pcm_.push_back(static_cast<int16_t>(right));
+    }
+    pos += reader.bytePos();
+  }
+  out->complete_ = true;
+  return true;
+}
+
+static std::vector<uint8_t> ReadFile(const std::string &path) {
+  std::vector<uint8_t> data;
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) return data;
+  uint8_t buf[4096];
+  size_t got;
+  while ((got = fread(buf, 1, sizeof(buf), file)) > 0) {
+    data.insert(data.end(), buf, buf + got);
+  }
+  fclose(file);
+  return data;
+}
+
+enum Signal {
+  SIGNAL_SPEECH,  // voiced pulses through a resonance, syllable envelope
+  SIGNAL_CHORD,   // four sines, slightly detuned between the channels
+  SIGNAL_NOISE,
+  SIGNAL_SILENCE,
+  SIGNAL_EXTREME,  // full scale square, channels opposed: 17 bit side
+  SIGNAL_COUNT
+};
+static const char *kSignalNames[SIGNAL_COUNT] = {"speech", "chord", "noise",
+                                                 "silence", "extreme"};
+
+static std::vector<int16_t> MakeSignal(int32_t signal, uint32_t frames,
+                                       uint32_t channels) {
+  std::vector<int16_t> pcm(frames * channels);
+  uint32_t seed = signal + 1;
+  auto noise = [&seed]() {
+    seed = seed * 1664525 + 1013904223;
+    return static_cast<int32_t>(seed >> 16) - 32768;
+  };
+  double y1 = 0.0, y2 = 0.0, phase = 0.0;
+  for (uint32_t i = 0; i < frames; i++) {
+    double t = static_cast<double>(i) / kRate;
+    double left = 0.0, right = 0.0;
+    switch (signal) {
+      case SIGNAL_SPEECH: {
+        double env = 0.5 + 0.5 * sin(2.0 * M_PI * 4.0 * t);
+        phase += 2.0 * M_PI * 120.0 / kRate;
+        double pulse = fmod(phase, 2.0 * M_PI) < 0.3 ? 1.0 : 0.0;
+        double y = pulse + 1.85 * y1 - 0.92 * y2;
+        y2 = y1;
+        y1 = y;
+        left = 900.0 * env * env * y + noise() / 4096.0;
+        right = 0.8 * left + noise() / 4096.0;
+        break;
+      }
+      case SIGNAL_CHORD:
+        for (double hz : {220.0, 277.2, 329.6, 440.0}) {
+          left += 2500.0 * sin(2.0 * M_PI * hz * t);
+          right += 2500.0 * sin(2.0 * M_PI * hz * 1.003 * t + 0.5);
+        }
+        break;
+      case SIGNAL_NOISE:
+        left = noise() / 4.0;
+        right = noise() / 4.0;
+        break;
+      case SIGNAL_EXTREME:
+        left = (i / 7) % 2 ? 32767.0 : -32768.0;
+        right = -1.0 - left;
+        break;
+      default:
+        break;
+    }
+    left = std::max(-32768.0, std::min(left, 32767.0));
+    right = std::max(-32768.0, std::min(right, 32767.0));
+    pcm[i * channels] = static_cast<int16_t>(lrint(left));
+    if (channels > 1) {
+      pcm[i * channels + 1] = static_cast<int16_t>(lrint(right));
+    }
+  }
+  return pcm;
+}
+
+static std::vector<uint8_t> Encode(const std::vector<int16_t> &pcm,
+                                   uint16_t channels) {
+  uint32_t frames = static_cast<uint32_t>(pcm.size()) / channels;
+  uint32_t block = FlacEncoder::kMaxBlockFrames;
+  FlacEncoder encoder(channels);
+  size_t maxBytes = (frames / block + 1) * encoder.maxFrameBytes(block);
+  std::vector<uint8_t> file(FlacEncoder::kStreamHeaderBytes + maxBytes);
+  FlacStreamInfo info = {kRate, channels, static_cast<uint16_t>(block),
+                         0, 0, frames};
+  FlacEncoder::writeStreamHeader(info, file.data());
+  size_t size = FlacEncoder::kStreamHeaderBytes;
+  uint32_t number = 0;
+  for (uint32_t f = 0; f < frames; f += block) {
+    size += encoder.encodeFrame(pcm.data() + f * channels,
+                                std::min(block, frames - f), number++,
+                                file.data() + size);
+  }
+  file.resize(size);
+  return file;
+}
+
+/*
+ * Every signal decodes bit exact, the partial last block too; a flipped bit
+ * stops the decoding
+ */
+static void TestEncoderRoundTrip(uint16_t channels, int32_t signal) {
+  uint32_t frames = 2 * kRate + 1234;
+  std::vector<int16_t> pcm = MakeSignal(signal, frames, channels);
+  std::vector<uint8_t> file = Encode(pcm, channels);
+  DecodedFlac decoded;
+  CHECK(DecodeFlac(file, &decoded));
+  CHECK(decoded.complete_);
+  CHECK(decoded.sampleRate_ == static_cast<uint32_t>(kRate));
+  CHECK(decoded.channels_ == channels);
+  CHECK(decoded.totalFrames_ == frames);
+  CHECK(decoded.pcm_ == pcm);
+  // and the decoder is not so lenient that anything would pass
+  file[file.size() / 2] ^= 0x10;
+  CHECK(DecodeFlac(file, &decoded));
+  CHECK(!decoded.complete_);
+  printf("flac %u ch %-7s: %5.1f%% of PCM\n", channels, kSignalNames[signal],
+         100.0 * file.size() / (pcm.size() * sizeof(int16_t)));
+}
+
+static void BenchEncoder(int32_t signal) {
+  const uint32_t block = FlacEncoder::kMaxBlockFrames;
+  std::vector<int16_t> pcm = MakeSignal(signal, block, 2);
+  FlacEncoder encoder(2);
+  std::vector<uint8_t> out(encoder.maxFrameBytes(block));
+  size_t written = 0;
+  double ns = NsPerCall([&] {
+    written = encoder.encodeFrame(pcm.data(), block, 0, out.data());
+  });
+  // bytes per ns * 1000 is MB/s
+  double inBytes = static_cast<double>(pcm.size() * sizeof(int16_t));
+  printf("flac encode %-7s: %7.1f MB/s of PCM in, %7.1f MB/s out, ratio "
+         "%.3f (%.0fx real time)\n", kSignalNames[signal],
+         1000.0 * inBytes / ns, 1000.0 * written / ns, written / inBytes,
+         block * 1e9 / kRate / ns);
+}
+
+/*
+ * A whole session: both streams decode bit exact once stopped. A copy of a
+ * file taken while recording, and the final file cut at an arbitrary byte,
+ * both decode to a prefix of what was written, as after a crash.
+ */
+static void TestSessionRecorder(void) {
+  char dir[] = "/tmp/flac_testXXXXXX";
+  CHECK(mkdtemp(dir) != nullptr);
+  std::string prefix = std::string(dir) + "/session";
+  const uint32_t frames = 3 * kRate;
+  const uint32_t bufFrames = 192;
+  std::vector<int16_t> input = MakeSignal(SIGNAL_SPEECH, frames, 2);
+  std::vector<int16_t> output = MakeSignal(SIGNAL_CHORD, frames, 2);
+
+  SessionRecorder recorder(kRate * 1000, 2);
+  CHECK(recorder.start(prefix.c_str(), (1u << SESSION_STREAM_INPUT) |
+                                           (1u << SESSION_STREAM_OUTPUT)));
+  std::vector<uint8_t> snapshot;
+  for (uint32_t f = 0; f < frames; f += bufFrames) {
+    recorder.write(SESSION_STREAM_INPUT, input.data() + f * 2, bufFrames);
+    recorder.write(SESSION_STREAM_OUTPUT, output.data() + f * 2, bufFrames);
+    // four times real time, well within what the rings hold
+    std::this_thread::sleep_for(std::chrono::microseconds(1000));
+    if (f == frames / 2) {
+      snapshot = ReadFile(prefix + "_input.flac");
+    }
+  }
+  recorder.stop();
+  CHECK(recorder.getDropped() == 0);
+
+  const std::vector<int16_t> *expected[] = {&input, &output};
+  const char *names[] = {"_input.flac", "_output.flac"};
+  for (int32_t stream = 0; stream < SESSION_STREAM_COUNT; stream++) {
+    SessionStreamStats stats;
+    recorder.getStats(static_cast<SessionStream>(stream), &stats);
+    std::vector<uint8_t> file = ReadFile(prefix + names[stream]);
+    DecodedFlac decoded;
+    CHECK(DecodeFlac(file, &decoded));
+    CHECK(decoded.complete_);
+    CHECK(decoded.totalFrames_ == frames);
+    CHECK(decoded.pcm_ == *expected[stream]);
+    CHECK(stats.frames_ == frames);
+    CHECK(stats.bytes_ == file.size());
+  }
+
+  DecodedFlac decoded;
+  CHECK(DecodeFlac(snapshot, &decoded));
+  CHECK(decoded.totalFrames_ == 0);  // still unknown while recording
+  CHECK(!decoded.pcm_.empty());
+  CHECK(std::equal(decoded.pcm_.begin(), decoded.pcm_.end(), input.begin()));
+  printf("flac session snapshot: %zu of %u frames\n", decoded.pcm_.size() / 2,
+         frames / 2);
+
+  std::vector<uint8_t> cut = ReadFile(prefix + "_input.flac");
+  cut.resize(cut.size() * 2 / 3 + 17);
+  CHECK(DecodeFlac(cut, &decoded));
+  CHECK(!decoded.complete_);
+  CHECK(decoded.pcm_.size() >= 2 * SessionRecorder::kBlockFrames);
+  CHECK(std::equal(decoded.pcm_.begin(), decoded.pcm_.end(), input.begin()));
+  printf("flac file cut at %zu bytes: %zu frames recovered\n", cut.size(),
+         decoded.pcm_.size() / 2);
+
+  for (const char *name : names) {
+    unlink((prefix + name).c_str());
+  }
+  rmdir(dir);
+}
+
+int main() {
+  for (uint16_t channels = 1; channels <= 2; channels++) {
+    for (int32_t signal = 0; signal < SIGNAL_COUNT; signal++) {
+      TestEncoderRoundTrip(channels, signal);
+    }
+  }
+  BenchEncoder(SIGNAL_SPEECH);
+  BenchEncoder(SIGNAL_NOISE);
+  TestSessionRecorder();
+  return TestResult();
+}
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <jni.h>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+class HostClass : public _jclass {};
+
+class HostString : public _jstring {
+ public:
+  explicit HostString(const char *utf) : utf_(utf) {}
+  std::string utf_;
+};
+
+class HostDirectBuffer : public _jobject {
+ public:
+  HostDirectBuffer(void *address, jlong capacity)
+      : address_(address), capacity_(capacity) {}
+  void *address_;
+  jlong capacity_;
+};
+
+template <typename Base, typename T>
+class HostArray : public Base {
+ public:
+  explicit HostArray(jsize length) : data_(length) {}
+  std::vector<T> data_;
+};
+
+class HostObjectArray : public _jobjectArray {
+ public:
+  explicit HostObjectArray(jsize length) : data_(length, nullptr) {}
+  ~HostObjectArray() {
+    for (jobject obj : data_) {
+      Release(obj);
+    }
+  }
+  static void Release(jobject obj) {
+    if (obj && --obj->hostRefs_ == 0) {
+      delete obj;
+    }
+  }
+  std::vector<jobject> data_;
+};
+
+template <typename Array>
+jsize Length(jarray array) {
+  return static_cast<jsize>(static_cast<Array *>(array)->data_.size());
+}
+
+template <typename Array, typename T>
+void GetRegion(jarray array, jsize start, jsize len, T *buf) {
+  Array *host = static_cast<Array *>(array);
+  assert(start >= 0 && len >= 0 &&
+         start + len <= static_cast<jsize>(host->data_.size()));
+  memcpy(buf, host->data_.data() + start, len * sizeof(T));
+}
+
+template <typename Array, typename T>
+void SetRegion(jarray array, jsize start, jsize len, const T *buf) {
+  Array *host = static_cast<Array *>(array);
+  assert(start >= 0 && len >= 0 &&
+         start + len <= static_cast<jsize>(host->data_.size()));
+  memcpy(host->data_.data() + start, buf, len * sizeof(T));
+}
+
+typedef HostArray<_jintArray, jint> HostIntArray;
+typedef HostArray<_jlongArray, jlong> HostLongArray;
+typedef HostArray<_jfloatArray, jfloat> HostFloatArray;
+typedef HostArray<_jdoubleArray, jdouble> HostDoubleArray;
+
+}  // namespace
+
+jclass _JNIEnv::FindClass(const char *name) { return new HostClass(); }
+
+void _JNIEnv::DeleteLocalRef(jobject obj) { HostObjectArray::Release(obj); }
+
+jstring _JNIEnv::NewStringUTF(const char *utf) { return new HostString(utf); }
+
+const char *_JNIEnv::GetStringUTFChars(jstring str, jboolean *isCopy) {
+  if (isCopy) {
+    *isCopy = JNI_FALSE;
+  }
+  return static_cast<HostString *>(str)->utf_.c_str();
+}
+
+void _JNIEnv::ReleaseStringUTFChars(jstring str, const char *utf) {}
+
+jsize _JNIEnv::GetArrayLength(jarray array) {
+  if (HostObjectArray *objects = dynamic_cast<HostObjectArray *>(array)) {
+    return static_cast<jsize>(objects->data_.size());
+  }
+  if (dynamic_cast<HostIntArray *>(array)) return Length<HostIntArray>(array);
+  if (dynamic_cast<HostLongArray *>(array)) return Length<HostLongArray>(array);
+  if (dynamic_cast<HostFloatArray *>(array)) {
+    return Length<HostFloatArray>(array);
+  }
+  return Length<HostDoubleArray>(array);
+}
+
+jobjectArray _JNIEnv::NewObjectArray(jsize length, jclass elementClass,
+                                     jobject initialElement) {
+  HostObjectArray *array = new HostObjectArray(length);
+  for (jsize i = 0; i < length; i++) {
+    SetObjectArrayElement(array, i, initialElement);
+  }
+  return array;
+}
+
+jobject _JNIEnv::GetObjectArrayElement(jobjectArray array, jsize index) {
+  jobject obj = static_cast<HostObjectArray *>(array)->data_.at(index);
+  if (obj) {
+    obj->hostRefs_++;
+  }
+  return obj;
+}
+
+void _JNIEnv::SetObjectArrayElement(jobjectArray array, jsize index,
+                                    jobject value) {
+  jobject &slot = static_cast<HostObjectArray *>(array)->data_.at(index);
+  if (value) {
+    value->hostRefs_++;
+  }
+  HostObjectArray::Release(slot);
+  slot = value;
+}
+
+jintArray _JNIEnv::NewIntArray(jsize length) {
+  return new HostIntArray(length);
+}
+
+jlongArray _JNIEnv::NewLongArray(jsize length) {
+  return new HostLongArray(length);
+}
+
+jfloatArray _JNIEnv::NewFloatArray(jsize length) {
+  return new HostFloatArray(length);
+}
+
+jdoubleArray _JNIEnv::NewDoubleArray(jsize length) {
+  return new HostDoubleArray(length);
+}
+
+void _JNIEnv::GetIntArrayRegion(jintArray array, jsize start, jsize len,
+                                jint *buf) {
+  GetRegion<HostIntArray>(array, start, len, buf);
+}
+
+void _JNIEnv::GetLongArrayRegion(jlongArray array, jsize start, jsize len,
+                                 jlong *buf) {
+  GetRegion<HostLongArray>(array, start, len, buf);
+}
+
+void _JNIEnv::GetFloatArrayRegion(jfloatArray array, jsize start, jsize len,
+                                  jfloat *buf) {
+  GetRegion<HostFloatArray>(array, start, len, buf);
+}
+
+void _JNIEnv::GetDoubleArrayRegion(jdoubleArray array, jsize start, jsize len,
+                                   jdouble *buf) {
+  GetRegion<HostDoubleArray>(array, start, len, buf);
+}
+
+void _JNIEnv::SetIntArrayRegion(jintArray array, jsize start, jsize len,
+                                const jint *buf) {
+  SetRegion<HostIntArray>(array, start, len, buf);
+}
+
+void _JNIEnv::SetLongArrayRegion(jlongArray array, jsize start, jsize len,
+                                 const jlong *buf) {
+  SetRegion<HostLongArray>(array, start, len, buf);
+}
+
+void _JNIEnv::SetFloatArrayRegion(jfloatArray array, jsize start, jsize len,
+                                  const jfloat *buf) {
+  SetRegion<HostFloatArray>(array, start, len, buf);
+}
+
+void _JNIEnv::SetDoubleArrayRegion(jdoubleArray array, jsize start, jsize len,
+                                   const jdouble *buf) {
+  SetRegion<HostDoubleArray>(array, start, len, buf);
+}
+
+jobject _JNIEnv::NewDirectByteBuffer(void *address, jlong capacity) {
+  return new HostDirectBuffer(address, capacity);
+}
+
+void *_JNIEnv::GetDirectBufferAddress(jobject buf) {
+  return static_cast<HostDirectBuffer *>(buf)->address_;
+}
+
+jlong _JNIEnv::GetDirectBufferCapacity(jobject buf) {
+  return static_cast<HostDirectBuffer *>(buf)->capacity_;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <android/log.h>
+#include <cstdarg>
+#include <cstdio>
+
+static const char kPriorityLetters[] = "??VDIWEFS";
+
+extern "C" int __android_log_print(int prio, const char *tag, const char *fmt,
+                                   ...) {
+  if (prio < ANDROID_LOG_UNKNOWN || prio > ANDROID_LOG_SILENT) {
+    prio = ANDROID_LOG_UNKNOWN;
+  }
+  fprintf(stderr, "%c/%s: ", kPriorityLetters[prio], tag);
+  va_list args;
+  va_start(args, fmt);
+  int written = vfprintf(stderr, fmt, args);
+  va_end(args);
+  fputc('\n', stderr);
+  return written;
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "host_sles.h"
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+
+static const SLInterfaceID_ kIids[] = {{1}, {2}, {3}, {4}, {5}, {6}, {7}};
+const SLInterfaceID SL_IID_ENGINE = &kIids[0];
+const SLInterfaceID SL_IID_PLAY = &kIids[1];
+const SLInterfaceID SL_IID_RECORD = &kIids[2];
+const SLInterfaceID SL_IID_BUFFERQUEUE = &kIids[3];
+const SLInterfaceID SL_IID_VOLUME = &kIids[4];
+const SLInterfaceID SL_IID_ANDROIDSIMPLEBUFFERQUEUE = &kIids[5];
+const SLInterfaceID SL_IID_ANDROIDCONFIGURATION = &kIids[6];
+
+namespace {
+
+enum ObjectKind { KIND_ENGINE, KIND_MIX, KIND_PLAYER, KIND_RECORDER };
+
+// what an interface handle points to: the method table, then its object
+template <typename Methods>
+struct Itf {
+  const Methods *methods_;
+  HostObject *owner_;
+};
+
+struct QueuedBuffer {
+  void *data_;
+  SLuint32 size_;
+};
+
+}  // namespace
+
+struct HostObject {
+  ObjectKind kind_;
+  Itf<SLObjectItf_> object_;
+  Itf<SLEngineItf_> engine_;
+  Itf<SLPlayItf_> play_;
+  Itf<SLRecordItf_> record_;
+  Itf<SLAndroidSimpleBufferQueueItf_> queue_;
+  Itf<SLAndroidConfigurationItf_> config_;
+  SLuint32 state_;
+  std::deque<QueuedBuffer> buffers_;
+  slAndroidSimpleBufferQueueCallback callback_;
+  void *context_;
+  // an engine: the player and recorder it created last; those: their engine
+  HostObject *player_;
+  HostObject *recorder_;
+  HostObject *parent_;
+};
+
+namespace {
+
+// OpenSL ES allows a single engine object per process
+HostObject *engine = nullptr;
+
+template <typename Methods>
+HostObject *Owner(const Methods *const *self) {
+  return reinterpret_cast<const Itf<Methods> *>(self)->owner_;
+}
+
+SLresult Realize(SLObjectItf self, SLboolean async) {
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult GetInterface(SLObjectItf self, const SLInterfaceID iid,
+                      void *pInterface) {
+  HostObject *obj = Owner(self);
+  const void *itf = nullptr;
+  if (iid == SL_IID_ENGINE && obj->kind_ == KIND_ENGINE) {
+    itf = &obj->engine_;
+  } else if (iid == SL_IID_PLAY && obj->kind_ == KIND_PLAYER) {
+    itf = &obj->play_;
+  } else if (iid == SL_IID_RECORD && obj->kind_ == KIND_RECORDER) {
+    itf = &obj->record_;
+  } else if ((iid == SL_IID_BUFFERQUEUE && obj->kind_ == KIND_PLAYER) ||
+             (iid == SL_IID_ANDROIDSIMPLEBUFFERQUEUE &&
+              obj->kind_ == KIND_RECORDER)) {
+    itf = &obj->queue_;
+  } else if (iid == SL_IID_ANDROIDCONFIGURATION &&
+             obj->kind_ == KIND_RECORDER) {
+    itf = &obj->config_;
+  }
+  if (!itf) {
+    return SL_RESULT_FEATURE_UNSUPPORTED;
+  }
+  *static_cast<const void **>(pInterface) = itf;
+  return SL_RESULT_SUCCESS;
+}
+
+void Destroy(SLObjectItf self) {
+  HostObject *obj = Owner(self);
+  if (obj == engine) engine = nullptr;
+  if (obj->parent_ && obj->parent_->player_ == obj) {
+    obj->parent_->player_ = nullptr;
+  }
+  if (obj->parent_ && obj->parent_->recorder_ == obj) {
+    obj->parent_->recorder_ = nullptr;
+  }
+  delete obj;
+}
+
+HostObject *NewObject(ObjectKind kind);
+
+SLresult CreateAudioPlayer(SLEngineItf self, SLObjectItf *pPlayer,
+                           SLDataSource *pAudioSrc, SLDataSink *pAudioSnk,
+                           SLuint32 numInterfaces,
+                           const SLInterfaceID *pInterfaceIds,
+                           const SLboolean *pInterfaceRequired) {
+  HostObject *player = NewObject(KIND_PLAYER);
+  player->state_ = SL_PLAYSTATE_STOPPED;
+  player->parent_ = Owner(self);
+  player->parent_->player_ = player;
+  *pPlayer = &player->object_.methods_;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult CreateAudioRecorder(SLEngineItf self, SLObjectItf *pRecorder,
+                             SLDataSource *pAudioSrc, SLDataSink *pAudioSnk,
+                             SLuint32 numInterfaces,
+                             const SLInterfaceID *pInterfaceIds,
+                             const SLboolean *pInterfaceRequired) {
+  HostObject *recorder = NewObject(KIND_RECORDER);
+  recorder->state_ = SL_RECORDSTATE_STOPPED;
+  recorder->parent_ = Owner(self);
+  recorder->parent_->recorder_ = recorder;
+  *pRecorder = &recorder->object_.methods_;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult CreateOutputMix(SLEngineItf self, SLObjectItf *pMix,
+                         SLuint32 numInterfaces,
+                         const SLInterfaceID *pInterfaceIds,
+                         const SLboolean *pInterfaceRequired) {
+  *pMix = &NewObject(KIND_MIX)->object_.methods_;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult SetPlayState(SLPlayItf self, SLuint32 state) {
+  Owner(self)->state_ = state;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult GetPlayState(SLPlayItf self, SLuint32 *pState) {
+  *pState = Owner(self)->state_;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult SetRecordState(SLRecordItf self, SLuint32 state) {
+  Owner(self)->state_ = state;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult GetRecordState(SLRecordItf self, SLuint32 *pState) {
+  *pState = Owner(self)->state_;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult Enqueue(SLAndroidSimpleBufferQueueItf self, const void *pBuffer,
+                 SLuint32 size) {
+  QueuedBuffer buf = {const_cast<void *>(pBuffer), size};
+  Owner(self)->buffers_.push_back(buf);
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult Clear(SLAndroidSimpleBufferQueueItf self) {
+  Owner(self)->buffers_.clear();
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult GetState(SLAndroidSimpleBufferQueueItf self,
+                  SLAndroidSimpleBufferQueueState *pState) {
+  pState->count = static_cast<SLuint32>(Owner(self)->buffers_.size());
+  pState->index = 0;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult RegisterCallback(SLAndroidSimpleBufferQueueItf self,
+                          slAndroidSimpleBufferQueueCallback callback,
+                          void *pContext) {
+  Owner(self)->callback_ = callback;
+  Owner(self)->context_ = pContext;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult SetConfiguration(SLAndroidConfigurationItf self,
+                          const SLchar *configKey, const void *pConfigValue,
+                          SLuint32 valueSize) {
+  return SL_RESULT_SUCCESS;
+}
+
+const SLObjectItf_ kObjectMethods = {Realize, GetInterface, Destroy};
+const SLEngineItf_ kEngineMethods = {CreateAudioPlayer, CreateAudioRecorder,
+                                     CreateOutputMix};
+const SLPlayItf_ kPlayMethods = {SetPlayState, GetPlayState};
+const SLRecordItf_ kRecordMethods = {SetRecordState, GetRecordState};
+const SLAndroidSimpleBufferQueueItf_ kQueueMethods = {Enqueue, Clear, GetState,
+                                                      RegisterCallback};
+const SLAndroidConfigurationItf_ kConfigMethods = {SetConfiguration};
+
+HostObject *NewObject(ObjectKind kind) {
+  HostObject *obj = new HostObject();
+  obj->kind_ = kind;
+  obj->object_ = {&kObjectMethods, obj};
+  obj->engine_ = {&kEngineMethods, obj};
+  obj->play_ = {&kPlayMethods, obj};
+  obj->record_ = {&kRecordMethods, obj};
+  obj->queue_ = {&kQueueMethods, obj};
+  obj->config_ = {&kConfigMethods, obj};
+  obj->callback_ = nullptr;
+  obj->context_ = nullptr;
+  obj->player_ = nullptr;
+  obj->recorder_ = nullptr;
+  obj->parent_ = nullptr;
+  return obj;
+}
+
+// the callback may enqueue again: the buffer leaves the queue first
+bool Complete(HostObject *obj, SLuint32 activeState, QueuedBuffer *buf) {
+  if (!obj || obj->state_ != activeState || obj->buffers_.empty()) {
+    return false;
+  }
+  *buf = obj->buffers_.front();
+  obj->buffers_.pop_front();
+  return true;
+}
+
+void RunCallback(HostObject *obj) {
+  if (obj->callback_) {
+    obj->callback_(reinterpret_cast<SLAndroidSimpleBufferQueueItf>(
+                       &obj->queue_.methods_),
+                   obj->context_);
+  }
+}
+
+}  // namespace
+
+SLresult slCreateEngine(SLObjectItf *pEngine, SLuint32 numOptions,
+                        const SLEngineOption *pEngineOptions,
+                        SLuint32 numInterfaces,
+                        const SLInterfaceID *pInterfaceIds,
+                        const SLboolean *pInterfaceRequired) {
+  engine = NewObject(KIND_ENGINE);
+  *pEngine = &engine->object_.methods_;
+  return SL_RESULT_SUCCESS;
+}
+
+HostObject *HostLastPlayer(void) { return engine ? engine->player_ : nullptr; }
+
+HostObject *HostLastRecorder(void) {
+  return engine ? engine->recorder_ : nullptr;
+}
+
+bool HostRecorderCapture(HostObject *recorder, const void *data,
+                         uint32_t bytes) {
+  QueuedBuffer buf;
+  if (!Complete(recorder, SL_RECORDSTATE_RECORDING, &buf)) {
+    return false;
+  }
+  uint32_t copied = std::min(bytes, buf.size_);
+  memcpy(buf.data_, data, copied);
+  memset(static_cast<uint8_t *>(buf.data_) + copied, 0, buf.size_ - copied);
+  RunCallback(recorder);
+  return true;
+}
+
+bool HostPlayerConsume(HostObject *player, void *out, uint32_t capBytes,
+                       uint32_t *bytes) {
+  QueuedBuffer buf;
+  if (!Complete(player, SL_PLAYSTATE_PLAYING, &buf)) {
+    return false;
+  }
+  uint32_t copied = std::min(capBytes, buf.size_);
+  if (out) {
+    memcpy(out, buf.data_, copied);
+  }
+  if (bytes) {
+    *bytes = copied;
+  }
+  RunCallback(player);
+  return true;
+}
+
+uint32_t HostRecorderQueued(const HostObject *recorder) {
+  return recorder ? static_cast<uint32_t>(recorder->buffers_.size()) : 0;
+}
+
+uint32_t HostPlayerQueued(const HostObject *player) {
+  return player ? static_cast<uint32_t>(player->buffers_.size()) : 0;
+}
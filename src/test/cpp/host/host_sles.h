@@ -0,0 +1,49 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_HOST_SLES_H
+#define NATIVE_AUDIO_HOST_SLES_H
+#include <cstdint>
+
+/*
+ * The scripted device behind the host OpenSL ES: buffers the engine
+ * enqueues wait until a test completes them, on the test's thread. Each
+ * player and recorder keeps its own queue and callback, so the engine
+ * instances sharing the one OpenSL engine can be driven side by side.
+ */
+struct HostObject;
+
+// the player and recorder the OpenSL engine created last: take an
+// instance's right after creating them, before the next instance does
+HostObject *HostLastPlayer(void);
+HostObject *HostLastRecorder(void);
+
+// fill the oldest buffer the recorder queued with bytes of data (the rest
+// of it zeroed) and run the recorder callback; false unless recording with
+// a buffer queued
+bool HostRecorderCapture(HostObject *recorder, const void *data,
+                         uint32_t bytes);
+
+// take the oldest buffer queued on the player, copying up to capBytes of it
+// to out (may be null), and run the player callback; false unless playing
+// with a buffer queued
+bool HostPlayerConsume(HostObject *player, void *out, uint32_t capBytes,
+                       uint32_t *bytes);
+
+// buffers waiting in the recorder and player queues
+uint32_t HostRecorderQueued(const HostObject *recorder);
+uint32_t HostPlayerQueued(const HostObject *player);
+
+#endif  // NATIVE_AUDIO_HOST_SLES_H
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_HOST_JNI_H
+#define NATIVE_AUDIO_HOST_JNI_H
+#include <cstdint>
+
+/*
+ * Host stand-in for the parts of JNI the native code uses, so the JNI entry
+ * points can be called from host tests. Local references are counted: an
+ * object lives until DeleteLocalRef() and every array slot holding it are
+ * gone. Tests pass any value as the jclass argument.
+ */
+typedef uint8_t jboolean;
+typedef int8_t jbyte;
+typedef uint16_t jchar;
+typedef int16_t jshort;
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef float jfloat;
+typedef double jdouble;
+typedef jint jsize;
+
+class _jobject {
+ public:
+  virtual ~_jobject() {}
+  int hostRefs_ = 1;
+};
+class _jclass : public _jobject {};
+class _jstring : public _jobject {};
+class _jarray : public _jobject {};
+class _jobjectArray : public _jarray {};
+class _jintArray : public _jarray {};
+class _jlongArray : public _jarray {};
+class _jfloatArray : public _jarray {};
+class _jdoubleArray : public _jarray {};
+
+typedef _jobject *jobject;
+typedef _jclass *jclass;
+typedef _jstring *jstring;
+typedef _jarray *jarray;
+typedef _jobjectArray *jobjectArray;
+typedef _jintArray *jintArray;
+typedef _jlongArray *jlongArray;
+typedef _jfloatArray *jfloatArray;
+typedef _jdoubleArray *jdoubleArray;
+
+#define JNI_FALSE 0
+#define JNI_TRUE 1
+#define JNIEXPORT __attribute__((visibility("default")))
+#define JNICALL
+
+struct _JNIEnv {
+  jclass FindClass(const char *name);
+  void DeleteLocalRef(jobject obj);
+
+  jstring NewStringUTF(const char *utf);
+  const char *GetStringUTFChars(jstring str, jboolean *isCopy);
+  void ReleaseStringUTFChars(jstring str, const char *utf);
+
+  jsize GetArrayLength(jarray array);
+  jobjectArray NewObjectArray(jsize length, jclass elementClass,
+                              jobject initialElement);
+  jobject GetObjectArrayElement(jobjectArray array, jsize index);
+  void SetObjectArrayElement(jobjectArray array, jsize index, jobject value);
+  jintArray NewIntArray(jsize length);
+  jlongArray NewLongArray(jsize length);
+  jfloatArray NewFloatArray(jsize length);
+  jdoubleArray NewDoubleArray(jsize length);
+  void GetIntArrayRegion(jintArray array, jsize start, jsize len, jint *buf);
+  void GetLongArrayRegion(jlongArray array, jsize start, jsize len,
+                          jlong *buf);
+  void GetFloatArrayRegion(jfloatArray array, jsize start, jsize len,
+                           jfloat *buf);
+  void GetDoubleArrayRegion(jdoubleArray array, jsize start, jsize len,
+                            jdouble *buf);
+  void SetIntArrayRegion(jintArray array, jsize start, jsize len,
+                         const jint *buf);
+  void SetLongArrayRegion(jlongArray array, jsize start, jsize len,
+                          const jlong *buf);
+  void SetFloatArrayRegion(jfloatArray array, jsize start, jsize len,
+                           const jfloat *buf);
+  void SetDoubleArrayRegion(jdoubleArray array, jsize start, jsize len,
+                            const jdouble *buf);
+
+  jobject NewDirectByteBuffer(void *address, jlong capacity);
+  void *GetDirectBufferAddress(jobject buf);
+  jlong GetDirectBufferCapacity(jobject buf);
+};
+typedef _JNIEnv JNIEnv;
+
+#endif  // NATIVE_AUDIO_HOST_JNI_H
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+#include "latency_meter.h"
+#include "test_util.h"
+
+/*
+ * LatencyMeter on a simulated loopback: what it plays comes back into the
+ * capture a known number of frames later, attenuated and with noise added.
+ */
+static const int32_t kRate = 48000;
+static const int32_t kChannels = 2;
+static const uint32_t kFramesPerBuf = 192;
+
+static bool Measure(int32_t delayFrames, int64_t dropBuffer,
+                    LatencyResult *result) {
+  LatencyMeter meter(kRate, kChannels);
+  CHECK(meter.start(4));
+  std::deque<int16_t> loopback(delayFrames * kChannels, 0);
+  std::vector<int16_t> buf(kFramesPerBuf * kChannels);
+  uint32_t seed = 7;
+  for (int64_t n = 0; n < 2000 && !meter.isDone(); n++) {
+    for (int16_t &sample : buf) {
+      seed = seed * 1664525 + 1013904223;
+      int32_t noise = static_cast<int32_t>(seed >> 24) - 128;
+      sample = static_cast<int16_t>(loopback.front() * 3 / 10 + noise);
+      loopback.pop_front();
+    }
+    if (n == dropBuffer) {
+      // lost on the way: the meter never sees it and the output is silent
+      std::fill(buf.begin(), buf.end(), 0);
+    } else {
+      meter.process(buf.data(), kFramesPerBuf, n * kFramesPerBuf);
+    }
+    loopback.insert(loopback.end(), buf.begin(), buf.end());
+  }
+  CHECK(meter.isDone());
+  return meter.getResult(result);
+}
+
+static void TestDelay(int32_t delayFrames, int64_t dropBuffer) {
+  LatencyResult result;
+  CHECK(Measure(delayFrames, dropBuffer, &result));
+  double expectedMs = 1000.0 * delayFrames / kRate;
+  CHECK(result.bursts_ == 4);
+  CHECK(result.valid_ >= (dropBuffer >= 0 ? 3 : 4));
+  CHECK(fabs(result.meanMs_ - expectedMs) < 0.05);
+  CHECK(result.maxMs_ - result.minMs_ < 0.05);
+  printf("delay %d frames: expected %.3f ms, measured %.3f ms (%d/%d)\n",
+         delayFrames, expectedMs, result.meanMs_, result.valid_,
+         result.bursts_);
+}
+
+int main() {
+  TestDelay(kFramesPerBuf, -1);
+  TestDelay(2500, -1);
+  TestDelay(9600, -1);
+  TestDelay(4321, 40);
+  return TestResult();
+}
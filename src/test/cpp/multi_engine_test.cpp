@@ -0,0 +1,140 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "audio_common.h"
+#include "host_sles.h"
+#include "jni_interface.h"
+#include "test_util.h"
+
+/*
+ * Two engine instances at once: each runs its own delay and pitch on its
+ * own thread, sharing only the OpenSL engine, and must play out exactly
+ * what the same settings play with the instance running alone.
+ */
+static const jint kRate = 48000;
+static const jint kFramesPerBuf = 192;
+static const uint32_t kBuffers = 500;
+static const uint32_t kBufSamples = kFramesPerBuf * AUDIO_SAMPLE_CHANNELS;
+static const uint32_t kBufBytes = kBufSamples * sizeof(int16_t);
+
+struct Settings {
+  jlong delayLMs_;
+  jlong delayRMs_;
+  jfloat semitones_;
+};
+
+struct Instance {
+  jlong engine_;
+  HostObject *recorder_;
+  HostObject *player_;
+};
+
+static std::vector<int16_t> MakeInput(void) {
+  std::vector<int16_t> pcm(kBuffers * kBufSamples);
+  for (uint32_t i = 0; i < pcm.size() / AUDIO_SAMPLE_CHANNELS; i++) {
+    float t = static_cast<float>(i) / kRate;
+    pcm[2 * i] = static_cast<int16_t>(8000 * sinf(2 * M_PI * 440 * t));
+    pcm[2 * i + 1] = static_cast<int16_t>(6000 * sinf(2 * M_PI * 1250 * t));
+  }
+  return pcm;
+}
+
+static Instance Open(JNIEnv *env, const Settings &settings) {
+  Instance inst;
+  inst.engine_ = Java_com_google_sample_echo_MainActivity_createSLEngine(
+      env, nullptr, kRate, kFramesPerBuf, settings.delayLMs_,
+      settings.delayRMs_);
+  CHECK(Java_com_google_sample_echo_MainActivity_configurePitchShift(
+      env, nullptr, inst.engine_, settings.semitones_, 20.0f, 1.0f));
+  // its corrections follow the wall clock, which differs run to run
+  Java_com_google_sample_echo_MainActivity_enableDriftCompensation(
+      env, nullptr, inst.engine_, JNI_FALSE);
+  CHECK(Java_com_google_sample_echo_MainActivity_createSLBufferQueueAudioPlayer(
+      env, nullptr, inst.engine_));
+  CHECK(Java_com_google_sample_echo_MainActivity_createAudioRecorder(
+      env, nullptr, inst.engine_));
+  inst.recorder_ = HostLastRecorder();
+  inst.player_ = HostLastPlayer();
+  Java_com_google_sample_echo_MainActivity_startPlay(env, nullptr,
+                                                     inst.engine_);
+  return inst;
+}
+
+static void Close(JNIEnv *env, const Instance &inst) {
+  Java_com_google_sample_echo_MainActivity_stopPlay(env, nullptr,
+                                                    inst.engine_);
+  Java_com_google_sample_echo_MainActivity_deleteSLEngine(env, nullptr,
+                                                          inst.engine_);
+}
+
+// capture the input buffer by buffer, playing out what each one queues
+static std::vector<int16_t> Drive(const Instance &inst,
+                                  const std::vector<int16_t> &input) {
+  std::vector<int16_t> played;
+  std::vector<int16_t> buf(kBufSamples);
+  for (uint32_t i = 0; i < kBuffers; i++) {
+    CHECK(HostRecorderCapture(inst.recorder_, &input[i * kBufSamples],
+                              kBufBytes));
+    for (uint32_t queued = HostPlayerQueued(inst.player_); queued; queued--) {
+      uint32_t bytes = 0;
+      CHECK(HostPlayerConsume(inst.player_, buf.data(), kBufBytes, &bytes));
+      played.insert(played.end(), buf.begin(),
+                    buf.begin() + bytes / sizeof(int16_t));
+    }
+  }
+  return played;
+}
+
+static bool Audible(const std::vector<int16_t> &pcm) {
+  for (int16_t v : pcm) {
+    if (v > 1000 || v < -1000) return true;
+  }
+  return false;
+}
+
+int main() {
+  JNIEnv env;
+  std::vector<int16_t> input = MakeInput();
+  const Settings kSettings[2] = {{120, 200, 3.0f}, {40, 70, -5.0f}};
+
+  std::vector<int16_t> alone[2];
+  for (int32_t i = 0; i < 2; i++) {
+    Instance inst = Open(&env, kSettings[i]);
+    alone[i] = Drive(inst, input);
+    Close(&env, inst);
+  }
+
+  Instance insts[2] = {Open(&env, kSettings[0]), Open(&env, kSettings[1])};
+  CHECK(insts[0].recorder_ != insts[1].recorder_);
+  CHECK(insts[0].player_ != insts[1].player_);
+  std::vector<int16_t> together[2];
+  std::thread second([&] { together[1] = Drive(insts[1], input); });
+  together[0] = Drive(insts[0], input);
+  second.join();
+  Close(&env, insts[0]);
+  Close(&env, insts[1]);
+
+  printf("multi engine: %zu and %zu samples played\n", together[0].size(),
+         together[1].size());
+  for (int32_t i = 0; i < 2; i++) {
+    CHECK(Audible(alone[i]));
+    CHECK(together[i] == alone[i]);
+  }
+  CHECK(alone[0] != alone[1]);
+  return TestResult();
+}
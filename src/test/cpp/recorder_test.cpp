@@ -0,0 +1,94 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <vector>
+#include "audio_common.h"
+#include "host_sles.h"
+#include "jni_interface.h"
+#include "test_util.h"
+
+/*
+ * Stream positions across pause and resume: the recorder of a session
+ * numbers its buffers and frames on from where the pause left them, and
+ * only a new session starts again at 0.
+ */
+static const jint kFramesPerBuf = 192;
+static const uint32_t kBufBytes =
+    kFramesPerBuf * AUDIO_SAMPLE_CHANNELS * sizeof(int16_t);
+
+// capture count buffers, letting the player take each one
+static void Capture(uint32_t count) {
+  std::vector<int16_t> pcm(kBufBytes / sizeof(int16_t), 1000);
+  HostObject *recorder = HostLastRecorder();
+  HostObject *player = HostLastPlayer();
+  for (uint32_t i = 0; i < count; i++) {
+    CHECK(HostRecorderCapture(recorder, pcm.data(), kBufBytes));
+    // the player refills its queue with silence: only play what is there
+    for (uint32_t queued = HostPlayerQueued(player); queued; queued--) {
+      uint32_t bytes;
+      CHECK(HostPlayerConsume(player, nullptr, 0, &bytes));
+    }
+  }
+}
+
+static jlong Position(JNIEnv *env, jlong engine) {
+  return Java_com_google_sample_echo_MainActivity_getControlFramePosition(
+      env, nullptr, engine);
+}
+
+static jlong Gaps(JNIEnv *env, jlong engine) {
+  jlongArray stats =
+      Java_com_google_sample_echo_MainActivity_getPlayerStreamStats(
+          env, nullptr, engine);
+  jlong values[2] = {0, 0};
+  env->GetLongArrayRegion(stats, 0, 2, values);
+  env->DeleteLocalRef(stats);
+  return values[1];
+}
+
+static void StartSession(JNIEnv *env, jlong engine) {
+  CHECK(Java_com_google_sample_echo_MainActivity_createSLBufferQueueAudioPlayer(
+      env, nullptr, engine));
+  CHECK(Java_com_google_sample_echo_MainActivity_createAudioRecorder(
+      env, nullptr, engine));
+  Java_com_google_sample_echo_MainActivity_startPlay(env, nullptr, engine);
+}
+
+int main() {
+  JNIEnv env;
+  jlong engine = Java_com_google_sample_echo_MainActivity_createSLEngine(
+      &env, nullptr, 48000, kFramesPerBuf, 120, 200);
+
+  StartSession(&env, engine);
+  Capture(10);
+  CHECK(Position(&env, engine) == 10 * kFramesPerBuf);
+
+  Java_com_google_sample_echo_MainActivity_pausePlay(&env, nullptr, engine);
+  CHECK(Java_com_google_sample_echo_MainActivity_resumePlay(&env, nullptr,
+                                                            engine));
+  Capture(5);
+  CHECK(Position(&env, engine) == 15 * kFramesPerBuf);
+  CHECK(Gaps(&env, engine) == 0);
+
+  Java_com_google_sample_echo_MainActivity_stopPlay(&env, nullptr, engine);
+  StartSession(&env, engine);
+  Capture(3);
+  CHECK(Position(&env, engine) == 3 * kFramesPerBuf);
+  Java_com_google_sample_echo_MainActivity_stopPlay(&env, nullptr, engine);
+
+  Java_com_google_sample_echo_MainActivity_deleteSLEngine(&env, nullptr,
+                                                          engine);
+  return TestResult();
+}
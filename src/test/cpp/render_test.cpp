@@ -0,0 +1,162 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unistd.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "audio_common.h"
+#include "buf_manager.h"
+#include "control_queue.h"
+#include "jni_interface.h"
+#include "test_util.h"
+#include "wav_header.h"
+
+bool EngineService(void *ctx, uint32_t msg, void *data);
+
+/*
+ * renderFile() against the live chain: the same input, fed block by block
+ * to EngineService of the live engine, must come out bit for bit as the
+ * offline render does once both start from the same settings.
+ */
+static const jint kRate = 48000;
+static const jint kFramesPerBuf = 192;
+static const uint32_t kBlocks = 250;
+
+static std::vector<int16_t> MakeInput(void) {
+  std::vector<int16_t> pcm(kBlocks * kFramesPerBuf * AUDIO_SAMPLE_CHANNELS);
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < pcm.size() / AUDIO_SAMPLE_CHANNELS; i++) {
+    uint32_t block = i / kFramesPerBuf;
+    if (block >= 100 && block < 150) {
+      continue;  // long enough for the silence bypass
+    }
+    seed = seed * 1664525 + 1013904223;
+    float noise = static_cast<int32_t>(seed >> 16) - 32768.0f;
+    float t = static_cast<float>(i) / kRate;
+    pcm[2 * i] = static_cast<int16_t>(
+        300 + 9000 * sinf(2 * M_PI * 440 * t) + 0.02f * noise);
+    pcm[2 * i + 1] = static_cast<int16_t>(
+        -200 + 6000 * sinf(2 * M_PI * 1250 * t) + 0.02f * noise);
+  }
+  return pcm;
+}
+
+static bool WriteWav(const std::string &path, const std::vector<int16_t> &pcm) {
+  WavInfo info = {kWavFormatPcm, AUDIO_SAMPLE_CHANNELS,
+                  static_cast<uint32_t>(kRate), 16, nullptr,
+                  static_cast<uint32_t>(pcm.size() * sizeof(int16_t))};
+  uint8_t header[kWavHeaderSize];
+  WriteWavHeader(header, info);
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file) return false;
+  bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+            fwrite(pcm.data(), info.dataSize_, 1, file) == 1;
+  return fclose(file) == 0 && ok;
+}
+
+static std::vector<int16_t> ReadWavData(const std::string &path) {
+  std::vector<int16_t> pcm;
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) return pcm;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file) - kWavHeaderSize;
+  fseek(file, kWavHeaderSize, SEEK_SET);
+  if (size > 0) {
+    pcm.resize(size / sizeof(int16_t));
+    if (fread(pcm.data(), size, 1, file) != 1) pcm.clear();
+  }
+  fclose(file);
+  return pcm;
+}
+
+static std::vector<int16_t> Render(JNIEnv *env, jlong engine,
+                                   const std::string &in,
+                                   const std::string &out) {
+  jstring inPath = env->NewStringUTF(in.c_str());
+  jstring outPath = env->NewStringUTF(out.c_str());
+  CHECK(Java_com_google_sample_echo_MainActivity_renderFile(
+            env, nullptr, engine, inPath, outPath) == JNI_TRUE);
+  env->DeleteLocalRef(inPath);
+  env->DeleteLocalRef(outPath);
+  std::vector<int16_t> pcm = ReadWavData(out);
+  unlink(out.c_str());
+  return pcm;
+}
+
+static void Configure(JNIEnv *env, jlong engine) {
+  CHECK(Java_com_google_sample_echo_MainActivity_configurePitchShift(
+      env, nullptr, engine, 3.0f, 20.0f, 0.6f));
+  CHECK(Java_com_google_sample_echo_MainActivity_configureEqSection(
+      env, nullptr, engine, 0, EQ_TYPE_PEAK, 1000.0f, 1.0f, 6.0f, 0));
+  CHECK(Java_com_google_sample_echo_MainActivity_configureDynamics(
+      env, nullptr, engine, DYNAMICS_PLACEMENT_OUTPUT, -20.0f, 4.0f, 6.0f,
+      5.0f, 50.0f, 3.0f, -1.0f, 50.0f));
+  CHECK(Java_com_google_sample_echo_MainActivity_configureInputConditioner(
+      env, nullptr, engine, JNI_TRUE, JNI_TRUE, -50.0f, 1.0f, 10.0f, 50.0f));
+  CHECK(Java_com_google_sample_echo_MainActivity_configureSilenceBypass(
+      env, nullptr, engine, JNI_TRUE, -60.0f, 20.0f));
+  Java_com_google_sample_echo_MainActivity_enableDriftCompensation(
+      env, nullptr, engine, JNI_FALSE);
+}
+
+int main() {
+  JNIEnv env;
+  const char *tmp = getenv("TMPDIR");
+  std::string dir = tmp ? tmp : "/tmp";
+  std::string in = dir + "/render_test_in.wav";
+  std::string out = dir + "/render_test_out.wav";
+
+  std::vector<int16_t> input = MakeInput();
+  CHECK(WriteWav(in, input));
+
+  jlong engine = Java_com_google_sample_echo_MainActivity_createSLEngine(
+      &env, nullptr, kRate, kFramesPerBuf, 120, 200);
+  std::vector<int16_t> plain = Render(&env, engine, in, out);
+  Configure(&env, engine);
+  std::vector<int16_t> rendered = Render(&env, engine, in, out);
+
+  // the live engine has applied nothing yet: its queue still holds the
+  // settings for the first buffer
+  uint32_t blockBytes = kFramesPerBuf * AUDIO_SAMPLE_CHANNELS * sizeof(int16_t);
+  std::vector<uint8_t> storage(2 * blockBytes);
+  std::vector<int16_t> live(input.size());
+  sample_buf buf;
+  memset(&buf, 0, sizeof(buf));
+  buf.buf_ = storage.data();
+  buf.cap_ = static_cast<uint32_t>(storage.size());
+  for (uint32_t block = 0; block < kBlocks; block++) {
+    const int16_t *src = input.data() + block * blockBytes / sizeof(int16_t);
+    memcpy(buf.buf_, src, blockBytes);
+    buf.size_ = blockBytes;
+    buf.seq_ = block;
+    buf.framePos_ = static_cast<uint64_t>(block) * kFramesPerBuf;
+    EngineService(reinterpret_cast<void *>(engine),
+                  ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE, &buf);
+    CHECK(buf.size_ == blockBytes);
+    memcpy(live.data() + block * blockBytes / sizeof(int16_t), buf.buf_,
+           blockBytes);
+  }
+
+  CHECK(rendered.size() == input.size());
+  CHECK(rendered == live);
+  CHECK(plain.size() == input.size());
+  CHECK(plain != live);
+
+  Java_com_google_sample_echo_MainActivity_deleteSLEngine(&env, nullptr,
+                                                          engine);
+  unlink(in.c_str());
+  return TestResult();
+}
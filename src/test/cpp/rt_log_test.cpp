@@ -0,0 +1,81 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "rt_log.h"
+#include "test_util.h"
+
+/*
+ * Ring slots of the real-time logger: a thread's slot is free again once
+ * the thread is gone, and a thread without one gets one as soon as a slot
+ * is given back.
+ */
+static void LogFromThread(void) {
+  std::thread([] { RTLOG("short lived thread %d", 1); }).join();
+}
+
+int main() {
+  RtLogger *logger = RtLogger::instance();
+  CHECK(logger->start());
+
+  // many more threads than slots, one after the other
+  for (uint32_t i = 0; i < 4 * kRtLogMaxThreads; i++) {
+    LogFromThread();
+  }
+  CHECK(logger->getDropped() == 0);
+
+  // every slot held: the thread left out drops until one is given back
+  std::mutex lock;
+  std::condition_variable changed;
+  uint32_t holding = 0;
+  bool release = false;
+  std::vector<std::thread> holders;
+  for (uint32_t i = 0; i < kRtLogMaxThreads; i++) {
+    holders.emplace_back([&] {
+      RTLOG("holder");
+      std::unique_lock<std::mutex> guard(lock);
+      holding++;
+      changed.notify_all();
+      changed.wait(guard, [&] { return release; });
+    });
+  }
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&] { return holding == kRtLogMaxThreads; });
+  }
+  uint64_t dropped = logger->getDropped();
+  std::thread late([&] {
+    RTLOG("late %d", 1);
+    RTLOG("late %d", 2);
+    CHECK(logger->getDropped() == dropped + 2);
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      release = true;
+      changed.notify_all();
+    }
+    for (std::thread &holder : holders) {
+      holder.join();
+    }
+    RTLOG("late %d", 3);
+    CHECK(logger->getDropped() == dropped + 2);
+  });
+  late.join();
+
+  logger->stop();
+  return TestResult();
+}
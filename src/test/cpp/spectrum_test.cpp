@@ -0,0 +1,101 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "spectrum_analyzer.h"
+#include "test_util.h"
+
+/*
+ * SpectrumAnalyzer::read() against the analyzer thread: a sine on a bin
+ * center is fed in real time while another thread polls; every frame it
+ * gets is whole, with the sine's level in both the levels and the bin.
+ */
+static const int32_t kRate = 48000;
+static const uint16_t kChannels = 2;
+static const uint32_t kFftSize = 1024;
+static const uint32_t kSineBin = 32;  // 1500 Hz
+static const float kAmplitude = 0.5f;
+static const int32_t kFramesPerBuf = 480;
+
+int main() {
+  SpectrumAnalyzer analyzer(kRate * 1000, kChannels);
+  const uint32_t kBins = kFftSize / 2 + 1;
+  std::vector<float> bins(kBins);
+  float peakDb[2], rmsDb[2];
+  uint32_t count = 0;
+  CHECK(analyzer.read(peakDb, rmsDb, bins.data(), kBins, &count) < 0);
+  CHECK(analyzer.start(kFftSize, SpectrumAnalyzer::kMaxFramesPerSecond));
+
+  std::atomic<bool> done(false);
+  int32_t frames = 0, torn = 0;
+  std::thread reader([&] {
+    std::vector<float> magnitudesDb(kBins);
+    int32_t last = 0;
+    while (!done.load()) {
+      float peak[2], rms[2];
+      uint32_t n = 0;
+      int32_t sequence = analyzer.read(peak, rms, magnitudesDb.data(), kBins,
+                                       &n);
+      if (sequence <= last) {
+        continue;
+      }
+      last = sequence;
+      // skip the frames the sine had not filled yet
+      if (sequence < 20) {
+        continue;
+      }
+      frames++;
+      float expectDb = 20.0f * log10f(kAmplitude);
+      bool whole = n == kBins &&
+                   fabsf(peak[0] - expectDb) < 0.1f &&
+                   fabsf(rms[1] - (expectDb - 3.01f)) < 0.1f &&
+                   fabsf(magnitudesDb[kSineBin] - expectDb) < 0.1f;
+      for (uint32_t k = 0; k < n; k++) {
+        whole = whole && magnitudesDb[k] <= magnitudesDb[kSineBin];
+      }
+      if (!whole) {
+        torn++;
+      }
+    }
+  });
+
+  // half a second, in buffers at the rate a device would deliver them
+  std::vector<int16_t> buf(kFramesPerBuf * kChannels);
+  double phase = 0.0;
+  double step = 2.0 * M_PI * kSineBin / kFftSize;
+  auto next = std::chrono::steady_clock::now();
+  for (int32_t n = 0; n < kRate / 2 / kFramesPerBuf; n++) {
+    for (int32_t i = 0; i < kFramesPerBuf; i++, phase += step) {
+      int16_t v = static_cast<int16_t>(lrint(32767.0 * kAmplitude *
+                                             sin(phase)));
+      buf[i * kChannels] = buf[i * kChannels + 1] = v;
+    }
+    analyzer.write(buf.data(), kFramesPerBuf);
+    next += std::chrono::microseconds(1000000LL * kFramesPerBuf / kRate);
+    std::this_thread::sleep_until(next);
+  }
+  done.store(true);
+  reader.join();
+  analyzer.stop();
+
+  printf("spectrum: %d frames read, %d not whole\n", frames, torn);
+  CHECK(frames > 10);
+  CHECK(torn == 0);
+  return TestResult();
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_TEST_UTIL_H
+#define NATIVE_AUDIO_TEST_UTIL_H
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Host tests are plain executables run by ctest: CHECK reports a failed
+ * condition and the test carries on, main() returns TestResult().
+ */
+static int testFailures = 0;
+
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,  \
+              #cond);                                                   \
+      testFailures++;                                                   \
+    }                                                                   \
+  } while (0)
+
+static inline int TestResult(void) {
+  if (testFailures) {
+    fprintf(stderr, "%d check(s) failed\n", testFailures);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// ns per call of fn, over about 20 ms of calls
+template <typename Fn>
+static double NsPerCall(Fn fn) {
+  using Clock = std::chrono::steady_clock;
+  uint64_t calls = 0;
+  auto start = Clock::now();
+  auto elapsed = Clock::duration::zero();
+  do {
+    fn();
+    calls++;
+    elapsed = Clock::now() - start;
+  } while (elapsed < std::chrono::milliseconds(20));
+  return std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+}
+
+#endif  // NATIVE_AUDIO_TEST_UTIL_H
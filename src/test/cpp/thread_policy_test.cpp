@@ -0,0 +1,109 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <sched.h>
+#include <cstring>
+#include <thread>
+#include "test_util.h"
+#include "thread_policy.h"
+
+/*
+ * ThreadPolicy::apply() on Linux, each case on a fresh thread: a thread the
+ * policy made real-time goes back to nice when asked, one that was
+ * real-time before is neither lowered to nice nor below its priority.
+ * Needs permission for SCHED_FIFO (root or RLIMIT_RTPRIO), else skipped.
+ */
+static void SetFifo(int32_t priority) {
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+  CHECK(sched_setscheduler(0, SCHED_FIFO, &param) == 0);
+}
+
+static int32_t Policy(void) {
+  return sched_getscheduler(0) & ~SCHED_RESET_ON_FORK;
+}
+
+static int32_t Priority(void) {
+  struct sched_param param;
+  return sched_getparam(0, &param) ? -1 : param.sched_priority;
+}
+
+static void Configure(ThreadSched sched, int32_t fifoPriority) {
+  ThreadPolicyConfig config = {sched, fifoPriority, 0, kThreadCpusAny};
+  CHECK(ThreadPolicy::instance()->configure(THREAD_ROLE_WORKER, config));
+}
+
+static void Apply(void) {
+  ThreadPolicy::instance()->applyIfChanged(THREAD_ROLE_WORKER);
+}
+
+static bool FifoAllowed(void) {
+  bool allowed = false;
+  std::thread([&] {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = 1;
+    allowed = sched_setscheduler(0, SCHED_FIFO, &param) == 0;
+  }).join();
+  return allowed;
+}
+
+int main() {
+  if (!FifoAllowed()) {
+    printf("SCHED_FIFO not permitted, skipped\n");
+    return TestResult();
+  }
+
+  // raised by the policy: follows it up and back down to nice
+  std::thread([] {
+    Configure(THREAD_SCHED_FIFO, 10);
+    Apply();
+    CHECK(Policy() == SCHED_FIFO && Priority() == 10);
+    Configure(THREAD_SCHED_FIFO, 5);
+    Apply();
+    CHECK(Policy() == SCHED_FIFO && Priority() == 5);
+    Configure(THREAD_SCHED_NICE, 0);
+    Apply();
+    CHECK(Policy() == SCHED_OTHER);
+  }).join();
+
+  // real-time already, above what the policy asks: left as it is
+  std::thread([] {
+    SetFifo(30);
+    Configure(THREAD_SCHED_FIFO, 10);
+    Apply();
+    CHECK(Policy() == SCHED_FIFO && Priority() == 30);
+    Configure(THREAD_SCHED_NICE, 0);
+    Apply();
+    CHECK(Policy() == SCHED_FIFO && Priority() == 30);
+  }).join();
+
+  // real-time already, below what the policy asks: raised, never lowered
+  std::thread([] {
+    SetFifo(5);
+    Configure(THREAD_SCHED_FIFO, 20);
+    Apply();
+    CHECK(Policy() == SCHED_FIFO && Priority() == 20);
+    Configure(THREAD_SCHED_FIFO, 3);
+    Apply();
+    CHECK(Policy() == SCHED_FIFO && Priority() >= 5);
+    Configure(THREAD_SCHED_NICE, 0);
+    Apply();
+    CHECK(Policy() == SCHED_FIFO);
+  }).join();
+
+  return TestResult();
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unistd.h>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test_util.h"
+#include "trace.h"
+
+/*
+ * Chrome trace JSON export, with threads coming and going: each thread's
+ * events carry its own tid, and a slot given back by an exited thread is
+ * taken by the next one without losing what the first left in the ring.
+ */
+struct ExportedEvent {
+  std::string name_;
+  char phase_;
+  int32_t tid_;
+};
+
+// one event per line, as exportChromeJson() writes them
+static bool ReadTrace(const std::string &path,
+                      std::vector<ExportedEvent> *events) {
+  FILE *fp = fopen(path.c_str(), "r");
+  if (!fp) return false;
+  char line[256];
+  static const char kHeader[] =
+      "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool header = fgets(line, sizeof(line), fp) && !strcmp(line, kHeader);
+  bool footer = false;
+  while (fgets(line, sizeof(line), fp)) {
+    char name[64];
+    char phase;
+    double ts;
+    int32_t pid, tid;
+    if (sscanf(line, "{\"name\":\"%63[^\"]\",\"ph\":\"%c\",\"ts\":%lf,"
+               "\"pid\":%d,\"tid\":%d", name, &phase, &ts, &pid, &tid) == 5) {
+      CHECK(pid == getpid());
+      events->push_back({name, phase, tid});
+    } else {
+      footer = !strcmp(line, "]}\n");
+    }
+  }
+  fclose(fp);
+  return header && footer;
+}
+
+int main() {
+  const char *tmp = getenv("TMPDIR");
+  std::string path = std::string(tmp ? tmp : "/tmp") + "/trace_test.json";
+  const uint32_t kThreads = 3 * kTraceMaxThreads;
+
+  Tracer *tracer = Tracer::instance();
+  tracer->start();
+  {
+    TRACE_SCOPE_SEQ("main", 1);
+    TRACE_INSTANT("handoff", 1);
+  }
+  for (uint32_t i = 0; i < kThreads; i++) {
+    std::thread([] { TRACE_SCOPE("worker"); }).join();
+  }
+  tracer->stop();
+  CHECK(tracer->getDropped() == 0);
+  CHECK(tracer->exportChromeJson(path.c_str()));
+
+  std::vector<ExportedEvent> events;
+  CHECK(ReadTrace(path, &events));
+  unlink(path.c_str());
+  CHECK(events.size() == 3 + 2 * kThreads);
+  std::map<int32_t, int32_t> open;  // per tid: begins minus ends
+  uint32_t workers = 0;
+  for (const ExportedEvent &event : events) {
+    if (event.phase_ == 'B') {
+      open[event.tid_]++;
+      workers += event.name_ == "worker";
+    } else if (event.phase_ == 'E') {
+      CHECK(open[event.tid_]-- > 0);
+    } else {
+      CHECK(event.phase_ == 'i' && event.name_ == "handoff");
+    }
+  }
+  CHECK(workers == kThreads);
+  CHECK(open.size() == kThreads + 1);
+  for (const auto &thread : open) {
+    CHECK(thread.second == 0);
+  }
+  return TestResult();
+}